@@ -77,46 +77,11 @@ void dump_registration(char* registration_filename) {
   freenect_registration reg;
   reg = freenect_copy_registration( f_dev );
 
-  FILE* fp = fopen(registration_filename, "w");
-  if (!fp) {
-	printf("Error: Cannot open file '%s'\n", registration_filename);
+  if (freenect_save_registration(&reg, registration_filename) < 0) {
+	printf("Error: Cannot write file '%s'\n", registration_filename);
 	exit(1);
   }
-
-  // from freenect_copy_registration in registration.c
-  /*
-  reg.reg_info = reg->registration.reg_info;
-  reg.reg_pad_info = reg->registration.reg_pad_info;
-  reg.zero_plane_info = reg->registration.zero_plane_info;
-  reg.const_shift = reg->registration.const_shift;
-  reg.raw_to_mm_shift    = (uint16_t*)malloc( sizeof(uint16_t) * DEPTH_MAX_RAW_VALUE );
-  reg.depth_to_rgb_shift = (int32_t*)malloc( sizeof( int32_t) * DEPTH_MAX_METRIC_VALUE );
-  reg.registration_table = (int32_t (*)[2])malloc( sizeof( int32_t) * DEPTH_X_RES * DEPTH_Y_RES * 2 );
-  */
-
-  /* Should be ~2.4 MB
-  printf( "\n\n%d\n\n", sizeof(reg)+
-		  sizeof(uint16_t)*DEPTH_MAX_RAW_VALUE + 
-		  sizeof(int32_t)*DEPTH_MAX_METRIC_VALUE + 
-		  sizeof(int32_t)*DEPTH_X_RES*DEPTH_Y_RES*2 );
-  */
-
-  // write out first four fields
-  fwrite( &reg.reg_info, sizeof(reg.reg_info), 1, fp );
-  fwrite( &reg.reg_pad_info, sizeof(reg.reg_pad_info), 1, fp);
-  fwrite( &reg.zero_plane_info, sizeof(reg.zero_plane_info), 1, fp);
-  fwrite( &reg.const_shift, sizeof(reg.const_shift), 1, fp);
-
-  //printf( "\n\n%d\n\n", sizeof(uint16_t)*DEPTH_MAX_RAW_VALUE ); // 4096
-  fwrite( (&reg)->raw_to_mm_shift, sizeof(uint16_t), DEPTH_MAX_RAW_VALUE, fp );
-
-  //printf( "\n\n%d\n\n", sizeof(int32_t)*DEPTH_MAX_METRIC_VALUE ); // 4000
-  fwrite( (&reg)->depth_to_rgb_shift, sizeof(int32_t), DEPTH_MAX_METRIC_VALUE, fp );
-
-  //printf( "\n\n%d\n\n", sizeof(int32_t)*DEPTH_X_RES*DEPTH_Y_RES*2 ); // 2457600
-  fwrite( (&reg)->registration_table, sizeof(int32_t), DEPTH_X_RES*DEPTH_Y_RES*2, fp );
-
-  fclose(fp);
+  freenect_destroy_registration(&reg);
 }
 
 void usage()
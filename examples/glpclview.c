@@ -50,24 +50,11 @@ int rotangles[2] = {0}; // Panning angles
 float zoom = 1;         // zoom factor
 int color = 1;          // Use the RGB texture or just draw it as color
 
-// Do the projection from u,v,depth to X,Y,Z directly in an opengl matrix
-// These numbers come from a combination of the ros kinect_node wiki, and
-// nicolas burrus' posts.
+// FREENECT_DEPTH_XYZ points are in mm, with y pointing down and z away from
+// the camera. Turn them into meters in the opengl frame.
 void LoadVertexMatrix()
 {
-    float fx = 594.21f;
-    float fy = 591.04f;
-    float a = -0.0030711f;
-    float b = 3.3309495f;
-    float cx = 339.5f;
-    float cy = 242.7f;
-    GLfloat mat[16] = {
-        1/fx,     0,  0, 0,
-        0,    -1/fy,  0, 0,
-        0,       0,  0, a,
-        -cx/fx, cy/fy, -1, b
-    };
-    glMultMatrixf(mat);
+    glScalef(0.001f, -0.001f, -0.001f);
 }
 
 
@@ -114,24 +101,22 @@ void no_kinect_quit(void)
 
 void DrawGLScene()
 {
-    short *depth = 0;
+    float *xyz = 0;
     char *rgb = 0;
     uint32_t ts;
-    if (freenect_sync_get_depth((void**)&depth, &ts, 0, FREENECT_DEPTH_11BIT) < 0)
+    if (freenect_sync_get_depth((void**)&xyz, &ts, 0, FREENECT_DEPTH_XYZ) < 0)
 	no_kinect_quit();
     if (freenect_sync_get_video((void**)&rgb, &ts, 0, FREENECT_VIDEO_RGB) < 0)
 	no_kinect_quit();
 
     static unsigned int indices[480][640];
-    static short xyz[480][640][3];
+    static int indices_ready = 0;
     int i,j;
-    for (i = 0; i < 480; i++) {
-        for (j = 0; j < 640; j++) {
-            xyz[i][j][0] = j;
-            xyz[i][j][1] = i;
-            xyz[i][j][2] = depth[i*640+j];
-            indices[i][j] = i*640+j;
-        }
+    if (!indices_ready) {
+        for (i = 0; i < 480; i++)
+            for (j = 0; j < 640; j++)
+                indices[i][j] = i*640+j;
+        indices_ready = 1;
     }
 
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -157,9 +142,9 @@ void DrawGLScene()
     glPointSize(1);
 
     glEnableClientState(GL_VERTEX_ARRAY);
-    glVertexPointer(3, GL_SHORT, 0, xyz);
+    glVertexPointer(3, GL_FLOAT, 0, xyz);
     glEnableClientState(GL_TEXTURE_COORD_ARRAY);
-    glTexCoordPointer(3, GL_SHORT, 0, xyz);
+    glTexCoordPointer(3, GL_FLOAT, 0, xyz);
 
     if (color)
         glEnable(GL_TEXTURE_2D);
@@ -196,37 +196,69 @@ static char *skip_line(char *str)
 }
 
 
+// Dumps written by older versions of record were the raw structures and
+// tables back to back, without any header.
+//
 // (cvk) this was stolen from
 // https://github.com/mankoff/libfreenect.git
 // more info: http://kenmankoff.com/2012/05/01/offline-registration-for-the-kinect
-freenect_registration load_registration(char* regfile) 
-{
-
+//
+// Having no header, such a dump is only recognized by its exact size, so that
+// a truncated or damaged file in the new format isn't taken for one.
+static int load_legacy_registration(freenect_registration* reg, char* regfile)
+{
+  const long legacy_size = sizeof(reg->reg_info) + sizeof(reg->reg_pad_info)
+	+ sizeof(reg->zero_plane_info) + sizeof(reg->const_shift)
+	+ sizeof(uint16_t) * DEPTH_MAX_RAW_VALUE
+	+ sizeof(int32_t) * DEPTH_MAX_METRIC_VALUE
+	+ sizeof(int32_t) * DEPTH_X_RES * DEPTH_Y_RES * 2;
   FILE *fp = NULL;
+  int ok;
   /* load the regdump file */
-  fp = fopen(regfile, "r");
-  if (!fp) {
-	perror(regfile);
-	exit(1);
+  fp = fopen(regfile, "rb");
+  if (!fp)
+	return -1;
+  if (fseek(fp, 0, SEEK_END) != 0 || ftell(fp) != legacy_size || fseek(fp, 0, SEEK_SET) != 0) {
+	fclose(fp);
+	return -1;
   }
-  
-  freenect_registration reg;
+
   // allocate memory and set up pointers
   // (from freenect_copy_registration in registration.c)
-  reg.raw_to_mm_shift    = (uint16_t*)malloc( sizeof(uint16_t) * DEPTH_MAX_RAW_VALUE );
-  reg.depth_to_rgb_shift = (int32_t*)malloc( sizeof( int32_t) * DEPTH_MAX_METRIC_VALUE );
-  reg.registration_table = (int32_t (*)[2])malloc( sizeof( int32_t) * DEPTH_X_RES * DEPTH_Y_RES * 2 );
+  reg->raw_to_mm_shift    = (uint16_t*)malloc( sizeof(uint16_t) * DEPTH_MAX_RAW_VALUE );
+  reg->depth_to_rgb_shift = (int32_t*)malloc( sizeof( int32_t) * DEPTH_MAX_METRIC_VALUE );
+  reg->registration_table = (int32_t (*)[2])malloc( sizeof( int32_t) * DEPTH_X_RES * DEPTH_Y_RES * 2 );
   // load (inverse of kinect_regdump)
-  fread( &reg.reg_info, sizeof(reg.reg_info), 1, fp );
-  fread( &reg.reg_pad_info, sizeof(reg.reg_pad_info), 1, fp);
-  fread( &reg.zero_plane_info, sizeof(reg.zero_plane_info), 1, fp);
-  fread( &reg.const_shift, sizeof(reg.const_shift), 1, fp);
-  fread( reg.raw_to_mm_shift, sizeof(uint16_t), DEPTH_MAX_RAW_VALUE, fp );
-  fread( reg.depth_to_rgb_shift, sizeof(int32_t), DEPTH_MAX_METRIC_VALUE, fp );
-  fread( reg.registration_table, sizeof(int32_t), DEPTH_X_RES*DEPTH_Y_RES*2, fp );
+  ok = reg->raw_to_mm_shift && reg->depth_to_rgb_shift && reg->registration_table
+	&& fread( &reg->reg_info, sizeof(reg->reg_info), 1, fp ) == 1
+	&& fread( &reg->reg_pad_info, sizeof(reg->reg_pad_info), 1, fp) == 1
+	&& fread( &reg->zero_plane_info, sizeof(reg->zero_plane_info), 1, fp) == 1
+	&& fread( &reg->const_shift, sizeof(reg->const_shift), 1, fp) == 1
+	&& fread( reg->raw_to_mm_shift, sizeof(uint16_t), DEPTH_MAX_RAW_VALUE, fp ) == DEPTH_MAX_RAW_VALUE
+	&& fread( reg->depth_to_rgb_shift, sizeof(int32_t), DEPTH_MAX_METRIC_VALUE, fp ) == DEPTH_MAX_METRIC_VALUE
+	&& fread( reg->registration_table, sizeof(int32_t), DEPTH_X_RES*DEPTH_Y_RES*2, fp ) == DEPTH_X_RES*DEPTH_Y_RES*2;
   fclose(fp);
+  if (!ok) {
+	free(reg->raw_to_mm_shift);
+	free(reg->depth_to_rgb_shift);
+	free(reg->registration_table);
+	reg->raw_to_mm_shift = NULL;
+	reg->depth_to_rgb_shift = NULL;
+	reg->registration_table = NULL;
+	return -1;
+  }
+  return 0;
+}
 
-  return reg;
+freenect_registration load_registration(char* regfile)
+{
+  freenect_registration reg;
+  if (freenect_load_registration(&reg, regfile) == 0)
+	return reg;
+  if (load_legacy_registration(&reg, regfile) == 0)
+	return reg;
+  printf("Error: %s is not a registration dump, or it is damaged\n", regfile);
+  exit(1);
 }
 
 // (cvk) this was stolen from registration.c, but i modified it to work on
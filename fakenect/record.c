@@ -52,6 +52,9 @@ char *ffmpeg_opts = 0;
 char *depth_name = 0;
 char *rgb_name = 0;
 
+int use_raw = 0;
+char *raw_name = 0;
+
 FILE *depth_stream=0;
 FILE *rgb_stream=0;
 
@@ -230,46 +233,11 @@ void dump_registration(freenect_device *f_dev) {
 	freenect_registration reg;
 	reg = freenect_copy_registration( f_dev );
 
-	FILE* fp = fopen(registration_filename, "w");
-	if (!fp) {
-		printf("Error: Cannot open file '%s'\n", registration_filename);
+	if (freenect_save_registration(&reg, registration_filename) < 0) {
+		printf("Error: Cannot write file '%s'\n", registration_filename);
 		exit(1);
 	}
-
-	// from freenect_copy_registration in registration.c
-	/*
-	   reg.reg_info = reg->registration.reg_info;
-	   reg.reg_pad_info = reg->registration.reg_pad_info;
-	   reg.zero_plane_info = reg->registration.zero_plane_info;
-	   reg.const_shift = reg->registration.const_shift;
-	   reg.raw_to_mm_shift    = (uint16_t*)malloc( sizeof(uint16_t) * DEPTH_MAX_RAW_VALUE );
-	   reg.depth_to_rgb_shift = (int32_t*)malloc( sizeof( int32_t) * DEPTH_MAX_METRIC_VALUE );
-	   reg.registration_table = (int32_t (*)[2])malloc( sizeof( int32_t) * DEPTH_X_RES * DEPTH_Y_RES * 2 );
-	   */
-
-	/* Should be ~2.4 MB
-	   printf( "\n\n%d\n\n", sizeof(reg)+
-	   sizeof(uint16_t)*DEPTH_MAX_RAW_VALUE + 
-	   sizeof(int32_t)*DEPTH_MAX_METRIC_VALUE + 
-	   sizeof(int32_t)*DEPTH_X_RES*DEPTH_Y_RES*2 );
-	   */
-
-	// write out first four fields
-	fwrite( &reg.reg_info, sizeof(reg.reg_info), 1, fp );
-	fwrite( &reg.reg_pad_info, sizeof(reg.reg_pad_info), 1, fp);
-	fwrite( &reg.zero_plane_info, sizeof(reg.zero_plane_info), 1, fp);
-	fwrite( &reg.const_shift, sizeof(reg.const_shift), 1, fp);
-
-	//printf( "\n\n%d\n\n", sizeof(uint16_t)*DEPTH_MAX_RAW_VALUE ); // 4096
-	fwrite( (&reg)->raw_to_mm_shift, sizeof(uint16_t), DEPTH_MAX_RAW_VALUE, fp );
-
-	//printf( "\n\n%d\n\n", sizeof(int32_t)*DEPTH_MAX_METRIC_VALUE ); // 4000
-	fwrite( (&reg)->depth_to_rgb_shift, sizeof(int32_t), DEPTH_MAX_METRIC_VALUE, fp );
-
-	//printf( "\n\n%d\n\n", sizeof(int32_t)*DEPTH_X_RES*DEPTH_Y_RES*2 ); // 2457600
-	fwrite( (&reg)->registration_table, sizeof(int32_t), DEPTH_X_RES*DEPTH_Y_RES*2, fp );
-
-	fclose(fp);
+	freenect_destroy_registration(&reg);
 }
 
 void init()
@@ -291,15 +259,25 @@ void init()
 
 	// (cvk) save the kinect's registration data to a file so it can be
 	// used for playback of this recording
-	dump_registration(dev);
+	if (!use_raw)
+		dump_registration(dev);
 
 	print_mode("Depth", freenect_find_depth_mode(FREENECT_RESOLUTION_MEDIUM, FREENECT_DEPTH_11BIT));
 	print_mode("Video", freenect_find_video_mode(FREENECT_RESOLUTION_MEDIUM, FREENECT_VIDEO_RGB));
 	freenect_set_depth_mode(dev, freenect_find_depth_mode(FREENECT_RESOLUTION_MEDIUM, FREENECT_DEPTH_11BIT));
-	freenect_start_depth(dev);
 	freenect_set_video_mode(dev, freenect_find_video_mode(FREENECT_RESOLUTION_MEDIUM, FREENECT_VIDEO_RGB));
+	if (use_raw && freenect_start_capture(dev, raw_name)) {
+		printf("Error: Cannot write capture [%s]\n", raw_name);
+		freenect_close_device(dev);
+		freenect_shutdown(ctx);
+		return;
+	}
+	freenect_start_depth(dev);
 	freenect_start_video(dev);
-	if (use_ffmpeg) {
+	if (use_raw) {
+		// the capture sees the packets before they're decoded, nothing to do
+		// per frame
+	} else if (use_ffmpeg) {
 		init_ffmpeg_streams();
 		freenect_set_depth_callback(dev, depth_cb_ffmpeg);
 		freenect_set_video_callback(dev, rgb_cb_ffmpeg);
@@ -311,6 +289,8 @@ void init()
 		snapshot_accel(dev);
 	freenect_stop_depth(dev);
 	freenect_stop_video(dev);
+	if (use_raw)
+		freenect_stop_capture(dev);
 	freenect_close_device(dev);
 	freenect_shutdown(ctx);
 }
@@ -342,8 +322,10 @@ void signal_cleanup(int num)
 void usage()
 {
 	printf("Records the Kinect sensor data to a directory\nResult can be used as input to Fakenect\nUsage:\n");
-	printf("  record [-h] [-ffmpeg] [-ffmpeg-opts <options>] "
+	printf("  record [-h] [-ffmpeg] [-ffmpeg-opts <options>] [-raw] "
 		   "<target basename>\n");
+	printf("  -raw writes every USB packet to <target basename>.fncap, for replay\n"
+		   "       with FREENECT_USB_BACKEND=mock FREENECT_MOCK_CAPTURE=<file>\n");
 	exit(0);
 }
 
@@ -356,7 +338,9 @@ int main(int argc, char **argv)
 		else if (strcmp(argv[c],"-ffmpeg-opts")==0) {
 			if (++c < argc)
 				ffmpeg_opts = argv[c];
-		} else if (strcmp(argv[c],"-h")==0)
+		} else if (strcmp(argv[c],"-raw")==0)
+			use_raw = 1;
+		else if (strcmp(argv[c],"-h")==0)
 			usage();
 		else
 			out_dir = argv[c];
@@ -368,7 +352,21 @@ int main(int argc, char **argv)
 
 	signal(SIGINT, signal_cleanup);
 
-	if (use_ffmpeg) {
+	if (use_raw) {
+		FILE *f;
+
+		raw_name = malloc(strlen(out_dir) + 50);
+		sprintf(raw_name, "%s.fncap", out_dir);
+		f = fopen(raw_name, "r");
+		if (f) {
+			printf("Error: %s already exists, to avoid overwriting "
+				   "use a different name.\n", raw_name);
+			fclose(f);
+			exit(1);
+		}
+		init();
+		free(raw_name);
+	} else if (use_ffmpeg) {
 		FILE *f;
 
 		char *index_fn = malloc(strlen(out_dir) + 50);
@@ -97,6 +97,12 @@ typedef struct {
 	float reference_pixel_size;  // The size of a single pixel on the zero plane, in mm.
 } freenect_zero_plane_info;
 
+/// In-memory layouts of the registration table
+typedef enum {
+	FREENECT_REGISTRATION_TABLE_INT32       = 1, /**< int32_t[640*480][2]: x * 256 and y of each pixel's target (freenect_registration.registration_table) */
+	FREENECT_REGISTRATION_TABLE_INT16_DELTA = 2, /**< int16_t[640*480][2]: target minus the pixel's own position (x offset by one constant per table), half the size */
+} freenect_registration_table_format;
+
 /// all data needed for depth->RGB mapping
 typedef struct {
 	freenect_reg_info        reg_info;
@@ -111,17 +117,97 @@ typedef struct {
 	                                   // Index first by pixel, then x:0 and y:1.
 } freenect_registration;
 
+/// A point of the colored point cloud: position in mm in the depth camera
+/// frame (as FREENECT_DEPTH_XYZ) and the color of the RGB pixel it maps to
+typedef struct {
+	float x;
+	float y;
+	float z;
+	uint8_t r;
+	uint8_t g;
+	uint8_t b;
+	uint8_t pad;
+} freenect_point_xyzrgb;
+
+/// Typedef for colored point cloud callbacks; points holds count points
+typedef void (*freenect_points_cb)(freenect_device *dev, freenect_point_xyzrgb *points, int count, uint32_t timestamp);
+
 
 // These allow clients to export registration parameters; proper docs will
 // come later
 FREENECTAPI freenect_registration freenect_copy_registration(freenect_device* dev);
 FREENECTAPI int freenect_destroy_registration(freenect_registration* reg);
 
+// Save the parameters and tables of a registration to a file, or load them
+// back. The file format is versioned and stores every table 64-byte aligned
+// in host byte order, so the file can also be mmap()ed directly.
+// freenect_load_registration() allocates new tables, to be released with
+// freenect_destroy_registration(). Both return 0 on success, < 0 on error.
+FREENECTAPI int freenect_save_registration(const freenect_registration* reg, const char* filename);
+FREENECTAPI int freenect_load_registration(freenect_registration* reg, const char* filename);
+
+// Cache the registration of cameras opened from this context in the
+// existing directory path, one file per camera serial and video resolution.
+// Cameras seen before then skip fetching their registration parameters and
+// rebuilding the tables. Defaults to the LIBFREENECT_REGISTRATION_CACHE
+// environment variable; NULL disables the cache. Returns 0 on success, < 0
+// on error.
+FREENECTAPI int freenect_set_registration_cache_dir(freenect_context* ctx, const char* path);
+
+// Set the number of threads used to register FREENECT_DEPTH_REGISTERED frames,
+// counting the thread that runs freenect_process_events(). With more than one
+// thread the frame is split into row stripes that are registered in parallel
+// and merged; the output is identical to the single-threaded path. Defaults
+// to 1. Must be called while the depth stream is stopped; returns 0 on
+// success, < 0 on error.
+FREENECTAPI int freenect_set_registration_threads(freenect_device* dev, int threads);
+FREENECTAPI int freenect_get_registration_threads(freenect_device* dev);
+
+// Select the table layout used internally to register depth frames. The
+// results do not depend on it; FREENECT_REGISTRATION_TABLE_INT16_DELTA
+// (default) halves the table to 1.2 MB, which is friendlier to the cache.
+// If the table of a device does not fit in int16 deltas, INT32 is used
+// instead, as reported by freenect_get_registration_table_format().
+// freenect_copy_registration() always returns the INT32 layout. Must be
+// called while the depth stream is stopped; returns 0 on success, < 0 on
+// error.
+FREENECTAPI int freenect_set_registration_table_format(freenect_device* dev, freenect_registration_table_format format);
+FREENECTAPI freenect_registration_table_format freenect_get_registration_table_format(freenect_device* dev);
+
+// Deliver a colored point cloud with every depth frame, built in a single
+// pass from the packed depth frame and the latest video frame. Pixels without
+// depth, or that map outside the RGB image, are left out. Needs a depth
+// format based on the 11 bit stream (11BIT, 11BIT_PACKED, REGISTERED, MM or
+// XYZ) and a medium resolution RGB, BAYER, YUV_RGB or YUV_RAW video stream.
+// The callback runs right after the depth callback, on the same thread: the
+// one calling freenect_process_events() when no decode threads are set, or
+// else the decode thread of the device (see freenect_set_decode_threads();
+// with a points callback set, depth and video share a single decode thread).
+// Building the cloud is spread over the freenect_set_registration_threads()
+// threads, but the callback is never called from them. Set it before
+// freenect_start_depth(); NULL disables it.
+FREENECTAPI void freenect_set_points_callback(freenect_device *dev, freenect_points_cb cb);
+
 // convenience function to convert a single x-y coordinate pair from camera
 // to world coordinates
 FREENECTAPI void freenect_camera_to_world(freenect_device* dev,
 	int cx, int cy, int wz, double* wx, double* wy);
 
+// Batch versions of freenect_camera_to_world() and its inverse, for n points
+// stored as separate arrays: (cx[i], cy[i]) in the 640x480 depth image and
+// (wx[i], wy[i]) in mm, both at depth wz[i] in mm. Points with wz <= 0 are
+// written as 0. If valid is not NULL, valid[i] is set to 1 if wz[i] > 0 and,
+// for world_to_camera, the point lands inside the depth image, 0 otherwise.
+// Return 0 on success, < 0 on error.
+FREENECTAPI int freenect_camera_to_world_batch(freenect_device* dev, int n,
+	const float* cx, const float* cy, const float* wz, float* wx, float* wy, uint8_t* valid);
+FREENECTAPI int freenect_camera_to_world_batch_s16(freenect_device* dev, int n,
+	const int16_t* cx, const int16_t* cy, const int16_t* wz, float* wx, float* wy, uint8_t* valid);
+FREENECTAPI int freenect_world_to_camera_batch(freenect_device* dev, int n,
+	const float* wx, const float* wy, const float* wz, float* cx, float* cy, uint8_t* valid);
+FREENECTAPI int freenect_world_to_camera_batch_s16(freenect_device* dev, int n,
+	const int16_t* wx, const int16_t* wy, const int16_t* wz, float* cx, float* cy, uint8_t* valid);
+
 #ifdef __cplusplus
 }
 #endif
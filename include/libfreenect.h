@@ -104,6 +104,7 @@ typedef enum {
 	FREENECT_DEPTH_10BIT_PACKED = 3, /**< 10 bit packed depth information */
 	FREENECT_DEPTH_REGISTERED   = 4, /**< processed depth data in mm, aligned to 640x480 RGB */
 	FREENECT_DEPTH_MM           = 5, /**< depth to each pixel in mm, but left unaligned to RGB image */
+	FREENECT_DEPTH_XYZ          = 6, /**< point cloud: x, y and z in mm as three floats/pixel, in the depth camera frame (unaligned to RGB). Pixels without depth are 0, 0, 0 */
 	FREENECT_DEPTH_DUMMY        = 2147483647, /**< Dummy value to force enum to be 32 bits wide */
 } freenect_depth_format;
 
@@ -253,6 +254,86 @@ FREENECTAPI int freenect_process_events(freenect_context *ctx);
  */
 FREENECTAPI int freenect_process_events_timeout(freenect_context *ctx, struct timeval* timeout);
 
+/**
+ * Wake the thread blocked in freenect_process_events() or
+ * freenect_process_events_timeout(), which then returns 0 right away instead
+ * of at its next event or timeout. If no thread is waiting, the next call
+ * returns early instead. Use it to stop an event thread, or to get it to let
+ * go of the context promptly, without waiting for the next frame. An external
+ * loop waiting on freenect_get_pollfds() is woken as well. Can be called from
+ * any thread.
+ *
+ * @param ctx Context whose event processing to interrupt
+ *
+ * @return 0 on success, < 0 if the USB backend cannot be interrupted (Windows,
+ *         libusb older than 1.0.21)
+ */
+FREENECTAPI int freenect_interrupt_events(freenect_context *ctx);
+
+/// A file descriptor to watch, see freenect_get_pollfds()
+typedef struct {
+	int fd;       /**< File descriptor */
+	short events; /**< Events to watch for, as poll() takes them (POLLIN, POLLOUT) */
+} freenect_pollfd;
+
+/**
+ * Get the file descriptors that become ready when the USB layer has events
+ * to handle, so that libfreenect can be driven from an external event loop
+ * (poll, epoll, libuv, ...) instead of a thread of its own: wait for the
+ * descriptors, or for freenect_get_next_timeout(), then call
+ * freenect_handle_ready_events().
+ *
+ * The set changes as devices are opened and closed; see
+ * freenect_set_pollfd_notifiers().
+ *
+ * @param ctx Context to get the descriptors of
+ * @param fds Filled with up to max descriptors
+ * @param max Size of fds
+ *
+ * @return Number of descriptors, which may be more than max, or < 0 if the
+ *         USB backend has none to offer (Windows)
+ */
+FREENECTAPI int freenect_get_pollfds(freenect_context *ctx, freenect_pollfd *fds, int max);
+
+/// Typedef for the callback of a descriptor joining the set of freenect_get_pollfds()
+typedef void (*freenect_pollfd_added_cb)(int fd, short events, void *user);
+/// Typedef for the callback of a descriptor leaving the set of freenect_get_pollfds()
+typedef void (*freenect_pollfd_removed_cb)(int fd, void *user);
+
+/**
+ * Be told when descriptors join or leave the set of freenect_get_pollfds().
+ * The callbacks run on the thread that changes the set.
+ *
+ * @param ctx Context to watch
+ * @param added Called for a new descriptor, may be NULL
+ * @param removed Called for a descriptor that is gone, may be NULL
+ * @param user Passed to the callbacks
+ */
+FREENECTAPI void freenect_set_pollfd_notifiers(freenect_context *ctx, freenect_pollfd_added_cb added, freenect_pollfd_removed_cb removed, void *user);
+
+/**
+ * Get how long an external event loop may wait before calling
+ * freenect_handle_ready_events(), even if no descriptor becomes ready.
+ *
+ * @param ctx Context to query
+ * @param timeout Set to the time left when there is a deadline
+ *
+ * @return 1 if timeout was set, 0 if there is no deadline (wait for the
+ *         descriptors only), < 0 on error
+ */
+FREENECTAPI int freenect_get_next_timeout(freenect_context *ctx, struct timeval *timeout);
+
+/**
+ * Handle the events that are ready, without waiting for more, and return.
+ * Does what freenect_process_events() does after its wait, including
+ * stopping the streams of unplugged devices.
+ *
+ * @param ctx Context to handle events for
+ *
+ * @return 0 on success, < 0 on error
+ */
+FREENECTAPI int freenect_handle_ready_events(freenect_context *ctx);
+
 /**
  * Return the number of kinect devices currently connected to the
  * system
@@ -329,6 +410,31 @@ FREENECTAPI int freenect_open_device(freenect_context *ctx, freenect_device **de
  */
 FREENECTAPI int freenect_open_device_by_camera_serial(freenect_context *ctx, freenect_device **dev, const char* camera_serial);
 
+/// One device to open with freenect_open_devices(), and how that went
+typedef struct {
+	int index;            /**< Index of the device on the bus, set by the caller */
+	freenect_device *dev; /**< The opened device, NULL if it failed */
+	int status;           /**< 0 on success, < 0 on error */
+	uint64_t open_ns;     /**< Time taken to open the subdevices, including firmware upload */
+	uint64_t init_ns;     /**< Time taken to initialize the camera, including the calibration fetch */
+} freenect_open_request;
+
+/**
+ * Opens several devices at once. Each device is opened and initialized as
+ * by freenect_open_device(), on up to threads threads, so that the USB
+ * round trips of firmware uploads and calibration fetches of different
+ * devices overlap. The opened devices are added to the context in the
+ * order of the requests. Devices that fail are closed again.
+ *
+ * @param ctx Context to open the devices through
+ * @param requests Devices to open; dev, status and the timings are filled in
+ * @param count Number of requests
+ * @param threads Number of devices opened at a time, 0 for all of them
+ *
+ * @return Number of devices opened, < 0 on error
+ */
+FREENECTAPI int freenect_open_devices(freenect_context *ctx, freenect_open_request *requests, int count, int threads);
+
 /**
  * Closes a device that is currently open
  *
@@ -338,6 +444,66 @@ FREENECTAPI int freenect_open_device_by_camera_serial(freenect_context *ctx, fre
  */
 FREENECTAPI int freenect_close_device(freenect_device *dev);
 
+/// What happened to a device with auto-reconnect, see freenect_set_reconnect_callback()
+typedef enum {
+	FREENECT_RECONNECT_LOST     = 0, /**< The camera went away and its streams were stopped */
+	FREENECT_RECONNECT_RESTORED = 1, /**< The camera was reopened and its streams restarted */
+	FREENECT_RECONNECT_FAILED   = 2, /**< The camera is back but could not be reopened; tried again later */
+} freenect_reconnect_event;
+
+/// Typedef for the callback of freenect_set_reconnect_callback()
+typedef void (*freenect_reconnect_cb)(freenect_device *dev, freenect_reconnect_event event);
+
+/// Counters of auto-reconnect since the device was opened, see freenect_get_reconnect_stats()
+typedef struct {
+	uint64_t disconnects;     /**< Times the camera went away */
+	uint64_t reconnects;      /**< Times it was reopened with its streams restarted */
+	uint64_t failed_attempts; /**< Attempts that found the camera but could not reopen it */
+	uint64_t downtime_ns;     /**< Time between going away and being restored, summed over the reconnects */
+} freenect_reconnect_stats;
+
+/**
+ * Keep a device open through USB disconnects, such as brown-outs or a
+ * replugged cable. When the camera goes away, freenect_process_events()
+ * stops its streams as usual, but keeps returning 0 rather than < 0. Once a
+ * camera with the same serial number is plugged in again, it reopens the
+ * device and restarts the streams that were running, in the modes and with
+ * the buffers they had, and their callbacks resume.
+ *
+ * The camera is looked for when the USB stack reports a new one (libusb
+ * hotplug events, where available) and otherwise twice a second, from
+ * freenect_process_events(). Until it is back, calls that talk to the
+ * device fail with < 0. The tilt, the LED, flags set with
+ * freenect_set_flag() and audio streams are not restored. Cameras without a
+ * serial number cannot be found again, and stop as if auto-reconnect were
+ * off. Defaults to the LIBFREENECT_RECONNECT environment variable, or off.
+ *
+ * @param dev Device to keep open
+ * @param enable 1 to enable, 0 to disable
+ */
+FREENECTAPI void freenect_set_auto_reconnect(freenect_device *dev, int enable);
+
+/**
+ * Set callback to be told when the camera of a device with auto-reconnect
+ * goes away and comes back. It runs on the thread calling
+ * freenect_process_events().
+ *
+ * @param dev Device to set callback for
+ * @param cb Function pointer for the events, NULL to disable
+ */
+FREENECTAPI void freenect_set_reconnect_callback(freenect_device *dev, freenect_reconnect_cb cb);
+
+/**
+ * Get the auto-reconnect counters of a device. Never blocks, and may be
+ * called from any thread.
+ *
+ * @param dev Device to get counters for
+ * @param stats Filled with the counters
+ *
+ * @return 0 on success, < 0 on error
+ */
+FREENECTAPI int freenect_get_reconnect_stats(freenect_device *dev, freenect_reconnect_stats *stats);
+
 /**
  * Set the device user data, for passing generic information into
  * callbacks
@@ -356,6 +522,29 @@ FREENECTAPI void freenect_set_user(freenect_device *dev, void *user);
  */
 FREENECTAPI void *freenect_get_user(freenect_device *dev);
 
+/// Enumeration of the streams of a device
+typedef enum {
+	FREENECT_STREAM_DEPTH = 0, /**< Depth stream */
+	FREENECT_STREAM_VIDEO = 1  /**< Video stream */
+} freenect_stream;
+
+/// Details on how a frame was received, see freenect_set_frame_info_callback()
+typedef struct {
+	freenect_stream stream;    /**< Stream the frame belongs to */
+	uint32_t timestamp;        /**< Timestamp of the frame, as passed to the frame callback */
+	int packets;               /**< Number of packets making up a complete frame */
+	int lost_packets;          /**< Packets of this frame that never arrived */
+	int packet_bytes;          /**< Bytes of the raw (packed) frame carried by each packet */
+	const uint8_t *packet_map; /**< With partial frames, bit i % 8 of byte i / 8 is set if packet i arrived; NULL otherwise */
+	uint64_t device_timestamp; /**< timestamp unwrapped to 64 bits, in ticks of the 60 MHz device clock, counted from the start of the stream */
+	uint64_t host_timestamp;   /**< device_timestamp mapped onto the freenect_get_time_ns() clock, in nanoseconds */
+	uint64_t arrival_time;     /**< freenect_get_time_ns() time the last packet of the frame was processed */
+	double clock_drift_ppm;    /**< Estimated rate error of the device clock against the host clock, in parts per million; positive when the device runs fast */
+} freenect_frame_info;
+
+/// Typedef for frame details callbacks
+typedef void (*freenect_frame_info_cb)(freenect_device *dev, const freenect_frame_info *info);
+
 /// Typedef for depth image received event callbacks
 typedef void (*freenect_depth_cb)(freenect_device *dev, void *depth, uint32_t timestamp);
 /// Typedef for video image received event callbacks
@@ -377,6 +566,91 @@ FREENECTAPI void freenect_set_depth_callback(freenect_device *dev, freenect_dept
  */
 FREENECTAPI void freenect_set_video_callback(freenect_device *dev, freenect_video_cb cb);
 
+/**
+ * Set callback receiving the details of each depth and video frame. It is
+ * called right before the depth or video callback of the frame, from the
+ * same thread, and the info is only valid during the call.
+ *
+ * Besides the packets that arrived, the info places the frame on the host
+ * clock. The device timestamps are mapped through a line fitted to the
+ * frames that arrived with the least delay in each of the last seconds,
+ * which follows the drift between the two clocks; the transfer latency that
+ * every frame has is not taken out. The fit restarts with the stream, and
+ * settles over its first few seconds. Frames of several devices can be
+ * aligned on their host_timestamp.
+ *
+ * @param dev Device to set callback for
+ * @param cb Function pointer for processing frame details, NULL to disable
+ */
+FREENECTAPI void freenect_set_frame_info_callback(freenect_device *dev, freenect_frame_info_cb cb);
+
+/**
+ * Get the host clock used by freenect_frame_info: CLOCK_MONOTONIC on POSIX
+ * systems, the performance counter on Windows and mach_absolute_time() on
+ * OS X, in nanoseconds.
+ *
+ * @return Current host time, in nanoseconds from an arbitrary origin
+ */
+FREENECTAPI uint64_t freenect_get_time_ns(void);
+
+/**
+ * Deliver frames that lost packets instead of dropping them. By default a
+ * frame missing a few packets keeps stale data from an earlier frame where
+ * they should be, and losing more than that drops it while the stream
+ * resyncs. With partial frames enabled, missing parts read as no data
+ * (FREENECT_DEPTH_RAW_NO_VALUE in 11 bit depth, 1023 in 10 bit depth,
+ * FREENECT_DEPTH_MM_NO_VALUE in mm and XYZ) or black video, and every frame
+ * that got any packet is delivered; freenect_frame_info tells which packets
+ * arrived. Must be called
+ * while both streams are stopped.
+ *
+ * @param dev Device to set partial frames for
+ * @param enable 1 to enable, 0 (default) to disable
+ *
+ * @return 0 on success, < 0 on error
+ */
+FREENECTAPI int freenect_set_partial_frames(freenect_device *dev, int enable);
+
+/// Number of buckets in the latency histograms of freenect_stream_stats
+#define FREENECT_STATS_LATENCY_BUCKETS 20
+
+/// Cumulative statistics of a stream since the device was opened, see freenect_get_stream_stats()
+typedef struct {
+	uint64_t packets;         /**< Packets received while the stream was running */
+	uint64_t bytes;           /**< Bytes of those packets, headers included */
+	uint64_t lost_packets;    /**< Packets missing from the sequence numbers */
+	uint64_t invalid_magic;   /**< Packets ignored for a bad header magic */
+	uint64_t size_mismatches; /**< Packets not carrying the expected number of bytes */
+	uint64_t resyncs;         /**< Times the stream lost sync and waited for the next frame */
+	uint64_t frames;          /**< Frames completed */
+	uint64_t dropped_frames;  /**< Completed frames not delivered, because the decode threads or the frame pool had no room */
+	uint64_t decode_ns;       /**< Total time spent converting frames, in nanoseconds */
+	uint64_t callback_ns;     /**< Total time spent in the callbacks of the stream, in nanoseconds */
+	/**
+	 * Delivered frames by time from their last packet to the converted
+	 * frame, which includes waiting for a decode thread. Bucket 0 counts
+	 * frames under 2 microseconds, bucket i those from 2^i up to 2^(i+1)
+	 * microseconds, and the last bucket everything longer.
+	 */
+	uint64_t decode_latency[FREENECT_STATS_LATENCY_BUCKETS];
+	/// Delivered frames by time spent in the callbacks, in the same buckets
+	uint64_t callback_latency[FREENECT_STATS_LATENCY_BUCKETS];
+} freenect_stream_stats;
+
+/**
+ * Get the statistics of a stream. The counters are updated without locks,
+ * so this never waits for the thread calling freenect_process_events(), and
+ * may be called from any thread; each counter is read atomically, but a
+ * frame in progress may show in some counters and not yet in others.
+ *
+ * @param dev Device to get statistics for
+ * @param stream Stream to get statistics for
+ * @param stats Filled with the statistics
+ *
+ * @return 0 on success, < 0 on error
+ */
+FREENECTAPI int freenect_get_stream_stats(freenect_device *dev, freenect_stream stream, freenect_stream_stats *stats);
+
 /**
  * Set the buffer to store depth information to. Size of buffer is
  * dependant on depth format. See FREENECT_DEPTH_*_SIZE defines for
@@ -401,6 +675,102 @@ FREENECTAPI int freenect_set_depth_buffer(freenect_device *dev, void *buf);
  */
 FREENECTAPI int freenect_set_video_buffer(freenect_device *dev, void *buf);
 
+/**
+ * Move frame conversion and the depth and video callbacks off the thread
+ * calling freenect_process_events(). That thread then only reassembles
+ * packets into raw frames, so a slow conversion or callback no longer delays
+ * the USB transfers and causes packet loss; when the decode threads fall
+ * behind, the newest complete frame is dropped instead.
+ *
+ * With 1 thread both streams are decoded on one thread, in the order their
+ * frames arrived. With 2 threads each stream gets its own, and the depth and
+ * video callbacks may run at the same time. A colored point cloud callback
+ * keeps both streams on one thread. Must be called while both streams are
+ * stopped.
+ *
+ * @param dev Device to set the number of decode threads for
+ * @param threads 0 (default) to decode on the event thread, 1 or 2
+ *
+ * @return 0 on success, < 0 if threads is out of range or a stream is running
+ */
+FREENECTAPI int freenect_set_decode_threads(freenect_device *dev, int threads);
+
+/**
+ * Get the number of decode threads set with freenect_set_decode_threads().
+ *
+ * @param dev Device to query
+ *
+ * @return Number of decode threads, 0 when frames are decoded on the event thread
+ */
+FREENECTAPI int freenect_get_decode_threads(freenect_device *dev);
+
+/**
+ * Convert depth rows as soon as all of their packets have arrived, instead
+ * of converting the whole frame once its last packet is in. Only the last
+ * rows are left for the end of the frame, which cuts the time from the last
+ * packet to the depth callback. Applies to the FREENECT_DEPTH_11BIT,
+ * 10BIT, MM and XYZ formats, and only while no decode threads are set with
+ * freenect_set_decode_threads(). Must be called while the depth stream is
+ * stopped.
+ *
+ * @param dev Device to set incremental depth decoding for
+ * @param enable 1 to enable, 0 (default) to convert whole frames
+ *
+ * @return 0 on success, < 0 on error
+ */
+FREENECTAPI int freenect_set_depth_incremental_decode(freenect_device *dev, int enable);
+
+/// Isochronous USB transfer settings of a stream, see freenect_set_iso_geometry()
+typedef struct {
+	int transfers;    /**< Transfers kept in flight */
+	int packets;      /**< Packets per transfer, a multiple of 8 */
+	int packet_bytes; /**< Buffer bytes per packet */
+} freenect_iso_geometry;
+
+/**
+ * Set how a stream's data is requested from the USB stack. More transfers
+ * in flight let the thread calling freenect_process_events() fall further
+ * behind before packets are lost. transfers * packets may not exceed 1000,
+ * and packet_bytes must hold a whole packet of the stream (1760 bytes for
+ * depth, 1920 for video) and be at most 3072.
+ *
+ * The defaults are per platform, and can be replaced for every device with
+ * the LIBFREENECT_ISO_XFERS, LIBFREENECT_ISO_PKTS_PER_XFER,
+ * LIBFREENECT_DEPTH_PKTBUF and LIBFREENECT_VIDEO_PKTBUF environment
+ * variables. Must be called while the stream is stopped.
+ *
+ * @param dev Device to set the transfers for
+ * @param stream Stream to set the transfers for
+ * @param geometry Settings to use, NULL to go back to the defaults
+ *
+ * @return 0 on success, < 0 if the stream is running or the settings are out of bounds
+ */
+FREENECTAPI int freenect_set_iso_geometry(freenect_device *dev, freenect_stream stream, const freenect_iso_geometry *geometry);
+
+/**
+ * Get the transfer settings a stream runs with, or will start with,
+ * including any growth from freenect_set_iso_autotune().
+ *
+ * @param dev Device to query
+ * @param stream Stream to query
+ * @param geometry Filled with the settings
+ *
+ * @return 0 on success, < 0 on error
+ */
+FREENECTAPI int freenect_get_iso_geometry(freenect_device *dev, freenect_stream stream, freenect_iso_geometry *geometry);
+
+/**
+ * Grow the number of transfers in flight when a stream loses packets. Once
+ * a second, a stream that lost packets restarts its transfers, from
+ * freenect_process_events(), with half as many more, until transfers *
+ * packets reaches 1000. The restart itself costs a frame. Defaults to the
+ * LIBFREENECT_ISO_AUTOTUNE environment variable, or off.
+ *
+ * @param dev Device to set auto-tuning for
+ * @param enable 1 to enable, 0 to disable
+ */
+FREENECTAPI void freenect_set_iso_autotune(freenect_device *dev, int enable);
+
 /**
  * Start the depth information stream for a device.
  *
@@ -419,6 +789,44 @@ FREENECTAPI int freenect_start_depth(freenect_device *dev);
  */
 FREENECTAPI int freenect_start_video(freenect_device *dev);
 
+/// Typedef for the completion callbacks of freenect_start_depth_async() and freenect_start_video_async()
+typedef void (*freenect_command_cb)(freenect_device *dev, int status, void *user);
+
+/**
+ * Start the depth stream without waiting for the camera. The transfers
+ * start, and the register writes that configure and start the camera's
+ * stream are queued and carried out by freenect_process_events(), one
+ * after the other. freenect_start_depth() makes the same writes, but waits
+ * for each of them.
+ *
+ * The stream counts as running right away: stop it with
+ * freenect_stop_depth(), also when the writes fail. Blocking calls that talk
+ * to the camera wait for queued writes, running the event loop themselves
+ * if need be.
+ *
+ * @param dev Device to start the depth stream for
+ * @param cb Called from freenect_process_events() once the writes are done,
+ *           with 0 or the error of the first failed write. May be NULL.
+ * @param user Passed to cb
+ *
+ * @return 0 if the stream started and the writes are queued, < 0 on error,
+ *         including when the USB backend has no asynchronous control
+ *         transfers (Windows). cb is not called then.
+ */
+FREENECTAPI int freenect_start_depth_async(freenect_device *dev, freenect_command_cb cb, void *user);
+
+/**
+ * Start the video stream without waiting for the camera, see
+ * freenect_start_depth_async().
+ *
+ * @param dev Device to start the video stream for
+ * @param cb Called from freenect_process_events() once the writes are done. May be NULL.
+ * @param user Passed to cb
+ *
+ * @return 0 if the stream started and the writes are queued, < 0 on error (cb is not called)
+ */
+FREENECTAPI int freenect_start_video_async(freenect_device *dev, freenect_command_cb cb, void *user);
+
 /**
  * Stop the depth information stream for a device
  *
@@ -615,6 +1023,174 @@ FREENECTAPI freenect_frame_mode freenect_find_depth_mode(freenect_resolution res
  */
 FREENECTAPI int freenect_set_depth_mode(freenect_device* dev, const freenect_frame_mode mode);
 
+/**
+ * Starts logging every isochronous packet that reaches the depth and video
+ * streams of a device, with its arrival time, to a raw capture file. Unlike
+ * recording decoded frames, this keeps packet loss and resyncs; replaying
+ * the file with the mock USB backend (FREENECT_USB_BACKEND=mock and
+ * FREENECT_MOCK_CAPTURE=filename) runs it through the same decoding path.
+ *
+ * The capture may be started and stopped from any thread, also while the
+ * streams are running and another thread is in freenect_process_events().
+ *
+ * @param dev Device to capture from
+ * @param filename File to write; an existing file is replaced
+ *
+ * @return 0 on success, < 0 on error
+ */
+FREENECTAPI int freenect_start_capture(freenect_device *dev, const char *filename);
+
+/**
+ * Stops the capture started by freenect_start_capture() and closes the
+ * file. Closing the device does this too.
+ *
+ * @param dev Device to stop capturing from
+ *
+ * @return 0 on success, < 0 if no capture was running or writing it failed
+ */
+FREENECTAPI int freenect_stop_capture(freenect_device *dev);
+
+/// Frame taken from a stream's frame pool, see freenect_set_depth_frame_pool()
+typedef struct {
+	freenect_device *dev;     /**< Device the frame came from */
+	void *data;               /**< Frame data, in the format of mode */
+	uint32_t timestamp;       /**< Timestamp of the frame */
+	freenect_frame_mode mode; /**< Mode the stream was started with */
+} freenect_frame;
+
+/// What to do with a completed frame when every pool buffer is taken
+typedef enum {
+	FREENECT_FRAME_POOL_DROP_NEWEST = 0, /**< Drop the frame that just arrived */
+	FREENECT_FRAME_POOL_DROP_OLDEST = 1  /**< Reuse the oldest frame not leased yet */
+} freenect_frame_pool_policy;
+
+/// Typedef for pooled frame received event callbacks
+typedef void (*freenect_frame_cb)(freenect_device *dev, freenect_frame *frame);
+
+/**
+ * Let the library deliver depth frames in a pool of buffers it owns, instead
+ * of the single buffer set with freenect_set_depth_buffer(). Each frame is
+ * converted into a free pool buffer and leased to the application, which
+ * hands it back with freenect_release_frame() when done, from any thread.
+ *
+ * A frame is leased either to the callback set with
+ * freenect_set_depth_frame_callback(), or, without one, queued until the
+ * application takes it with freenect_lease_depth_frame(). When all buffers
+ * are leased or queued, policy decides which frame is dropped; a queued
+ * frame is the only kind DROP_OLDEST can reuse. The depth callback still
+ * runs, with the pool buffer, before the frame is leased.
+ *
+ * Must be called while the depth stream is stopped. Leases outlive the
+ * stream: the buffers are freed once the last one is released.
+ *
+ * @param dev Device to set the depth frame pool for
+ * @param frames Number of buffers, 0 (default) to disable the pool
+ * @param policy Frame to drop when the pool runs dry
+ *
+ * @return 0 on success, < 0 on error
+ */
+FREENECTAPI int freenect_set_depth_frame_pool(freenect_device *dev, int frames, freenect_frame_pool_policy policy);
+
+/**
+ * Video counterpart of freenect_set_depth_frame_pool().
+ *
+ * @param dev Device to set the video frame pool for
+ * @param frames Number of buffers, 0 (default) to disable the pool
+ * @param policy Frame to drop when the pool runs dry
+ *
+ * @return 0 on success, < 0 on error
+ */
+FREENECTAPI int freenect_set_video_frame_pool(freenect_device *dev, int frames, freenect_frame_pool_policy policy);
+
+/**
+ * Set callback receiving the leased frames of the depth frame pool. The
+ * callback owns the frame and must eventually pass it to
+ * freenect_release_frame().
+ *
+ * @param dev Device to set callback for
+ * @param cb Function pointer for processing depth frames, NULL to queue them
+ */
+FREENECTAPI void freenect_set_depth_frame_callback(freenect_device *dev, freenect_frame_cb cb);
+
+/**
+ * Set callback receiving the leased frames of the video frame pool.
+ *
+ * @param dev Device to set callback for
+ * @param cb Function pointer for processing video frames, NULL to queue them
+ */
+FREENECTAPI void freenect_set_video_frame_callback(freenect_device *dev, freenect_frame_cb cb);
+
+/**
+ * Lease the oldest queued depth frame. Only frames not delivered to a frame
+ * callback are queued.
+ *
+ * @param dev Device to take the frame from
+ *
+ * @return Frame to pass to freenect_release_frame(), or NULL if none is queued
+ */
+FREENECTAPI freenect_frame *freenect_lease_depth_frame(freenect_device *dev);
+
+/**
+ * Lease the oldest queued video frame.
+ *
+ * @param dev Device to take the frame from
+ *
+ * @return Frame to pass to freenect_release_frame(), or NULL if none is queued
+ */
+FREENECTAPI freenect_frame *freenect_lease_video_frame(freenect_device *dev);
+
+/**
+ * Return a leased frame to its pool. May be called from any thread, also
+ * after the stream was stopped or the device closed.
+ *
+ * @param frame Frame from a frame callback or a lease call
+ */
+FREENECTAPI void freenect_release_frame(freenect_frame *frame);
+
+/// Typedef for frameset callbacks, see freenect_set_frameset_callback()
+typedef void (*freenect_frameset_cb)(freenect_device *dev, void *depth, const freenect_frame_info *depth_info,
+                                     void *video, const freenect_frame_info *video_info);
+
+/// Counters of the frameset callback, see freenect_get_frameset_stats()
+typedef struct {
+	uint64_t framesets;       /**< Depth and video pairs delivered */
+	uint64_t unmatched_depth; /**< Depth frames dropped for want of a video frame within the tolerance */
+	uint64_t unmatched_video; /**< Video frames dropped for want of a depth frame within the tolerance */
+} freenect_frameset_stats;
+
+/**
+ * Set callback receiving depth and video frames in pairs taken at the same
+ * time. Frames pair up when their device timestamps are at most
+ * tolerance_us apart; both streams are stamped from the same device clock.
+ * The last few frames of each stream wait in library buffers for their
+ * pairs, and are dropped, and counted in freenect_get_frameset_stats(), once
+ * a frame of the other stream shows they can't have one. The depth and video
+ * callbacks keep running for every frame, before it is offered for a pair.
+ *
+ * The callback runs on the thread that decoded the second frame of the
+ * pair. The frames and infos are only valid during the call. Half a frame
+ * period, about 16000 us at 30 Hz, pairs each frame with its nearest
+ * counterpart. Must be called while both streams are stopped.
+ *
+ * @param dev Device to set callback for
+ * @param cb Function pointer for processing framesets, NULL to disable
+ * @param tolerance_us Largest timestamp difference of a pair, in microseconds
+ *
+ * @return 0 on success, < 0 on error
+ */
+FREENECTAPI int freenect_set_frameset_callback(freenect_device *dev, freenect_frameset_cb cb, uint32_t tolerance_us);
+
+/**
+ * Get the counters of the frameset callback since the device was opened.
+ * Never blocks, and may be called from any thread.
+ *
+ * @param dev Device to get counters for
+ * @param stats Filled with the counters
+ *
+ * @return 0 on success, < 0 on error
+ */
+FREENECTAPI int freenect_get_frameset_stats(freenect_device *dev, freenect_frameset_stats *stats);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,104 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2010 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+#ifndef ATOMICS_H
+#define ATOMICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The few atomic operations the lock-free parts of the library need, on the
+// GCC/clang __atomic builtins. MSVC gives volatile accesses acquire/release
+// semantics on x86 and x64, which is what the fallback relies on.
+
+#if defined(_MSC_VER)
+#include <windows.h>
+#include <intrin.h>
+
+static inline uint32_t fn_atomic_load_u32(volatile uint32_t *p) { return *p; }
+static inline void fn_atomic_store_u32(volatile uint32_t *p, uint32_t v) { *p = v; }
+static inline void *fn_atomic_load_ptr(void * volatile *p) { return *p; }
+static inline void fn_atomic_store_ptr(void * volatile *p, void *v) { *p = v; }
+static inline void fn_atomic_fence(void) { MemoryBarrier(); }
+static inline uint64_t fn_atomic_load_u64(volatile uint64_t *p) { return (uint64_t)InterlockedCompareExchange64((volatile LONG64*)p, 0, 0); }
+static inline void fn_atomic_add_u64(volatile uint64_t *p, uint64_t v) { InterlockedExchangeAdd64((volatile LONG64*)p, (LONG64)v); }
+#else
+// acquire loads and release stores
+static inline uint32_t fn_atomic_load_u32(volatile uint32_t *p) { return __atomic_load_n(p, __ATOMIC_ACQUIRE); }
+static inline void fn_atomic_store_u32(volatile uint32_t *p, uint32_t v) { __atomic_store_n(p, v, __ATOMIC_RELEASE); }
+static inline void *fn_atomic_load_ptr(void * volatile *p) { return __atomic_load_n(p, __ATOMIC_ACQUIRE); }
+static inline void fn_atomic_store_ptr(void * volatile *p, void *v) { __atomic_store_n(p, v, __ATOMIC_RELEASE); }
+// full barrier, for the store-then-load handshakes release/acquire can't order
+static inline void fn_atomic_fence(void) { __atomic_thread_fence(__ATOMIC_SEQ_CST); }
+// relaxed 64 bit counters: never torn, even on 32 bit targets, but unordered
+static inline uint64_t fn_atomic_load_u64(volatile uint64_t *p) { return __atomic_load_n(p, __ATOMIC_RELAXED); }
+static inline void fn_atomic_add_u64(volatile uint64_t *p, uint64_t v) { __atomic_fetch_add(p, v, __ATOMIC_RELAXED); }
+#endif
+
+// Bounded single-producer, single-consumer queue of pointers. The producer
+// only writes head and the consumer only writes tail, so neither side ever
+// waits for the other. size must be a power of two.
+#define FN_RING_SIZE 4
+
+typedef struct {
+	void *slots[FN_RING_SIZE];
+	volatile uint32_t head; // next slot to fill, written by the producer
+	char pad[64];           // keep the two indices on separate cache lines
+	volatile uint32_t tail; // next slot to take, written by the consumer
+} fn_ring;
+
+// Returns 0, or -1 when the ring is full
+static inline int fn_ring_push(fn_ring *ring, void *item)
+{
+	uint32_t head = ring->head;
+	if (head - fn_atomic_load_u32(&ring->tail) == FN_RING_SIZE)
+		return -1;
+	ring->slots[head & (FN_RING_SIZE - 1)] = item;
+	fn_atomic_store_u32(&ring->head, head + 1);
+	return 0;
+}
+
+// Returns NULL when the ring is empty
+static inline void *fn_ring_pop(fn_ring *ring)
+{
+	uint32_t tail = ring->tail;
+	if (fn_atomic_load_u32(&ring->head) == tail)
+		return NULL;
+	void *item = ring->slots[tail & (FN_RING_SIZE - 1)];
+	fn_atomic_store_u32(&ring->tail, tail + 1);
+	return item;
+}
+
+// The oldest item, left in the ring; NULL when empty. Consumer side only.
+static inline void *fn_ring_peek(fn_ring *ring)
+{
+	uint32_t tail = ring->tail;
+	if (fn_atomic_load_u32(&ring->head) == tail)
+		return NULL;
+	return ring->slots[tail & (FN_RING_SIZE - 1)];
+}
+
+#endif
@@ -32,6 +32,7 @@
 #include "freenect_internal.h"
 #include "registration.h"
 #include "cameras.h"
+#include "convert.h"
 
 #define MAKE_RESERVED(res, fmt) (uint32_t)(((res & 0xff) << 8) | (((fmt & 0xff))))
 #define RESERVED_TO_RESOLUTION(reserved) (freenect_resolution)((reserved >> 8) & 0xff)
@@ -60,7 +61,7 @@ static freenect_frame_mode supported_video_modes[video_mode_count] = {
 	{MAKE_RESERVED(FREENECT_RESOLUTION_MEDIUM, FREENECT_VIDEO_YUV_RAW), FREENECT_RESOLUTION_MEDIUM, {FREENECT_VIDEO_YUV_RAW}, 640*480*2, 640, 480, 16, 0, 15, 1 },
 };
 
-#define depth_mode_count 6
+#define depth_mode_count 7
 static freenect_frame_mode supported_depth_modes[depth_mode_count] = {
 	// reserved, resolution, format, bytes, width, height, data_bits_per_pixel, padding_bits_per_pixel, framerate, is_valid
 	{MAKE_RESERVED(FREENECT_RESOLUTION_MEDIUM, FREENECT_DEPTH_11BIT), FREENECT_RESOLUTION_MEDIUM, {FREENECT_DEPTH_11BIT}, 640*480*2, 640, 480, 11, 5, 30, 1},
@@ -69,6 +70,7 @@ static freenect_frame_mode supported_depth_modes[depth_mode_count] = {
 	{MAKE_RESERVED(FREENECT_RESOLUTION_MEDIUM, FREENECT_DEPTH_10BIT_PACKED), FREENECT_RESOLUTION_MEDIUM, {FREENECT_DEPTH_10BIT_PACKED}, 640*480*10/8, 640, 480, 10, 0, 30, 1},
 	{MAKE_RESERVED(FREENECT_RESOLUTION_MEDIUM, FREENECT_DEPTH_REGISTERED), FREENECT_RESOLUTION_MEDIUM, {FREENECT_DEPTH_REGISTERED}, 640*480*2, 640, 480, 16, 0, 30, 1},
 	{MAKE_RESERVED(FREENECT_RESOLUTION_MEDIUM, FREENECT_DEPTH_MM), FREENECT_RESOLUTION_MEDIUM, {FREENECT_DEPTH_MM}, 640*480*2, 640, 480, 16, 0, 30, 1},
+	{MAKE_RESERVED(FREENECT_RESOLUTION_MEDIUM, FREENECT_DEPTH_XYZ), FREENECT_RESOLUTION_MEDIUM, {FREENECT_DEPTH_XYZ}, 640*480*3*sizeof(float), 640, 480, 96, 0, 30, 1},
 };
 static const freenect_frame_mode invalid_mode = {0, (freenect_resolution)0, {(freenect_video_format)0}, 0, 0, 0, 0, 0, 0, 0};
 
@@ -83,6 +85,68 @@ struct pkt_hdr {
 	uint32_t timestamp;
 };
 
+// The statistics are read from any thread and dropped frames are counted
+// on the decode threads too, so they are only touched atomically
+#define STREAM_COUNT(strm, counter, n) fn_atomic_add_u64(&(strm)->stats.counter, (n))
+
+// add a duration to a latency histogram, and to total unless it is NULL
+static void stream_time(uint64_t *hist, uint64_t *total, uint64_t ns)
+{
+	uint64_t us = ns / 1000;
+	int bucket = 0;
+	while (us >= 2 && bucket < FREENECT_STATS_LATENCY_BUCKETS - 1) {
+		us >>= 1;
+		bucket++;
+	}
+	fn_atomic_add_u64(&hist[bucket], 1);
+	if (total)
+		fn_atomic_add_u64(total, ns);
+}
+
+static void stream_lost_sync(packet_stream *strm)
+{
+	strm->synced = 0;
+	STREAM_COUNT(strm, resyncs, 1);
+}
+
+// bookkeeping for a frame that is complete, or as complete as it gets
+static void stream_complete(packet_stream *strm)
+{
+	STREAM_COUNT(strm, frames, 1);
+	strm->valid_pkts = strm->got_pkts;
+	strm->got_pkts = 0;
+	strm->timestamp = strm->last_timestamp;
+	strm->valid_frames++;
+	strm->new_frame = 1;
+}
+
+// partial frames: overwrite the data of count lost packets, starting at
+// packet first, with no-data values
+static void stream_fill(packet_stream *strm, int first, int count)
+{
+	if (!strm->partial)
+		return;
+	int begin = first * strm->pkt_size;
+	int end = (first + count) * strm->pkt_size;
+	if (end > strm->frame_size)
+		end = strm->frame_size;
+	if (begin < end)
+		memset(strm->raw_buf + begin, strm->fill, end - begin);
+}
+
+// partial frames: deliver what arrived of a frame that has to be given up.
+// The packet is looked at again once the frame is out of the way.
+static int stream_cut_frame(packet_stream *strm)
+{
+	if (!strm->partial || strm->variable_length || strm->got_pkts == 0)
+		return 0;
+	stream_fill(strm, strm->pkt_num, strm->pkts_per_frame - strm->pkt_num);
+	strm->pkt_num = 0;
+	strm->redo = 1;
+	stream_complete(strm);
+	return strm->frame_size;
+}
+
 static int stream_process(freenect_context *ctx, packet_stream *strm, uint8_t *pkt, int len)
 {
 	if (len < 12)
@@ -101,6 +165,7 @@ static int stream_process(freenect_context *ctx, packet_stream *strm, uint8_t *p
 	if (hdr->magic[0] != 'R' || hdr->magic[1] != 'B') {
 		FN_LOG(l_notice, "[Stream %02x] Invalid magic %02x%02x\n",
 		       strm->flag, hdr->magic[0], hdr->magic[1]);
+		STREAM_COUNT(strm, invalid_magic, 1);
 		return 0;
 	}
 
@@ -119,6 +184,8 @@ static int stream_process(freenect_context *ctx, packet_stream *strm, uint8_t *p
 		strm->synced = 1;
 		strm->seq = hdr->seq;
 		strm->pkt_num = 0;
+		strm->converted_rows = 0;
+		strm->new_frame = 1;
 		strm->valid_pkts = 0;
 		strm->got_pkts = 0;
 	}
@@ -129,21 +196,31 @@ static int stream_process(freenect_context *ctx, packet_stream *strm, uint8_t *p
 	if (strm->seq != hdr->seq) {
 		uint8_t lost = hdr->seq - strm->seq;
 		FN_LOG(l_info, "[Stream %02x] Lost %d packets\n", strm->flag, lost);
-		if (lost > 5 || strm->variable_length) {
+		STREAM_COUNT(strm, lost_packets, lost);
+		// with partial frames, skip anything the 8 bit sequence number
+		// still counts reliably
+		if (lost > (strm->partial ? 127 : 5) || strm->variable_length) {
 			FN_LOG(l_notice, "[Stream %02x] Lost too many packets, resyncing...\n", strm->flag);
-			strm->synced = 0;
-			return 0;
+			stream_lost_sync(strm);
+			return stream_cut_frame(strm);
 		}
-		strm->seq = hdr->seq;
 		int left = strm->pkts_per_frame - strm->pkt_num;
+		if (left <= lost && strm->partial) {
+			// finish this frame first, then the packet starts the next one
+			stream_fill(strm, strm->pkt_num, left);
+			strm->seq += left;
+			strm->pkt_num = 0;
+			strm->redo = 1;
+			stream_complete(strm);
+			return strm->frame_size;
+		}
+		strm->seq = hdr->seq;
 		if (left <= lost) {
 			strm->pkt_num = lost - left;
-			strm->valid_pkts = strm->got_pkts;
-			strm->got_pkts = 0;
 			got_frame_size = strm->frame_size;
-			strm->timestamp = strm->last_timestamp;
-			strm->valid_frames++;
+			stream_complete(strm);
 		} else {
+			stream_fill(strm, strm->pkt_num, lost);
 			strm->pkt_num += lost;
 		}
 	}
@@ -157,38 +234,43 @@ static int stream_process(freenect_context *ctx, packet_stream *strm, uint8_t *p
 		    !(strm->pkt_num > 0 && strm->pkt_num < strm->pkts_per_frame-1 && hdr->flag == mof)) {
 			FN_LOG(l_notice, "[Stream %02x] Inconsistent flag %02x with %d packets in buf (%d total), resyncing...\n",
 			       strm->flag, hdr->flag, strm->pkt_num, strm->pkts_per_frame);
-			strm->synced = 0;
-			return got_frame_size;
+			stream_lost_sync(strm);
+			return got_frame_size ? got_frame_size : stream_cut_frame(strm);
 		}
 		// check data length
 		if (datalen > expected_pkt_size) {
 			FN_LOG(l_warning, "[Stream %02x] Expected max %d data bytes, but got %d. Dropping...\n",
 			       strm->flag, expected_pkt_size, datalen);
+			STREAM_COUNT(strm, size_mismatches, 1);
 			return got_frame_size;
 		}
-		if (datalen < expected_pkt_size)
+		if (datalen < expected_pkt_size) {
 			FN_LOG(l_warning, "[Stream %02x] Expected %d data bytes, but got %d\n",
 			       strm->flag, expected_pkt_size, datalen);
+			STREAM_COUNT(strm, size_mismatches, 1);
+		}
 	} else {
 		// check the header to make sure it's what we expect
 		if (!(strm->pkt_num == 0 && hdr->flag == sof) &&
 		    !(strm->pkt_num < strm->pkts_per_frame && (hdr->flag == eof || hdr->flag == mof))) {
 			FN_LOG(l_notice, "[Stream %02x] Inconsistent flag %02x with %d packets in buf (%d total), resyncing...\n",
 			       strm->flag, hdr->flag, strm->pkt_num, strm->pkts_per_frame);
-			strm->synced = 0;
+			stream_lost_sync(strm);
 			return got_frame_size;
 		}
 		// check data length
 		if (datalen > expected_pkt_size) {
 			FN_LOG(l_warning, "[Stream %02x] Expected max %d data bytes, but got %d. Resyncng...\n",
 			       strm->flag, expected_pkt_size, datalen);
-			strm->synced = 0;
+			STREAM_COUNT(strm, size_mismatches, 1);
+			stream_lost_sync(strm);
 			return got_frame_size;
 		}
 		if (datalen < expected_pkt_size && hdr->flag != eof) {
 			FN_LOG(l_warning, "[Stream %02x] Expected %d data bytes, but got %d. Resyncing...\n",
 			       strm->flag, expected_pkt_size, datalen);
-			strm->synced = 0;
+			STREAM_COUNT(strm, size_mismatches, 1);
+			stream_lost_sync(strm);
 			return got_frame_size;
 		}
 	}
@@ -196,6 +278,13 @@ static int stream_process(freenect_context *ctx, packet_stream *strm, uint8_t *p
 	// copy data
 	uint8_t *dbuf = strm->raw_buf + strm->pkt_num * strm->pkt_size;
 	memcpy(dbuf, data, datalen);
+	if (strm->partial) {
+		uint8_t *map = strm->raw_buf + strm->frame_size;
+		if (strm->new_frame)
+			memset(map, 0, strm->raw_size - strm->frame_size);
+		map[strm->pkt_num / 8] |= 1 << (strm->pkt_num % 8);
+	}
+	strm->new_frame = 0;
 
 	strm->pkt_num++;
 	strm->seq++;
@@ -209,10 +298,7 @@ static int stream_process(freenect_context *ctx, packet_stream *strm, uint8_t *p
 		else
 			got_frame_size = (dbuf - strm->raw_buf) + strm->last_pkt_size;
 		strm->pkt_num = 0;
-		strm->valid_pkts = strm->got_pkts;
-		strm->got_pkts = 0;
-		strm->timestamp = strm->last_timestamp;
-		strm->valid_frames++;
+		stream_complete(strm);
 	}
 	return got_frame_size;
 }
@@ -221,6 +307,7 @@ static void stream_init(freenect_context *ctx, packet_stream *strm, int rlen, in
 {
 	strm->valid_frames = 0;
 	strm->synced = 0;
+	strm->converted_rows = 0;
 
 	if (strm->usr_buf) {
 		strm->lib_buf = NULL;
@@ -230,29 +317,113 @@ static void stream_init(freenect_context *ctx, packet_stream *strm, int rlen, in
 		strm->proc_buf = strm->lib_buf;
 	}
 
-	if (rlen == 0) {
+	// partial frames need a raw buffer of their own for the packet map
+	if (rlen == 0 && !strm->partial) {
 		strm->split_bufs = 0;
-		strm->raw_buf = (uint8_t*)strm->proc_buf;
 		strm->frame_size = plen;
 	} else {
 		strm->split_bufs = 1;
-		strm->raw_buf = (uint8_t*)malloc(rlen);
-		strm->frame_size = rlen;
+		strm->frame_size = rlen ? rlen : plen;
 	}
 
 	strm->last_pkt_size = strm->frame_size % strm->pkt_size;
 	if (strm->last_pkt_size == 0)
 		strm->last_pkt_size = strm->pkt_size;
 	strm->pkts_per_frame = (strm->frame_size + strm->pkt_size - 1) / strm->pkt_size;
+
+	strm->raw_size = strm->frame_size;
+	if (strm->partial)
+		strm->raw_size += (strm->pkts_per_frame + 7) / 8;
+	if (strm->split_bufs)
+		strm->raw_buf = (uint8_t*)malloc(strm->raw_size);
+	else
+		strm->raw_buf = (uint8_t*)strm->proc_buf;
+	strm->new_frame = 1;
+	strm->redo = 0;
+	fn_clock_reset(&strm->clock);
 }
 
-static void stream_freebufs(freenect_context *ctx, packet_stream *strm)
+// hand the frames of a started stream to a decode worker, if enabled; slot
+// is 0 for depth and 1 for video
+static int stream_offload(freenect_device *dev, packet_stream *strm, int slot, fn_decode_func decode)
 {
+	freenect_context *ctx = dev->parent;
+
+	if (dev->decode_threads == 0)
+		return 0;
+	// the colored point cloud passes the RGB frame from the video to the
+	// depth callbacks, so it keeps both streams on one thread
+	int w = dev->decode_threads > 1 && !dev->points_cb ? slot : 0;
+	if (!dev->decode_workers[w]) {
+		dev->decode_workers[w] = fn_decode_worker_create();
+		if (!dev->decode_workers[w]) {
+			FN_ERROR("Failed to start decode thread\n");
+			return -1;
+		}
+	}
+	strm->offload = fn_decode_attach(dev->decode_workers[w], slot, dev, decode, strm->raw_size);
+	if (!strm->offload) {
+		FN_ERROR("Failed to allocate decode buffers\n");
+		return -1;
+	}
 	if (strm->split_bufs)
 		free(strm->raw_buf);
+	strm->split_bufs = 1;
+	strm->raw_buf = strm->offload->filling->raw;
+	return 0;
+}
+
+// create the frame pool of a started stream, if one was asked for
+static int stream_pool(freenect_device *dev, packet_stream *strm, freenect_frame_mode mode)
+{
+	freenect_context *ctx = dev->parent;
+
+	if (strm->pool_frames == 0)
+		return 0;
+	strm->pool = fn_frame_pool_create(dev, strm->pool_frames, strm->pool_policy, mode);
+	if (!strm->pool) {
+		FN_ERROR("Failed to allocate frame pool\n");
+		return -1;
+	}
+	return 0;
+}
+
+// buffer to decode the next frame into, NULL to drop the frame
+static freenect_frame *stream_acquire(freenect_context *ctx, packet_stream *strm, fn_frame_pool *pool)
+{
+	int dropped_one;
+	freenect_frame *frame = fn_frame_pool_acquire(pool, &dropped_one);
+	if (dropped_one)
+		STREAM_COUNT(strm, dropped_frames, 1);
+	if (!frame) {
+		uint32_t dropped = fn_frame_pool_dropped(pool);
+		FN_LOG(dropped > 5 ? LL_SPEW : LL_NOTICE,
+		       "[Stream %02x] Frame pool is empty, dropped frame (%u dropped so far)\n",
+		       strm->flag, dropped);
+	}
+	return frame;
+}
+
+static void stream_freebufs(freenect_context *ctx, packet_stream *strm)
+{
+	if (strm->offload) {
+		fn_decode_detach(strm->offload);
+		strm->offload = NULL;
+	} else if (strm->split_bufs) {
+		free(strm->raw_buf);
+	}
 	if (strm->lib_buf)
 		free(strm->lib_buf);
 
+	// leased frames keep the pool alive until they are released
+	if (strm->pool) {
+		fn_frame_pool_close(strm->pool);
+		if (strm->pool_frame)
+			fn_frame_pool_publish(strm->pool, strm->pool_frame, 0, 0);
+		strm->pool = NULL;
+		strm->pool_frame = NULL;
+	}
+
 	strm->raw_buf = NULL;
 	strm->proc_buf = NULL;
 	strm->lib_buf = NULL;
@@ -277,409 +448,390 @@ static int stream_setbuf(freenect_context *ctx, packet_stream *strm, void *pbuf)
 
 		if (!strm->split_bufs)
 			strm->raw_buf = (uint8_t*)strm->proc_buf;
+		// rows already converted went to the old buffer
+		if (strm->converted_rows > 0)
+			strm->converted_rows = 0;
 		return 0;
 	}
 }
 
-/**
- * Convert a packed array of n elements with vw useful bits into array of
- * zero-padded 16bit elements.
- *
- * @param src The source packed array, of size (n * vw / 8) bytes
- * @param dest The destination unpacked array, of size (n * 2) bytes
- * @param vw The virtual width of elements, that is the number of useful bits for each of them
- * @param n The number of elements (in particular, of the destination array), NOT a length in bytes
- */
-static inline void convert_packed_to_16bit(uint8_t *src, uint16_t *dest, int vw, int n)
-{
-	unsigned int mask = (1 << vw) - 1;
-	uint32_t buffer = 0;
-	int bitsIn = 0;
-	while (n--) {
-		while (bitsIn < vw) {
-			buffer = (buffer << 8) | *(src++);
-			bitsIn += 8;
-		}
-		bitsIn -= vw;
-		*(dest++) = (buffer >> bitsIn) & mask;
-	}
+// details of the frame stream_process() just completed
+static void stream_frame_info(packet_stream *strm, freenect_stream stream, freenect_frame_info *info)
+{
+	uint64_t now = fn_get_time_ns();
+	info->device_timestamp = fn_clock_sample(&strm->clock, strm->timestamp, now);
+	info->host_timestamp = fn_clock_to_host(&strm->clock, info->device_timestamp);
+	info->arrival_time = now;
+	info->clock_drift_ppm = fn_clock_drift_ppm(&strm->clock);
+	info->stream = stream;
+	info->timestamp = strm->timestamp;
+	info->packets = strm->pkts_per_frame;
+	info->lost_packets = strm->pkts_per_frame - strm->valid_pkts;
+	info->packet_bytes = strm->pkt_size;
+	info->packet_map = strm->partial ? strm->raw_buf + strm->frame_size : NULL;
 }
 
-/**
- * Convert a packed array of n elements with vw useful bits into array of
- * 8bit elements, dropping LSB.
- *
- * @param src The source packed array, of size (n * vw / 8) bytes
- * @param dest The destination unpacked array, of size (n * 2) bytes
- * @param vw The virtual width of elements, that is the number of useful bits for each of them
- * @param n The number of elements (in particular, of the destination array), NOT a length in bytes
- *
- * @pre vw is expected to be >= 8.
- */
-static inline void convert_packed_to_8bit(uint8_t *src, uint8_t *dest, int vw, int n)
-{
-	uint32_t buffer = 0;
-	int bitsIn = 0;
-	while (n--) {
-		while (bitsIn < vw) {
-			buffer = (buffer << 8) | *(src++);
-			bitsIn += 8;
-		}
-		bitsIn -= vw;
-		*(dest++) = buffer >> (bitsIn + vw - 8);
-	}
+// depth formats whose raw buffer holds the 11 bit packed frame
+static int depth_is_packed11(freenect_depth_format fmt)
+{
+	return fmt == FREENECT_DEPTH_11BIT || fmt == FREENECT_DEPTH_11BIT_PACKED || fmt == FREENECT_DEPTH_REGISTERED
+		|| fmt == FREENECT_DEPTH_MM || fmt == FREENECT_DEPTH_XYZ;
 }
 
-// Loop-unrolled version of the 11-to-16 bit unpacker.  n must be a multiple of 8.
-static void convert_packed11_to_16bit(uint8_t *raw, uint16_t *frame, int n)
+// depth formats converted row by row, which can be done as the packets arrive
+static int depth_is_rowwise(freenect_depth_format fmt)
 {
-	uint16_t baseMask = (1 << 11) - 1;
-	while(n >= 8)
-	{
-		uint8_t r0  = *(raw+0);
-		uint8_t r1  = *(raw+1);
-		uint8_t r2  = *(raw+2);
-		uint8_t r3  = *(raw+3);
-		uint8_t r4  = *(raw+4);
-		uint8_t r5  = *(raw+5);
-		uint8_t r6  = *(raw+6);
-		uint8_t r7  = *(raw+7);
-		uint8_t r8  = *(raw+8);
-		uint8_t r9  = *(raw+9);
-		uint8_t r10 = *(raw+10);
+	return fmt == FREENECT_DEPTH_11BIT || fmt == FREENECT_DEPTH_10BIT || fmt == FREENECT_DEPTH_MM
+		|| fmt == FREENECT_DEPTH_XYZ;
+}
 
-		frame[0] =  (r0<<3)  | (r1>>5);
-		frame[1] = ((r1<<6)  | (r2>>2) )           & baseMask;
-		frame[2] = ((r2<<9)  | (r3<<1) | (r4>>7) ) & baseMask;
-		frame[3] = ((r4<<4)  | (r5>>4) )           & baseMask;
-		frame[4] = ((r5<<7)  | (r6>>1) )           & baseMask;
-		frame[5] = ((r6<<10) | (r7<<2) | (r8>>6) ) & baseMask;
-		frame[6] = ((r8<<5)  | (r9>>3) )           & baseMask;
-		frame[7] = ((r9<<8)  | (r10)   )           & baseMask;
+static void depth_convert_rows(freenect_device *dev, uint8_t *raw, void *out, int first_row, int last_row)
+{
+	int bits = dev->depth_format == FREENECT_DEPTH_10BIT ? 10 : 11;
+	uint8_t *in = raw + first_row * 640 * bits / 8;
 
-		n -= 8;
-		raw += 11;
-		frame += 8;
+	switch (dev->depth_format) {
+		case FREENECT_DEPTH_11BIT:
+			freenect_convert_packed11_to_16bit(in, (uint16_t*)out + first_row * 640, (last_row - first_row) * 640);
+			break;
+		case FREENECT_DEPTH_10BIT:
+			freenect_convert_packed10_to_16bit(in, (uint16_t*)out + first_row * 640, (last_row - first_row) * 640);
+			break;
+		case FREENECT_DEPTH_MM:
+			freenect_apply_depth_to_mm_rows(dev, raw, (uint16_t*)out, first_row, last_row);
+			break;
+		case FREENECT_DEPTH_XYZ:
+			freenect_apply_depth_to_xyz_rows(dev, raw, (float*)out, first_row, last_row);
+			break;
+		default:
+			break;
 	}
 }
 
-static void depth_process(freenect_device *dev, uint8_t *pkt, int len)
+// incremental decoding: convert the rows of the frame being assembled whose
+// packets have all arrived, leaving only the tail for the end of the frame
+static void depth_decode_rows(freenect_device *dev)
 {
 	freenect_context *ctx = dev->parent;
+	packet_stream *strm = &dev->depth;
 
-	if (len == 0)
+	if (strm->converted_rows < 0)
 		return;
-
-	if (!dev->depth.running)
+	int row_bytes = 640 * (dev->depth_format == FREENECT_DEPTH_10BIT ? 10 : 11) / 8;
+	int rows = strm->pkt_num * strm->pkt_size / row_bytes;
+	if (rows > 480)
+		rows = 480;
+	if (rows <= strm->converted_rows)
 		return;
 
-	int got_frame_size = stream_process(ctx, &dev->depth, pkt, len);
-
-	if (!got_frame_size)
-		return;
+	void *out = strm->proc_buf;
+	if (strm->pool) {
+		if (!strm->pool_frame)
+			strm->pool_frame = stream_acquire(ctx, strm, strm->pool);
+		if (!strm->pool_frame) {
+			strm->converted_rows = -1;
+			return;
+		}
+		out = strm->pool_frame->data;
+	}
+	uint64_t start = fn_get_time_ns();
+	depth_convert_rows(dev, strm->raw_buf, out, strm->converted_rows, rows);
+	STREAM_COUNT(strm, decode_ns, fn_get_time_ns() - start);
+	strm->converted_rows = rows;
+}
 
-	FN_SPEW("Got depth frame of size %d/%d, %d/%d packets arrived, TS %08x\n", got_frame_size,
-	        dev->depth.frame_size, dev->depth.valid_pkts, dev->depth.pkts_per_frame, dev->depth.timestamp);
+// convert a complete depth frame and run the callbacks, on the event thread
+// or on a decode worker
+static void depth_decode(freenect_device *dev, uint8_t *raw, const freenect_frame_info *info)
+{
+	uint32_t timestamp = info->timestamp;
+	freenect_context *ctx = dev->parent;
+	fn_frame_pool *pool = dev->depth.pool;
+	freenect_frame_cb frame_cb = dev->depth_frame_cb;
+	freenect_frame *frame = NULL;
+	void *out = dev->depth.proc_buf;
+	int first_row = 0;
+
+	if (dev->depth.incremental) {
+		first_row = dev->depth.converted_rows;
+		dev->depth.converted_rows = 0;
+		// the pool was empty when the frame started
+		if (first_row < 0)
+			return;
+	}
+	if (pool) {
+		frame = dev->depth.pool_frame;
+		dev->depth.pool_frame = NULL;
+		if (!frame)
+			frame = stream_acquire(ctx, &dev->depth, pool);
+		if (!frame)
+			return;
+		out = frame->data;
+	}
 
+	uint64_t start = fn_get_time_ns();
 	switch (dev->depth_format) {
 		case FREENECT_DEPTH_11BIT:
-			convert_packed11_to_16bit(dev->depth.raw_buf, (uint16_t*)dev->depth.proc_buf, 640*480);
-			break;
-		case FREENECT_DEPTH_REGISTERED:
-			freenect_apply_registration(dev, dev->depth.raw_buf, (uint16_t*)dev->depth.proc_buf );
-			break;
+		case FREENECT_DEPTH_10BIT:
 		case FREENECT_DEPTH_MM:
-			freenect_apply_depth_to_mm(dev, dev->depth.raw_buf, (uint16_t*)dev->depth.proc_buf );
+		case FREENECT_DEPTH_XYZ:
+			depth_convert_rows(dev, raw, out, first_row, 480);
 			break;
-		case FREENECT_DEPTH_10BIT:
-			convert_packed_to_16bit(dev->depth.raw_buf, (uint16_t*)dev->depth.proc_buf, 10, 640*480);
+		case FREENECT_DEPTH_REGISTERED:
+			freenect_apply_registration(dev, raw, (uint16_t*)out );
 			break;
 		case FREENECT_DEPTH_10BIT_PACKED:
 		case FREENECT_DEPTH_11BIT_PACKED:
+			if (raw != out)
+				memcpy(out, raw, freenect_find_depth_mode(dev->depth_resolution, dev->depth_format).bytes);
 			break;
 		default:
 			FN_ERROR("depth_process() was called, but an invalid depth_format is set\n");
 			break;
 	}
+	uint64_t decoded = fn_get_time_ns();
+	STREAM_COUNT(&dev->depth, decode_ns, decoded - start);
+	stream_time(dev->depth.stats.decode_latency, NULL, decoded - info->arrival_time);
+
+	if (dev->frame_info_cb)
+		dev->frame_info_cb(dev, info);
 	if (dev->depth_cb)
-		dev->depth_cb(dev, dev->depth.proc_buf, dev->depth.timestamp);
-}
-
-#define CLAMP(x) if (x < 0) {x = 0;} if (x > 255) {x = 255;}
-static void convert_uyvy_to_rgb(uint8_t *raw_buf, uint8_t *proc_buf, freenect_frame_mode frame_mode)
-{
-	int x, y;
-	for(y = 0; y < frame_mode.height; ++y) {
-		for(x = 0; x < frame_mode.width; x+=2) {
-			int i = (frame_mode.width * y + x);
-			int u  = raw_buf[2*i];
-			int y1 = raw_buf[2*i+1];
-			int v  = raw_buf[2*i+2];
-			int y2 = raw_buf[2*i+3];
-			int r1 = (y1-16)*1164/1000 + (v-128)*1596/1000;
-			int g1 = (y1-16)*1164/1000 - (v-128)*813/1000 - (u-128)*391/1000;
-			int b1 = (y1-16)*1164/1000 + (u-128)*2018/1000;
-			int r2 = (y2-16)*1164/1000 + (v-128)*1596/1000;
-			int g2 = (y2-16)*1164/1000 - (v-128)*813/1000 - (u-128)*391/1000;
-			int b2 = (y2-16)*1164/1000 + (u-128)*2018/1000;
-			CLAMP(r1)
-			CLAMP(g1)
-			CLAMP(b1)
-			CLAMP(r2)
-			CLAMP(g2)
-			CLAMP(b2)
-			proc_buf[3*i]  =r1;
-			proc_buf[3*i+1]=g1;
-			proc_buf[3*i+2]=b1;
-			proc_buf[3*i+3]=r2;
-			proc_buf[3*i+4]=g2;
-			proc_buf[3*i+5]=b2;
-		}
+		dev->depth_cb(dev, out, timestamp);
+
+	if (dev->points_cb && dev->points_rgb_valid && depth_is_packed11(dev->depth_format)) {
+		int count = freenect_apply_points(dev, raw, dev->points_rgb, dev->points);
+		if (count >= 0)
+			dev->points_cb(dev, dev->points, count, timestamp);
 	}
+	if (dev->frameset)
+		fn_frameset_add(dev->frameset, dev, out, freenect_find_depth_mode(dev->depth_resolution, dev->depth_format).bytes, info);
+
+	if (frame && fn_frame_pool_publish(pool, frame, timestamp, frame_cb != NULL) && frame_cb)
+		frame_cb(dev, frame);
+
+	stream_time(dev->depth.stats.callback_latency, &dev->depth.stats.callback_ns, fn_get_time_ns() - decoded);
 }
-#undef CLAMP
-
-static void convert_bayer_to_rgb(uint8_t *raw_buf, uint8_t *proc_buf, freenect_frame_mode frame_mode)
-{
-	int x,y;
-	/* Pixel arrangement:
-	 * G R G R G R G R
-	 * B G B G B G B G
-	 * G R G R G R G R
-	 * B G B G B G B G
-	 * G R G R G R G R
-	 * B G B G B G B G
-	 *
-	 * To convert a Bayer-pattern into RGB you have to handle four pattern
-	 * configurations:
-	 * 1)         2)         3)         4)
-	 *      B1      B1 G1 B2   R1 G1 R2      R1       <- previous line
-	 *   R1 G1 R2   G2 R1 G3   G2 B1 G3   B1 G1 B2    <- current line
-	 *      B2      B3 G4 B4   R3 G4 R4      R2       <- next line
-	 *   ^  ^  ^
-	 *   |  |  next pixel
-	 *   |  current pixel
-	 *   previous pixel
-	 *
-	 * The RGB values (r,g,b) for each configuration are calculated as
-	 * follows:
-	 *
-	 * 1) r = (R1 + R2) / 2
-	 *    g =  G1
-	 *    b = (B1 + B2) / 2
-	 *
-	 * 2) r =  R1
-	 *    g = (G1 + G2 + G3 + G4) / 4
-	 *    b = (B1 + B2 + B3 + B4) / 4
-	 *
-	 * 3) r = (R1 + R2 + R3 + R4) / 4
-	 *    g = (G1 + G2 + G3 + G4) / 4
-	 *    b =  B1
-	 *
-	 * 4) r = (R1 + R2) / 2
-	 *    g =  G1
-	 *    b = (B1 + B2) / 2
-	 *
-	 * To efficiently calculate these values, two 32bit integers are used
-	 * as "shift-buffers". One integer to store the 3 horizontal bayer pixel
-	 * values (previous, current, next) of the current line. The other
-	 * integer to store the vertical average value of the bayer pixels
-	 * (previous, current, next) of the previous and next line.
-	 *
-	 * The boundary conditions for the first and last line and the first
-	 * and last column are solved via mirroring the second and second last
-	 * line and the second and second last column.
-	 *
-	 * To reduce slow memory access, the values of a rgb pixel are packet
-	 * into a 32bit variable and transfered together.
-	 */
-
-	uint8_t *dst = proc_buf; // pointer to destination
-
-	uint8_t *prevLine;        // pointer to previous, current and next line
-	uint8_t *curLine;         // of the source bayer pattern
-	uint8_t *nextLine;
-
-	// storing horizontal values in hVals:
-	// previous << 16, current << 8, next
-	uint32_t hVals;
-	// storing vertical averages in vSums:
-	// previous << 16, current << 8, next
-	uint32_t vSums;
-
-	// init curLine and nextLine pointers
-	curLine  = raw_buf;
-	nextLine = curLine + frame_mode.width;
-	for (y = 0; y < frame_mode.height; ++y) {
-
-		if ((y > 0) && (y < frame_mode.height-1))
-			prevLine = curLine - frame_mode.width; // normal case
-		else if (y == 0)
-			prevLine = nextLine;      // top boundary case
-		else
-			nextLine = prevLine;      // bottom boundary case
-
-		// init horizontal shift-buffer with current value
-		hVals  = (*(curLine++) << 8);
-		// handle left column boundary case
-		hVals |= (*curLine << 16);
-		// init vertical average shift-buffer with current values average
-		vSums = ((*(prevLine++) + *(nextLine++)) << 7) & 0xFF00;
-		// handle left column boundary case
-		vSums |= ((*prevLine + *nextLine) << 15) & 0xFF0000;
-
-		// store if line is odd or not
-		uint8_t yOdd = y & 1;
-		// the right column boundary case is not handled inside this loop
-		// thus the "639"
-		for (x = 0; x < frame_mode.width-1; ++x) {
-			// place next value in shift buffers
-			hVals |= *(curLine++);
-			vSums |= (*(prevLine++) + *(nextLine++)) >> 1;
-
-			// calculate the horizontal sum as this sum is needed in
-			// any configuration
-			uint8_t hSum = ((uint8_t)(hVals >> 16) + (uint8_t)(hVals)) >> 1;
-
-			if (yOdd == 0) {
-				if ((x & 1) == 0) {
-					// Configuration 1
-					*(dst++) = hSum;		// r
-					*(dst++) = hVals >> 8;	// g
-					*(dst++) = vSums >> 8;	// b
-				} else {
-					// Configuration 2
-					*(dst++) = hVals >> 8;
-					*(dst++) = (hSum + (uint8_t)(vSums >> 8)) >> 1;
-					*(dst++) = ((uint8_t)(vSums >> 16) + (uint8_t)(vSums)) >> 1;
-				}
-			} else {
-				if ((x & 1) == 0) {
-					// Configuration 3
-					*(dst++) = ((uint8_t)(vSums >> 16) + (uint8_t)(vSums)) >> 1;
-					*(dst++) = (hSum + (uint8_t)(vSums >> 8)) >> 1;
-					*(dst++) = hVals >> 8;
-				} else {
-					// Configuration 4
-					*(dst++) = vSums >> 8;
-					*(dst++) = hVals >> 8;
-					*(dst++) = hSum;
-				}
-			}
 
-			// shift the shift-buffers
-			hVals <<= 8;
-			vSums <<= 8;
-		} // end of for x loop
-		// right column boundary case, mirroring second last column
-		hVals |= (uint8_t)(hVals >> 16);
-		vSums |= (uint8_t)(vSums >> 16);
-
-		// the horizontal sum simplifies to the second last column value
-		uint8_t hSum = (uint8_t)(hVals);
-
-		if (yOdd == 0) {
-			if ((x & 1) == 0) {
-				*(dst++) = hSum;
-				*(dst++) = hVals >> 8;
-				*(dst++) = vSums >> 8;
-			} else {
-				*(dst++) = hVals >> 8;
-				*(dst++) = (hSum + (uint8_t)(vSums >> 8)) >> 1;
-				*(dst++) = vSums;
-			}
-		} else {
-			if ((x & 1) == 0) {
-				*(dst++) = vSums;
-				*(dst++) = (hSum + (uint8_t)(vSums >> 8)) >> 1;
-				*(dst++) = hVals >> 8;
-			} else {
-				*(dst++) = vSums >> 8;
-				*(dst++) = hVals >> 8;
-				*(dst++) = hSum;
-			}
-		}
+// queue a complete frame for the decode worker
+static void stream_submit(freenect_context *ctx, packet_stream *strm, freenect_device *dev, const freenect_frame_info *info)
+{
+	uint32_t dropped = strm->offload->dropped;
+	strm->raw_buf = fn_decode_submit(strm->offload, info, dev->decode_seq++);
+	if (strm->offload->dropped != dropped) {
+		STREAM_COUNT(strm, dropped_frames, 1);
+		FN_LOG(strm->offload->dropped > 5 ? LL_SPEW : LL_NOTICE,
+		       "[Stream %02x] Decode worker is behind, dropped frame (%u dropped so far)\n",
+		       strm->flag, strm->offload->dropped);
+	}
+}
+
+// Frames between the auto-tune checks, about a second of depth
+#define ISO_TUNE_FRAMES 30
+
+// Auto-tune: grow the transfers in flight of a stream that lost packets
+// over the last ISO_TUNE_FRAMES frames. The transfers are restarted by
+// freenect_camera_retune(), outside of the transfer callbacks.
+static void stream_autotune(freenect_device *dev, packet_stream *strm)
+{
+	freenect_context *ctx = dev->parent;
+
+	if (!dev->iso_autotune || strm->retune)
+		return;
+	uint64_t lost = fn_atomic_load_u64(&strm->stats.lost_packets);
+	if (strm->tune_frames++ == 0) {
+		strm->tune_lost = lost;
+		return;
+	}
+	if (strm->tune_frames <= ISO_TUNE_FRAMES)
+		return;
+	strm->tune_frames = 0;
+	if (lost == strm->tune_lost)
+		return;
 
-	} // end of for y loop
+	int max_transfers = ISO_MAX_PKTS_IN_FLIGHT / strm->iso.packets;
+	int transfers = strm->iso.transfers + (strm->iso.transfers + 1) / 2;
+	if (transfers > max_transfers)
+		transfers = max_transfers;
+	if (transfers == strm->iso.transfers)
+		return;
+	FN_INFO("[Stream %02x] Lost %llu packets, growing transfers in flight from %d to %d\n", strm->flag,
+	        (unsigned long long)(lost - strm->tune_lost), strm->iso.transfers, transfers);
+	strm->retune = transfers;
 }
 
-static void video_process(freenect_device *dev, uint8_t *pkt, int len)
+static void depth_process(freenect_device *dev, uint8_t *pkt, int len)
 {
 	freenect_context *ctx = dev->parent;
 
+	fn_capture_packet(dev, dev->depth.flag, pkt, len);
+
 	if (len == 0)
 		return;
 
-	if (!dev->video.running)
+	if (!dev->depth.running)
 		return;
 
-	int got_frame_size = stream_process(ctx, &dev->video, pkt, len);
+	STREAM_COUNT(&dev->depth, packets, 1);
+	STREAM_COUNT(&dev->depth, bytes, len);
+	do {
+		dev->depth.redo = 0;
+		int got_frame_size = stream_process(ctx, &dev->depth, pkt, len);
 
-	if (!got_frame_size)
-		return;
+		if (!got_frame_size) {
+			if (dev->depth.incremental && dev->depth.synced)
+				depth_decode_rows(dev);
+			return;
+		}
 
-	FN_SPEW("Got video frame of size %d/%d, %d/%d packets arrived, TS %08x\n", got_frame_size,
-	        dev->video.frame_size, dev->video.valid_pkts, dev->video.pkts_per_frame, dev->video.timestamp);
+		FN_SPEW("Got depth frame of size %d/%d, %d/%d packets arrived, TS %08x\n", got_frame_size,
+		        dev->depth.frame_size, dev->depth.valid_pkts, dev->depth.pkts_per_frame, dev->depth.timestamp);
 
-	freenect_frame_mode frame_mode = freenect_get_current_video_mode(dev);
+		stream_autotune(dev, &dev->depth);
+		freenect_frame_info info;
+		stream_frame_info(&dev->depth, FREENECT_STREAM_DEPTH, &info);
+		if (dev->depth.offload)
+			stream_submit(ctx, &dev->depth, dev, &info);
+		else
+			depth_decode(dev, dev->depth.raw_buf, &info);
+	} while (dev->depth.redo && dev->depth.running);
+}
+
+// keep a 640x480 RGB copy of the video frame for the colored point cloud
+static void store_points_rgb(freenect_device *dev, uint8_t *raw, void *out, freenect_frame_mode frame_mode)
+{
+	uint8_t *rgb = dev->points_rgb;
+
+	if (dev->video_resolution != FREENECT_RESOLUTION_MEDIUM)
+		return;
 	switch (dev->video_format) {
 		case FREENECT_VIDEO_RGB:
-			convert_bayer_to_rgb(dev->video.raw_buf, (uint8_t*)dev->video.proc_buf, frame_mode);
+		case FREENECT_VIDEO_YUV_RGB:
+			memcpy(rgb, out, frame_mode.bytes);
 			break;
 		case FREENECT_VIDEO_BAYER:
+			freenect_convert_bayer_to_rgb(raw, rgb, frame_mode.width, frame_mode.height);
 			break;
-		case FREENECT_VIDEO_IR_10BIT:
-			convert_packed_to_16bit(dev->video.raw_buf, (uint16_t*)dev->video.proc_buf, 10, frame_mode.width * frame_mode.height);
+		case FREENECT_VIDEO_YUV_RAW:
+			freenect_convert_uyvy_to_rgb(raw, rgb, frame_mode.width, frame_mode.height);
 			break;
-		case FREENECT_VIDEO_IR_10BIT_PACKED:
+		default:
+			return;
+	}
+	dev->points_rgb_valid = 1;
+}
+
+static void video_decode(freenect_device *dev, uint8_t *raw, const freenect_frame_info *info)
+{
+	uint32_t timestamp = info->timestamp;
+	freenect_context *ctx = dev->parent;
+	fn_frame_pool *pool = dev->video.pool;
+	freenect_frame_cb frame_cb = dev->video_frame_cb;
+	freenect_frame *frame = NULL;
+	void *out = dev->video.proc_buf;
+
+	if (pool) {
+		frame = stream_acquire(ctx, &dev->video, pool);
+		if (!frame)
+			return;
+		out = frame->data;
+	}
+
+	uint64_t start = fn_get_time_ns();
+	freenect_frame_mode frame_mode = freenect_get_current_video_mode(dev);
+	switch (dev->video_format) {
+		case FREENECT_VIDEO_RGB:
+			freenect_convert_bayer_to_rgb(raw, (uint8_t*)out, frame_mode.width, frame_mode.height);
+			break;
+		case FREENECT_VIDEO_IR_10BIT:
+			freenect_convert_packed10_to_16bit(raw, (uint16_t*)out, frame_mode.width * frame_mode.height);
 			break;
 		case FREENECT_VIDEO_IR_8BIT:
-			convert_packed_to_8bit(dev->video.raw_buf, (uint8_t*)dev->video.proc_buf, 10, frame_mode.width * frame_mode.height);
+			freenect_convert_packed10_to_8bit(raw, (uint8_t*)out, frame_mode.width * frame_mode.height);
 			break;
 		case FREENECT_VIDEO_YUV_RGB:
-			convert_uyvy_to_rgb(dev->video.raw_buf, (uint8_t*)dev->video.proc_buf, frame_mode);
+			freenect_convert_uyvy_to_rgb(raw, (uint8_t*)out, frame_mode.width, frame_mode.height);
 			break;
+		case FREENECT_VIDEO_BAYER:
+		case FREENECT_VIDEO_IR_10BIT_PACKED:
 		case FREENECT_VIDEO_YUV_RAW:
+			if (raw != out)
+				memcpy(out, raw, frame_mode.bytes);
 			break;
 		default:
 			FN_ERROR("video_process() was called, but an invalid video_format is set\n");
 			break;
 	}
 
+	if (dev->points_cb)
+		store_points_rgb(dev, raw, out, frame_mode);
+	uint64_t decoded = fn_get_time_ns();
+	STREAM_COUNT(&dev->video, decode_ns, decoded - start);
+	stream_time(dev->video.stats.decode_latency, NULL, decoded - info->arrival_time);
+
+	if (dev->frame_info_cb)
+		dev->frame_info_cb(dev, info);
 	if (dev->video_cb)
-		dev->video_cb(dev, dev->video.proc_buf, dev->video.timestamp);
+		dev->video_cb(dev, out, timestamp);
+	if (dev->frameset)
+		fn_frameset_add(dev->frameset, dev, out, frame_mode.bytes, info);
+
+	if (frame && fn_frame_pool_publish(pool, frame, timestamp, frame_cb != NULL) && frame_cb)
+		frame_cb(dev, frame);
+
+	stream_time(dev->video.stats.callback_latency, &dev->video.stats.callback_ns, fn_get_time_ns() - decoded);
 }
 
-typedef struct {
-	uint8_t magic[2];
-	uint16_t len;
-	uint16_t cmd;
-	uint16_t tag;
-} cam_hdr;
+static void video_process(freenect_device *dev, uint8_t *pkt, int len)
+{
+	freenect_context *ctx = dev->parent;
+
+	fn_capture_packet(dev, dev->video.flag, pkt, len);
+
+	if (len == 0)
+		return;
+
+	if (!dev->video.running)
+		return;
+
+	STREAM_COUNT(&dev->video, packets, 1);
+	STREAM_COUNT(&dev->video, bytes, len);
+	do {
+		dev->video.redo = 0;
+		int got_frame_size = stream_process(ctx, &dev->video, pkt, len);
+
+		if (!got_frame_size)
+			return;
+
+		FN_SPEW("Got video frame of size %d/%d, %d/%d packets arrived, TS %08x\n", got_frame_size,
+		        dev->video.frame_size, dev->video.valid_pkts, dev->video.pkts_per_frame, dev->video.timestamp);
+
+		stream_autotune(dev, &dev->video);
+		freenect_frame_info info;
+		stream_frame_info(&dev->video, FREENECT_STREAM_VIDEO, &info);
+		if (dev->video.offload)
+			stream_submit(ctx, &dev->video, dev, &info);
+		else
+			video_decode(dev, dev->video.raw_buf, &info);
+	} while (dev->video.redo && dev->video.running);
+}
 
 static int send_cmd(freenect_device *dev, uint16_t cmd, void *cmdbuf, unsigned int cmd_len, void *replybuf, int reply_len)
 {
 	freenect_context *ctx = dev->parent;
 	int res, actual_len;
-	uint8_t obuf[0x400];
-	uint8_t ibuf[0x200];
-	cam_hdr *chdr = (cam_hdr*)obuf;
-	cam_hdr *rhdr = (cam_hdr*)ibuf;
+	uint8_t obuf[FN_CMD_OBUF];
+	uint8_t ibuf[FN_CMD_IBUF];
 
-	if (cmd_len & 1 || cmd_len > (0x400 - sizeof(*chdr))) {
-		FN_ERROR("send_cmd: Invalid command length (0x%x)\n", cmd_len);
-		return -1;
-	}
-
-	chdr->magic[0] = 0x47;
-	chdr->magic[1] = 0x4d;
-	chdr->cmd = fn_le16(cmd);
-	chdr->tag = fn_le16(dev->cam_tag);
-	chdr->len = fn_le16(cmd_len / 2);
+	// one command at a time: let the queued ones go first
+	res = fn_cmd_queue_drain(dev->cmd_queue);
+	if (res < 0)
+		return res;
 
-	memcpy(obuf+sizeof(*chdr), cmdbuf, cmd_len);
+	res = fn_cmd_request(dev, obuf, cmd, cmdbuf, cmd_len);
+	if (res < 0)
+		return res;
 
-	res = fnusb_control(&dev->usb_cam, 0x40, 0, 0, 0, obuf, cmd_len + sizeof(*chdr));
+	res = fnusb_control(&dev->usb_cam, 0x40, 0, 0, 0, obuf, res);
 	FN_SPEW("Control cmd=%04x tag=%04x len=%04x: %d\n", cmd, dev->cam_tag, cmd_len, res);
 	if (res < 0) {
 		FN_ERROR("send_cmd: Output control transfer failed (%d)\n", res);
@@ -687,43 +839,12 @@ static int send_cmd(freenect_device *dev, uint16_t cmd, void *cmdbuf, unsigned i
 	}
 
 	do {
-		actual_len = fnusb_control(&dev->usb_cam, 0xc0, 0, 0, 0, ibuf, 0x200);
+		actual_len = fnusb_control(&dev->usb_cam, 0xc0, 0, 0, 0, ibuf, FN_CMD_IBUF);
 		FN_FLOOD("actual_len: %d\n", actual_len);
-	} while ((actual_len == 0) || (actual_len == 0x200));
-	FN_SPEW("Control reply: %d\n", res);
-	if (actual_len < (int)sizeof(*rhdr)) {
-		FN_ERROR("send_cmd: Input control transfer failed (%d)\n", res);
-		return res;
-	}
-	actual_len -= sizeof(*rhdr);
-
-	if (rhdr->magic[0] != 0x52 || rhdr->magic[1] != 0x42) {
-		FN_ERROR("send_cmd: Bad magic %02x %02x\n", rhdr->magic[0], rhdr->magic[1]);
-		return -1;
-	}
-	if (rhdr->cmd != chdr->cmd) {
-		FN_ERROR("send_cmd: Bad cmd %02x != %02x\n", rhdr->cmd, chdr->cmd);
-		return -1;
-	}
-	if (rhdr->tag != chdr->tag) {
-		FN_ERROR("send_cmd: Bad tag %04x != %04x\n", rhdr->tag, chdr->tag);
-		return -1;
-	}
-	if (fn_le16(rhdr->len) != (actual_len/2)) {
-		FN_ERROR("send_cmd: Bad len %04x != %04x\n", fn_le16(rhdr->len), (int)(actual_len/2));
-		return -1;
-	}
-
-	if (actual_len > reply_len) {
-		FN_WARNING("send_cmd: Data buffer is %d bytes long, but got %d bytes\n", reply_len, actual_len);
-		memcpy(replybuf, ibuf+sizeof(*rhdr), reply_len);
-	} else {
-		memcpy(replybuf, ibuf+sizeof(*rhdr), actual_len);
-	}
-
-	dev->cam_tag++;
+	} while ((actual_len == 0) || (actual_len == FN_CMD_IBUF));
+	FN_SPEW("Control reply: %d\n", actual_len);
 
-	return actual_len;
+	return fn_cmd_reply(dev, obuf, ibuf, actual_len, replybuf, reply_len);
 }
 
 static int write_register(freenect_device *dev, uint16_t reg, uint16_t data)
@@ -841,6 +962,9 @@ static int freenect_fetch_reg_info(freenect_device *dev)
 	FN_SPEW("back_comp1:            %d\n", dev_reg_info->back_comp1);
 	FN_SPEW("back_comp2:            %d\n", dev_reg_info->back_comp2);
 	*/
+	dev->registration_stale = 1;
+	dev->reg_info_valid = 1;
+	dev->reg_info_resolution = dev->video_resolution;
 	return 0;
 }
 
@@ -868,6 +992,7 @@ static int freenect_fetch_reg_pad_info(freenect_device *dev)
 	FN_SPEW("start_lines:    %u\n",dev->registration.reg_pad_info.start_lines);
 	FN_SPEW("end_lines:      %u\n",dev->registration.reg_pad_info.end_lines);
 	FN_SPEW("cropping_lines: %u\n",dev->registration.reg_pad_info.cropping_lines);
+	dev->registration_stale = 1;
 	return 0;
 }
 
@@ -893,6 +1018,7 @@ static int freenect_fetch_reg_const_shift(freenect_device *dev)
 	shift = fn_le16(shift);
 	dev->registration.const_shift = (double)shift;
 	FN_SPEW("const_shift: %f\n",dev->registration.const_shift);
+	dev->registration_stale = 1;
 	return 0;
 }
 
@@ -939,13 +1065,51 @@ static int freenect_fetch_zero_plane_info(freenect_device *dev)
 
 	// FIXME: OpenNI seems to use a hardcoded value of 2.4 instead of 2.3 as reported by Kinect
 	dev->registration.zero_plane_info.dcmos_rcmos_dist = 2.4;
+	dev->registration_stale = 1;
 
 	return 0;
 }
 
-int freenect_start_depth(freenect_device *dev)
+// the transfer settings a stream starts with: its own, or the context's
+static void stream_iso(freenect_device *dev, packet_stream *strm, freenect_stream stream)
+{
+	if (strm->iso.transfers == 0)
+		strm->iso = dev->parent->iso[stream];
+	strm->retune = 0;
+	strm->tune_frames = 0;
+}
+
+static void add_write(fn_reg_write *writes, int *count, uint16_t reg, uint16_t data)
+{
+	writes[*count].reg = reg;
+	writes[*count].data = data;
+	(*count)++;
+}
+
+// make the register writes that start a stream, waiting for each of them,
+// or queue them when async is set
+static int camera_writes(freenect_device *dev, const fn_reg_write *writes, int count, int async, freenect_command_cb cb, void *user)
+{
+	int i;
+
+	if (!async) {
+		for (i = 0; i < count; i++)
+			write_register(dev, writes[i].reg, writes[i].data);
+		return 0;
+	}
+	if (!dev->cmd_queue) {
+		dev->cmd_queue = fn_cmd_queue_create(dev);
+		if (!dev->cmd_queue)
+			return -1;
+	}
+	return fn_cmd_queue_write(dev->cmd_queue, writes, count, cb, user);
+}
+
+static int start_depth(freenect_device *dev, int async, freenect_command_cb cb, void *user)
 {
 	freenect_context *ctx = dev->parent;
+	fn_reg_write writes[FN_CMD_MAX_WRITES];
+	int count = 0;
 	int res;
 
 	if (dev->depth.running)
@@ -954,13 +1118,20 @@ int freenect_start_depth(freenect_device *dev)
 	dev->depth.pkt_size = DEPTH_PKTDSIZE;
 	dev->depth.flag = 0x70;
 	dev->depth.variable_length = 0;
+	dev->depth.partial = dev->partial_frames;
+	dev->depth.fill = 0xff; // all ones is the no-data value in both packings
+
+	// the colored point cloud needs the registration tables in every mode
+	if (dev->points_cb && depth_is_packed11(dev->depth_format))
+		freenect_init_registration(dev);
 
 	switch (dev->depth_format) {
 		case FREENECT_DEPTH_REGISTERED:
 		case FREENECT_DEPTH_MM:
+		case FREENECT_DEPTH_XYZ:
 			freenect_init_registration(dev);
 		case FREENECT_DEPTH_11BIT:
-			stream_init(ctx, &dev->depth, freenect_find_depth_mode(dev->depth_resolution, FREENECT_DEPTH_11BIT_PACKED).bytes, freenect_find_depth_mode(dev->depth_resolution, FREENECT_DEPTH_11BIT).bytes);
+			stream_init(ctx, &dev->depth, freenect_find_depth_mode(dev->depth_resolution, FREENECT_DEPTH_11BIT_PACKED).bytes, freenect_find_depth_mode(dev->depth_resolution, dev->depth_format).bytes);
 			break;
 		case FREENECT_DEPTH_10BIT:
 			stream_init(ctx, &dev->depth, freenect_find_depth_mode(dev->depth_resolution, FREENECT_DEPTH_10BIT_PACKED).bytes, freenect_find_depth_mode(dev->depth_resolution, FREENECT_DEPTH_10BIT).bytes);
@@ -974,38 +1145,68 @@ int freenect_start_depth(freenect_device *dev)
 			return -1;
 	}
 
-	res = fnusb_start_iso(&dev->usb_cam, &dev->depth_isoc, depth_process, 0x82, NUM_XFERS, PKTS_PER_XFER, DEPTH_PKTBUF);
-	if (res < 0)
+	if (stream_pool(dev, &dev->depth, freenect_get_current_depth_mode(dev)) < 0 || stream_offload(dev, &dev->depth, 0, depth_decode) < 0) {
+		stream_freebufs(ctx, &dev->depth);
+		return -1;
+	}
+	// decode threads get whole frames
+	dev->depth.incremental = dev->depth_incremental && !dev->depth.offload && depth_is_rowwise(dev->depth_format);
+
+	stream_iso(dev, &dev->depth, FREENECT_STREAM_DEPTH);
+	res = fnusb_start_iso(&dev->usb_cam, &dev->depth_isoc, depth_process, 0x82, dev->depth.iso.transfers, dev->depth.iso.packets, dev->depth.iso.packet_bytes);
+	if (res < 0) {
+		stream_freebufs(ctx, &dev->depth);
 		return res;
+	}
 
-	write_register(dev, 0x105, 0x00); // Disable auto-cycle of projector
-	write_register(dev, 0x06, 0x00); // reset depth stream
+	add_write(writes, &count, 0x105, 0x00); // Disable auto-cycle of projector
+	add_write(writes, &count, 0x06, 0x00); // reset depth stream
 	switch (dev->depth_format) {
 		case FREENECT_DEPTH_11BIT:
 		case FREENECT_DEPTH_11BIT_PACKED:
 		case FREENECT_DEPTH_REGISTERED:
 		case FREENECT_DEPTH_MM:
-			write_register(dev, 0x12, 0x03);
+		case FREENECT_DEPTH_XYZ:
+			add_write(writes, &count, 0x12, 0x03);
 			break;
 		case FREENECT_DEPTH_10BIT:
 		case FREENECT_DEPTH_10BIT_PACKED:
-			write_register(dev, 0x12, 0x02);
+			add_write(writes, &count, 0x12, 0x02);
 			break;
 		case FREENECT_DEPTH_DUMMY: // Returned already, hush gcc
 			break;
 	}
-	write_register(dev, 0x13, 0x01);
-	write_register(dev, 0x14, 0x1e);
-	write_register(dev, 0x06, 0x02); // start depth stream
-	write_register(dev, 0x17, 0x00); // disable depth hflip
+	add_write(writes, &count, 0x13, 0x01);
+	add_write(writes, &count, 0x14, 0x1e);
+	add_write(writes, &count, 0x06, 0x02); // start depth stream
+	add_write(writes, &count, 0x17, 0x00); // disable depth hflip
+
+	res = camera_writes(dev, writes, count, async, cb, user);
+	if (res < 0) {
+		fnusb_stop_iso(&dev->usb_cam, &dev->depth_isoc);
+		stream_freebufs(ctx, &dev->depth);
+		return res;
+	}
 
 	dev->depth.running = 1;
 	return 0;
 }
 
-int freenect_start_video(freenect_device *dev)
+int freenect_start_depth(freenect_device *dev)
+{
+	return start_depth(dev, 0, NULL, NULL);
+}
+
+int freenect_start_depth_async(freenect_device *dev, freenect_command_cb cb, void *user)
+{
+	return start_depth(dev, 1, cb, user);
+}
+
+static int start_video(freenect_device *dev, int async, freenect_command_cb cb, void *user)
 {
 	freenect_context *ctx = dev->parent;
+	fn_reg_write writes[FN_CMD_MAX_WRITES];
+	int count = 0;
 	int res;
 
 	if (dev->video.running)
@@ -1014,6 +1215,9 @@ int freenect_start_video(freenect_device *dev)
 	dev->video.pkt_size = VIDEO_PKTDSIZE;
 	dev->video.flag = 0x80;
 	dev->video.variable_length = 0;
+	dev->video.partial = dev->partial_frames;
+	dev->video.fill = 0;
+	dev->points_rgb_valid = 0;
 
 	uint16_t mode_reg, mode_value;
 	uint16_t res_reg, res_value;
@@ -1052,10 +1256,10 @@ int freenect_start_video(freenect_device *dev)
 				// Due to some ridiculous condition in the firmware, we have to start and stop the
 				// depth stream before the camera will hand us 1280x1024 IR.  This is a stupid
 				// workaround, but we've yet to find a better solution.
-				write_register(dev, 0x13, 0x01); // set depth camera resolution (640x480)
-				write_register(dev, 0x14, 0x1e); // set depth camera FPS (30)
-				write_register(dev, 0x06, 0x02); // start depth camera
-				write_register(dev, 0x06, 0x00); // stop depth camera
+				add_write(writes, &count, 0x13, 0x01); // set depth camera resolution (640x480)
+				add_write(writes, &count, 0x14, 0x1e); // set depth camera FPS (30)
+				add_write(writes, &count, 0x06, 0x02); // start depth camera
+				add_write(writes, &count, 0x06, 0x00); // stop depth camera
 
 				mode_value = 0x00; // Luminance, 10-bit packed
 				res_value = 0x02; // 1280x1024
@@ -1120,46 +1324,73 @@ int freenect_start_video(freenect_device *dev)
 			break;
 	}
 
-	res = fnusb_start_iso(&dev->usb_cam, &dev->video_isoc, video_process, 0x81, NUM_XFERS, PKTS_PER_XFER, VIDEO_PKTBUF);
-	if (res < 0)
+	if (stream_pool(dev, &dev->video, freenect_get_current_video_mode(dev)) < 0 || stream_offload(dev, &dev->video, 1, video_decode) < 0) {
+		stream_freebufs(ctx, &dev->video);
+		return -1;
+	}
+
+	stream_iso(dev, &dev->video, FREENECT_STREAM_VIDEO);
+	res = fnusb_start_iso(&dev->usb_cam, &dev->video_isoc, video_process, 0x81, dev->video.iso.transfers, dev->video.iso.packets, dev->video.iso.packet_bytes);
+	if (res < 0) {
+		stream_freebufs(ctx, &dev->video);
 		return res;
+	}
 
-	write_register(dev, mode_reg, mode_value);
-	write_register(dev, res_reg, res_value);
-	write_register(dev, fps_reg, fps_value);
+	add_write(writes, &count, mode_reg, mode_value);
+	add_write(writes, &count, res_reg, res_value);
+	add_write(writes, &count, fps_reg, fps_value);
 
 	switch (dev->video_format) {
 		case FREENECT_VIDEO_RGB:
 		case FREENECT_VIDEO_BAYER:
 		case FREENECT_VIDEO_YUV_RGB:
 		case FREENECT_VIDEO_YUV_RAW:
-			write_register(dev, 0x05, 0x01); // start video stream
+			add_write(writes, &count, 0x05, 0x01); // start video stream
 			break;
 		case FREENECT_VIDEO_IR_8BIT:
 		case FREENECT_VIDEO_IR_10BIT:
 		case FREENECT_VIDEO_IR_10BIT_PACKED:
-			write_register(dev, 0x105, 0x00); // Disable auto-cycle of projector
-			write_register(dev, 0x05, 0x03); // start video stream
+			add_write(writes, &count, 0x105, 0x00); // Disable auto-cycle of projector
+			add_write(writes, &count, 0x05, 0x03); // start video stream
 			break;
 		case FREENECT_VIDEO_DUMMY: // Silence compiler
 			break;
 	}
-	write_register(dev, hflip_reg, 0x00); // disable Hflip
+	add_write(writes, &count, hflip_reg, 0x00); // disable Hflip
+
+	res = camera_writes(dev, writes, count, async, cb, user);
+	if (res < 0) {
+		fnusb_stop_iso(&dev->usb_cam, &dev->video_isoc);
+		stream_freebufs(ctx, &dev->video);
+		return res;
+	}
 
 	dev->video.running = 1;
 	return 0;
 }
 
+int freenect_start_video(freenect_device *dev)
+{
+	return start_video(dev, 0, NULL, NULL);
+}
+
+int freenect_start_video_async(freenect_device *dev, freenect_command_cb cb, void *user)
+{
+	return start_video(dev, 1, cb, user);
+}
+
 int freenect_stop_depth(freenect_device *dev)
 {
 	freenect_context *ctx = dev->parent;
 	int res;
 
+	dev->resume_streams &= ~(1 << FREENECT_STREAM_DEPTH);
 	if (!dev->depth.running)
 		return -1;
 
 	dev->depth.running = 0;
-	freenect_destroy_registration(&(dev->registration));
+	// the registration tables are kept, so that restarting the stream
+	// does not have to rebuild them
 	write_register(dev, 0x06, 0x00); // stop depth stream
 
 	res = fnusb_stop_iso(&dev->usb_cam, &dev->depth_isoc);
@@ -1177,6 +1408,7 @@ int freenect_stop_video(freenect_device *dev)
 	freenect_context *ctx = dev->parent;
 	int res;
 
+	dev->resume_streams &= ~(1 << FREENECT_STREAM_VIDEO);
 	if (!dev->video.running)
 		return -1;
 
@@ -1262,7 +1494,10 @@ int freenect_set_video_mode(freenect_device* dev, const freenect_frame_mode mode
 	dev->video_resolution = res;
 	// Now that we've changed video format and resolution, we need to update
 	// registration tables.
-	freenect_fetch_reg_info(dev);
+	if (!dev->reg_info_valid || dev->reg_info_resolution != res) {
+		if (freenect_load_registration_cache(dev, res) < 0)
+			freenect_fetch_reg_info(dev);
+	}
 	return 0;
 }
 
@@ -1324,6 +1559,262 @@ int freenect_set_depth_mode(freenect_device* dev, const freenect_frame_mode mode
 	dev->depth_resolution = res;
 	return 0;
 }
+int freenect_set_decode_threads(freenect_device *dev, int threads)
+{
+	int i;
+	if (threads < 0 || threads > 2)
+		return -1;
+	if (dev->depth.running || dev->video.running)
+		return -1;
+
+	for (i = 0; i < 2; i++) {
+		fn_decode_worker_destroy(dev->decode_workers[i]);
+		dev->decode_workers[i] = NULL;
+	}
+	dev->decode_threads = threads;
+	return 0;
+}
+
+int freenect_get_decode_threads(freenect_device *dev)
+{
+	return dev->decode_threads;
+}
+
+int freenect_set_partial_frames(freenect_device *dev, int enable)
+{
+	if (dev->depth.running || dev->video.running)
+		return -1;
+	dev->partial_frames = enable != 0;
+	return 0;
+}
+
+void freenect_set_frame_info_callback(freenect_device *dev, freenect_frame_info_cb cb)
+{
+	dev->frame_info_cb = cb;
+}
+
+int freenect_get_stream_stats(freenect_device *dev, freenect_stream stream, freenect_stream_stats *stats)
+{
+	packet_stream *strm;
+	int i;
+
+	switch (stream) {
+		case FREENECT_STREAM_DEPTH:
+			strm = &dev->depth;
+			break;
+		case FREENECT_STREAM_VIDEO:
+			strm = &dev->video;
+			break;
+		default:
+			return -1;
+	}
+	stats->packets = fn_atomic_load_u64(&strm->stats.packets);
+	stats->bytes = fn_atomic_load_u64(&strm->stats.bytes);
+	stats->lost_packets = fn_atomic_load_u64(&strm->stats.lost_packets);
+	stats->invalid_magic = fn_atomic_load_u64(&strm->stats.invalid_magic);
+	stats->size_mismatches = fn_atomic_load_u64(&strm->stats.size_mismatches);
+	stats->resyncs = fn_atomic_load_u64(&strm->stats.resyncs);
+	stats->frames = fn_atomic_load_u64(&strm->stats.frames);
+	stats->dropped_frames = fn_atomic_load_u64(&strm->stats.dropped_frames);
+	stats->decode_ns = fn_atomic_load_u64(&strm->stats.decode_ns);
+	stats->callback_ns = fn_atomic_load_u64(&strm->stats.callback_ns);
+	for (i = 0; i < FREENECT_STATS_LATENCY_BUCKETS; i++) {
+		stats->decode_latency[i] = fn_atomic_load_u64(&strm->stats.decode_latency[i]);
+		stats->callback_latency[i] = fn_atomic_load_u64(&strm->stats.callback_latency[i]);
+	}
+	return 0;
+}
+
+// checks transfer settings against the constraints in usb_libusb10.h, and
+// returns why they do not meet them
+static const char *iso_invalid(freenect_stream stream, const freenect_iso_geometry *geometry)
+{
+	int min_bytes = stream == FREENECT_STREAM_DEPTH ? DEPTH_PKTSIZE : VIDEO_PKTSIZE;
+
+	if (geometry->transfers < 1)
+		return "at least one transfer is needed";
+	if (geometry->packets < 8 || geometry->packets % 8 != 0)
+		return "packets per transfer must be a non-zero multiple of 8";
+	if (geometry->transfers > ISO_MAX_PKTS_IN_FLIGHT / geometry->packets)
+		return "more than 1000 packets in flight";
+	if (geometry->packet_bytes < min_bytes || geometry->packet_bytes > ISO_MAX_PKTBUF)
+		return "packet buffer size out of range";
+	return NULL;
+}
+
+// a setting from the environment, left alone if unset or not a number
+static void env_int(freenect_context *ctx, const char *name, int *value)
+{
+	const char *str = getenv(name);
+	char *end;
+
+	if (!str || !*str)
+		return;
+	long v = strtol(str, &end, 10);
+	if (*end || v < 0 || v > 0xffff) {
+		FN_WARNING("Ignoring %s=%s: not a number\n", name, str);
+		return;
+	}
+	*value = (int)v;
+}
+
+FN_INTERNAL void freenect_camera_iso_defaults(freenect_context *ctx)
+{
+	int transfers = NUM_XFERS;
+	int packets = PKTS_PER_XFER;
+	int stream;
+
+	env_int(ctx, "LIBFREENECT_ISO_XFERS", &transfers);
+	env_int(ctx, "LIBFREENECT_ISO_PKTS_PER_XFER", &packets);
+	for (stream = FREENECT_STREAM_DEPTH; stream <= FREENECT_STREAM_VIDEO; stream++) {
+		freenect_iso_geometry defaults = { NUM_XFERS, PKTS_PER_XFER, stream == FREENECT_STREAM_DEPTH ? DEPTH_PKTBUF : VIDEO_PKTBUF };
+		freenect_iso_geometry geometry = { transfers, packets, defaults.packet_bytes };
+		const char *reason;
+
+		env_int(ctx, stream == FREENECT_STREAM_DEPTH ? "LIBFREENECT_DEPTH_PKTBUF" : "LIBFREENECT_VIDEO_PKTBUF", &geometry.packet_bytes);
+		reason = iso_invalid((freenect_stream)stream, &geometry);
+		if (reason) {
+			FN_WARNING("Ignoring the %s transfer settings from the environment (%d x %d packets of %d bytes): %s\n",
+			           stream == FREENECT_STREAM_DEPTH ? "depth" : "video",
+			           geometry.transfers, geometry.packets, geometry.packet_bytes, reason);
+			geometry = defaults;
+		}
+		ctx->iso[stream] = geometry;
+	}
+	ctx->iso_autotune = 0;
+	env_int(ctx, "LIBFREENECT_ISO_AUTOTUNE", &ctx->iso_autotune);
+}
+
+static void stream_retune(freenect_device *dev, packet_stream *strm, fnusb_isoc_stream *isoc, fnusb_iso_cb cb, int ep)
+{
+	freenect_context *ctx = dev->parent;
+	int transfers = strm->retune;
+	int res;
+
+	strm->retune = 0;
+	strm->tune_frames = 0; // the restart loses packets of its own
+	res = fnusb_stop_iso(&dev->usb_cam, isoc);
+	if (res < 0) {
+		FN_ERROR("[Stream %02x] Failed to stop the transfers for auto-tuning: %d\n", strm->flag, res);
+		return;
+	}
+	res = fnusb_start_iso(&dev->usb_cam, isoc, cb, ep, transfers, strm->iso.packets, strm->iso.packet_bytes);
+	if (res >= 0) {
+		strm->iso.transfers = transfers;
+	} else {
+		// most likely more than the host controller takes; stop growing
+		FN_INFO("[Stream %02x] Could not start %d transfers, staying with %d\n", strm->flag, transfers, strm->iso.transfers);
+		dev->iso_autotune = 0;
+		res = fnusb_start_iso(&dev->usb_cam, isoc, cb, ep, strm->iso.transfers, strm->iso.packets, strm->iso.packet_bytes);
+		if (res < 0)
+			FN_ERROR("[Stream %02x] Failed to restart the transfers: %d\n", strm->flag, res);
+	}
+}
+
+FN_INTERNAL void freenect_camera_retune(freenect_device *dev)
+{
+	if (dev->depth.retune && dev->depth.running)
+		stream_retune(dev, &dev->depth, &dev->depth_isoc, depth_process, 0x82);
+	if (dev->video.retune && dev->video.running)
+		stream_retune(dev, &dev->video, &dev->video_isoc, video_process, 0x81);
+}
+
+FN_INTERNAL void freenect_camera_suspend(freenect_device *dev)
+{
+	int streams = 0;
+
+	if (dev->depth.running)
+		streams |= 1 << FREENECT_STREAM_DEPTH;
+	if (dev->video.running)
+		streams |= 1 << FREENECT_STREAM_VIDEO;
+	freenect_stop_video(dev);
+	freenect_stop_depth(dev);
+	dev->resume_streams = streams;
+}
+
+FN_INTERNAL int freenect_camera_resume(freenect_device *dev)
+{
+	int streams = dev->resume_streams;
+	int res = 0;
+
+	// the modes and user buffers were left alone while the streams were stopped
+	if (streams & (1 << FREENECT_STREAM_DEPTH))
+		res = freenect_start_depth(dev);
+	if (res >= 0 && (streams & (1 << FREENECT_STREAM_VIDEO)))
+		res = freenect_start_video(dev);
+	if (res < 0) {
+		freenect_stop_video(dev);
+		freenect_stop_depth(dev);
+		dev->resume_streams = streams;
+		return res;
+	}
+	dev->resume_streams = 0;
+	return 0;
+}
+
+int freenect_set_iso_geometry(freenect_device *dev, freenect_stream stream, const freenect_iso_geometry *geometry)
+{
+	freenect_context *ctx = dev->parent;
+	packet_stream *strm;
+	const char *reason;
+
+	switch (stream) {
+		case FREENECT_STREAM_DEPTH:
+			strm = &dev->depth;
+			break;
+		case FREENECT_STREAM_VIDEO:
+			strm = &dev->video;
+			break;
+		default:
+			return -1;
+	}
+	if (strm->running)
+		return -1;
+	if (!geometry) {
+		strm->iso.transfers = 0;
+		return 0;
+	}
+	reason = iso_invalid(stream, geometry);
+	if (reason) {
+		FN_ERROR("freenect_set_iso_geometry(): %d x %d packets of %d bytes: %s\n",
+		         geometry->transfers, geometry->packets, geometry->packet_bytes, reason);
+		return -1;
+	}
+	strm->iso = *geometry;
+	return 0;
+}
+
+int freenect_get_iso_geometry(freenect_device *dev, freenect_stream stream, freenect_iso_geometry *geometry)
+{
+	packet_stream *strm;
+
+	switch (stream) {
+		case FREENECT_STREAM_DEPTH:
+			strm = &dev->depth;
+			break;
+		case FREENECT_STREAM_VIDEO:
+			strm = &dev->video;
+			break;
+		default:
+			return -1;
+	}
+	*geometry = strm->iso.transfers ? strm->iso : dev->parent->iso[stream];
+	return 0;
+}
+
+void freenect_set_iso_autotune(freenect_device *dev, int enable)
+{
+	dev->iso_autotune = enable != 0;
+}
+
+int freenect_set_depth_incremental_decode(freenect_device *dev, int enable)
+{
+	if (dev->depth.running)
+		return -1;
+	dev->depth_incremental = enable != 0;
+	return 0;
+}
+
 int freenect_set_depth_buffer(freenect_device *dev, void *buf)
 {
 	return stream_setbuf(dev->parent, &dev->depth, buf);
@@ -1338,6 +1829,12 @@ FN_INTERNAL int freenect_camera_init(freenect_device *dev)
 {
 	freenect_context *ctx = dev->parent;
 	int res;
+	// A cached registration for this camera holds everything fetched below
+	if (freenect_load_registration_cache(dev, FREENECT_RESOLUTION_MEDIUM) == 0) {
+		res = freenect_set_video_mode(dev, freenect_find_video_mode(FREENECT_RESOLUTION_MEDIUM, FREENECT_VIDEO_RGB));
+		res = freenect_set_depth_mode(dev, freenect_find_depth_mode(FREENECT_RESOLUTION_MEDIUM, FREENECT_DEPTH_11BIT));
+		return 0;
+	}
 	res = freenect_fetch_reg_pad_info(dev);
 	if (res < 0) {
 		FN_ERROR("freenect_camera_init(): Failed to fetch registration pad info for device\n");
@@ -1362,20 +1859,20 @@ FN_INTERNAL int freenect_camera_teardown(freenect_device *dev)
 {
 	freenect_context *ctx = dev->parent;
 	int res = 0;
+	// stop both streams even if one of them fails, so that the other
+	// stream's transfers and the registration tables are not leaked
 	if (dev->depth.running) {
-		res = freenect_stop_depth(dev);
-		if (res < 0) {
+		if (freenect_stop_depth(dev) < 0) {
 			FN_ERROR("freenect_camera_teardown(): Failed to stop depth camera\n");
+			res = -1;
 		}
-		return res;
 	}
 	if (dev->video.running) {
-		res = freenect_stop_video(dev);
-		if (res < 0) {
+		if (freenect_stop_video(dev) < 0) {
 			FN_ERROR("freenect_camera_teardown(): Failed to stop video camera\n");
+			res = -1;
 		}
-		return res;
 	}
 	freenect_destroy_registration(&(dev->registration));
-	return 0;
+	return res;
 }
@@ -36,5 +36,14 @@
 int freenect_camera_init(freenect_device *dev);
 int freenect_camera_teardown(freenect_device *dev);
 
+// Read the isochronous transfer settings from the environment, at init
+void freenect_camera_iso_defaults(freenect_context *ctx);
+// Apply transfer settings changed by auto-tuning, from the event loop
+void freenect_camera_retune(freenect_device *dev);
+// Stop the streams of a camera that went away, remembering which ran
+void freenect_camera_suspend(freenect_device *dev);
+// Restart them once it is reopened; on failure they stay stopped and remembered
+int freenect_camera_resume(freenect_device *dev);
+
 #endif
 
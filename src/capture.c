@@ -0,0 +1,209 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2010 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freenect_internal.h"
+#include "capture.h"
+
+// the layouts above are what goes to disk, make sure no padding sneaks in
+typedef char capture_header_size_check[sizeof(capture_header) == 32 ? 1 : -1];
+typedef char capture_record_size_check[sizeof(capture_record) == 8 ? 1 : -1];
+
+struct _fn_capture {
+	FILE *fp;
+	uint64_t last_ns;
+	int failed;
+	char *buffer; // stdio buffer, large enough to absorb a few frames
+};
+
+#define CAPTURE_BUFFER_SIZE (1 << 20)
+
+static int capture_write(fn_capture *cap, uint8_t flag, const uint8_t *pkt, int len)
+{
+	if (cap->failed)
+		return -1;
+
+	uint64_t now = fn_get_time_ns();
+	capture_record rec;
+	rec.flag = flag;
+	rec.reserved = 0;
+	rec.len = (uint16_t)len;
+	rec.delta_us = (uint32_t)((now - cap->last_ns) / 1000);
+	// carry the sub-microsecond remainder so long captures don't drift
+	cap->last_ns += (uint64_t)rec.delta_us * 1000;
+
+	if (fwrite(&rec, sizeof(rec), 1, cap->fp) != 1
+		|| (len > 0 && fwrite(pkt, 1, len, cap->fp) != (size_t)len)) {
+		cap->failed = 1;
+		return -1;
+	}
+	return 0;
+}
+
+// Packets are written on the event or decode thread while the capture may be
+// started or stopped from any other one; dev->capture only changes, and the
+// file is only written, with dev->capture_lock held. The lock is per device
+// and only taken while a capture is running.
+FN_INTERNAL int fn_capture_packet(freenect_device *dev, uint8_t flag, const uint8_t *pkt, int len)
+{
+	int res = 0;
+
+	if (!fn_atomic_load_ptr((void * volatile *)&dev->capture))
+		return 0;
+	pthread_mutex_lock(&dev->capture_lock);
+	if (dev->capture)
+		res = capture_write(dev->capture, flag, pkt, len);
+	pthread_mutex_unlock(&dev->capture_lock);
+	return res;
+}
+
+FREENECTAPI int freenect_start_capture(freenect_device *dev, const char *filename)
+{
+	freenect_context *ctx = dev->parent;
+
+	if (fn_atomic_load_ptr((void * volatile *)&dev->capture)) {
+		FN_ERROR("freenect_start_capture: a capture is already running\n");
+		return -1;
+	}
+
+	fn_capture *cap = (fn_capture*)calloc(1, sizeof(fn_capture));
+	if (!cap)
+		return -1;
+	cap->fp = fopen(filename, "wb");
+	if (!cap->fp) {
+		FN_ERROR("freenect_start_capture: can't open %s\n", filename);
+		free(cap);
+		return -1;
+	}
+	cap->buffer = (char*)malloc(CAPTURE_BUFFER_SIZE);
+	if (cap->buffer)
+		setvbuf(cap->fp, cap->buffer, _IOFBF, CAPTURE_BUFFER_SIZE);
+
+	capture_header header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, CAPTURE_MAGIC, sizeof(header.magic));
+	header.version = CAPTURE_VERSION;
+	header.endian = CAPTURE_ENDIAN;
+	header.header_size = sizeof(header);
+	header.depth_mode = freenect_get_current_depth_mode(dev).reserved;
+	header.video_mode = freenect_get_current_video_mode(dev).reserved;
+	if (fwrite(&header, sizeof(header), 1, cap->fp) != 1) {
+		FN_ERROR("freenect_start_capture: can't write %s\n", filename);
+		fclose(cap->fp);
+		free(cap->buffer);
+		free(cap);
+		return -1;
+	}
+
+	cap->last_ns = fn_get_time_ns();
+	pthread_mutex_lock(&dev->capture_lock);
+	if (dev->capture) {
+		// lost a race with another freenect_start_capture()
+		pthread_mutex_unlock(&dev->capture_lock);
+		FN_ERROR("freenect_start_capture: a capture is already running\n");
+		fclose(cap->fp);
+		free(cap->buffer);
+		free(cap);
+		return -1;
+	}
+	fn_atomic_store_ptr((void * volatile *)&dev->capture, cap);
+	pthread_mutex_unlock(&dev->capture_lock);
+	return 0;
+}
+
+FREENECTAPI int freenect_stop_capture(freenect_device *dev)
+{
+	freenect_context *ctx = dev->parent;
+	fn_capture *cap;
+	int res = 0;
+
+	pthread_mutex_lock(&dev->capture_lock);
+	cap = dev->capture;
+	fn_atomic_store_ptr((void * volatile *)&dev->capture, NULL);
+	pthread_mutex_unlock(&dev->capture_lock);
+	if (!cap)
+		return -1;
+
+	if (fclose(cap->fp) != 0 || cap->failed) {
+		FN_ERROR("freenect_stop_capture: writing the capture failed, it is truncated\n");
+		res = -1;
+	}
+	free(cap->buffer);
+	free(cap);
+	return res;
+}
+
+FN_INTERNAL int fn_capture_open(fn_capture_reader *reader, const char *filename)
+{
+	memset(reader, 0, sizeof(*reader));
+	reader->fp = fopen(filename, "rb");
+	if (!reader->fp)
+		return -1;
+	if (fread(&reader->header, sizeof(reader->header), 1, reader->fp) != 1
+		|| memcmp(reader->header.magic, CAPTURE_MAGIC, sizeof(reader->header.magic)) != 0
+		|| reader->header.version != CAPTURE_VERSION
+		|| reader->header.endian != CAPTURE_ENDIAN
+		|| reader->header.header_size < sizeof(reader->header)
+		|| fseek(reader->fp, reader->header.header_size, SEEK_SET) != 0) {
+		fclose(reader->fp);
+		reader->fp = NULL;
+		return -1;
+	}
+	return 0;
+}
+
+FN_INTERNAL int fn_capture_read(fn_capture_reader *reader, uint8_t *flag, uint8_t *pkt, int max_len)
+{
+	capture_record rec;
+	if (fread(&rec, sizeof(rec), 1, reader->fp) != 1)
+		return -1;
+	if (rec.len > max_len) {
+		// too big for the caller; hand it on as a packet that arrived empty
+		if (fseek(reader->fp, rec.len, SEEK_CUR) != 0)
+			return -1;
+		rec.len = 0;
+	} else if (rec.len > 0 && fread(pkt, 1, rec.len, reader->fp) != rec.len) {
+		return -1;
+	}
+	*flag = rec.flag;
+	reader->time_us += rec.delta_us;
+	return rec.len;
+}
+
+FN_INTERNAL int fn_capture_rewind(fn_capture_reader *reader)
+{
+	reader->time_us = 0;
+	return fseek(reader->fp, reader->header.header_size, SEEK_SET);
+}
+
+FN_INTERNAL void fn_capture_close(fn_capture_reader *reader)
+{
+	if (reader->fp)
+		fclose(reader->fp);
+	reader->fp = NULL;
+}
@@ -0,0 +1,104 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2010 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "libfreenect.h"
+
+// Raw isochronous capture file, version 1. Everything is stored in the byte
+// order of the host that wrote the file (see endian); packets are kept
+// exactly as they came off the wire.
+//
+//   offset  size
+//        0     8  magic "FNISOCAP"
+//        8     4  version
+//       12     4  endian marker, CAPTURE_ENDIAN as written by the host
+//       16     4  header size
+//       20     4  depth mode (freenect_frame_mode.reserved) at capture start
+//       24     4  video mode
+//       28     4  reserved
+//       32        records
+//
+// followed by one record per packet:
+//
+//        0     1  stream flag, 0x70 for depth and 0x80 for video
+//        1     1  reserved
+//        2     2  packet length, 0 for a packet that arrived empty
+//        4     4  arrival time, in microseconds after the previous record
+//        8        the packet, header included
+
+#define CAPTURE_MAGIC "FNISOCAP"
+#define CAPTURE_VERSION 1
+#define CAPTURE_ENDIAN 0x01020304
+#define CAPTURE_PKT_MAX 0xffff
+
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t endian;
+	uint32_t header_size;
+	uint32_t depth_mode;
+	uint32_t video_mode;
+	uint32_t reserved;
+} capture_header;
+
+typedef struct {
+	uint8_t flag;
+	uint8_t reserved;
+	uint16_t len;
+	uint32_t delta_us;
+} capture_record;
+
+typedef struct _fn_capture fn_capture;
+
+// Append one packet of the stream with the given flag to the device's
+// capture, if one is running. Safe against freenect_stop_capture() being
+// called from another thread. Returns < 0 once writing failed.
+int fn_capture_packet(freenect_device *dev, uint8_t flag, const uint8_t *pkt, int len);
+
+// Sequential reader used to replay a capture
+typedef struct {
+	FILE *fp;
+	capture_header header;
+	uint64_t time_us; // arrival time of the last record read, from the first
+} fn_capture_reader;
+
+// Open a capture and check its header. Returns < 0 on failure.
+int fn_capture_open(fn_capture_reader *reader, const char *filename);
+
+// Read the next record into pkt, which holds max_len bytes. Returns the
+// packet length, or < 0 at the end of the file or on a damaged record.
+int fn_capture_read(fn_capture_reader *reader, uint8_t *flag, uint8_t *pkt, int max_len);
+
+// Go back to the first record
+int fn_capture_rewind(fn_capture_reader *reader);
+
+void fn_capture_close(fn_capture_reader *reader);
+
+#endif
@@ -0,0 +1,121 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2010 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+#include <string.h>
+#include "freenect_internal.h"
+#include "clock.h"
+
+#define NOMINAL_NS_PER_TICK (1e9 / FN_CLOCK_HZ)
+
+FN_INTERNAL void fn_clock_reset(fn_clock *clock)
+{
+	memset(clock, 0, sizeof(*clock));
+	clock->ns_per_tick = NOMINAL_NS_PER_TICK;
+}
+
+// how much later than the nominal rate says a point arrived, relative to ref
+static double nominal_delay(const fn_clock_point *p, const fn_clock_point *ref)
+{
+	return (double)(int64_t)(p->host - ref->host)
+		- (double)(int64_t)(p->device - ref->device) * NOMINAL_NS_PER_TICK;
+}
+
+// least squares line through the window minima, lowered until none of them
+// is early; the nominal rate until they span a few windows
+static void fit(fn_clock *clock)
+{
+	const fn_clock_point *ref = &clock->windows[0];
+	int n = clock->num_windows;
+	int i;
+
+	double slope = NOMINAL_NS_PER_TICK;
+	if (n >= 3) {
+		double sx = 0, sy = 0, sxx = 0, sxy = 0;
+		for (i = 0; i < n; i++) {
+			double x = (double)(int64_t)(clock->windows[i].device - ref->device);
+			double y = (double)(int64_t)(clock->windows[i].host - ref->host);
+			sx += x;
+			sy += y;
+			sxx += x * x;
+			sxy += x * y;
+		}
+		double det = n * sxx - sx * sx;
+		if (det > 0)
+			slope = (n * sxy - sx * sy) / det;
+	}
+
+	double offset = 0;
+	for (i = 0; i < n; i++) {
+		double x = (double)(int64_t)(clock->windows[i].device - ref->device);
+		double y = (double)(int64_t)(clock->windows[i].host - ref->host);
+		double d = y - x * slope;
+		if (i == 0 || d < offset)
+			offset = d;
+	}
+
+	clock->base_device = ref->device;
+	clock->base_host = ref->host + (int64_t)offset;
+	clock->ns_per_tick = slope;
+}
+
+FN_INTERNAL uint64_t fn_clock_sample(fn_clock *clock, uint32_t raw, uint64_t arrival_ns)
+{
+	if (!clock->started) {
+		clock->started = 1;
+		clock->device = raw;
+	} else {
+		// frames are far less than half a wrap apart
+		clock->device += (int32_t)(raw - clock->last_raw);
+	}
+	clock->last_raw = raw;
+
+	fn_clock_point p = { clock->device, arrival_ns };
+	if (clock->num_windows == 0 || arrival_ns - clock->window_start >= FN_CLOCK_WINDOW_NS) {
+		// start a new window, dropping the oldest if all are taken
+		if (clock->num_windows == FN_CLOCK_WINDOWS) {
+			memmove(clock->windows, clock->windows + 1, (FN_CLOCK_WINDOWS - 1) * sizeof(*clock->windows));
+			clock->num_windows--;
+		}
+		clock->windows[clock->num_windows++] = p;
+		clock->window_start = arrival_ns;
+	} else {
+		fn_clock_point *cur = &clock->windows[clock->num_windows - 1];
+		if (nominal_delay(&p, cur) < 0)
+			*cur = p;
+	}
+	fit(clock);
+	return clock->device;
+}
+
+FN_INTERNAL uint64_t fn_clock_to_host(const fn_clock *clock, uint64_t device)
+{
+	return clock->base_host + (int64_t)((double)(int64_t)(device - clock->base_device) * clock->ns_per_tick);
+}
+
+FN_INTERNAL double fn_clock_drift_ppm(const fn_clock *clock)
+{
+	return (NOMINAL_NS_PER_TICK / clock->ns_per_tick - 1) * 1e6;
+}
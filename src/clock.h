@@ -0,0 +1,77 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2010 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <stdint.h>
+
+// Device clock tracking for one stream: unwraps the 32 bit frame timestamps
+// and fits a line from device ticks to host time through the frames that
+// arrived with the least delay. USB and scheduling delays only ever make a
+// frame late, so the earliest arrivals are the ones that best show the
+// device clock. They are kept per window of host time, and the fit over the
+// last windows follows the device clock as it drifts.
+
+#define FN_CLOCK_HZ 60000000 // nominal rate of the frame timestamps
+#define FN_CLOCK_WINDOW_NS 1000000000ull
+#define FN_CLOCK_WINDOWS 16
+
+typedef struct {
+	uint64_t device; // unwrapped ticks
+	uint64_t host;   // arrival time, fn_get_time_ns()
+} fn_clock_point;
+
+typedef struct {
+	int started;
+	uint32_t last_raw;
+	uint64_t device; // last unwrapped timestamp
+	// earliest arrival of each window, oldest first; the last one is the
+	// window still being filled
+	fn_clock_point windows[FN_CLOCK_WINDOWS];
+	int num_windows;
+	uint64_t window_start; // host time the last window began
+	// host = base_host + (device - base_device) * ns_per_tick
+	uint64_t base_device;
+	uint64_t base_host;
+	double ns_per_tick;
+} fn_clock;
+
+// Forget everything, for a (re)started stream
+void fn_clock_reset(fn_clock *clock);
+
+// Add a frame with timestamp raw that arrived at host time arrival_ns, and
+// update the fit. Returns the unwrapped timestamp.
+uint64_t fn_clock_sample(fn_clock *clock, uint32_t raw, uint64_t arrival_ns);
+
+// Host time of an unwrapped device timestamp, from the current fit
+uint64_t fn_clock_to_host(const fn_clock *clock, uint64_t device);
+
+// Rate error of the device clock against the host clock, in parts per
+// million; positive when the device clock runs fast
+double fn_clock_drift_ppm(const fn_clock *clock);
+
+#endif
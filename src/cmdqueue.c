@@ -0,0 +1,300 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2010 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "freenect_internal.h"
+#include "cmdqueue.h"
+
+typedef struct {
+	uint8_t magic[2];
+	uint16_t len;
+	uint16_t cmd;
+	uint16_t tag;
+} cam_hdr;
+
+typedef struct _fn_cmd_batch {
+	struct _fn_cmd_batch *next;
+	fn_reg_write writes[FN_CMD_MAX_WRITES];
+	int count;
+	int done; // writes finished, the next one is in flight
+	int status; // of the first write that failed
+	freenect_command_cb cb;
+	void *user;
+} fn_cmd_batch;
+
+struct _fn_cmd_queue {
+	freenect_device *dev;
+	pthread_mutex_t lock;
+	fn_cmd_batch *head; // in progress; the queue is idle when there is none
+	fn_cmd_batch *tail;
+	uint8_t obuf[FN_CMD_OBUF];
+	uint8_t ibuf[FN_CMD_IBUF];
+	int olen;
+};
+
+FN_INTERNAL int fn_cmd_request(freenect_device *dev, uint8_t *obuf, uint16_t cmd, const void *cmdbuf, unsigned int cmd_len)
+{
+	freenect_context *ctx = dev->parent;
+	cam_hdr *chdr = (cam_hdr*)obuf;
+
+	if (cmd_len & 1 || cmd_len > (FN_CMD_OBUF - sizeof(*chdr))) {
+		FN_ERROR("fn_cmd_request: Invalid command length (0x%x)\n", cmd_len);
+		return -1;
+	}
+
+	chdr->magic[0] = 0x47;
+	chdr->magic[1] = 0x4d;
+	chdr->cmd = fn_le16(cmd);
+	chdr->tag = fn_le16(dev->cam_tag);
+	chdr->len = fn_le16(cmd_len / 2);
+
+	memcpy(obuf+sizeof(*chdr), cmdbuf, cmd_len);
+	return cmd_len + sizeof(*chdr);
+}
+
+FN_INTERNAL int fn_cmd_reply(freenect_device *dev, const uint8_t *obuf, const uint8_t *ibuf, int len, void *replybuf, int reply_len)
+{
+	freenect_context *ctx = dev->parent;
+	const cam_hdr *chdr = (const cam_hdr*)obuf;
+	const cam_hdr *rhdr = (const cam_hdr*)ibuf;
+	int actual_len;
+
+	if (len < (int)sizeof(*rhdr)) {
+		FN_ERROR("fn_cmd_reply: Input control transfer failed (%d)\n", len);
+		return len < 0 ? len : -1;
+	}
+	actual_len = len - sizeof(*rhdr);
+
+	if (rhdr->magic[0] != 0x52 || rhdr->magic[1] != 0x42) {
+		FN_ERROR("fn_cmd_reply: Bad magic %02x %02x\n", rhdr->magic[0], rhdr->magic[1]);
+		return -1;
+	}
+	if (rhdr->cmd != chdr->cmd) {
+		FN_ERROR("fn_cmd_reply: Bad cmd %02x != %02x\n", rhdr->cmd, chdr->cmd);
+		return -1;
+	}
+	if (rhdr->tag != chdr->tag) {
+		FN_ERROR("fn_cmd_reply: Bad tag %04x != %04x\n", rhdr->tag, chdr->tag);
+		return -1;
+	}
+	if (fn_le16(rhdr->len) != (actual_len/2)) {
+		FN_ERROR("fn_cmd_reply: Bad len %04x != %04x\n", fn_le16(rhdr->len), (int)(actual_len/2));
+		return -1;
+	}
+
+	if (actual_len > reply_len) {
+		FN_WARNING("fn_cmd_reply: Data buffer is %d bytes long, but got %d bytes\n", reply_len, actual_len);
+		memcpy(replybuf, ibuf+sizeof(*rhdr), reply_len);
+	} else {
+		memcpy(replybuf, ibuf+sizeof(*rhdr), actual_len);
+	}
+
+	dev->cam_tag++;
+
+	return actual_len;
+}
+
+FN_INTERNAL fn_cmd_queue *fn_cmd_queue_create(freenect_device *dev)
+{
+	fn_cmd_queue *q = (fn_cmd_queue*)calloc(1, sizeof(fn_cmd_queue));
+	if (!q)
+		return NULL;
+	if (pthread_mutex_init(&q->lock, NULL) != 0) {
+		free(q);
+		return NULL;
+	}
+	q->dev = dev;
+	return q;
+}
+
+FN_INTERNAL void fn_cmd_queue_destroy(fn_cmd_queue *q)
+{
+	if (!q)
+		return;
+	if (fn_cmd_queue_drain(q) < 0) {
+		// transfers still point at it
+		freenect_context *ctx = q->dev->parent;
+		FN_WARNING("fn_cmd_queue_destroy: Commands still in flight, leaking the queue\n");
+		return;
+	}
+	pthread_mutex_destroy(&q->lock);
+	free(q);
+}
+
+static void request_done(fnusb_dev *usb, int res, void *user);
+static void reply_done(fnusb_dev *usb, int res, void *user);
+
+// send the next write of the batch at the head; called with the lock held
+static int submit_write(fn_cmd_queue *q)
+{
+	fn_cmd_batch *batch = q->head;
+	const fn_reg_write *w = &batch->writes[batch->done];
+	freenect_context *ctx = q->dev->parent;
+	uint16_t cmd[2];
+
+	cmd[0] = fn_le16(w->reg);
+	cmd[1] = fn_le16(w->data);
+	FN_DEBUG("Write Reg 0x%04x <= 0x%02x (queued)\n", w->reg, w->data);
+	q->olen = fn_cmd_request(q->dev, q->obuf, 0x03, cmd, 4);
+	if (q->olen < 0)
+		return q->olen;
+	return fnusb_control_async(&q->dev->usb_cam, 0x40, 0, 0, 0, q->obuf, q->olen, request_done, q);
+}
+
+static int submit_poll(fn_cmd_queue *q)
+{
+	return fnusb_control_async(&q->dev->usb_cam, 0xc0, 0, 0, 0, q->ibuf, FN_CMD_IBUF, reply_done, q);
+}
+
+// the write in flight finished with status: move on to the next one, and
+// collect the batches that are complete in *finished. Called with the lock
+// held.
+static void write_done(fn_cmd_queue *q, int status, fn_cmd_batch ***finished)
+{
+	for (;;) {
+		fn_cmd_batch *batch = q->head;
+		if (status < 0 && batch->status == 0)
+			batch->status = status;
+		if (++batch->done == batch->count) {
+			q->head = batch->next;
+			if (!q->head)
+				q->tail = NULL;
+			batch->next = NULL;
+			**finished = batch;
+			*finished = &batch->next;
+			if (!q->head)
+				return;
+		}
+		status = submit_write(q);
+		if (status >= 0)
+			return;
+	}
+}
+
+static void run_callbacks(fn_cmd_queue *q, fn_cmd_batch *finished)
+{
+	while (finished) {
+		fn_cmd_batch *batch = finished;
+		finished = batch->next;
+		if (batch->cb)
+			batch->cb(q->dev, batch->status, batch->user);
+		free(batch);
+	}
+}
+
+static void request_done(fnusb_dev *usb, int res, void *user)
+{
+	fn_cmd_queue *q = (fn_cmd_queue*)user;
+	fn_cmd_batch *finished = NULL, **tail = &finished;
+	freenect_context *ctx = q->dev->parent;
+
+	pthread_mutex_lock(&q->lock);
+	if (res >= 0)
+		res = submit_poll(q);
+	if (res < 0) {
+		FN_ERROR("fn_cmd_queue: Output control transfer failed (%d)\n", res);
+		write_done(q, res, &tail);
+	}
+	pthread_mutex_unlock(&q->lock);
+	run_callbacks(q, finished);
+}
+
+static void reply_done(fnusb_dev *usb, int res, void *user)
+{
+	fn_cmd_queue *q = (fn_cmd_queue*)user;
+	fn_cmd_batch *finished = NULL, **tail = &finished;
+	freenect_context *ctx = q->dev->parent;
+	uint16_t reply[2];
+
+	pthread_mutex_lock(&q->lock);
+	// nothing, or a full buffer, until the camera has the reply ready
+	if (res == 0 || res == FN_CMD_IBUF) {
+		res = submit_poll(q);
+		if (res >= 0) {
+			pthread_mutex_unlock(&q->lock);
+			return;
+		}
+	} else {
+		res = fn_cmd_reply(q->dev, q->obuf, q->ibuf, res, reply, 4);
+		if (res >= 0 && res != 2)
+			FN_WARNING("fn_cmd_queue: reply of %d bytes [%04x %04x], 0000 expected\n", res, reply[0], reply[1]);
+	}
+	write_done(q, res < 0 ? res : 0, &tail);
+	pthread_mutex_unlock(&q->lock);
+	run_callbacks(q, finished);
+}
+
+FN_INTERNAL int fn_cmd_queue_write(fn_cmd_queue *q, const fn_reg_write *writes, int count, freenect_command_cb cb, void *user)
+{
+	fn_cmd_batch *batch;
+	int res = 0;
+
+	if (count < 1 || count > FN_CMD_MAX_WRITES)
+		return -1;
+	batch = (fn_cmd_batch*)calloc(1, sizeof(fn_cmd_batch));
+	if (!batch)
+		return -1;
+	memcpy(batch->writes, writes, count * sizeof(fn_reg_write));
+	batch->count = count;
+	batch->cb = cb;
+	batch->user = user;
+
+	pthread_mutex_lock(&q->lock);
+	if (q->tail) {
+		q->tail->next = batch;
+		q->tail = batch;
+	} else {
+		q->head = q->tail = batch;
+		res = submit_write(q);
+		if (res < 0)
+			q->head = q->tail = NULL;
+	}
+	pthread_mutex_unlock(&q->lock);
+	if (res < 0)
+		free(batch);
+	return res < 0 ? res : 0;
+}
+
+FN_INTERNAL int fn_cmd_queue_drain(fn_cmd_queue *q)
+{
+	if (!q)
+		return 0;
+	freenect_context *ctx = q->dev->parent;
+	for (;;) {
+		pthread_mutex_lock(&q->lock);
+		int idle = q->head == NULL;
+		pthread_mutex_unlock(&q->lock);
+		if (idle)
+			return 0;
+		struct timeval timeout = { 0, 10000 };
+		int res = fnusb_process_events_timeout(&ctx->usb, &timeout);
+		if (res < 0)
+			return res;
+	}
+}
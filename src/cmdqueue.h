@@ -0,0 +1,77 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2010 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+#ifndef CMDQUEUE_H
+#define CMDQUEUE_H
+
+#include <stdint.h>
+#include "libfreenect.h"
+
+// Camera commands go out in a vendor control transfer; the reply is fetched
+// with a second one, repeated until the camera has it ready. The camera
+// takes one command at a time, so the queue below runs the register writes
+// handed to it back to back, each step submitted from the completion of
+// the one before, instead of blocking a thread on every round trip.
+
+#define FN_CMD_OBUF 0x400
+#define FN_CMD_IBUF 0x200
+#define FN_CMD_MAX_WRITES 16
+
+typedef struct {
+	uint16_t reg;
+	uint16_t data;
+} fn_reg_write;
+
+typedef struct _fn_cmd_queue fn_cmd_queue;
+
+// Write the request for command cmd with cmd_len bytes of arguments into
+// obuf (FN_CMD_OBUF bytes). Returns the request length, or < 0 if the
+// arguments do not fit.
+int fn_cmd_request(freenect_device *dev, uint8_t *obuf, uint16_t cmd, const void *cmdbuf, unsigned int cmd_len);
+
+// Check a reply of len bytes in ibuf against the request in obuf and copy
+// at most reply_len bytes of its payload to replybuf. Returns the payload
+// length, or < 0 if the reply does not answer the request.
+int fn_cmd_reply(freenect_device *dev, const uint8_t *obuf, const uint8_t *ibuf, int len, void *replybuf, int reply_len);
+
+// Returns NULL on failure.
+fn_cmd_queue *fn_cmd_queue_create(freenect_device *dev);
+
+// Waits for the queued commands first. NULL is allowed.
+void fn_cmd_queue_destroy(fn_cmd_queue *q);
+
+// Queue count register writes (at most FN_CMD_MAX_WRITES). cb runs from
+// freenect_process_events() once all of them are done, with 0 or the error
+// of the first one that failed. Returns < 0, without calling cb, if the
+// writes could not be started. May be called from any thread.
+int fn_cmd_queue_write(fn_cmd_queue *q, const fn_reg_write *writes, int count, freenect_command_cb cb, void *user);
+
+// Run the event loop until every queued command is done, so that a blocking
+// command can follow. Returns < 0 if the event loop failed first. NULL is
+// allowed.
+int fn_cmd_queue_drain(fn_cmd_queue *q);
+
+#endif
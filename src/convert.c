@@ -0,0 +1,1484 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2010 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "freenect_internal.h"
+#include "convert.h"
+
+// x86: GCC/Clang can build SSSE3/AVX2 functions without global -m flags
+// through the target attribute; MSVC always exposes the intrinsics.
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define FN_SIMD_X86
+#define FN_TARGET(isa) __attribute__ ((target (isa)))
+#include <immintrin.h>
+#elif defined(_MSC_VER) && (defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define FN_SIMD_X86
+#define FN_TARGET(isa)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+// ARM: NEON is part of the aarch64 baseline, so no runtime check is needed.
+#if defined(__aarch64__) && defined(__ARM_NEON) && !defined(FN_BIGENDIAN)
+#define FN_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+enum {
+	SIMD_C,
+	SIMD_SSE2,
+	SIMD_SSSE3,
+	SIMD_AVX2,
+	SIMD_NEON,
+};
+
+static const char *simd_names[] = { "c", "sse2", "ssse3", "avx2", "neon" };
+static int simd_level = -1;
+
+static int detect_simd(void)
+{
+	int level = SIMD_C;
+#if defined(FN_SIMD_X86) && !defined(_MSC_VER)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse2"))
+		level = SIMD_SSE2;
+	if (level == SIMD_SSE2 && __builtin_cpu_supports("ssse3"))
+		level = SIMD_SSSE3;
+	if (level == SIMD_SSSE3 && __builtin_cpu_supports("avx2"))
+		level = SIMD_AVX2;
+#elif defined(FN_SIMD_X86)
+	int info[4];
+	level = SIMD_SSE2;
+	__cpuid(info, 1);
+	if (info[2] & (1 << 9))
+		level = SIMD_SSSE3;
+	// AVX2 also needs the OS to save the YMM registers (OSXSAVE + XCR0)
+	if (level == SIMD_SSSE3 && (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6) {
+		__cpuidex(info, 7, 0);
+		if (info[1] & (1 << 5))
+			level = SIMD_AVX2;
+	}
+#elif defined(FN_SIMD_NEON)
+	level = SIMD_NEON;
+#endif
+	return level;
+}
+
+// cap a level by name, e.g. "none" forces plain C; NULL leaves it alone
+static int cap_simd(int level, const char *cap)
+{
+	if (cap) {
+		if (!strcmp(cap, "none"))
+			return SIMD_C;
+		int i;
+		for (i = SIMD_C; i <= SIMD_NEON; i++) {
+			if (!strcmp(cap, simd_names[i]) && i < level)
+				level = i;
+		}
+	}
+	return level;
+}
+
+static int get_simd_level(void)
+{
+	// Racing threads all compute the same value, so no locking is needed
+	if (simd_level < 0)
+		simd_level = cap_simd(detect_simd(), getenv("LIBFREENECT_SIMD"));
+	return simd_level;
+}
+
+FN_INTERNAL const char *freenect_convert_simd_name(void)
+{
+	return simd_names[get_simd_level()];
+}
+
+/*
+ * 11-bit unpacker
+ *
+ * Eight 11-bit values are packed MSB first into 11 bytes. Value i starts at
+ * bit 11*i, i.e. in byte b = 11*i/8 at bit offset s = 11*i%8, so
+ *
+ *   value = ((BE16(b) << s) | (BE16(b+1) >> (8 - s))) >> 5
+ *
+ * where the shifts are done on 16 bits. The SIMD versions gather BE16(b) and
+ * BE16(b+1) for all eight values into 16-bit lanes and do the variable shifts
+ * with multiplies: mullo by 1<<s is a left shift, mulhi by 1<<(8+s) is a
+ * right shift by 8-s.
+ */
+
+static void convert_packed11_to_16bit_c(const uint8_t *raw, uint16_t *frame, int n)
+{
+	uint16_t baseMask = (1 << 11) - 1;
+	while(n >= 8)
+	{
+		uint8_t r0  = *(raw+0);
+		uint8_t r1  = *(raw+1);
+		uint8_t r2  = *(raw+2);
+		uint8_t r3  = *(raw+3);
+		uint8_t r4  = *(raw+4);
+		uint8_t r5  = *(raw+5);
+		uint8_t r6  = *(raw+6);
+		uint8_t r7  = *(raw+7);
+		uint8_t r8  = *(raw+8);
+		uint8_t r9  = *(raw+9);
+		uint8_t r10 = *(raw+10);
+
+		frame[0] =  (r0<<3)  | (r1>>5);
+		frame[1] = ((r1<<6)  | (r2>>2) )           & baseMask;
+		frame[2] = ((r2<<9)  | (r3<<1) | (r4>>7) ) & baseMask;
+		frame[3] = ((r4<<4)  | (r5>>4) )           & baseMask;
+		frame[4] = ((r5<<7)  | (r6>>1) )           & baseMask;
+		frame[5] = ((r6<<10) | (r7<<2) | (r8>>6) ) & baseMask;
+		frame[6] = ((r8<<5)  | (r9>>3) )           & baseMask;
+		frame[7] = ((r9<<8)  | (r10)   )           & baseMask;
+
+		n -= 8;
+		raw += 11;
+		frame += 8;
+	}
+}
+
+#ifdef FN_SIMD_X86
+
+// Byte shuffles building BE16(b) and BE16(b+1) for b = 0,1,2,4,5,6,8,9
+#define PACKED11_SHUF_B0 1, 0, 2, 1, 3, 2, 5, 4, 6, 5, 7, 6, 9, 8, 10, 9
+#define PACKED11_SHUF_B1 2, 1, 3, 2, 4, 3, 6, 5, 7, 6, 8, 7, 10, 9, -1, 10
+#define PACKED11_MUL_LO 1 << 0, 1 << 3, 1 << 6, 1 << 1, 1 << 4, 1 << 7, 1 << 2, 1 << 5
+#define PACKED11_MUL_HI 1 << 8, 1 << 11, 1 << 14, 1 << 9, 1 << 12, (short)(1 << 15), 1 << 10, 1 << 13
+
+FN_TARGET("sse2")
+static void convert_packed11_to_16bit_sse2(const uint8_t *raw, uint16_t *frame, int n)
+{
+	const __m128i m012 = _mm_setr_epi16(-1, -1, -1, 0, 0, 0, 0, 0);
+	const __m128i m345 = _mm_setr_epi16(0, 0, 0, -1, -1, -1, 0, 0);
+	const __m128i m67 = _mm_setr_epi16(0, 0, 0, 0, 0, 0, -1, -1);
+	const __m128i mul_lo = _mm_setr_epi16(PACKED11_MUL_LO);
+	const __m128i mul_hi = _mm_setr_epi16(PACKED11_MUL_HI);
+
+	// Each step reads 16 bytes but consumes 11; stop while 22 are left
+	while (n >= 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)raw);
+		__m128i v1 = _mm_srli_si128(v, 1);
+		// e = BE16 at even offsets, o = BE16 at odd offsets
+		__m128i e = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+		__m128i o = _mm_or_si128(_mm_slli_epi16(v1, 8), _mm_srli_epi16(v1, 8));
+		// lo = BE16(0..7), hi = BE16(8..15)
+		__m128i lo = _mm_unpacklo_epi16(e, o);
+		__m128i hi = _mm_unpackhi_epi16(e, o);
+		__m128i lo2 = _mm_srli_si128(lo, 2);
+		__m128i b0 = _mm_or_si128(_mm_or_si128(_mm_and_si128(lo, m012), _mm_and_si128(lo2, m345)),
+		                          _mm_slli_si128(hi, 12));
+		__m128i b1 = _mm_or_si128(_mm_or_si128(_mm_and_si128(lo2, m012), _mm_and_si128(_mm_srli_si128(lo, 4), m345)),
+		                          _mm_and_si128(_mm_slli_si128(hi, 10), m67));
+		__m128i px = _mm_or_si128(_mm_mullo_epi16(b0, mul_lo), _mm_mulhi_epu16(b1, mul_hi));
+		_mm_storeu_si128((__m128i *)frame, _mm_srli_epi16(px, 5));
+		n -= 8;
+		raw += 11;
+		frame += 8;
+	}
+	convert_packed11_to_16bit_c(raw, frame, n);
+}
+
+FN_TARGET("ssse3")
+static void convert_packed11_to_16bit_ssse3(const uint8_t *raw, uint16_t *frame, int n)
+{
+	const __m128i shuf_b0 = _mm_setr_epi8(PACKED11_SHUF_B0);
+	const __m128i shuf_b1 = _mm_setr_epi8(PACKED11_SHUF_B1);
+	const __m128i mul_lo = _mm_setr_epi16(PACKED11_MUL_LO);
+	const __m128i mul_hi = _mm_setr_epi16(PACKED11_MUL_HI);
+
+	while (n >= 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)raw);
+		__m128i b0 = _mm_shuffle_epi8(v, shuf_b0);
+		__m128i b1 = _mm_shuffle_epi8(v, shuf_b1);
+		__m128i px = _mm_or_si128(_mm_mullo_epi16(b0, mul_lo), _mm_mulhi_epu16(b1, mul_hi));
+		_mm_storeu_si128((__m128i *)frame, _mm_srli_epi16(px, 5));
+		n -= 8;
+		raw += 11;
+		frame += 8;
+	}
+	convert_packed11_to_16bit_c(raw, frame, n);
+}
+
+FN_TARGET("avx2")
+static void convert_packed11_to_16bit_avx2(const uint8_t *raw, uint16_t *frame, int n)
+{
+	const __m256i shuf_b0 = _mm256_setr_epi8(PACKED11_SHUF_B0, PACKED11_SHUF_B0);
+	const __m256i shuf_b1 = _mm256_setr_epi8(PACKED11_SHUF_B1, PACKED11_SHUF_B1);
+	const __m256i mul_lo = _mm256_setr_epi16(PACKED11_MUL_LO, PACKED11_MUL_LO);
+	const __m256i mul_hi = _mm256_setr_epi16(PACKED11_MUL_HI, PACKED11_MUL_HI);
+
+	// Two 11-byte groups per step, one per 128-bit lane; the second load
+	// ends 27 bytes in, so stop while 33 are left
+	while (n >= 24) {
+		__m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)raw)),
+		                                    _mm_loadu_si128((const __m128i *)(raw + 11)), 1);
+		__m256i b0 = _mm256_shuffle_epi8(v, shuf_b0);
+		__m256i b1 = _mm256_shuffle_epi8(v, shuf_b1);
+		__m256i px = _mm256_or_si256(_mm256_mullo_epi16(b0, mul_lo), _mm256_mulhi_epu16(b1, mul_hi));
+		_mm256_storeu_si256((__m256i *)frame, _mm256_srli_epi16(px, 5));
+		n -= 16;
+		raw += 22;
+		frame += 16;
+	}
+	convert_packed11_to_16bit_ssse3(raw, frame, n);
+}
+
+#endif // FN_SIMD_X86
+
+#ifdef FN_SIMD_NEON
+
+static void convert_packed11_to_16bit_neon(const uint8_t *raw, uint16_t *frame, int n)
+{
+	static const uint8_t shuf_b0[16] = { 1, 0, 2, 1, 3, 2, 5, 4, 6, 5, 7, 6, 9, 8, 10, 9 };
+	static const uint8_t shuf_b1[16] = { 2, 1, 3, 2, 4, 3, 6, 5, 7, 6, 8, 7, 10, 9, 0xff, 10 };
+	static const int16_t shl[8] = { 0, 3, 6, 1, 4, 7, 2, 5 };
+	static const int16_t shr[8] = { -8, -5, -2, -7, -4, -1, -6, -3 };
+	const uint8x16_t tb0 = vld1q_u8(shuf_b0);
+	const uint8x16_t tb1 = vld1q_u8(shuf_b1);
+	const int16x8_t vshl = vld1q_s16(shl);
+	const int16x8_t vshr = vld1q_s16(shr);
+
+	while (n >= 16) {
+		uint8x16_t v = vld1q_u8(raw);
+		uint16x8_t b0 = vreinterpretq_u16_u8(vqtbl1q_u8(v, tb0));
+		uint16x8_t b1 = vreinterpretq_u16_u8(vqtbl1q_u8(v, tb1));
+		uint16x8_t px = vorrq_u16(vshlq_u16(b0, vshl), vshlq_u16(b1, vshr));
+		vst1q_u16(frame, vshrq_n_u16(px, 5));
+		n -= 8;
+		raw += 11;
+		frame += 8;
+	}
+	convert_packed11_to_16bit_c(raw, frame, n);
+}
+
+#endif // FN_SIMD_NEON
+
+typedef void (*packed11_fn)(const uint8_t *raw, uint16_t *frame, int n);
+static packed11_fn packed11_impl = NULL;
+
+static packed11_fn select_packed11(void)
+{
+	switch (get_simd_level()) {
+#ifdef FN_SIMD_X86
+		case SIMD_AVX2:
+			return convert_packed11_to_16bit_avx2;
+		case SIMD_SSSE3:
+			return convert_packed11_to_16bit_ssse3;
+		case SIMD_SSE2:
+			return convert_packed11_to_16bit_sse2;
+#endif
+#ifdef FN_SIMD_NEON
+		case SIMD_NEON:
+			return convert_packed11_to_16bit_neon;
+#endif
+		default:
+			return convert_packed11_to_16bit_c;
+	}
+}
+
+FN_INTERNAL void freenect_convert_packed11_to_16bit(const uint8_t *raw, uint16_t *frame, int n)
+{
+	if (!packed11_impl)
+		packed11_impl = select_packed11();
+	packed11_impl(raw, frame, n);
+}
+
+/*
+ * 10-bit unpacker
+ *
+ * Four 10-bit values are packed MSB first into 5 bytes, value i starting in
+ * byte b = i at bit offset s = 2*i, so
+ *
+ *   value = (BE16(b) << s) >> 6
+ *
+ * and its 8-bit version (the 8 MSBs) is (BE16(b) << s) >> 8. The SIMD
+ * versions handle two 5-byte groups per 128 bits.
+ */
+
+static void convert_packed10_to_16bit_c(const uint8_t *raw, uint16_t *frame, int n)
+{
+	uint16_t baseMask = (1 << 10) - 1;
+	while (n >= 4) {
+		uint8_t r0 = *(raw+0);
+		uint8_t r1 = *(raw+1);
+		uint8_t r2 = *(raw+2);
+		uint8_t r3 = *(raw+3);
+		uint8_t r4 = *(raw+4);
+
+		frame[0] =  (r0<<2) | (r1>>6);
+		frame[1] = ((r1<<4) | (r2>>4)) & baseMask;
+		frame[2] = ((r2<<6) | (r3>>2)) & baseMask;
+		frame[3] = ((r3<<8) | (r4)   ) & baseMask;
+
+		n -= 4;
+		raw += 5;
+		frame += 4;
+	}
+}
+
+static void convert_packed10_to_8bit_c(const uint8_t *raw, uint8_t *frame, int n)
+{
+	while (n >= 4) {
+		uint8_t r0 = *(raw+0);
+		uint8_t r1 = *(raw+1);
+		uint8_t r2 = *(raw+2);
+		uint8_t r3 = *(raw+3);
+		uint8_t r4 = *(raw+4);
+
+		frame[0] = r0;
+		frame[1] = (r1<<2) | (r2>>6);
+		frame[2] = (r2<<4) | (r3>>4);
+		frame[3] = (r3<<6) | (r4>>2);
+
+		n -= 4;
+		raw += 5;
+		frame += 4;
+	}
+}
+
+#ifdef FN_SIMD_X86
+
+// Byte shuffle building BE16(b) for b = 0,1,2,3,5,6,7,8
+#define PACKED10_SHUF 1, 0, 2, 1, 3, 2, 4, 3, 6, 5, 7, 6, 8, 7, 9, 8
+#define PACKED10_MUL 1 << 0, 1 << 2, 1 << 4, 1 << 6, 1 << 0, 1 << 2, 1 << 4, 1 << 6
+
+// Returns BE16(b) << s for the eight values in the 10 bytes at raw.
+// Reads 16 bytes.
+FN_TARGET("sse2")
+static inline __m128i packed10_sse2(const uint8_t *raw)
+{
+	const __m128i m0123 = _mm_setr_epi16(-1, -1, -1, -1, 0, 0, 0, 0);
+	const __m128i m456 = _mm_setr_epi16(0, 0, 0, 0, -1, -1, -1, 0);
+	const __m128i mul = _mm_setr_epi16(PACKED10_MUL);
+	__m128i v = _mm_loadu_si128((const __m128i *)raw);
+	__m128i v1 = _mm_srli_si128(v, 1);
+	// e = BE16 at even offsets, o = BE16 at odd offsets
+	__m128i e = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+	__m128i o = _mm_or_si128(_mm_slli_epi16(v1, 8), _mm_srli_epi16(v1, 8));
+	// lo = BE16(0..7), hi = BE16(8..15)
+	__m128i lo = _mm_unpacklo_epi16(e, o);
+	__m128i hi = _mm_unpackhi_epi16(e, o);
+	__m128i b = _mm_or_si128(_mm_or_si128(_mm_and_si128(lo, m0123), _mm_and_si128(_mm_srli_si128(lo, 2), m456)),
+	                         _mm_slli_si128(hi, 14));
+	return _mm_mullo_epi16(b, mul);
+}
+
+FN_TARGET("ssse3")
+static inline __m128i packed10_ssse3(const uint8_t *raw)
+{
+	const __m128i shuf = _mm_setr_epi8(PACKED10_SHUF);
+	const __m128i mul = _mm_setr_epi16(PACKED10_MUL);
+	return _mm_mullo_epi16(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)raw), shuf), mul);
+}
+
+// Same as above for two runs of 10 bytes, at raw and raw + 10. Reads 26 bytes.
+FN_TARGET("avx2")
+static inline __m256i packed10_avx2(const uint8_t *raw)
+{
+	const __m256i shuf = _mm256_setr_epi8(PACKED10_SHUF, PACKED10_SHUF);
+	const __m256i mul = _mm256_setr_epi16(PACKED10_MUL, PACKED10_MUL);
+	__m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)raw)),
+	                                    _mm_loadu_si128((const __m128i *)(raw + 10)), 1);
+	return _mm256_mullo_epi16(_mm256_shuffle_epi8(v, shuf), mul);
+}
+
+// The 128-bit loops read 16 bytes but consume 10, so they stop while 20 are
+// left; the AVX2 loops read 26 and consume 20, so they stop while 30 are left.
+
+FN_TARGET("sse2")
+static void convert_packed10_to_16bit_sse2(const uint8_t *raw, uint16_t *frame, int n)
+{
+	for (; n >= 16; n -= 8, raw += 10, frame += 8)
+		_mm_storeu_si128((__m128i *)frame, _mm_srli_epi16(packed10_sse2(raw), 6));
+	convert_packed10_to_16bit_c(raw, frame, n);
+}
+
+FN_TARGET("sse2")
+static void convert_packed10_to_8bit_sse2(const uint8_t *raw, uint8_t *frame, int n)
+{
+	for (; n >= 16; n -= 8, raw += 10, frame += 8) {
+		__m128i px = _mm_srli_epi16(packed10_sse2(raw), 8);
+		_mm_storel_epi64((__m128i *)frame, _mm_packus_epi16(px, px));
+	}
+	convert_packed10_to_8bit_c(raw, frame, n);
+}
+
+FN_TARGET("ssse3")
+static void convert_packed10_to_16bit_ssse3(const uint8_t *raw, uint16_t *frame, int n)
+{
+	for (; n >= 16; n -= 8, raw += 10, frame += 8)
+		_mm_storeu_si128((__m128i *)frame, _mm_srli_epi16(packed10_ssse3(raw), 6));
+	convert_packed10_to_16bit_c(raw, frame, n);
+}
+
+FN_TARGET("ssse3")
+static void convert_packed10_to_8bit_ssse3(const uint8_t *raw, uint8_t *frame, int n)
+{
+	for (; n >= 16; n -= 8, raw += 10, frame += 8) {
+		__m128i px = _mm_srli_epi16(packed10_ssse3(raw), 8);
+		_mm_storel_epi64((__m128i *)frame, _mm_packus_epi16(px, px));
+	}
+	convert_packed10_to_8bit_c(raw, frame, n);
+}
+
+FN_TARGET("avx2")
+static void convert_packed10_to_16bit_avx2(const uint8_t *raw, uint16_t *frame, int n)
+{
+	for (; n >= 24; n -= 16, raw += 20, frame += 16)
+		_mm256_storeu_si256((__m256i *)frame, _mm256_srli_epi16(packed10_avx2(raw), 6));
+	convert_packed10_to_16bit_ssse3(raw, frame, n);
+}
+
+FN_TARGET("avx2")
+static void convert_packed10_to_8bit_avx2(const uint8_t *raw, uint8_t *frame, int n)
+{
+	for (; n >= 24; n -= 16, raw += 20, frame += 16) {
+		__m256i px = _mm256_srli_epi16(packed10_avx2(raw), 8);
+		// packus works per 128-bit lane, so gather the two low halves
+		px = _mm256_permute4x64_epi64(_mm256_packus_epi16(px, px), 0x08);
+		_mm_storeu_si128((__m128i *)frame, _mm256_castsi256_si128(px));
+	}
+	convert_packed10_to_8bit_ssse3(raw, frame, n);
+}
+
+#endif // FN_SIMD_X86
+
+#ifdef FN_SIMD_NEON
+
+static inline uint16x8_t packed10_neon(const uint8_t *raw)
+{
+	static const uint8_t shuf[16] = { 1, 0, 2, 1, 3, 2, 4, 3, 6, 5, 7, 6, 8, 7, 9, 8 };
+	static const int16_t shl[8] = { 0, 2, 4, 6, 0, 2, 4, 6 };
+	uint16x8_t b = vreinterpretq_u16_u8(vqtbl1q_u8(vld1q_u8(raw), vld1q_u8(shuf)));
+	return vshlq_u16(b, vld1q_s16(shl));
+}
+
+static void convert_packed10_to_16bit_neon(const uint8_t *raw, uint16_t *frame, int n)
+{
+	for (; n >= 16; n -= 8, raw += 10, frame += 8)
+		vst1q_u16(frame, vshrq_n_u16(packed10_neon(raw), 6));
+	convert_packed10_to_16bit_c(raw, frame, n);
+}
+
+static void convert_packed10_to_8bit_neon(const uint8_t *raw, uint8_t *frame, int n)
+{
+	for (; n >= 16; n -= 8, raw += 10, frame += 8)
+		vst1_u8(frame, vshrn_n_u16(packed10_neon(raw), 8));
+	convert_packed10_to_8bit_c(raw, frame, n);
+}
+
+#endif // FN_SIMD_NEON
+
+typedef void (*packed10_16_fn)(const uint8_t *raw, uint16_t *frame, int n);
+typedef void (*packed10_8_fn)(const uint8_t *raw, uint8_t *frame, int n);
+static packed10_16_fn packed10_16_impl = NULL;
+static packed10_8_fn packed10_8_impl = NULL;
+
+static packed10_16_fn select_packed10_16(void)
+{
+	switch (get_simd_level()) {
+#ifdef FN_SIMD_X86
+		case SIMD_AVX2:
+			return convert_packed10_to_16bit_avx2;
+		case SIMD_SSSE3:
+			return convert_packed10_to_16bit_ssse3;
+		case SIMD_SSE2:
+			return convert_packed10_to_16bit_sse2;
+#endif
+#ifdef FN_SIMD_NEON
+		case SIMD_NEON:
+			return convert_packed10_to_16bit_neon;
+#endif
+		default:
+			return convert_packed10_to_16bit_c;
+	}
+}
+
+static packed10_8_fn select_packed10_8(void)
+{
+	switch (get_simd_level()) {
+#ifdef FN_SIMD_X86
+		case SIMD_AVX2:
+			return convert_packed10_to_8bit_avx2;
+		case SIMD_SSSE3:
+			return convert_packed10_to_8bit_ssse3;
+		case SIMD_SSE2:
+			return convert_packed10_to_8bit_sse2;
+#endif
+#ifdef FN_SIMD_NEON
+		case SIMD_NEON:
+			return convert_packed10_to_8bit_neon;
+#endif
+		default:
+			return convert_packed10_to_8bit_c;
+	}
+}
+
+FN_INTERNAL void freenect_convert_packed10_to_16bit(const uint8_t *raw, uint16_t *frame, int n)
+{
+	if (!packed10_16_impl)
+		packed10_16_impl = select_packed10_16();
+	packed10_16_impl(raw, frame, n);
+}
+
+FN_INTERNAL void freenect_convert_packed10_to_8bit(const uint8_t *raw, uint8_t *frame, int n)
+{
+	if (!packed10_8_impl)
+		packed10_8_impl = select_packed10_8();
+	packed10_8_impl(raw, frame, n);
+}
+
+FN_INTERNAL const char *freenect_convert_set_simd(const char *cap)
+{
+	simd_level = cap_simd(detect_simd(), cap);
+	packed11_impl = NULL;
+	packed10_16_impl = NULL;
+	packed10_8_impl = NULL;
+	return simd_names[simd_level];
+}
+
+/*
+ * Bayer to RGB demosaic
+ */
+
+static void convert_bayer_to_rgb_c(const uint8_t *raw_buf, uint8_t *proc_buf, int width, int height)
+{
+	int x,y;
+	/* Pixel arrangement:
+	 * G R G R G R G R
+	 * B G B G B G B G
+	 * G R G R G R G R
+	 * B G B G B G B G
+	 * G R G R G R G R
+	 * B G B G B G B G
+	 *
+	 * To convert a Bayer-pattern into RGB you have to handle four pattern
+	 * configurations:
+	 * 1)         2)         3)         4)
+	 *      B1      B1 G1 B2   R1 G1 R2      R1       <- previous line
+	 *   R1 G1 R2   G2 R1 G3   G2 B1 G3   B1 G1 B2    <- current line
+	 *      B2      B3 G4 B4   R3 G4 R4      R2       <- next line
+	 *   ^  ^  ^
+	 *   |  |  next pixel
+	 *   |  current pixel
+	 *   previous pixel
+	 *
+	 * The RGB values (r,g,b) for each configuration are calculated as
+	 * follows:
+	 *
+	 * 1) r = (R1 + R2) / 2
+	 *    g =  G1
+	 *    b = (B1 + B2) / 2
+	 *
+	 * 2) r =  R1
+	 *    g = (G1 + G2 + G3 + G4) / 4
+	 *    b = (B1 + B2 + B3 + B4) / 4
+	 *
+	 * 3) r = (R1 + R2 + R3 + R4) / 4
+	 *    g = (G1 + G2 + G3 + G4) / 4
+	 *    b =  B1
+	 *
+	 * 4) r = (R1 + R2) / 2
+	 *    g =  G1
+	 *    b = (B1 + B2) / 2
+	 *
+	 * To efficiently calculate these values, two 32bit integers are used
+	 * as "shift-buffers". One integer to store the 3 horizontal bayer pixel
+	 * values (previous, current, next) of the current line. The other
+	 * integer to store the vertical average value of the bayer pixels
+	 * (previous, current, next) of the previous and next line.
+	 *
+	 * The boundary conditions for the first and last line and the first
+	 * and last column are solved via mirroring the second and second last
+	 * line and the second and second last column.
+	 *
+	 * To reduce slow memory access, the values of a rgb pixel are packet
+	 * into a 32bit variable and transfered together.
+	 */
+
+	uint8_t *dst = proc_buf; // pointer to destination
+
+	const uint8_t *prevLine;  // pointer to previous, current and next line
+	const uint8_t *curLine;   // of the source bayer pattern
+	const uint8_t *nextLine;
+
+	// storing horizontal values in hVals:
+	// previous << 16, current << 8, next
+	uint32_t hVals;
+	// storing vertical averages in vSums:
+	// previous << 16, current << 8, next
+	uint32_t vSums;
+
+	// init curLine and nextLine pointers
+	curLine  = raw_buf;
+	nextLine = curLine + width;
+	for (y = 0; y < height; ++y) {
+
+		if ((y > 0) && (y < height-1))
+			prevLine = curLine - width; // normal case
+		else if (y == 0)
+			prevLine = nextLine;      // top boundary case
+		else
+			nextLine = prevLine;      // bottom boundary case
+
+		// init horizontal shift-buffer with current value
+		hVals  = (*(curLine++) << 8);
+		// handle left column boundary case
+		hVals |= (*curLine << 16);
+		// init vertical average shift-buffer with current values average
+		vSums = ((*(prevLine++) + *(nextLine++)) << 7) & 0xFF00;
+		// handle left column boundary case
+		vSums |= ((*prevLine + *nextLine) << 15) & 0xFF0000;
+
+		// store if line is odd or not
+		uint8_t yOdd = y & 1;
+		// the right column boundary case is not handled inside this loop
+		// thus the "639"
+		for (x = 0; x < width-1; ++x) {
+			// place next value in shift buffers
+			hVals |= *(curLine++);
+			vSums |= (*(prevLine++) + *(nextLine++)) >> 1;
+
+			// calculate the horizontal sum as this sum is needed in
+			// any configuration
+			uint8_t hSum = ((uint8_t)(hVals >> 16) + (uint8_t)(hVals)) >> 1;
+
+			if (yOdd == 0) {
+				if ((x & 1) == 0) {
+					// Configuration 1
+					*(dst++) = hSum;		// r
+					*(dst++) = hVals >> 8;	// g
+					*(dst++) = vSums >> 8;	// b
+				} else {
+					// Configuration 2
+					*(dst++) = hVals >> 8;
+					*(dst++) = (hSum + (uint8_t)(vSums >> 8)) >> 1;
+					*(dst++) = ((uint8_t)(vSums >> 16) + (uint8_t)(vSums)) >> 1;
+				}
+			} else {
+				if ((x & 1) == 0) {
+					// Configuration 3
+					*(dst++) = ((uint8_t)(vSums >> 16) + (uint8_t)(vSums)) >> 1;
+					*(dst++) = (hSum + (uint8_t)(vSums >> 8)) >> 1;
+					*(dst++) = hVals >> 8;
+				} else {
+					// Configuration 4
+					*(dst++) = vSums >> 8;
+					*(dst++) = hVals >> 8;
+					*(dst++) = hSum;
+				}
+			}
+
+			// shift the shift-buffers
+			hVals <<= 8;
+			vSums <<= 8;
+		} // end of for x loop
+		// right column boundary case, mirroring second last column
+		hVals |= (uint8_t)(hVals >> 16);
+		vSums |= (uint8_t)(vSums >> 16);
+
+		// the horizontal sum simplifies to the second last column value
+		uint8_t hSum = (uint8_t)(hVals);
+
+		if (yOdd == 0) {
+			if ((x & 1) == 0) {
+				*(dst++) = hSum;
+				*(dst++) = hVals >> 8;
+				*(dst++) = vSums >> 8;
+			} else {
+				*(dst++) = hVals >> 8;
+				*(dst++) = (hSum + (uint8_t)(vSums >> 8)) >> 1;
+				*(dst++) = vSums;
+			}
+		} else {
+			if ((x & 1) == 0) {
+				*(dst++) = vSums;
+				*(dst++) = (hSum + (uint8_t)(vSums >> 8)) >> 1;
+				*(dst++) = hVals >> 8;
+			} else {
+				*(dst++) = vSums >> 8;
+				*(dst++) = hVals >> 8;
+				*(dst++) = hSum;
+			}
+		}
+
+	} // end of for y loop
+}
+
+/*
+ * The SIMD versions compute the same bilinear interpolation as above without
+ * shift-buffers. With avg(a, b) = (a + b) >> 1, c[] the current line and
+ * v[] = avg(prev[], next[]) the vertical averages, pixel x gets
+ *
+ *   h  = avg(c[x-1], c[x+1])
+ *   vv = avg(v[x-1], v[x+1])
+ *   g4 = avg(h, v[x])
+ *
+ *               even x   odd x
+ *   even line   h        c[x]     r
+ *               c[x]     g4       g
+ *               v[x]     vv       b
+ *   odd line    vv       v[x]     r
+ *               g4       c[x]     g
+ *               c[x]     h        b
+ *
+ * which is what configurations 1-4 work out to, including the mirrored
+ * borders. The vector loops cover the inner pixels, bayer_pixel() the first
+ * two and the last few pixels of each line.
+ */
+
+static inline uint8_t avg_u8(uint8_t a, uint8_t b)
+{
+	return (a + b) >> 1;
+}
+
+static inline void bayer_pixel(const uint8_t *prev, const uint8_t *cur, const uint8_t *next,
+                               uint8_t *dst, int x, int width, int yOdd)
+{
+	int xm = x > 0 ? x - 1 : 1;
+	int xp = x < width - 1 ? x + 1 : width - 2;
+	uint8_t c = cur[x];
+	uint8_t h = avg_u8(cur[xm], cur[xp]);
+	uint8_t v = avg_u8(prev[x], next[x]);
+	uint8_t vv = avg_u8(avg_u8(prev[xm], next[xm]), avg_u8(prev[xp], next[xp]));
+	uint8_t g4 = avg_u8(h, v);
+
+	dst += 3 * x;
+	if (!yOdd) {
+		dst[0] = x & 1 ? c  : h;
+		dst[1] = x & 1 ? g4 : c;
+		dst[2] = x & 1 ? vv : v;
+	} else {
+		dst[0] = x & 1 ? v  : vv;
+		dst[1] = x & 1 ? c  : g4;
+		dst[2] = x & 1 ? h  : c;
+	}
+}
+
+// Vector loop over a line: processes pixels from x (even) onwards while
+// x + 1 stays inside the line, returns the first pixel left over.
+typedef int (*bayer_line_fn)(const uint8_t *prev, const uint8_t *cur, const uint8_t *next,
+                             uint8_t *dst, int x, int width, int yOdd);
+
+static void convert_bayer_to_rgb_lines(const uint8_t *raw_buf, uint8_t *proc_buf, int width, int height, bayer_line_fn line)
+{
+	int x, y;
+	for (y = 0; y < height; ++y) {
+		const uint8_t *cur = raw_buf + y * width;
+		// mirror the second and second last line at the borders
+		const uint8_t *prev = y > 0 ? cur - width : cur + width;
+		const uint8_t *next = y < height - 1 ? cur + width : cur - width;
+		uint8_t *dst = proc_buf + 3 * y * width;
+		int yOdd = y & 1;
+
+		bayer_pixel(prev, cur, next, dst, 0, width, yOdd);
+		bayer_pixel(prev, cur, next, dst, 1, width, yOdd);
+		for (x = line(prev, cur, next, dst, 2, width, yOdd); x < width; ++x)
+			bayer_pixel(prev, cur, next, dst, x, width, yOdd);
+	}
+}
+
+#ifdef FN_SIMD_X86
+
+// floor((a + b) / 2); pavgb rounds up, so correct by the dropped bit
+FN_TARGET("ssse3")
+static inline __m128i avg_epu8_ssse3(__m128i a, __m128i b)
+{
+	return _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), _mm_set1_epi8(1)));
+}
+
+// even lanes from e, odd lanes from o
+FN_TARGET("ssse3")
+static inline __m128i blend_odd_ssse3(__m128i e, __m128i o)
+{
+	const __m128i odd = _mm_set1_epi16((short)0xff00);
+	return _mm_or_si128(_mm_andnot_si128(odd, e), _mm_and_si128(odd, o));
+}
+
+// interleave 16 r, g and b values into 48 bytes of RGB
+FN_TARGET("ssse3")
+static inline void store_rgb_ssse3(uint8_t *dst, __m128i r, __m128i g, __m128i b)
+{
+	const __m128i r0 = _mm_setr_epi8(0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1, 5);
+	const __m128i g0 = _mm_setr_epi8(-1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1);
+	const __m128i b0 = _mm_setr_epi8(-1, -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1);
+	const __m128i r1 = _mm_setr_epi8(-1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10, -1);
+	const __m128i g1 = _mm_setr_epi8(5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10);
+	const __m128i b1 = _mm_setr_epi8(-1, 5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1);
+	const __m128i r2 = _mm_setr_epi8(-1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1, -1);
+	const __m128i g2 = _mm_setr_epi8(-1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1);
+	const __m128i b2 = _mm_setr_epi8(10, -1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15);
+	_mm_storeu_si128((__m128i *)dst, _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(r, r0), _mm_shuffle_epi8(g, g0)), _mm_shuffle_epi8(b, b0)));
+	_mm_storeu_si128((__m128i *)(dst + 16), _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(r, r1), _mm_shuffle_epi8(g, g1)), _mm_shuffle_epi8(b, b1)));
+	_mm_storeu_si128((__m128i *)(dst + 32), _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(r, r2), _mm_shuffle_epi8(g, g2)), _mm_shuffle_epi8(b, b2)));
+}
+
+FN_TARGET("ssse3")
+static int bayer_line_ssse3(const uint8_t *prev, const uint8_t *cur, const uint8_t *next,
+                            uint8_t *dst, int x, int width, int yOdd)
+{
+	for (; x + 17 <= width; x += 16) {
+		__m128i c = _mm_loadu_si128((const __m128i *)(cur + x));
+		__m128i h = avg_epu8_ssse3(_mm_loadu_si128((const __m128i *)(cur + x - 1)), _mm_loadu_si128((const __m128i *)(cur + x + 1)));
+		__m128i vm = avg_epu8_ssse3(_mm_loadu_si128((const __m128i *)(prev + x - 1)), _mm_loadu_si128((const __m128i *)(next + x - 1)));
+		__m128i v = avg_epu8_ssse3(_mm_loadu_si128((const __m128i *)(prev + x)), _mm_loadu_si128((const __m128i *)(next + x)));
+		__m128i vp = avg_epu8_ssse3(_mm_loadu_si128((const __m128i *)(prev + x + 1)), _mm_loadu_si128((const __m128i *)(next + x + 1)));
+		__m128i vv = avg_epu8_ssse3(vm, vp);
+		__m128i g4 = avg_epu8_ssse3(h, v);
+		if (!yOdd)
+			store_rgb_ssse3(dst + 3 * x, blend_odd_ssse3(h, c), blend_odd_ssse3(c, g4), blend_odd_ssse3(v, vv));
+		else
+			store_rgb_ssse3(dst + 3 * x, blend_odd_ssse3(vv, v), blend_odd_ssse3(g4, c), blend_odd_ssse3(c, h));
+	}
+	return x;
+}
+
+FN_TARGET("avx2")
+static inline __m256i avg_epu8_avx2(__m256i a, __m256i b)
+{
+	return _mm256_sub_epi8(_mm256_avg_epu8(a, b), _mm256_and_si256(_mm256_xor_si256(a, b), _mm256_set1_epi8(1)));
+}
+
+FN_TARGET("avx2")
+static inline __m256i blend_odd_avx2(__m256i e, __m256i o)
+{
+	const __m256i odd = _mm256_set1_epi16((short)0xff00);
+	return _mm256_or_si256(_mm256_andnot_si256(odd, e), _mm256_and_si256(odd, o));
+}
+
+FN_TARGET("avx2")
+static inline void store_rgb_avx2(uint8_t *dst, __m256i r, __m256i g, __m256i b)
+{
+	store_rgb_ssse3(dst, _mm256_castsi256_si128(r), _mm256_castsi256_si128(g), _mm256_castsi256_si128(b));
+	store_rgb_ssse3(dst + 48, _mm256_extracti128_si256(r, 1), _mm256_extracti128_si256(g, 1), _mm256_extracti128_si256(b, 1));
+}
+
+FN_TARGET("avx2")
+static int bayer_line_avx2(const uint8_t *prev, const uint8_t *cur, const uint8_t *next,
+                           uint8_t *dst, int x, int width, int yOdd)
+{
+	for (; x + 33 <= width; x += 32) {
+		__m256i c = _mm256_loadu_si256((const __m256i *)(cur + x));
+		__m256i h = avg_epu8_avx2(_mm256_loadu_si256((const __m256i *)(cur + x - 1)), _mm256_loadu_si256((const __m256i *)(cur + x + 1)));
+		__m256i vm = avg_epu8_avx2(_mm256_loadu_si256((const __m256i *)(prev + x - 1)), _mm256_loadu_si256((const __m256i *)(next + x - 1)));
+		__m256i v = avg_epu8_avx2(_mm256_loadu_si256((const __m256i *)(prev + x)), _mm256_loadu_si256((const __m256i *)(next + x)));
+		__m256i vp = avg_epu8_avx2(_mm256_loadu_si256((const __m256i *)(prev + x + 1)), _mm256_loadu_si256((const __m256i *)(next + x + 1)));
+		__m256i vv = avg_epu8_avx2(vm, vp);
+		__m256i g4 = avg_epu8_avx2(h, v);
+		if (!yOdd)
+			store_rgb_avx2(dst + 3 * x, blend_odd_avx2(h, c), blend_odd_avx2(c, g4), blend_odd_avx2(v, vv));
+		else
+			store_rgb_avx2(dst + 3 * x, blend_odd_avx2(vv, v), blend_odd_avx2(g4, c), blend_odd_avx2(c, h));
+	}
+	return bayer_line_ssse3(prev, cur, next, dst, x, width, yOdd);
+}
+
+#endif // FN_SIMD_X86
+
+#ifdef FN_SIMD_NEON
+
+static int bayer_line_neon(const uint8_t *prev, const uint8_t *cur, const uint8_t *next,
+                           uint8_t *dst, int x, int width, int yOdd)
+{
+	// vhaddq_u8 is the truncating average, vbslq_u8 picks odd lanes from o
+	const uint8x16_t odd = vreinterpretq_u8_u16(vdupq_n_u16(0xff00));
+	for (; x + 17 <= width; x += 16) {
+		uint8x16_t c = vld1q_u8(cur + x);
+		uint8x16_t h = vhaddq_u8(vld1q_u8(cur + x - 1), vld1q_u8(cur + x + 1));
+		uint8x16_t vm = vhaddq_u8(vld1q_u8(prev + x - 1), vld1q_u8(next + x - 1));
+		uint8x16_t v = vhaddq_u8(vld1q_u8(prev + x), vld1q_u8(next + x));
+		uint8x16_t vp = vhaddq_u8(vld1q_u8(prev + x + 1), vld1q_u8(next + x + 1));
+		uint8x16_t vv = vhaddq_u8(vm, vp);
+		uint8x16_t g4 = vhaddq_u8(h, v);
+		uint8x16x3_t rgb;
+		if (!yOdd) {
+			rgb.val[0] = vbslq_u8(odd, c, h);
+			rgb.val[1] = vbslq_u8(odd, g4, c);
+			rgb.val[2] = vbslq_u8(odd, vv, v);
+		} else {
+			rgb.val[0] = vbslq_u8(odd, v, vv);
+			rgb.val[1] = vbslq_u8(odd, c, g4);
+			rgb.val[2] = vbslq_u8(odd, h, c);
+		}
+		vst3q_u8(dst + 3 * x, rgb);
+	}
+	return x;
+}
+
+#endif // FN_SIMD_NEON
+
+FN_INTERNAL void freenect_convert_bayer_to_rgb(const uint8_t *raw_buf, uint8_t *proc_buf, int width, int height)
+{
+	switch (get_simd_level()) {
+#ifdef FN_SIMD_X86
+		case SIMD_AVX2:
+			convert_bayer_to_rgb_lines(raw_buf, proc_buf, width, height, bayer_line_avx2);
+			break;
+		case SIMD_SSSE3:
+			convert_bayer_to_rgb_lines(raw_buf, proc_buf, width, height, bayer_line_ssse3);
+			break;
+#endif
+#ifdef FN_SIMD_NEON
+		case SIMD_NEON:
+			convert_bayer_to_rgb_lines(raw_buf, proc_buf, width, height, bayer_line_neon);
+			break;
+#endif
+		default:
+			convert_bayer_to_rgb_c(raw_buf, proc_buf, width, height);
+			break;
+	}
+}
+
+/*
+ * UYVY to RGB
+ *
+ * The reference conversion, for each pixel of a u y1 v y2 pair, is
+ *
+ *   r = (y-16)*1164/1000 + (v-128)*1596/1000
+ *   g = (y-16)*1164/1000 - (v-128)*813/1000 - (u-128)*391/1000
+ *   b = (y-16)*1164/1000 + (u-128)*2018/1000
+ *
+ * with C (truncating) division per term and each channel clamped to 0..255.
+ * Implementations must stay within +-1 of it per channel.
+ *
+ * Instead of dividing, each term x*k/1000 is computed in fixed point as
+ * +-((|x| << a) * m >> 16), with a and m chosen so that this equals the
+ * truncated quotient for every x the term can see. With the constants below
+ * the result happens to match the reference exactly, but only the +-1 bound
+ * is promised, so other constants or rounding may be used. The SIMD versions
+ * use a 16-bit multiply-high for it and saturate to 0..255 when packing to
+ * bytes.
+ */
+
+#define YUV_Y_1164  1, 38140 // |x| <= 239
+#define YUV_V_1596  1, 52297 // |x| <= 128 from here on
+#define YUV_V_813   0, 53248
+#define YUV_U_391   0, 25619
+#define YUV_U_2018  2, 33061
+
+static inline int scale_1000(int x, int a, uint32_t m)
+{
+	int t = (int)((((uint32_t)(x < 0 ? -x : x) << a) * m) >> 16);
+	return x < 0 ? -t : t;
+}
+
+static inline uint8_t clamp_u8(int x)
+{
+	return x < 0 ? 0 : x > 255 ? 255 : x;
+}
+
+static void convert_uyvy_to_rgb_c(const uint8_t *raw_buf, uint8_t *proc_buf, int n)
+{
+	for (; n >= 2; n -= 2, raw_buf += 4, proc_buf += 6) {
+		int u  = raw_buf[0] - 128;
+		int y1 = scale_1000(raw_buf[1] - 16, YUV_Y_1164);
+		int v  = raw_buf[2] - 128;
+		int y2 = scale_1000(raw_buf[3] - 16, YUV_Y_1164);
+		int r = scale_1000(v, YUV_V_1596);
+		int g = -scale_1000(v, YUV_V_813) - scale_1000(u, YUV_U_391);
+		int b = scale_1000(u, YUV_U_2018);
+		proc_buf[0] = clamp_u8(y1 + r);
+		proc_buf[1] = clamp_u8(y1 + g);
+		proc_buf[2] = clamp_u8(y1 + b);
+		proc_buf[3] = clamp_u8(y2 + r);
+		proc_buf[4] = clamp_u8(y2 + g);
+		proc_buf[5] = clamp_u8(y2 + b);
+	}
+}
+
+#ifdef FN_SIMD_X86
+
+FN_TARGET("ssse3")
+static inline __m128i scale_1000_ssse3(__m128i x, int a, int m)
+{
+	__m128i t = _mm_mulhi_epu16(_mm_slli_epi16(_mm_abs_epi16(x), a), _mm_set1_epi16((short)m));
+	__m128i sign = _mm_srai_epi16(x, 15);
+	return _mm_sub_epi16(_mm_xor_si128(t, sign), sign);
+}
+
+// r, g and b (unclamped, 16-bit) of the 8 pixels in 16 bytes of UYVY
+FN_TARGET("ssse3")
+static inline void uyvy_ssse3(__m128i p, __m128i *r, __m128i *g, __m128i *b)
+{
+	__m128i y = _mm_sub_epi16(_mm_srli_epi16(p, 8), _mm_set1_epi16(16));
+	__m128i uv = _mm_sub_epi16(_mm_and_si128(p, _mm_set1_epi16(0xff)), _mm_set1_epi16(128));
+	__m128i u = _mm_shufflehi_epi16(_mm_shufflelo_epi16(uv, _MM_SHUFFLE(2, 2, 0, 0)), _MM_SHUFFLE(2, 2, 0, 0));
+	__m128i v = _mm_shufflehi_epi16(_mm_shufflelo_epi16(uv, _MM_SHUFFLE(3, 3, 1, 1)), _MM_SHUFFLE(3, 3, 1, 1));
+	y = scale_1000_ssse3(y, YUV_Y_1164);
+	*r = _mm_add_epi16(y, scale_1000_ssse3(v, YUV_V_1596));
+	*g = _mm_sub_epi16(_mm_sub_epi16(y, scale_1000_ssse3(v, YUV_V_813)), scale_1000_ssse3(u, YUV_U_391));
+	*b = _mm_add_epi16(y, scale_1000_ssse3(u, YUV_U_2018));
+}
+
+FN_TARGET("ssse3")
+static void convert_uyvy_to_rgb_ssse3(const uint8_t *raw_buf, uint8_t *proc_buf, int n)
+{
+	for (; n >= 16; n -= 16, raw_buf += 32, proc_buf += 48) {
+		__m128i r0, g0, b0, r1, g1, b1;
+		uyvy_ssse3(_mm_loadu_si128((const __m128i *)raw_buf), &r0, &g0, &b0);
+		uyvy_ssse3(_mm_loadu_si128((const __m128i *)(raw_buf + 16)), &r1, &g1, &b1);
+		store_rgb_ssse3(proc_buf, _mm_packus_epi16(r0, r1), _mm_packus_epi16(g0, g1), _mm_packus_epi16(b0, b1));
+	}
+	convert_uyvy_to_rgb_c(raw_buf, proc_buf, n);
+}
+
+FN_TARGET("avx2")
+static inline __m256i scale_1000_avx2(__m256i x, int a, int m)
+{
+	__m256i t = _mm256_mulhi_epu16(_mm256_slli_epi16(_mm256_abs_epi16(x), a), _mm256_set1_epi16((short)m));
+	__m256i sign = _mm256_srai_epi16(x, 15);
+	return _mm256_sub_epi16(_mm256_xor_si256(t, sign), sign);
+}
+
+FN_TARGET("avx2")
+static inline void uyvy_avx2(__m256i p, __m256i *r, __m256i *g, __m256i *b)
+{
+	__m256i y = _mm256_sub_epi16(_mm256_srli_epi16(p, 8), _mm256_set1_epi16(16));
+	__m256i uv = _mm256_sub_epi16(_mm256_and_si256(p, _mm256_set1_epi16(0xff)), _mm256_set1_epi16(128));
+	__m256i u = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(uv, _MM_SHUFFLE(2, 2, 0, 0)), _MM_SHUFFLE(2, 2, 0, 0));
+	__m256i v = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(uv, _MM_SHUFFLE(3, 3, 1, 1)), _MM_SHUFFLE(3, 3, 1, 1));
+	y = scale_1000_avx2(y, YUV_Y_1164);
+	*r = _mm256_add_epi16(y, scale_1000_avx2(v, YUV_V_1596));
+	*g = _mm256_sub_epi16(_mm256_sub_epi16(y, scale_1000_avx2(v, YUV_V_813)), scale_1000_avx2(u, YUV_U_391));
+	*b = _mm256_add_epi16(y, scale_1000_avx2(u, YUV_U_2018));
+}
+
+// packus works per 128-bit lane; reorder so the 32 bytes are in pixel order
+FN_TARGET("avx2")
+static inline __m256i packus_ordered_avx2(__m256i a, __m256i b)
+{
+	return _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), _MM_SHUFFLE(3, 1, 2, 0));
+}
+
+FN_TARGET("avx2")
+static void convert_uyvy_to_rgb_avx2(const uint8_t *raw_buf, uint8_t *proc_buf, int n)
+{
+	for (; n >= 32; n -= 32, raw_buf += 64, proc_buf += 96) {
+		__m256i r0, g0, b0, r1, g1, b1;
+		uyvy_avx2(_mm256_loadu_si256((const __m256i *)raw_buf), &r0, &g0, &b0);
+		uyvy_avx2(_mm256_loadu_si256((const __m256i *)(raw_buf + 32)), &r1, &g1, &b1);
+		store_rgb_avx2(proc_buf, packus_ordered_avx2(r0, r1), packus_ordered_avx2(g0, g1), packus_ordered_avx2(b0, b1));
+	}
+	convert_uyvy_to_rgb_ssse3(raw_buf, proc_buf, n);
+}
+
+#endif // FN_SIMD_X86
+
+#ifdef FN_SIMD_NEON
+
+static inline int16x8_t scale_1000_neon(int16x8_t x, int a, uint16_t m)
+{
+	uint16x8_t ax = vshlq_u16(vreinterpretq_u16_s16(vabsq_s16(x)), vdupq_n_s16(a));
+	uint16x4_t vm = vdup_n_u16(m);
+	uint16x8_t t = vcombine_u16(vshrn_n_u32(vmull_u16(vget_low_u16(ax), vm), 16),
+	                            vshrn_n_u32(vmull_u16(vget_high_u16(ax), vm), 16));
+	int16x8_t sign = vshrq_n_s16(x, 15);
+	return vsubq_s16(veorq_s16(vreinterpretq_s16_u16(t), sign), sign);
+}
+
+static inline int16x8_t widen_neon(uint8x8_t x, int16_t offset)
+{
+	return vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(x)), vdupq_n_s16(offset));
+}
+
+// interleave the even (y1) and odd (y2) pixels of 8 pairs
+static inline uint8x16_t zip_neon(int16x8_t c1, int16x8_t c2)
+{
+	uint8x8x2_t z = vzip_u8(vqmovun_s16(c1), vqmovun_s16(c2));
+	return vcombine_u8(z.val[0], z.val[1]);
+}
+
+static void convert_uyvy_to_rgb_neon(const uint8_t *raw_buf, uint8_t *proc_buf, int n)
+{
+	for (; n >= 16; n -= 16, raw_buf += 32, proc_buf += 48) {
+		uint8x8x4_t p = vld4_u8(raw_buf); // u, y1, v, y2 of 8 pairs
+		int16x8_t u = widen_neon(p.val[0], 128);
+		int16x8_t y1 = scale_1000_neon(widen_neon(p.val[1], 16), YUV_Y_1164);
+		int16x8_t v = widen_neon(p.val[2], 128);
+		int16x8_t y2 = scale_1000_neon(widen_neon(p.val[3], 16), YUV_Y_1164);
+		int16x8_t r = scale_1000_neon(v, YUV_V_1596);
+		int16x8_t g = vnegq_s16(vaddq_s16(scale_1000_neon(v, YUV_V_813), scale_1000_neon(u, YUV_U_391)));
+		int16x8_t b = scale_1000_neon(u, YUV_U_2018);
+		uint8x16x3_t rgb;
+		rgb.val[0] = zip_neon(vaddq_s16(y1, r), vaddq_s16(y2, r));
+		rgb.val[1] = zip_neon(vaddq_s16(y1, g), vaddq_s16(y2, g));
+		rgb.val[2] = zip_neon(vaddq_s16(y1, b), vaddq_s16(y2, b));
+		vst3q_u8(proc_buf, rgb);
+	}
+	convert_uyvy_to_rgb_c(raw_buf, proc_buf, n);
+}
+
+#endif // FN_SIMD_NEON
+
+FN_INTERNAL void freenect_convert_uyvy_to_rgb(const uint8_t *raw_buf, uint8_t *proc_buf, int width, int height)
+{
+	switch (get_simd_level()) {
+#ifdef FN_SIMD_X86
+		case SIMD_AVX2:
+			convert_uyvy_to_rgb_avx2(raw_buf, proc_buf, width * height);
+			break;
+		case SIMD_SSSE3:
+			convert_uyvy_to_rgb_ssse3(raw_buf, proc_buf, width * height);
+			break;
+#endif
+#ifdef FN_SIMD_NEON
+		case SIMD_NEON:
+			convert_uyvy_to_rgb_neon(raw_buf, proc_buf, width * height);
+			break;
+#endif
+		default:
+			convert_uyvy_to_rgb_c(raw_buf, proc_buf, width * height);
+			break;
+	}
+}
+
+/*
+ * Camera <-> world projection
+ *
+ * camera_to_world: sz = scale * z, wx = (cx - center_x) * sz, and the same
+ * for y. world_to_camera: inv = 1 / (scale * z), cx = wx * inv + center_x.
+ * The SIMD versions do the same float operations in the same order as the
+ * C ones, four points at a time.
+ */
+
+static inline void camera_to_world_point(const freenect_projection *p, float u, float v, float z, float *wx, float *wy, uint8_t *valid)
+{
+	float sz = z > 0 ? p->scale * z : 0;
+	*wx = (u - p->center_x) * sz;
+	*wy = (v - p->center_y) * sz;
+	if (valid)
+		*valid = z > 0;
+}
+
+static inline void world_to_camera_point(const freenect_projection *p, float x, float y, float z, float *cx, float *cy, uint8_t *valid)
+{
+	float u = 0, v = 0;
+	if (z > 0) {
+		float inv = 1.0f / (p->scale * z);
+		u = x * inv + p->center_x;
+		v = y * inv + p->center_y;
+	}
+	*cx = u;
+	*cy = v;
+	if (valid)
+		*valid = z > 0 && u >= 0 && u <= p->max_x && v >= 0 && v <= p->max_y;
+}
+
+static void camera_to_world_c(const freenect_projection *p, int n, const float *cx, const float *cy, const float *wz, float *wx, float *wy, uint8_t *valid)
+{
+	int i;
+	for (i = 0; i < n; i++)
+		camera_to_world_point(p, cx[i], cy[i], wz[i], &wx[i], &wy[i], valid ? &valid[i] : NULL);
+}
+
+static void camera_to_world_s16_c(const freenect_projection *p, int n, const int16_t *cx, const int16_t *cy, const int16_t *wz, float *wx, float *wy, uint8_t *valid)
+{
+	int i;
+	for (i = 0; i < n; i++)
+		camera_to_world_point(p, cx[i], cy[i], wz[i], &wx[i], &wy[i], valid ? &valid[i] : NULL);
+}
+
+static void world_to_camera_c(const freenect_projection *p, int n, const float *wx, const float *wy, const float *wz, float *cx, float *cy, uint8_t *valid)
+{
+	int i;
+	for (i = 0; i < n; i++)
+		world_to_camera_point(p, wx[i], wy[i], wz[i], &cx[i], &cy[i], valid ? &valid[i] : NULL);
+}
+
+static void world_to_camera_s16_c(const freenect_projection *p, int n, const int16_t *wx, const int16_t *wy, const int16_t *wz, float *cx, float *cy, uint8_t *valid)
+{
+	int i;
+	for (i = 0; i < n; i++)
+		world_to_camera_point(p, wx[i], wy[i], wz[i], &cx[i], &cy[i], valid ? &valid[i] : NULL);
+}
+
+#ifdef FN_SIMD_X86
+
+FN_TARGET("sse2")
+static inline void store_valid_sse2(uint8_t *valid, __m128 mask)
+{
+	__m128i m = _mm_castps_si128(mask);
+	m = _mm_packs_epi32(m, m);
+	m = _mm_packs_epi16(m, m);
+	m = _mm_and_si128(m, _mm_set1_epi8(1));
+	int bytes = _mm_cvtsi128_si32(m);
+	memcpy(valid, &bytes, 4);
+}
+
+FN_TARGET("sse2")
+static inline void camera_to_world_sse2_4(const freenect_projection *p, __m128 u, __m128 v, __m128 z, float *wx, float *wy, uint8_t *valid)
+{
+	__m128 positive = _mm_cmpgt_ps(z, _mm_setzero_ps());
+	__m128 sz = _mm_and_ps(_mm_mul_ps(_mm_set1_ps(p->scale), z), positive);
+	_mm_storeu_ps(wx, _mm_mul_ps(_mm_sub_ps(u, _mm_set1_ps(p->center_x)), sz));
+	_mm_storeu_ps(wy, _mm_mul_ps(_mm_sub_ps(v, _mm_set1_ps(p->center_y)), sz));
+	if (valid)
+		store_valid_sse2(valid, positive);
+}
+
+FN_TARGET("sse2")
+static inline void world_to_camera_sse2_4(const freenect_projection *p, __m128 x, __m128 y, __m128 z, float *cx, float *cy, uint8_t *valid)
+{
+	const __m128 zero = _mm_setzero_ps();
+	__m128 positive = _mm_cmpgt_ps(z, zero);
+	__m128 inv = _mm_div_ps(_mm_set1_ps(1.0f), _mm_mul_ps(_mm_set1_ps(p->scale), z));
+	__m128 u = _mm_and_ps(_mm_add_ps(_mm_mul_ps(x, inv), _mm_set1_ps(p->center_x)), positive);
+	__m128 v = _mm_and_ps(_mm_add_ps(_mm_mul_ps(y, inv), _mm_set1_ps(p->center_y)), positive);
+	_mm_storeu_ps(cx, u);
+	_mm_storeu_ps(cy, v);
+	if (valid) {
+		__m128 inside = _mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmple_ps(u, _mm_set1_ps(p->max_x)));
+		inside = _mm_and_ps(inside, _mm_and_ps(_mm_cmpge_ps(v, zero), _mm_cmple_ps(v, _mm_set1_ps(p->max_y))));
+		store_valid_sse2(valid, _mm_and_ps(positive, inside));
+	}
+}
+
+// sign-extend the low and high four int16 of s into floats
+FN_TARGET("sse2")
+static inline void s16_to_ps_sse2(const int16_t *src, __m128 *lo, __m128 *hi)
+{
+	__m128i s = _mm_loadu_si128((const __m128i*)src);
+	*lo = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16));
+	*hi = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16));
+}
+
+FN_TARGET("sse2")
+static void camera_to_world_sse2(const freenect_projection *p, int n, const float *cx, const float *cy, const float *wz, float *wx, float *wy, uint8_t *valid)
+{
+	int i;
+	for (i = 0; i + 4 <= n; i += 4)
+		camera_to_world_sse2_4(p, _mm_loadu_ps(cx + i), _mm_loadu_ps(cy + i), _mm_loadu_ps(wz + i), wx + i, wy + i, valid ? valid + i : NULL);
+	camera_to_world_c(p, n - i, cx + i, cy + i, wz + i, wx + i, wy + i, valid ? valid + i : NULL);
+}
+
+FN_TARGET("sse2")
+static void camera_to_world_s16_sse2(const freenect_projection *p, int n, const int16_t *cx, const int16_t *cy, const int16_t *wz, float *wx, float *wy, uint8_t *valid)
+{
+	int i;
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m128 u0, u1, v0, v1, z0, z1;
+		s16_to_ps_sse2(cx + i, &u0, &u1);
+		s16_to_ps_sse2(cy + i, &v0, &v1);
+		s16_to_ps_sse2(wz + i, &z0, &z1);
+		camera_to_world_sse2_4(p, u0, v0, z0, wx + i, wy + i, valid ? valid + i : NULL);
+		camera_to_world_sse2_4(p, u1, v1, z1, wx + i + 4, wy + i + 4, valid ? valid + i + 4 : NULL);
+	}
+	camera_to_world_s16_c(p, n - i, cx + i, cy + i, wz + i, wx + i, wy + i, valid ? valid + i : NULL);
+}
+
+FN_TARGET("sse2")
+static void world_to_camera_sse2(const freenect_projection *p, int n, const float *wx, const float *wy, const float *wz, float *cx, float *cy, uint8_t *valid)
+{
+	int i;
+	for (i = 0; i + 4 <= n; i += 4)
+		world_to_camera_sse2_4(p, _mm_loadu_ps(wx + i), _mm_loadu_ps(wy + i), _mm_loadu_ps(wz + i), cx + i, cy + i, valid ? valid + i : NULL);
+	world_to_camera_c(p, n - i, wx + i, wy + i, wz + i, cx + i, cy + i, valid ? valid + i : NULL);
+}
+
+FN_TARGET("sse2")
+static void world_to_camera_s16_sse2(const freenect_projection *p, int n, const int16_t *wx, const int16_t *wy, const int16_t *wz, float *cx, float *cy, uint8_t *valid)
+{
+	int i;
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m128 x0, x1, y0, y1, z0, z1;
+		s16_to_ps_sse2(wx + i, &x0, &x1);
+		s16_to_ps_sse2(wy + i, &y0, &y1);
+		s16_to_ps_sse2(wz + i, &z0, &z1);
+		world_to_camera_sse2_4(p, x0, y0, z0, cx + i, cy + i, valid ? valid + i : NULL);
+		world_to_camera_sse2_4(p, x1, y1, z1, cx + i + 4, cy + i + 4, valid ? valid + i + 4 : NULL);
+	}
+	world_to_camera_s16_c(p, n - i, wx + i, wy + i, wz + i, cx + i, cy + i, valid ? valid + i : NULL);
+}
+
+#endif // FN_SIMD_X86
+
+#ifdef FN_SIMD_NEON
+
+static inline void store_valid_neon(uint8_t *valid, uint32x4_t mask)
+{
+	uint16x4_t m16 = vmovn_u32(mask);
+	uint8x8_t m8 = vand_u8(vmovn_u16(vcombine_u16(m16, m16)), vdup_n_u8(1));
+	vst1_lane_u32((uint32_t*)(void*)valid, vreinterpret_u32_u8(m8), 0);
+}
+
+static inline void camera_to_world_neon_4(const freenect_projection *p, float32x4_t u, float32x4_t v, float32x4_t z, float *wx, float *wy, uint8_t *valid)
+{
+	uint32x4_t positive = vcgtq_f32(z, vdupq_n_f32(0));
+	float32x4_t sz = vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(vmulq_n_f32(z, p->scale)), positive));
+	vst1q_f32(wx, vmulq_f32(vsubq_f32(u, vdupq_n_f32(p->center_x)), sz));
+	vst1q_f32(wy, vmulq_f32(vsubq_f32(v, vdupq_n_f32(p->center_y)), sz));
+	if (valid)
+		store_valid_neon(valid, positive);
+}
+
+static inline void world_to_camera_neon_4(const freenect_projection *p, float32x4_t x, float32x4_t y, float32x4_t z, float *cx, float *cy, uint8_t *valid)
+{
+	const float32x4_t zero = vdupq_n_f32(0);
+	uint32x4_t positive = vcgtq_f32(z, zero);
+	float32x4_t inv = vdivq_f32(vdupq_n_f32(1.0f), vmulq_n_f32(z, p->scale));
+	float32x4_t u = vaddq_f32(vmulq_f32(x, inv), vdupq_n_f32(p->center_x));
+	float32x4_t v = vaddq_f32(vmulq_f32(y, inv), vdupq_n_f32(p->center_y));
+	u = vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(u), positive));
+	v = vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(v), positive));
+	vst1q_f32(cx, u);
+	vst1q_f32(cy, v);
+	if (valid) {
+		uint32x4_t inside = vandq_u32(vcgeq_f32(u, zero), vcleq_f32(u, vdupq_n_f32(p->max_x)));
+		inside = vandq_u32(inside, vandq_u32(vcgeq_f32(v, zero), vcleq_f32(v, vdupq_n_f32(p->max_y))));
+		store_valid_neon(valid, vandq_u32(positive, inside));
+	}
+}
+
+static void camera_to_world_neon(const freenect_projection *p, int n, const float *cx, const float *cy, const float *wz, float *wx, float *wy, uint8_t *valid)
+{
+	int i;
+	for (i = 0; i + 4 <= n; i += 4)
+		camera_to_world_neon_4(p, vld1q_f32(cx + i), vld1q_f32(cy + i), vld1q_f32(wz + i), wx + i, wy + i, valid ? valid + i : NULL);
+	camera_to_world_c(p, n - i, cx + i, cy + i, wz + i, wx + i, wy + i, valid ? valid + i : NULL);
+}
+
+static void camera_to_world_s16_neon(const freenect_projection *p, int n, const int16_t *cx, const int16_t *cy, const int16_t *wz, float *wx, float *wy, uint8_t *valid)
+{
+	int i;
+	for (i = 0; i + 4 <= n; i += 4) {
+		float32x4_t u = vcvtq_f32_s32(vmovl_s16(vld1_s16(cx + i)));
+		float32x4_t v = vcvtq_f32_s32(vmovl_s16(vld1_s16(cy + i)));
+		float32x4_t z = vcvtq_f32_s32(vmovl_s16(vld1_s16(wz + i)));
+		camera_to_world_neon_4(p, u, v, z, wx + i, wy + i, valid ? valid + i : NULL);
+	}
+	camera_to_world_s16_c(p, n - i, cx + i, cy + i, wz + i, wx + i, wy + i, valid ? valid + i : NULL);
+}
+
+static void world_to_camera_neon(const freenect_projection *p, int n, const float *wx, const float *wy, const float *wz, float *cx, float *cy, uint8_t *valid)
+{
+	int i;
+	for (i = 0; i + 4 <= n; i += 4)
+		world_to_camera_neon_4(p, vld1q_f32(wx + i), vld1q_f32(wy + i), vld1q_f32(wz + i), cx + i, cy + i, valid ? valid + i : NULL);
+	world_to_camera_c(p, n - i, wx + i, wy + i, wz + i, cx + i, cy + i, valid ? valid + i : NULL);
+}
+
+static void world_to_camera_s16_neon(const freenect_projection *p, int n, const int16_t *wx, const int16_t *wy, const int16_t *wz, float *cx, float *cy, uint8_t *valid)
+{
+	int i;
+	for (i = 0; i + 4 <= n; i += 4) {
+		float32x4_t x = vcvtq_f32_s32(vmovl_s16(vld1_s16(wx + i)));
+		float32x4_t y = vcvtq_f32_s32(vmovl_s16(vld1_s16(wy + i)));
+		float32x4_t z = vcvtq_f32_s32(vmovl_s16(vld1_s16(wz + i)));
+		world_to_camera_neon_4(p, x, y, z, cx + i, cy + i, valid ? valid + i : NULL);
+	}
+	world_to_camera_s16_c(p, n - i, wx + i, wy + i, wz + i, cx + i, cy + i, valid ? valid + i : NULL);
+}
+
+#endif // FN_SIMD_NEON
+
+// The loops are bound by memory bandwidth, so all x86 levels use the SSE2
+// versions.
+FN_INTERNAL void freenect_convert_camera_to_world(const freenect_projection *p, int n, const float *cx, const float *cy, const float *wz, float *wx, float *wy, uint8_t *valid)
+{
+	switch (get_simd_level()) {
+#ifdef FN_SIMD_X86
+		case SIMD_AVX2:
+		case SIMD_SSSE3:
+		case SIMD_SSE2:
+			camera_to_world_sse2(p, n, cx, cy, wz, wx, wy, valid);
+			break;
+#endif
+#ifdef FN_SIMD_NEON
+		case SIMD_NEON:
+			camera_to_world_neon(p, n, cx, cy, wz, wx, wy, valid);
+			break;
+#endif
+		default:
+			camera_to_world_c(p, n, cx, cy, wz, wx, wy, valid);
+			break;
+	}
+}
+
+FN_INTERNAL void freenect_convert_camera_to_world_s16(const freenect_projection *p, int n, const int16_t *cx, const int16_t *cy, const int16_t *wz, float *wx, float *wy, uint8_t *valid)
+{
+	switch (get_simd_level()) {
+#ifdef FN_SIMD_X86
+		case SIMD_AVX2:
+		case SIMD_SSSE3:
+		case SIMD_SSE2:
+			camera_to_world_s16_sse2(p, n, cx, cy, wz, wx, wy, valid);
+			break;
+#endif
+#ifdef FN_SIMD_NEON
+		case SIMD_NEON:
+			camera_to_world_s16_neon(p, n, cx, cy, wz, wx, wy, valid);
+			break;
+#endif
+		default:
+			camera_to_world_s16_c(p, n, cx, cy, wz, wx, wy, valid);
+			break;
+	}
+}
+
+FN_INTERNAL void freenect_convert_world_to_camera(const freenect_projection *p, int n, const float *wx, const float *wy, const float *wz, float *cx, float *cy, uint8_t *valid)
+{
+	switch (get_simd_level()) {
+#ifdef FN_SIMD_X86
+		case SIMD_AVX2:
+		case SIMD_SSSE3:
+		case SIMD_SSE2:
+			world_to_camera_sse2(p, n, wx, wy, wz, cx, cy, valid);
+			break;
+#endif
+#ifdef FN_SIMD_NEON
+		case SIMD_NEON:
+			world_to_camera_neon(p, n, wx, wy, wz, cx, cy, valid);
+			break;
+#endif
+		default:
+			world_to_camera_c(p, n, wx, wy, wz, cx, cy, valid);
+			break;
+	}
+}
+
+FN_INTERNAL void freenect_convert_world_to_camera_s16(const freenect_projection *p, int n, const int16_t *wx, const int16_t *wy, const int16_t *wz, float *cx, float *cy, uint8_t *valid)
+{
+	switch (get_simd_level()) {
+#ifdef FN_SIMD_X86
+		case SIMD_AVX2:
+		case SIMD_SSSE3:
+		case SIMD_SSE2:
+			world_to_camera_s16_sse2(p, n, wx, wy, wz, cx, cy, valid);
+			break;
+#endif
+#ifdef FN_SIMD_NEON
+		case SIMD_NEON:
+			world_to_camera_s16_neon(p, n, wx, wy, wz, cx, cy, valid);
+			break;
+#endif
+		default:
+			world_to_camera_s16_c(p, n, wx, wy, wz, cx, cy, valid);
+			break;
+	}
+}
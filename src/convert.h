@@ -0,0 +1,91 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2010 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+#ifndef CONVERT_H
+#define CONVERT_H
+
+#include <stdint.h>
+
+// Pixel format converters shared by cameras.c and registration.c.
+//
+// Each converter has a plain C implementation and, where the compiler and
+// CPU allow it, SIMD variants (SSE2/SSSE3/AVX2 on x86, NEON on ARM). The
+// fastest variant supported by the running CPU is picked the first time a
+// converter is called. All variants produce bit-identical output, except
+// that freenect_convert_uyvy_to_rgb() only promises a tolerance (below).
+//
+// Setting the LIBFREENECT_SIMD environment variable to "none", "sse2",
+// "ssse3" or "avx2" caps the instruction set used, which is handy for
+// comparing against the plain C path.
+
+// Unpack n 11-bit big-endian packed values into 16-bit values.
+// n must be a multiple of 8; raw holds n * 11 / 8 bytes.
+void freenect_convert_packed11_to_16bit(const uint8_t *raw, uint16_t *frame, int n);
+
+// Unpack n 10-bit big-endian packed values into 16-bit values.
+// n must be a multiple of 4; raw holds n * 10 / 8 bytes.
+void freenect_convert_packed10_to_16bit(const uint8_t *raw, uint16_t *frame, int n);
+
+// Same as above, but keep only the 8 most significant bits of each value.
+void freenect_convert_packed10_to_8bit(const uint8_t *raw, uint8_t *frame, int n);
+
+// Demosaic a width x height Bayer frame (GRBG) into packed 24-bit RGB using
+// bilinear interpolation. width must be at least 2 and height at least 3.
+void freenect_convert_bayer_to_rgb(const uint8_t *raw_buf, uint8_t *proc_buf, int width, int height);
+
+// Convert a width x height UYVY frame into packed 24-bit RGB. Each channel is
+// within +-1 of the integer reference formula documented in convert.c;
+// tests/test_uyvy checks this for every u, y and v. width must be even.
+void freenect_convert_uyvy_to_rgb(const uint8_t *raw_buf, uint8_t *proc_buf, int width, int height);
+
+// Pinhole model of the depth camera: pixel (cx, cy) at depth z sees the
+// world point ((cx - center_x) * scale * z, (cy - center_y) * scale * z, z).
+typedef struct {
+	float center_x;
+	float center_y;
+	float scale;
+	float max_x; // largest column of the image
+	float max_y; // largest row of the image
+} freenect_projection;
+
+// Batch versions of the projection above, over n points stored as separate
+// arrays. Points with a depth <= 0 are written as 0 and flagged 0 in valid
+// (if not NULL); world_to_camera also flags points that land outside
+// [0, max_x] x [0, max_y], but writes their coordinates.
+void freenect_convert_camera_to_world(const freenect_projection *p, int n, const float *cx, const float *cy, const float *wz, float *wx, float *wy, uint8_t *valid);
+void freenect_convert_camera_to_world_s16(const freenect_projection *p, int n, const int16_t *cx, const int16_t *cy, const int16_t *wz, float *wx, float *wy, uint8_t *valid);
+void freenect_convert_world_to_camera(const freenect_projection *p, int n, const float *wx, const float *wy, const float *wz, float *cx, float *cy, uint8_t *valid);
+void freenect_convert_world_to_camera_s16(const freenect_projection *p, int n, const int16_t *wx, const int16_t *wy, const int16_t *wz, float *cx, float *cy, uint8_t *valid);
+
+// Name of the instruction set picked by the dispatcher ("c", "sse2", ...).
+const char *freenect_convert_simd_name(void);
+
+// Pick the instruction set again, capped by cap as LIBFREENECT_SIMD would
+// (NULL for the best one available), and return its name. Meant for tests
+// and benchmarks; no converter may be running meanwhile.
+const char *freenect_convert_set_simd(const char *cap);
+
+#endif
@@ -30,6 +30,13 @@
 #include <stdarg.h>
 
 #include <unistd.h>
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(__APPLE__)
+#include <mach/mach_time.h>
+#else
+#include <time.h>
+#endif
 
 #include "freenect_internal.h"
 #include "registration.h"
@@ -38,9 +45,13 @@
 #include "loader.h"
 #endif
 
+// how often a lost device is looked for, when no hotplug event comes first
+#define RECONNECT_INTERVAL_NS 500000000ull
+
 FREENECTAPI int freenect_init(freenect_context **ctx, freenect_usb_context *usb_ctx)
 {
 	int res;
+	const char *reconnect;
 
 	*ctx = (freenect_context*)malloc(sizeof(freenect_context));
 	if (!ctx)
@@ -58,7 +69,12 @@ FREENECTAPI int freenect_init(freenect_context **ctx, freenect_usb_context *usb_
 	if (res < 0) {
 		free(*ctx);
 		*ctx = NULL;
+		return res;
 	}
+	freenect_set_registration_cache_dir(*ctx, getenv("LIBFREENECT_REGISTRATION_CACHE"));
+	freenect_camera_iso_defaults(*ctx);
+	reconnect = getenv("LIBFREENECT_RECONNECT");
+	(*ctx)->reconnect = reconnect && atoi(reconnect) > 0;
 	return res;
 }
 
@@ -70,6 +86,7 @@ FREENECTAPI int freenect_shutdown(freenect_context *ctx)
 	}
 
 	fnusb_shutdown(&ctx->usb);
+	free(ctx->registration_cache_dir);
 	free(ctx);
 	return 0;
 }
@@ -82,20 +99,128 @@ FREENECTAPI int freenect_process_events(freenect_context *ctx)
 	return freenect_process_events_timeout(ctx, &timeout);
 }
 
-FREENECTAPI int freenect_process_events_timeout(freenect_context *ctx, struct timeval *timeout)
+// A camera of a device with auto-reconnect went away: stop its streams but
+// keep the device, and its dead handles, until it is back
+static void device_lost(freenect_context *ctx, freenect_device *dev)
+{
+	FN_WARNING("USB camera %s went away, stopping streams until it is back\n", dev->camera_serial);
+	freenect_camera_suspend(dev);
+#ifdef BUILD_AUDIO
+	freenect_stop_audio(dev);
+#endif
+	// queued commands fail now rather than go to the reopened camera
+	fn_cmd_queue_destroy(dev->cmd_queue);
+	dev->cmd_queue = NULL;
+
+	dev->lost = 1;
+	dev->lost_ns = fn_get_time_ns();
+	dev->reconnect_next_ns = dev->lost_ns + RECONNECT_INTERVAL_NS;
+	fn_atomic_add_u64(&dev->reconnect_stats.disconnects, 1);
+	if (dev->reconnect_cb)
+		dev->reconnect_cb(dev, FREENECT_RECONNECT_LOST);
+}
+
+// Reopen a lost device by its camera serial and restart its streams.
+// Returns 1 while no camera with that serial is plugged in.
+static int reopen_device(freenect_context *ctx, freenect_device *dev)
+{
+	struct freenect_device_attributes* attrlist;
+	struct freenect_device_attributes* item;
+	int index = 0;
+	int found = 0;
+	int res;
+
+	if (fnusb_list_device_attributes(&ctx->usb, &attrlist) < 0)
+		return 1;
+	for (item = attrlist; item != NULL; item = item->next, index++) {
+		if (strcmp(item->camera_serial, dev->camera_serial) == 0) {
+			found = 1;
+			break;
+		}
+	}
+	freenect_free_device_attributes(attrlist);
+	if (!found)
+		return 1;
+
+	fnusb_close_subdevices(dev);
+	dev->usb_cam.device_dead = 0;
+	dev->usb_motor.device_dead = 0;
+#ifdef BUILD_AUDIO
+	dev->usb_audio.device_dead = 0;
+#endif
+	res = fnusb_open_subdevices(dev, index);
+	if (res < 0)
+		return res;
+	if (!dev->usb_cam.dev)
+		return -1;
+	// no freenect_camera_init(): the modes and registration are the device's
+	// own, and the same camera has the same parameters
+	return freenect_camera_resume(dev);
+}
+
+static void reconnect_device(freenect_context *ctx, freenect_device *dev)
+{
+	int res = reopen_device(ctx, dev);
+
+	dev->reconnect_next_ns = fn_get_time_ns() + RECONNECT_INTERVAL_NS;
+	if (res > 0)
+		return;
+	if (res < 0) {
+		FN_WARNING("USB camera %s is back, but could not be reopened: %d\n", dev->camera_serial, res);
+		fn_atomic_add_u64(&dev->reconnect_stats.failed_attempts, 1);
+		if (dev->reconnect_cb)
+			dev->reconnect_cb(dev, FREENECT_RECONNECT_FAILED);
+		return;
+	}
+	FN_NOTICE("USB camera %s is back, streams restarted\n", dev->camera_serial);
+	dev->lost = 0;
+	fn_atomic_add_u64(&dev->reconnect_stats.downtime_ns, fn_get_time_ns() - dev->lost_ns);
+	fn_atomic_add_u64(&dev->reconnect_stats.reconnects, 1);
+	if (dev->reconnect_cb)
+		dev->reconnect_cb(dev, FREENECT_RECONNECT_RESTORED);
+}
+
+// earliest reconnect attempt due, 0 if no device is waiting for one
+static uint64_t next_reconnect(freenect_context *ctx)
 {
-	int res = fnusb_process_events_timeout(&ctx->usb, timeout);
+	uint64_t next = 0;
+	freenect_device *dev;
+
+	for (dev = ctx->first; dev; dev = dev->next) {
+		if (dev->lost && dev->reconnect && (!next || dev->reconnect_next_ns < next))
+			next = dev->reconnect_next_ns;
+	}
+	return next;
+}
+
+// bookkeeping of the devices after the USB events were handled
+static int process_devices(freenect_context *ctx, int res)
+{
+	// lost cameras may be back as soon as any camera is plugged in
+	int arrived = ctx->usb.arrivals != ctx->arrivals_seen;
+	uint64_t now = fn_get_time_ns();
+
+	ctx->arrivals_seen = ctx->usb.arrivals;
 	// Iterate over the devices in ctx.  If any of them are flagged as
 	freenect_device* dev = ctx->first;
 	while(dev) {
-		if (dev->usb_cam.device_dead) {
+		if (dev->lost) {
+			if (!dev->reconnect)
+				res = -1;
+			else if (arrived || now >= dev->reconnect_next_ns)
+				reconnect_device(ctx, dev);
+		} else if (dev->usb_cam.device_dead && dev->reconnect && dev->camera_serial[0]) {
+			device_lost(ctx, dev);
+		} else if (dev->usb_cam.device_dead) {
 			FN_ERROR("USB camera marked dead, stopping streams\n");
 			res = -1;
 			freenect_stop_video(dev);
 			freenect_stop_depth(dev);
+		} else {
+			freenect_camera_retune(dev);
 		}
 #ifdef BUILD_AUDIO
-		if (dev->usb_audio.device_dead) {
+		if (dev->usb_audio.device_dead && !dev->lost) {
 			FN_ERROR("USB audio marked dead, stopping streams\n");
 			res = -1; // Or something else to tell the user that the device just vanished.
 			freenect_stop_audio(dev);
@@ -106,6 +231,65 @@ FREENECTAPI int freenect_process_events_timeout(freenect_context *ctx, struct ti
 	return res;
 }
 
+// shorten a wait to end by the next reconnect attempt
+static void clamp_timeout(freenect_context *ctx, struct timeval *timeout)
+{
+	uint64_t next = next_reconnect(ctx);
+	uint64_t now = fn_get_time_ns();
+	uint64_t left;
+
+	if (!next)
+		return;
+	left = next > now ? next - now : 0;
+	if (left < (uint64_t)timeout->tv_sec * 1000000000ull + (uint64_t)timeout->tv_usec * 1000) {
+		timeout->tv_sec = (long)(left / 1000000000);
+		timeout->tv_usec = (long)(left % 1000000000 / 1000);
+	}
+}
+
+FREENECTAPI int freenect_process_events_timeout(freenect_context *ctx, struct timeval *timeout)
+{
+	struct timeval wait = *timeout;
+
+	clamp_timeout(ctx, &wait);
+	return process_devices(ctx, fnusb_process_events_timeout(&ctx->usb, &wait));
+}
+
+FREENECTAPI int freenect_interrupt_events(freenect_context *ctx)
+{
+	return fnusb_interrupt_events(&ctx->usb);
+}
+
+FREENECTAPI int freenect_get_pollfds(freenect_context *ctx, freenect_pollfd *fds, int max)
+{
+	return fnusb_get_pollfds(&ctx->usb, fds, max);
+}
+
+FREENECTAPI void freenect_set_pollfd_notifiers(freenect_context *ctx, freenect_pollfd_added_cb added, freenect_pollfd_removed_cb removed, void *user)
+{
+	fnusb_set_pollfd_notifiers(&ctx->usb, added, removed, user);
+}
+
+FREENECTAPI int freenect_get_next_timeout(freenect_context *ctx, struct timeval *timeout)
+{
+	int res = fnusb_get_next_timeout(&ctx->usb, timeout);
+
+	if (res == 0 && next_reconnect(ctx)) {
+		timeout->tv_sec = 60;
+		timeout->tv_usec = 0;
+		res = 1;
+	}
+	if (res > 0)
+		clamp_timeout(ctx, timeout);
+	return res;
+}
+
+FREENECTAPI int freenect_handle_ready_events(freenect_context *ctx)
+{
+	struct timeval timeout = { 0, 0 };
+	return freenect_process_events_timeout(ctx, &timeout);
+}
+
 FREENECTAPI int freenect_num_devices(freenect_context *ctx)
 {
 	return fnusb_num_devices(&ctx->usb);
@@ -148,23 +332,32 @@ FREENECTAPI void freenect_select_subdevices(freenect_context *ctx, freenect_devi
 			));
 }
 
-FREENECTAPI int freenect_open_device(freenect_context *ctx, freenect_device **dev, int index)
+static freenect_device *new_device(freenect_context *ctx)
 {
-	int res;
 	freenect_device *pdev = (freenect_device*)malloc(sizeof(freenect_device));
 	if (!pdev)
-		return -1;
+		return NULL;
 
 	memset(pdev, 0, sizeof(*pdev));
+	if (pthread_mutex_init(&pdev->capture_lock, NULL) != 0) {
+		free(pdev);
+		return NULL;
+	}
 
 	pdev->parent = ctx;
+	pdev->iso_autotune = ctx->iso_autotune;
+	pdev->reconnect = ctx->reconnect;
+	return pdev;
+}
 
-	res = fnusb_open_subdevices(pdev, index);
-	if (res < 0) {
-		free(pdev);
-		return res;
-	}
+static void free_device(freenect_device *pdev)
+{
+	pthread_mutex_destroy(&pdev->capture_lock);
+	free(pdev);
+}
 
+static void link_device(freenect_context *ctx, freenect_device *pdev)
+{
 	if (!ctx->first) {
 		ctx->first = pdev;
 	} else {
@@ -173,6 +366,22 @@ FREENECTAPI int freenect_open_device(freenect_context *ctx, freenect_device **de
 			prev = prev->next;
 		prev->next = pdev;
 	}
+}
+
+FREENECTAPI int freenect_open_device(freenect_context *ctx, freenect_device **dev, int index)
+{
+	int res;
+	freenect_device *pdev = new_device(ctx);
+	if (!pdev)
+		return -1;
+
+	res = fnusb_open_subdevices(pdev, index);
+	if (res < 0) {
+		free_device(pdev);
+		return res;
+	}
+
+	link_device(ctx, pdev);
 
 	*dev = pdev;
 
@@ -186,6 +395,79 @@ FREENECTAPI int freenect_open_device(freenect_context *ctx, freenect_device **de
 	return 0;
 }
 
+typedef struct {
+	freenect_context *ctx;
+	freenect_open_request *requests;
+} open_job;
+
+// open and initialize one device of freenect_open_devices(), without adding
+// it to the context yet; runs on the threads of the pool
+static void open_task(void *arg, int i)
+{
+	open_job *job = (open_job*)arg;
+	freenect_open_request *req = &job->requests[i];
+	freenect_device *pdev = new_device(job->ctx);
+	uint64_t start = fn_get_time_ns();
+
+	req->dev = pdev;
+	req->open_ns = 0;
+	req->init_ns = 0;
+	if (!pdev) {
+		req->status = -1;
+		return;
+	}
+	req->status = fnusb_open_subdevices(pdev, req->index);
+	req->open_ns = fn_get_time_ns() - start;
+	if (req->status < 0) {
+		free_device(pdev);
+		req->dev = NULL;
+		return;
+	}
+
+	start = fn_get_time_ns();
+	if (pdev->usb_cam.dev && freenect_camera_init(pdev) < 0)
+		req->status = -1;
+	req->init_ns = fn_get_time_ns() - start;
+}
+
+FREENECTAPI int freenect_open_devices(freenect_context *ctx, freenect_open_request *requests, int count, int threads)
+{
+	open_job job;
+	fn_pool *pool = NULL;
+	int opened = 0;
+	int i;
+
+	if (count < 0 || threads < 0)
+		return -1;
+	if (threads == 0 || threads > count)
+		threads = count;
+	// the calling thread opens devices as well
+	if (threads > 1) {
+		pool = fn_pool_create(threads - 1);
+		if (!pool)
+			return -1;
+	}
+	job.ctx = ctx;
+	job.requests = requests;
+	fn_pool_run(pool, open_task, &job, count);
+	fn_pool_destroy(pool);
+
+	for (i = 0; i < count; i++) {
+		freenect_open_request *req = &requests[i];
+		if (!req->dev)
+			continue;
+		link_device(ctx, req->dev);
+		if (req->status < 0) {
+			FN_ERROR("freenect_open_devices: Failed to initialize device %d\n", req->index);
+			freenect_close_device(req->dev);
+			req->dev = NULL;
+			continue;
+		}
+		opened++;
+	}
+	return opened;
+}
+
 FREENECTAPI int freenect_open_device_by_camera_serial(freenect_context *ctx, freenect_device **dev, const char* camera_serial)
 {
 	// This is implemented by listing the devices and seeing which index (if
@@ -215,9 +497,15 @@ FREENECTAPI int freenect_close_device(freenect_device *dev)
 	freenect_context *ctx = dev->parent;
 	int res;
 
+	if (dev->capture)
+		freenect_stop_capture(dev);
+
 	if (dev->usb_cam.dev) {
 		freenect_camera_teardown(dev);
 	}
+	// waits for queued camera commands, which need the handles
+	fn_cmd_queue_destroy(dev->cmd_queue);
+	dev->cmd_queue = NULL;
 
 	res = fnusb_close_subdevices(dev);
 	if (res < 0) {
@@ -243,7 +531,30 @@ FREENECTAPI int freenect_close_device(freenect_device *dev)
 	else
 		ctx->first = cur->next;
 
-	free(dev);
+	freenect_teardown_registration(dev);
+	fn_decode_worker_destroy(dev->decode_workers[0]);
+	fn_decode_worker_destroy(dev->decode_workers[1]);
+	fn_frameset_destroy(dev->frameset);
+	free_device(dev);
+	return 0;
+}
+
+FREENECTAPI void freenect_set_auto_reconnect(freenect_device *dev, int enable)
+{
+	dev->reconnect = enable != 0;
+}
+
+FREENECTAPI void freenect_set_reconnect_callback(freenect_device *dev, freenect_reconnect_cb cb)
+{
+	dev->reconnect_cb = cb;
+}
+
+FREENECTAPI int freenect_get_reconnect_stats(freenect_device *dev, freenect_reconnect_stats *stats)
+{
+	stats->disconnects = fn_atomic_load_u64(&dev->reconnect_stats.disconnects);
+	stats->reconnects = fn_atomic_load_u64(&dev->reconnect_stats.reconnects);
+	stats->failed_attempts = fn_atomic_load_u64(&dev->reconnect_stats.failed_attempts);
+	stats->downtime_ns = fn_atomic_load_u64(&dev->reconnect_stats.downtime_ns);
 	return 0;
 }
 
@@ -289,3 +600,28 @@ FN_INTERNAL void fn_log(freenect_context *ctx, freenect_loglevel level, const ch
 		va_end(ap);
 	}
 }
+
+FN_INTERNAL uint64_t fn_get_time_ns(void)
+{
+#if defined(_WIN32)
+	LARGE_INTEGER freq, now;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+	return (uint64_t)(now.QuadPart / freq.QuadPart) * 1000000000ull
+		+ (uint64_t)(now.QuadPart % freq.QuadPart) * 1000000000ull / freq.QuadPart;
+#elif defined(__APPLE__)
+	static mach_timebase_info_data_t timebase;
+	if (timebase.denom == 0)
+		mach_timebase_info(&timebase);
+	return mach_absolute_time() * timebase.numer / timebase.denom;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+FREENECTAPI uint64_t freenect_get_time_ns(void)
+{
+	return fn_get_time_ns();
+}
@@ -0,0 +1,235 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2010 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "freenect_internal.h"
+#include "decode.h"
+
+struct _fn_decode_worker {
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t wake_cond;
+	void * volatile slots[2]; // attached streams
+	void * volatile busy[2];  // streams the worker is looking at right now
+	volatile uint32_t sleeping;
+	volatile uint32_t shutdown;
+};
+
+// Take hold of the stream in slot s, or return NULL. Detaching clears the
+// slot and then waits for busy to drop, so with the full barriers between
+// the store and the re-check either side sees the other.
+static fn_decode_stream *hold_slot(fn_decode_worker *w, int s)
+{
+	fn_decode_stream *stream = (fn_decode_stream*)fn_atomic_load_ptr(&w->slots[s]);
+	if (!stream)
+		return NULL;
+	fn_atomic_store_ptr(&w->busy[s], stream);
+	fn_atomic_fence();
+	if (fn_atomic_load_ptr(&w->slots[s]) != stream) {
+		fn_atomic_store_ptr(&w->busy[s], NULL);
+		return NULL;
+	}
+	return stream;
+}
+
+static void free_stream(fn_decode_stream *stream)
+{
+	int i;
+	for (i = 0; i < FN_DECODE_BUFS; i++)
+		free(stream->frames[i].raw);
+	free(stream);
+}
+
+static void *decode_worker(void *arg)
+{
+	fn_decode_worker *w = (fn_decode_worker*)arg;
+	for (;;) {
+		fn_decode_stream *held[2];
+		fn_decode_stream *pick = NULL;
+		fn_decode_frame *frame = NULL;
+		int s;
+
+		// with both streams on one worker, decode frames in the order they
+		// completed so the callbacks see the same sequence as inline decoding
+		for (s = 0; s < 2; s++) {
+			held[s] = hold_slot(w, s);
+			if (!held[s])
+				continue;
+			fn_decode_frame *f = (fn_decode_frame*)fn_ring_peek(&held[s]->ready);
+			if (f && (!frame || (int32_t)(f->seq - frame->seq) < 0)) {
+				frame = f;
+				pick = held[s];
+			}
+		}
+
+		if (pick) {
+			fn_ring_pop(&pick->ready);
+			pick->decode(pick->dev, frame->raw, &frame->info);
+			if (!pick->orphaned)
+				fn_ring_push(&pick->free, frame);
+		}
+		for (s = 0; s < 2; s++) {
+			if (!held[s])
+				continue;
+			// stopped by one of our own callbacks. Look before letting go:
+			// once busy is clear, a detach from another thread may free it.
+			int orphaned = held[s]->orphaned;
+			fn_atomic_store_ptr(&w->busy[s], NULL);
+			if (orphaned)
+				free_stream(held[s]);
+		}
+		if (pick)
+			continue;
+
+		pthread_mutex_lock(&w->lock);
+		fn_atomic_store_u32(&w->sleeping, 1);
+		fn_atomic_fence();
+		int ready = 0;
+		for (s = 0; s < 2; s++) {
+			fn_decode_stream *stream = hold_slot(w, s);
+			if (stream) {
+				ready |= fn_ring_peek(&stream->ready) != NULL;
+				fn_atomic_store_ptr(&w->busy[s], NULL);
+			}
+		}
+		if (!ready && !fn_atomic_load_u32(&w->shutdown))
+			pthread_cond_wait(&w->wake_cond, &w->lock);
+		fn_atomic_store_u32(&w->sleeping, 0);
+		pthread_mutex_unlock(&w->lock);
+		if (fn_atomic_load_u32(&w->shutdown))
+			break;
+	}
+	return NULL;
+}
+
+static void wake_worker(fn_decode_worker *w)
+{
+	fn_atomic_fence();
+	if (!fn_atomic_load_u32(&w->sleeping))
+		return;
+	pthread_mutex_lock(&w->lock);
+	pthread_cond_signal(&w->wake_cond);
+	pthread_mutex_unlock(&w->lock);
+}
+
+FN_INTERNAL fn_decode_worker *fn_decode_worker_create(void)
+{
+	fn_decode_worker *w = (fn_decode_worker*)malloc(sizeof(fn_decode_worker));
+	if (!w)
+		return NULL;
+	memset(w, 0, sizeof(*w));
+	pthread_mutex_init(&w->lock, NULL);
+	pthread_cond_init(&w->wake_cond, NULL);
+	if (pthread_create(&w->thread, NULL, decode_worker, w) != 0) {
+		pthread_cond_destroy(&w->wake_cond);
+		pthread_mutex_destroy(&w->lock);
+		free(w);
+		return NULL;
+	}
+	return w;
+}
+
+FN_INTERNAL void fn_decode_worker_destroy(fn_decode_worker *w)
+{
+	if (!w)
+		return;
+	pthread_mutex_lock(&w->lock);
+	fn_atomic_store_u32(&w->shutdown, 1);
+	pthread_cond_signal(&w->wake_cond);
+	pthread_mutex_unlock(&w->lock);
+	pthread_join(w->thread, NULL);
+
+	pthread_cond_destroy(&w->wake_cond);
+	pthread_mutex_destroy(&w->lock);
+	free(w);
+}
+
+FN_INTERNAL fn_decode_stream *fn_decode_attach(fn_decode_worker *w, int slot, freenect_device *dev,
+                                               fn_decode_func decode, int raw_size)
+{
+	int i;
+	fn_decode_stream *stream = (fn_decode_stream*)malloc(sizeof(fn_decode_stream));
+	if (!stream)
+		return NULL;
+	memset(stream, 0, sizeof(*stream));
+	for (i = 0; i < FN_DECODE_BUFS; i++) {
+		stream->frames[i].raw = (uint8_t*)malloc(raw_size);
+		if (!stream->frames[i].raw) {
+			free_stream(stream);
+			return NULL;
+		}
+	}
+	stream->dev = dev;
+	stream->decode = decode;
+	stream->worker = w;
+	stream->slot = slot;
+	stream->filling = &stream->frames[0];
+	for (i = 1; i < FN_DECODE_BUFS; i++)
+		fn_ring_push(&stream->free, &stream->frames[i]);
+
+	fn_atomic_store_ptr(&w->slots[slot], stream);
+	return stream;
+}
+
+FN_INTERNAL void fn_decode_detach(fn_decode_stream *stream)
+{
+	fn_decode_worker *w = stream->worker;
+	int s = stream->slot;
+
+	fn_atomic_store_ptr(&w->slots[s], NULL);
+	fn_atomic_fence();
+	if (pthread_equal(pthread_self(), w->thread)) {
+		// the worker frees it once the running callback returns
+		if (fn_atomic_load_ptr(&w->busy[s]) == stream) {
+			stream->orphaned = 1;
+			return;
+		}
+	} else {
+		while (fn_atomic_load_ptr(&w->busy[s]) == stream)
+			sched_yield();
+	}
+	free_stream(stream);
+}
+
+FN_INTERNAL uint8_t *fn_decode_submit(fn_decode_stream *stream, const freenect_frame_info *info, uint32_t seq)
+{
+	fn_decode_frame *next = (fn_decode_frame*)fn_ring_pop(&stream->free);
+	if (!next) {
+		// drop the newest frame rather than make the event thread wait
+		stream->dropped++;
+		return stream->filling->raw;
+	}
+	stream->filling->info = *info;
+	stream->filling->seq = seq;
+	fn_ring_push(&stream->ready, stream->filling);
+	stream->filling = next;
+	wake_worker(stream->worker);
+	return next->raw;
+}
@@ -0,0 +1,88 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2010 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+#ifndef DECODE_H
+#define DECODE_H
+
+#include <stdint.h>
+#include "libfreenect.h"
+#include "atomics.h"
+
+// Decode offload: the event thread only reassembles raw frames; conversion
+// and the user callbacks run on decode worker threads. Completed frames are
+// handed over through lock-free single-producer, single-consumer rings, so
+// the event thread never blocks on a worker.
+
+struct _freenect_device;
+
+// Converts a complete raw frame and runs the stream's callbacks
+typedef void (*fn_decode_func)(struct _freenect_device *dev, uint8_t *raw, const freenect_frame_info *info);
+
+#define FN_DECODE_BUFS 3
+
+typedef struct {
+	uint8_t *raw;
+	freenect_frame_info info;
+	uint32_t seq; // device-wide submission order
+} fn_decode_frame;
+
+typedef struct _fn_decode_worker fn_decode_worker;
+
+typedef struct {
+	struct _freenect_device *dev;
+	fn_decode_func decode;
+	fn_decode_worker *worker;
+	int slot;
+	fn_decode_frame frames[FN_DECODE_BUFS];
+	fn_decode_frame *filling; // owned by the event thread
+	fn_ring ready;            // event thread -> worker
+	fn_ring free;             // worker -> event thread
+	uint32_t dropped;         // frames dropped because every buffer was taken
+	volatile uint32_t orphaned; // detached from the worker's own thread
+} fn_decode_stream;
+
+// Start a worker thread serving up to two streams. Returns NULL on failure.
+fn_decode_worker *fn_decode_worker_create(void);
+
+// Stop and join the worker. No stream may be attached. NULL is allowed.
+void fn_decode_worker_destroy(fn_decode_worker *worker);
+
+// Allocate a stream offload with raw buffers of raw_size bytes and attach
+// it to slot (0 or 1) of worker. Returns NULL on failure.
+fn_decode_stream *fn_decode_attach(fn_decode_worker *worker, int slot, struct _freenect_device *dev,
+                                   fn_decode_func decode, int raw_size);
+
+// Detach and free the offload, waiting for a decode in progress to finish.
+// From the worker's own thread (a callback stopping its stream) the offload
+// is freed once that callback returns.
+void fn_decode_detach(fn_decode_stream *stream);
+
+// Hand the filled raw buffer to the worker. Returns the buffer to assemble
+// the next frame into; when the worker holds every buffer the frame is
+// dropped and the same buffer is returned.
+uint8_t *fn_decode_submit(fn_decode_stream *stream, const freenect_frame_info *info, uint32_t seq);
+
+#endif
@@ -0,0 +1,256 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2010 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "freenect_internal.h"
+#include "framepool.h"
+
+enum {
+	FRAME_FREE,
+	FRAME_BUSY,   // being decoded into
+	FRAME_QUEUED, // waiting for freenect_lease_*_frame()
+	FRAME_LEASED
+};
+
+typedef struct {
+	freenect_frame frame; // handed out to the application, must stay first
+	fn_frame_pool *pool;
+	int state;
+	uint32_t seq; // queue order
+} pool_frame;
+
+struct _fn_frame_pool {
+	pthread_mutex_t lock;
+	freenect_frame_pool_policy policy;
+	int num_frames;
+	pool_frame *frames;
+	uint8_t *data;
+	uint32_t next_seq;
+	uint32_t dropped;
+	int out; // busy and leased frames
+	int closed;
+};
+
+static void free_pool(fn_frame_pool *pool)
+{
+	pthread_mutex_destroy(&pool->lock);
+	free(pool->data);
+	free(pool->frames);
+	free(pool);
+}
+
+// oldest frame in the given state; called with the lock held
+static pool_frame *oldest(fn_frame_pool *pool, int state)
+{
+	pool_frame *found = NULL;
+	int i;
+	for (i = 0; i < pool->num_frames; i++) {
+		pool_frame *f = &pool->frames[i];
+		if (f->state == state && (!found || (int32_t)(f->seq - found->seq) < 0))
+			found = f;
+	}
+	return found;
+}
+
+FN_INTERNAL fn_frame_pool *fn_frame_pool_create(freenect_device *dev, int frames, freenect_frame_pool_policy policy, freenect_frame_mode mode)
+{
+	int i;
+	// keep every buffer cache line aligned
+	size_t stride = ((size_t)mode.bytes + 63) & ~(size_t)63;
+
+	fn_frame_pool *pool = (fn_frame_pool*)malloc(sizeof(fn_frame_pool));
+	if (!pool)
+		return NULL;
+	memset(pool, 0, sizeof(*pool));
+	pool->frames = (pool_frame*)calloc(frames, sizeof(pool_frame));
+	pool->data = (uint8_t*)malloc(stride * frames);
+	if (!pool->frames || !pool->data) {
+		free(pool->frames);
+		free(pool->data);
+		free(pool);
+		return NULL;
+	}
+	pthread_mutex_init(&pool->lock, NULL);
+	pool->policy = policy;
+	pool->num_frames = frames;
+	for (i = 0; i < frames; i++) {
+		pool->frames[i].frame.dev = dev;
+		pool->frames[i].frame.data = pool->data + stride * i;
+		pool->frames[i].frame.mode = mode;
+		pool->frames[i].pool = pool;
+		pool->frames[i].state = FRAME_FREE;
+	}
+	return pool;
+}
+
+FN_INTERNAL freenect_frame *fn_frame_pool_acquire(fn_frame_pool *pool, int *dropped)
+{
+	pthread_mutex_lock(&pool->lock);
+	uint32_t before = pool->dropped;
+	pool_frame *f = oldest(pool, FRAME_FREE);
+	if (!f && pool->policy == FREENECT_FRAME_POOL_DROP_OLDEST) {
+		f = oldest(pool, FRAME_QUEUED);
+		if (f)
+			pool->dropped++;
+	}
+	if (f) {
+		f->state = FRAME_BUSY;
+		pool->out++;
+	} else {
+		pool->dropped++;
+	}
+	*dropped = pool->dropped != before;
+	pthread_mutex_unlock(&pool->lock);
+	return f ? &f->frame : NULL;
+}
+
+FN_INTERNAL int fn_frame_pool_publish(fn_frame_pool *pool, freenect_frame *frame, uint32_t timestamp, int leased)
+{
+	pool_frame *f = (pool_frame*)frame;
+	int destroy = 0;
+	int delivered = 1;
+
+	pthread_mutex_lock(&pool->lock);
+	f->frame.timestamp = timestamp;
+	f->seq = pool->next_seq++;
+	if (pool->closed) {
+		f->state = FRAME_FREE;
+		destroy = --pool->out == 0;
+		delivered = 0;
+	} else if (leased) {
+		f->state = FRAME_LEASED;
+	} else {
+		f->state = FRAME_QUEUED;
+		pool->out--;
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	if (destroy)
+		free_pool(pool);
+	return delivered;
+}
+
+FN_INTERNAL freenect_frame *fn_frame_pool_lease(fn_frame_pool *pool)
+{
+	pthread_mutex_lock(&pool->lock);
+	pool_frame *f = oldest(pool, FRAME_QUEUED);
+	if (f) {
+		f->state = FRAME_LEASED;
+		pool->out++;
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return f ? &f->frame : NULL;
+}
+
+FN_INTERNAL uint32_t fn_frame_pool_dropped(fn_frame_pool *pool)
+{
+	pthread_mutex_lock(&pool->lock);
+	uint32_t dropped = pool->dropped;
+	pthread_mutex_unlock(&pool->lock);
+	return dropped;
+}
+
+FN_INTERNAL void fn_frame_pool_close(fn_frame_pool *pool)
+{
+	int i;
+	pthread_mutex_lock(&pool->lock);
+	pool->closed = 1;
+	for (i = 0; i < pool->num_frames; i++) {
+		if (pool->frames[i].state == FRAME_QUEUED)
+			pool->frames[i].state = FRAME_FREE;
+	}
+	int destroy = pool->out == 0;
+	pthread_mutex_unlock(&pool->lock);
+
+	if (destroy)
+		free_pool(pool);
+}
+
+static int set_frame_pool(freenect_device *dev, packet_stream *strm, int frames, freenect_frame_pool_policy policy)
+{
+	freenect_context *ctx = dev->parent;
+
+	if (strm->running)
+		return -1;
+	if (frames < 0 || (policy != FREENECT_FRAME_POOL_DROP_NEWEST && policy != FREENECT_FRAME_POOL_DROP_OLDEST)) {
+		FN_ERROR("Invalid frame pool of %d frames with policy %d\n", frames, policy);
+		return -1;
+	}
+	strm->pool_frames = frames;
+	strm->pool_policy = policy;
+	return 0;
+}
+
+int freenect_set_depth_frame_pool(freenect_device *dev, int frames, freenect_frame_pool_policy policy)
+{
+	return set_frame_pool(dev, &dev->depth, frames, policy);
+}
+
+int freenect_set_video_frame_pool(freenect_device *dev, int frames, freenect_frame_pool_policy policy)
+{
+	return set_frame_pool(dev, &dev->video, frames, policy);
+}
+
+void freenect_set_depth_frame_callback(freenect_device *dev, freenect_frame_cb cb)
+{
+	dev->depth_frame_cb = cb;
+}
+
+void freenect_set_video_frame_callback(freenect_device *dev, freenect_frame_cb cb)
+{
+	dev->video_frame_cb = cb;
+}
+
+freenect_frame *freenect_lease_depth_frame(freenect_device *dev)
+{
+	return dev->depth.pool ? fn_frame_pool_lease(dev->depth.pool) : NULL;
+}
+
+freenect_frame *freenect_lease_video_frame(freenect_device *dev)
+{
+	return dev->video.pool ? fn_frame_pool_lease(dev->video.pool) : NULL;
+}
+
+void freenect_release_frame(freenect_frame *frame)
+{
+	pool_frame *f = (pool_frame*)frame;
+	fn_frame_pool *pool = f->pool;
+	int destroy = 0;
+
+	pthread_mutex_lock(&pool->lock);
+	// frames that aren't leased are left alone
+	if (f->state == FRAME_LEASED) {
+		f->state = FRAME_FREE;
+		destroy = --pool->out == 0 && pool->closed;
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	if (destroy)
+		free_pool(pool);
+}
@@ -0,0 +1,61 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2010 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+#ifndef FRAMEPOOL_H
+#define FRAMEPOOL_H
+
+#include "libfreenect.h"
+
+// Pool of output buffers for one stream. Every buffer is free, being
+// written by the decoding thread, queued for freenect_lease_*_frame(), or
+// leased to the application. The pool is closed when its stream stops and
+// freed once no buffer is left out.
+
+typedef struct _fn_frame_pool fn_frame_pool;
+
+// Returns NULL on failure.
+fn_frame_pool *fn_frame_pool_create(freenect_device *dev, int frames, freenect_frame_pool_policy policy, freenect_frame_mode mode);
+
+// Take a buffer to decode the next frame into. Returns NULL, and counts a
+// dropped frame, when the policy doesn't let any be reused. *dropped is set
+// to 1 if a frame was dropped, the returned one or a queued one reused.
+freenect_frame *fn_frame_pool_acquire(fn_frame_pool *pool, int *dropped);
+
+// Finish a frame from fn_frame_pool_acquire(): lease it to the caller
+// (leased != 0) or queue it. Returns 0 if the pool was closed meanwhile, in
+// which case the frame went straight back.
+int fn_frame_pool_publish(fn_frame_pool *pool, freenect_frame *frame, uint32_t timestamp, int leased);
+
+// Oldest queued frame, or NULL
+freenect_frame *fn_frame_pool_lease(fn_frame_pool *pool);
+
+// Frames dropped since the pool was created
+uint32_t fn_frame_pool_dropped(fn_frame_pool *pool);
+
+// Drop the queued frames and free the pool once nothing is leased.
+void fn_frame_pool_close(fn_frame_pool *pool);
+
+#endif
@@ -0,0 +1,218 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2010 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "freenect_internal.h"
+#include "frameset.h"
+
+// Frames waiting for a pair, per stream. The other stream can lag by more
+// than a frame, since a frame arrives one transfer time after its timestamp
+// and the streams run at different rates.
+#define WAITING_FRAMES 3
+
+typedef struct {
+	void *data;
+	int size;
+	freenect_frame_info info;
+	uint8_t *map; // copy of info.packet_map
+	int map_size;
+} waiting_frame;
+
+typedef struct {
+	waiting_frame frames[WAITING_FRAMES]; // oldest first
+	int count;
+} waiting_queue;
+
+struct _fn_frameset {
+	pthread_mutex_t lock;
+	waiting_queue queues[2]; // by freenect_stream
+	freenect_frameset_cb cb;
+	uint32_t tolerance; // in device clock ticks
+	freenect_frameset_stats stats; // only updated with the fn_atomic_*_u64 helpers
+};
+
+FN_INTERNAL fn_frameset *fn_frameset_create(void)
+{
+	fn_frameset *fs = (fn_frameset*)calloc(1, sizeof(fn_frameset));
+	if (!fs)
+		return NULL;
+	if (pthread_mutex_init(&fs->lock, NULL) != 0) {
+		free(fs);
+		return NULL;
+	}
+	return fs;
+}
+
+FN_INTERNAL void fn_frameset_destroy(fn_frameset *fs)
+{
+	int i, j;
+	if (!fs)
+		return;
+	for (i = 0; i < 2; i++) {
+		for (j = 0; j < WAITING_FRAMES; j++) {
+			free(fs->queues[i].frames[j].data);
+			free(fs->queues[i].frames[j].map);
+		}
+	}
+	pthread_mutex_destroy(&fs->lock);
+	free(fs);
+}
+
+// drop the oldest waiting frame, keeping its buffers for reuse
+static void drop_oldest(waiting_queue *q)
+{
+	waiting_frame oldest = q->frames[0];
+	memmove(q->frames, q->frames + 1, (WAITING_FRAMES - 1) * sizeof(*q->frames));
+	q->frames[WAITING_FRAMES - 1] = oldest;
+	q->count--;
+}
+
+static void unmatched(fn_frameset *fs, int stream)
+{
+	if (stream == FREENECT_STREAM_DEPTH)
+		fn_atomic_add_u64(&fs->stats.unmatched_depth, 1);
+	else
+		fn_atomic_add_u64(&fs->stats.unmatched_video, 1);
+}
+
+// keep a copy of the frame until its pair arrives; 0 on success
+static int wait_for_pair(waiting_frame *w, const void *data, int bytes, const freenect_frame_info *info)
+{
+	if (w->size != bytes) {
+		void *buf = realloc(w->data, bytes);
+		if (!buf)
+			return -1;
+		w->data = buf;
+		w->size = bytes;
+	}
+	int map_size = info->packet_map ? (info->packets + 7) / 8 : 0;
+	if (w->map_size < map_size) {
+		uint8_t *map = (uint8_t*)realloc(w->map, map_size);
+		if (!map)
+			return -1;
+		w->map = map;
+		w->map_size = map_size;
+	}
+	memcpy(w->data, data, bytes);
+	w->info = *info;
+	if (info->packet_map) {
+		memcpy(w->map, info->packet_map, map_size);
+		w->info.packet_map = w->map;
+	}
+	return 0;
+}
+
+FN_INTERNAL void fn_frameset_add(fn_frameset *fs, freenect_device *dev, const void *data, int bytes, const freenect_frame_info *info)
+{
+	int stream = info->stream;
+	waiting_queue *own = &fs->queues[stream];
+	waiting_queue *other = &fs->queues[!stream];
+	int32_t tolerance = (int32_t)fs->tolerance;
+	int i;
+
+	if (!fs->cb)
+		return;
+
+	pthread_mutex_lock(&fs->lock);
+	// frames of the other stream this one is past by more than the
+	// tolerance can't pair with it, nor with anything later. The
+	// differences wrap safely, as long as frames are less than 35 s apart.
+	while (other->count > 0 && (int32_t)(info->timestamp - other->frames[0].info.timestamp) > tolerance) {
+		drop_oldest(other);
+		unmatched(fs, !stream);
+	}
+
+	int best = -1;
+	int32_t best_diff = 0;
+	for (i = 0; i < other->count; i++) {
+		int32_t diff = (int32_t)(other->frames[i].info.timestamp - info->timestamp);
+		if (diff < 0)
+			diff = -diff;
+		if (diff <= tolerance && (best < 0 || diff < best_diff)) {
+			best = i;
+			best_diff = diff;
+		}
+	}
+
+	if (best >= 0) {
+		// older frames than the pair's are out of the running too
+		for (i = 0; i < best; i++) {
+			drop_oldest(other);
+			unmatched(fs, !stream);
+		}
+		waiting_frame *pair = &other->frames[0];
+		fn_atomic_add_u64(&fs->stats.framesets, 1);
+		if (stream == FREENECT_STREAM_DEPTH)
+			fs->cb(dev, (void*)data, info, pair->data, &pair->info);
+		else
+			fs->cb(dev, pair->data, &pair->info, (void*)data, info);
+		drop_oldest(other);
+	} else if (other->count > 0) {
+		// the other stream is already past this frame
+		unmatched(fs, stream);
+	} else {
+		if (own->count == WAITING_FRAMES) {
+			drop_oldest(own);
+			unmatched(fs, stream);
+		}
+		if (wait_for_pair(&own->frames[own->count], data, bytes, info) == 0)
+			own->count++;
+		else
+			unmatched(fs, stream);
+	}
+	pthread_mutex_unlock(&fs->lock);
+}
+
+int freenect_set_frameset_callback(freenect_device *dev, freenect_frameset_cb cb, uint32_t tolerance_us)
+{
+	if (dev->depth.running || dev->video.running)
+		return -1;
+	if (!dev->frameset) {
+		dev->frameset = fn_frameset_create();
+		if (!dev->frameset)
+			return -1;
+	}
+	dev->frameset->cb = cb;
+	uint64_t ticks = (uint64_t)tolerance_us * FN_CLOCK_HZ / 1000000;
+	dev->frameset->tolerance = ticks > INT32_MAX ? INT32_MAX : (uint32_t)ticks;
+	dev->frameset->queues[0].count = 0;
+	dev->frameset->queues[1].count = 0;
+	return 0;
+}
+
+int freenect_get_frameset_stats(freenect_device *dev, freenect_frameset_stats *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+	if (!dev->frameset)
+		return 0;
+	stats->framesets = fn_atomic_load_u64(&dev->frameset->stats.framesets);
+	stats->unmatched_depth = fn_atomic_load_u64(&dev->frameset->stats.unmatched_depth);
+	stats->unmatched_video = fn_atomic_load_u64(&dev->frameset->stats.unmatched_video);
+	return 0;
+}
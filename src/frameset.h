@@ -0,0 +1,51 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2010 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+#ifndef FRAMESET_H
+#define FRAMESET_H
+
+#include "libfreenect.h"
+
+// Pairs depth and video frames for freenect_set_frameset_callback(). The
+// last few unpaired frames of a stream wait in copies until a frame of the
+// other stream within the tolerance arrives, or until one arrives that is so
+// much later that they can't be paired any more. The device stamps both
+// streams from one clock, so the timestamps compare directly.
+
+typedef struct _fn_frameset fn_frameset;
+
+// Returns NULL on failure.
+fn_frameset *fn_frameset_create(void);
+
+// NULL is allowed.
+void fn_frameset_destroy(fn_frameset *fs);
+
+// Offer a converted frame of bytes bytes at data; runs the frameset callback
+// if it completes a pair. May be called from the decode threads of both
+// streams at once.
+void fn_frameset_add(fn_frameset *fs, freenect_device *dev, const void *data, int bytes, const freenect_frame_info *info);
+
+#endif
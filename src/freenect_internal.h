@@ -28,6 +28,7 @@
 #define FREENECT_INTERNAL_H
 
 #include <stdint.h>
+#include <pthread.h>
 
 #include "libfreenect.h"
 #include "libfreenect-registration.h"
@@ -46,6 +47,13 @@
 typedef void (*fnusb_iso_cb)(freenect_device *dev, uint8_t *buf, int len);
 
 #include "usb_libusb10.h"
+#include "threadpool.h"
+#include "decode.h"
+#include "framepool.h"
+#include "capture.h"
+#include "clock.h"
+#include "frameset.h"
+#include "cmdqueue.h"
 
 struct _freenect_context {
 	freenect_loglevel log_level;
@@ -53,6 +61,11 @@ struct _freenect_context {
 	fnusb_ctx usb;
 	freenect_device_flags enabled_subdevices;
 	freenect_device *first;
+	char *registration_cache_dir; // NULL when the registration cache is off
+	freenect_iso_geometry iso[2]; // per freenect_stream, from the environment or the defaults
+	int iso_autotune; // LIBFREENECT_ISO_AUTOTUNE
+	int reconnect; // LIBFREENECT_RECONNECT
+	int arrivals_seen; // usb.arrivals when lost devices were last looked for
 };
 
 #define LL_FATAL FREENECT_LOG_FATAL
@@ -73,6 +86,9 @@ void fn_log(freenect_context *ctx, freenect_loglevel level, const char *fmt, ...
 void fn_log(freenect_context *ctx, freenect_loglevel level, const char *fmt, ...) __attribute__ ((format (printf, 3, 4)));
 #endif
 
+// Monotonic host clock, in nanoseconds from an arbitrary origin
+uint64_t fn_get_time_ns(void);
+
 #define FN_LOG(level, ...) fn_log(ctx, level, __VA_ARGS__)
 
 #define FN_FATAL(...) FN_LOG(LL_FATAL, __VA_ARGS__)
@@ -154,8 +170,37 @@ typedef struct {
 	void *usr_buf;
 	uint8_t *raw_buf;
 	void *proc_buf;
+	fn_decode_stream *offload; // NULL when frames are decoded on the event thread
+	int pool_frames; // 0 unless the frames go to a frame pool
+	freenect_frame_pool_policy pool_policy;
+	fn_frame_pool *pool;
+	int incremental; // rows are converted as their packets arrive
+	int converted_rows; // of the frame being assembled, -1 if it has no pool buffer
+	freenect_frame *pool_frame; // pool buffer the frame is converted into
+	int partial; // deliver frames with lost packets; raw_buf then ends with the packet map
+	uint8_t fill; // raw byte that decodes to no data
+	int raw_size; // frame_size plus the packet map, if any
+	int new_frame; // the next packet stored starts a new frame
+	int redo; // the packet just processed belongs to the next frame as well
+	freenect_stream_stats stats; // only updated with the fn_atomic_*_u64 helpers
+	fn_clock clock; // device timestamps to host time
+	freenect_iso_geometry iso; // transfers == 0 until set or started
+	int retune; // transfers auto-tuning asks for, 0 if none
+	int tune_frames; // frames into the auto-tune window
+	uint64_t tune_lost; // lost_packets when the window began
 } packet_stream;
 
+// One stripe of a frame registered in parallel: source rows
+// [first_row, last_row) scattered into a private z-buffer that covers the
+// output pixels [target_begin, target_end)
+typedef struct {
+	int first_row;
+	int last_row;
+	uint32_t target_begin;
+	uint32_t target_end;
+	uint16_t *zbuf;
+} registration_stripe;
+
 #ifdef BUILD_AUDIO
 typedef struct {
 	int running;
@@ -210,6 +255,12 @@ struct _freenect_device {
 
 	freenect_depth_cb depth_cb;
 	freenect_video_cb video_cb;
+	freenect_frame_cb depth_frame_cb;
+	freenect_frame_cb video_frame_cb;
+	fn_frameset *frameset; // NULL until a frameset callback is set
+	freenect_frame_info_cb frame_info_cb;
+	int partial_frames; // freenect_set_partial_frames()
+	int iso_autotune; // freenect_set_iso_autotune()
 	freenect_video_format video_format;
 	freenect_depth_format depth_format;
 	freenect_resolution video_resolution;
@@ -217,12 +268,48 @@ struct _freenect_device {
 
 	int cam_inited;
 	uint16_t cam_tag;
+	fn_cmd_queue *cmd_queue; // NULL until the first queued command
+
+	fn_capture *capture; // raw packet capture, NULL when off
+	pthread_mutex_t capture_lock; // guards capture, see capture.c
+	char camera_serial[64]; // empty if the camera has none
+
+	// Reconnection, see freenect_set_auto_reconnect()
+	int reconnect;
+	int lost; // the camera went away and is waiting to be reopened
+	int resume_streams; // bit per freenect_stream to restart once it is back
+	uint64_t lost_ns;
+	uint64_t reconnect_next_ns; // next attempt, when no hotplug event comes first
+	freenect_reconnect_cb reconnect_cb;
+	freenect_reconnect_stats reconnect_stats; // only updated with fn_atomic_add_u64
 
 	packet_stream depth;
 	packet_stream video;
 
 	// Registration
 	freenect_registration registration;
+	int registration_stale; // parameters changed since the tables were built
+	int reg_info_valid; // reg_info holds the values for reg_info_resolution
+	freenect_resolution reg_info_resolution;
+	int registration_threads;
+	fn_pool *registration_pool;
+	registration_stripe *registration_stripes; // NULL until the first parallel frame
+	freenect_registration_table_format registration_table_format; // requested layout, 0 for the default
+	int16_t (*registration_table16)[2]; // FREENECT_REGISTRATION_TABLE_INT16_DELTA table, if in use
+	int32_t registration_table16_bias; // added to the x deltas of registration_table16
+	float *depth_rays; // FREENECT_DEPTH_XYZ ray slopes: 640 for x, then 480 for y
+
+	// Colored point cloud
+	freenect_points_cb points_cb;
+	uint8_t *points_rgb; // latest video frame as 640x480 RGB
+	int points_rgb_valid;
+	freenect_point_xyzrgb *points;
+
+	// Decode offload
+	int decode_threads;
+	fn_decode_worker *decode_workers[2];
+	uint32_t decode_seq; // frames handed to the workers so far
+	int depth_incremental; // freenect_set_depth_incremental_decode()
 
 #ifdef BUILD_AUDIO
 	// Audio
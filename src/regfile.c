@@ -0,0 +1,221 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2011 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+#include <libfreenect.h>
+#include <libfreenect-registration.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+// Registration file layout, version 1. Everything is stored in the byte
+// order of the host that wrote the file (see endian) and every table starts
+// on a 64-byte boundary, so a reader on the same kind of host can mmap the
+// file and use the tables in place.
+//
+//   offset  size
+//        0     8  magic "FNREGTBL"
+//        8     4  version
+//       12     4  endian marker, REGFILE_ENDIAN as written by the host
+//       16     4  header size
+//       20     4  reserved
+//       24     8  const_shift
+//       32    16  zero_plane_info
+//       48   116  reg_info
+//      164     6  reg_pad_info
+//      170     6  reserved
+//      176    48  offset and entry count of raw_to_mm_shift (uint16_t),
+//                 depth_to_rgb_shift (int32_t) and registration_table
+//                 (int32_t pairs)
+//      224        tables
+
+#define REGFILE_MAGIC "FNREGTBL"
+#define REGFILE_VERSION 1
+#define REGFILE_ENDIAN 0x01020304
+#define REGFILE_ALIGN 64
+
+#define DEPTH_MAX_METRIC_VALUE FREENECT_DEPTH_MM_MAX_VALUE
+#define DEPTH_MAX_RAW_VALUE    FREENECT_DEPTH_RAW_MAX_VALUE
+#define DEPTH_X_RES 640
+#define DEPTH_Y_RES 480
+
+typedef struct {
+	uint64_t offset;
+	uint64_t count;
+} regfile_section;
+
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t endian;
+	uint32_t header_size;
+	uint32_t reserved0;
+	double const_shift;
+	freenect_zero_plane_info zero_plane_info;
+	freenect_reg_info reg_info;
+	freenect_reg_pad_info reg_pad_info;
+	uint16_t reserved1[3];
+	regfile_section sections[3];
+} regfile_header;
+
+// the layout above is what goes to disk, make sure no padding sneaks in
+typedef char regfile_header_size_check[sizeof(regfile_header) == 224 ? 1 : -1];
+
+static uint64_t regfile_align(uint64_t offset)
+{
+	return (offset + REGFILE_ALIGN - 1) & ~(uint64_t)(REGFILE_ALIGN - 1);
+}
+
+static void regfile_layout(regfile_header* header)
+{
+	header->sections[0].count = DEPTH_MAX_RAW_VALUE;
+	header->sections[1].count = DEPTH_MAX_METRIC_VALUE;
+	header->sections[2].count = DEPTH_X_RES * DEPTH_Y_RES;
+	header->sections[0].offset = regfile_align(sizeof(regfile_header));
+	header->sections[1].offset = regfile_align(header->sections[0].offset + sizeof(uint16_t) * DEPTH_MAX_RAW_VALUE);
+	header->sections[2].offset = regfile_align(header->sections[1].offset + sizeof(int32_t) * DEPTH_MAX_METRIC_VALUE);
+}
+
+static int regfile_write_section(FILE* fp, uint64_t offset, const void* data, size_t size)
+{
+	static const char zeros[REGFILE_ALIGN] = { 0 };
+	long pos = ftell(fp);
+	if (pos < 0 || (uint64_t)pos > offset || offset - pos > REGFILE_ALIGN)
+		return -1;
+	if (fwrite(zeros, 1, (size_t)(offset - pos), fp) != (size_t)(offset - pos))
+		return -1;
+	return fwrite(data, 1, size, fp) == size ? 0 : -1;
+}
+
+static int regfile_read_section(FILE* fp, uint64_t offset, void* data, size_t size)
+{
+	if (fseek(fp, (long)offset, SEEK_SET) != 0)
+		return -1;
+	return fread(data, 1, size, fp) == size ? 0 : -1;
+}
+
+int freenect_save_registration(const freenect_registration* reg, const char* filename)
+{
+	if (!reg->raw_to_mm_shift || !reg->depth_to_rgb_shift || !reg->registration_table)
+		return -1;
+
+	regfile_header header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, REGFILE_MAGIC, sizeof(header.magic));
+	header.version = REGFILE_VERSION;
+	header.endian = REGFILE_ENDIAN;
+	header.header_size = sizeof(header);
+	header.const_shift = reg->const_shift;
+	header.zero_plane_info = reg->zero_plane_info;
+	header.reg_info = reg->reg_info;
+	header.reg_pad_info = reg->reg_pad_info;
+	regfile_layout(&header);
+
+	// write to a scratch file and rename it into place, so that readers
+	// never see a partially written file
+	size_t len = strlen(filename);
+	char* tmpname = (char*)malloc(len + 5);
+	if (!tmpname)
+		return -1;
+	memcpy(tmpname, filename, len);
+	memcpy(tmpname + len, ".tmp", 5);
+
+	FILE* fp = fopen(tmpname, "wb");
+	if (!fp) {
+		free(tmpname);
+		return -1;
+	}
+	int res = 0;
+	if (fwrite(&header, sizeof(header), 1, fp) != 1)
+		res = -1;
+	if (res == 0)
+		res = regfile_write_section(fp, header.sections[0].offset, reg->raw_to_mm_shift, sizeof(uint16_t) * DEPTH_MAX_RAW_VALUE);
+	if (res == 0)
+		res = regfile_write_section(fp, header.sections[1].offset, reg->depth_to_rgb_shift, sizeof(int32_t) * DEPTH_MAX_METRIC_VALUE);
+	if (res == 0)
+		res = regfile_write_section(fp, header.sections[2].offset, reg->registration_table, sizeof(int32_t) * DEPTH_X_RES * DEPTH_Y_RES * 2);
+	if (fclose(fp) != 0)
+		res = -1;
+#ifdef _WIN32
+	// rename() does not replace existing files on Windows
+	if (res == 0)
+		remove(filename);
+#endif
+	if (res == 0 && rename(tmpname, filename) != 0)
+		res = -1;
+	if (res < 0)
+		remove(tmpname);
+	free(tmpname);
+	return res;
+}
+
+int freenect_load_registration(freenect_registration* reg, const char* filename)
+{
+	FILE* fp = fopen(filename, "rb");
+	if (!fp)
+		return -1;
+
+	regfile_header header, expected;
+	memset(&expected, 0, sizeof(expected));
+	regfile_layout(&expected);
+	if (fread(&header, sizeof(header), 1, fp) != 1
+	    || memcmp(header.magic, REGFILE_MAGIC, sizeof(header.magic)) != 0
+	    || header.version != REGFILE_VERSION
+	    || header.endian != REGFILE_ENDIAN
+	    || header.header_size != sizeof(header)
+	    || memcmp(header.sections, expected.sections, sizeof(header.sections)) != 0) {
+		fclose(fp);
+		return -1;
+	}
+
+	uint16_t* raw_to_mm_shift    = (uint16_t*)malloc( sizeof(uint16_t) * DEPTH_MAX_RAW_VALUE );
+	int32_t* depth_to_rgb_shift  = (int32_t*)malloc( sizeof( int32_t) * DEPTH_MAX_METRIC_VALUE );
+	int32_t (*registration_table)[2] = (int32_t (*)[2])malloc( sizeof( int32_t) * DEPTH_X_RES * DEPTH_Y_RES * 2 );
+	int res = 0;
+	if (!raw_to_mm_shift || !depth_to_rgb_shift || !registration_table)
+		res = -1;
+	if (res == 0)
+		res = regfile_read_section(fp, header.sections[0].offset, raw_to_mm_shift, sizeof(uint16_t) * DEPTH_MAX_RAW_VALUE);
+	if (res == 0)
+		res = regfile_read_section(fp, header.sections[1].offset, depth_to_rgb_shift, sizeof(int32_t) * DEPTH_MAX_METRIC_VALUE);
+	if (res == 0)
+		res = regfile_read_section(fp, header.sections[2].offset, registration_table, sizeof(int32_t) * DEPTH_X_RES * DEPTH_Y_RES * 2);
+	fclose(fp);
+	if (res < 0) {
+		free(raw_to_mm_shift);
+		free(depth_to_rgb_shift);
+		free(registration_table);
+		return -1;
+	}
+
+	reg->reg_info = header.reg_info;
+	reg->reg_pad_info = header.reg_pad_info;
+	reg->zero_plane_info = header.zero_plane_info;
+	reg->const_shift = header.const_shift;
+	reg->raw_to_mm_shift = raw_to_mm_shift;
+	reg->depth_to_rgb_shift = depth_to_rgb_shift;
+	reg->registration_table = registration_table;
+	return 0;
+}
@@ -27,6 +27,7 @@
 #include <libfreenect.h>
 #include <freenect_internal.h>
 #include "registration.h"
+#include "convert.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
@@ -51,6 +52,9 @@
 #define DEPTH_X_RES 640
 #define DEPTH_Y_RES 480
 
+// marks pixels mapped outside the image in the int16 delta table
+#define REG_TABLE16_OUT_OF_BOUNDS INT16_MIN
+
 // try to fill single empty pixels AKA "salt-and-pepper noise"
 // disabled by default, noise removal better handled in later stages
 // #define DENSE_REGISTRATION
@@ -73,58 +77,30 @@ static void freenect_init_depth_to_rgb(int32_t* depth_to_rgb, freenect_zero_plan
 	}
 }
 
-// unrolled inner loop of the 11-bit unpacker
-static inline void unpack_8_pixels(uint8_t *raw, uint16_t *frame)
+// register the source rows [first_row, last_row) of a packed frame, input_packed
+// pointing at first_row; output holds the output pixels [target_begin, target_end)
+// and is only ever lowered, so several calls can share one output.
+// table16 is the int16 delta form of the registration table, or NULL, and
+// bias_x the offset its x deltas are stored against.
+static void register_rows(freenect_registration* reg, const int16_t (*table16)[2], int32_t bias_x, uint8_t* input_packed,
+                          uint32_t first_row, uint32_t last_row,
+                          uint16_t* output_mm, uint32_t target_begin, uint32_t target_end)
 {
-	uint16_t baseMask = 0x7FF;
-
-	uint8_t r0  = *(raw+0);
-	uint8_t r1  = *(raw+1);
-	uint8_t r2  = *(raw+2);
-	uint8_t r3  = *(raw+3);
-	uint8_t r4  = *(raw+4);
-	uint8_t r5  = *(raw+5);
-	uint8_t r6  = *(raw+6);
-	uint8_t r7  = *(raw+7);
-	uint8_t r8  = *(raw+8);
-	uint8_t r9  = *(raw+9);
-	uint8_t r10 = *(raw+10);
-
-	frame[0] =  (r0<<3)  | (r1>>5);
-	frame[1] = ((r1<<6)  | (r2>>2) )           & baseMask;
-	frame[2] = ((r2<<9)  | (r3<<1) | (r4>>7) ) & baseMask;
-	frame[3] = ((r4<<4)  | (r5>>4) )           & baseMask;
-	frame[4] = ((r5<<7)  | (r6>>1) )           & baseMask;
-	frame[5] = ((r6<<10) | (r7<<2) | (r8>>6) ) & baseMask;
-	frame[6] = ((r8<<5)  | (r9>>3) )           & baseMask;
-	frame[7] = ((r9<<8)  | (r10)   )           & baseMask;
-}
+	uint16_t unpack[DEPTH_X_RES];
 
-// apply registration data to a single packed frame
-FN_INTERNAL int freenect_apply_registration(freenect_device* dev, uint8_t* input_packed, uint16_t* output_mm)
-{
-	freenect_registration* reg = &(dev->registration);
-	// set output buffer to zero using pointer-sized memory access (~ 30-40% faster than memset)
-	size_t i, *wipe = (size_t*)output_mm;
-	for (i = 0; i < DEPTH_X_RES * DEPTH_Y_RES * sizeof(uint16_t) / sizeof(size_t); i++) wipe[i] = DEPTH_NO_MM_VALUE;
+	uint32_t target_offset = DEPTH_Y_RES * reg->reg_pad_info.start_lines + target_begin;
+	uint32_t target_size = target_end - target_begin;
+	uint32_t x,y;
 
-	uint16_t unpack[8];
+	for (y = first_row; y < last_row; y++) {
+		// unpack one row of the packed frame
+		freenect_convert_packed11_to_16bit( input_packed, unpack, DEPTH_X_RES );
+		input_packed += DEPTH_X_RES * 11 / 8;
 
-	uint32_t target_offset = DEPTH_Y_RES * reg->reg_pad_info.start_lines;
-	uint32_t x,y,source_index = 8;
-
-	for (y = 0; y < DEPTH_Y_RES; y++) {
 		for (x = 0; x < DEPTH_X_RES; x++) {
 
-			// get 8 pixels from the packed frame
-			if (source_index == 8) {
-				unpack_8_pixels( input_packed, unpack );
-				source_index = 0;
-				input_packed += 11;
-			}
-
 			// get the value at the current depth pixel, convert to millimeters
-			uint16_t metric_depth = reg->raw_to_mm_shift[ unpack[source_index++] ];
+			uint16_t metric_depth = reg->raw_to_mm_shift[ unpack[x] ];
 
 			// so long as the current pixel has a depth value
 			if (metric_depth == DEPTH_NO_MM_VALUE) continue;
@@ -134,14 +110,25 @@ FN_INTERNAL int freenect_apply_registration(freenect_device* dev, uint8_t* input
 			// using registration_table for the basic rectification
 			// and depth_to_rgb_shift for determining the x shift
 			uint32_t reg_index = DEPTH_MIRROR_X ? ((y + 1) * DEPTH_X_RES - x - 1) : (y * DEPTH_X_RES + x);
-			uint32_t nx = (reg->registration_table[reg_index][0] + reg->depth_to_rgb_shift[metric_depth]) / REG_X_VAL_SCALE;
-			uint32_t ny =  reg->registration_table[reg_index][1];
+			int32_t table_x, table_y;
+			if (table16) {
+				uint32_t reg_x = DEPTH_MIRROR_X ? (DEPTH_X_RES - x - 1) : x;
+				int16_t dx = table16[reg_index][0];
+				table_x = (dx == REG_TABLE16_OUT_OF_BOUNDS) ? 2 * DEPTH_X_RES * REG_X_VAL_SCALE : (int32_t)(reg_x * REG_X_VAL_SCALE) + bias_x + dx;
+				table_y = (int32_t)y + table16[reg_index][1];
+			} else {
+				table_x = reg->registration_table[reg_index][0];
+				table_y = reg->registration_table[reg_index][1];
+			}
+			uint32_t nx = (table_x + reg->depth_to_rgb_shift[metric_depth]) / REG_X_VAL_SCALE;
+			uint32_t ny =  table_y;
 
 			// ignore anything outside the image bounds
 			if (nx >= DEPTH_X_RES) continue;
 
 			// convert nx, ny to an index in the depth image array
 			uint32_t target_index = (DEPTH_MIRROR_X ? ((ny + 1) * DEPTH_X_RES - nx - 1) : (ny * DEPTH_X_RES + nx)) - target_offset;
+			if (target_index >= target_size) continue;
 
 			// get the current value at the new location
 			uint16_t current_depth = output_mm[target_index];
@@ -165,31 +152,443 @@ FN_INTERNAL int freenect_apply_registration(freenect_device* dev, uint8_t* input
 			}
 		}
 	}
+}
+
+/*
+ * Parallel registration
+ *
+ * Every pixel ends up holding the smallest depth scattered to it, so the
+ * result does not depend on the order pixels are visited in. The frame is
+ * cut into row stripes that are scattered concurrently into private
+ * z-buffers, then the output is cut into bands and each band takes the
+ * smallest non-zero value of the stripes covering it. This gives exactly
+ * the serial result. (DENSE_REGISTRATION writes neighbours depending on
+ * visiting order, so it always runs serially.)
+ */
+
+typedef struct {
+	freenect_device* dev;
+	uint8_t* input_packed;
+	uint16_t* output_mm;
+	int num_bands;
+} registration_job;
+
+static void free_registration_stripes(freenect_device* dev)
+{
+	int i;
+	if (!dev->registration_stripes)
+		return;
+	for (i = 0; i < dev->registration_threads; i++)
+		free(dev->registration_stripes[i].zbuf);
+	free(dev->registration_stripes);
+	dev->registration_stripes = NULL;
+}
+
+// go back to registering on the thread that delivers the frame
+static void release_registration_pool(freenect_device* dev)
+{
+	free_registration_stripes(dev);
+	fn_pool_destroy(dev->registration_pool);
+	dev->registration_pool = NULL;
+	dev->registration_threads = 1;
+}
+
+// split the frame into one stripe per thread and find the output pixels
+// each stripe can reach from the y values in the registration table
+static int setup_registration_stripes(freenect_device* dev)
+{
+	freenect_registration* reg = &(dev->registration);
+	int n = dev->registration_threads;
+	int i, x, y;
+
+	dev->registration_stripes = (registration_stripe*)calloc(n, sizeof(registration_stripe));
+	if (!dev->registration_stripes)
+		return -1;
+
+	int64_t target_offset = DEPTH_Y_RES * reg->reg_pad_info.start_lines;
+	for (i = 0; i < n; i++) {
+		registration_stripe* stripe = &dev->registration_stripes[i];
+		stripe->first_row = i * DEPTH_Y_RES / n;
+		stripe->last_row = (i + 1) * DEPTH_Y_RES / n;
+
+		int32_t min_y = DEPTH_Y_RES, max_y = -1;
+		for (y = stripe->first_row; y < stripe->last_row; y++) {
+			for (x = 0; x < DEPTH_X_RES; x++) {
+				int32_t ny = reg->registration_table[y * DEPTH_X_RES + x][1];
+				if (ny < min_y) min_y = ny;
+				if (ny > max_y) max_y = ny;
+			}
+		}
+		int64_t begin = (int64_t)min_y * DEPTH_X_RES - target_offset;
+		int64_t end = (int64_t)(max_y + 1) * DEPTH_X_RES - target_offset;
+		if (begin < 0) begin = 0;
+		if (end > DEPTH_X_RES * DEPTH_Y_RES) end = DEPTH_X_RES * DEPTH_Y_RES;
+		if (end < begin) end = begin;
+		stripe->target_begin = (uint32_t)begin;
+		stripe->target_end = (uint32_t)end;
+
+		stripe->zbuf = (uint16_t*)malloc(sizeof(uint16_t) * (end - begin + 1));
+		if (!stripe->zbuf) {
+			free_registration_stripes(dev);
+			return -1;
+		}
+	}
 	return 0;
 }
 
+static void register_stripe_task(void* arg, int index)
+{
+	registration_job* job = (registration_job*)arg;
+	registration_stripe* stripe = &job->dev->registration_stripes[index];
+	memset(stripe->zbuf, 0, sizeof(uint16_t) * (stripe->target_end - stripe->target_begin));
+	register_rows(&job->dev->registration, (const int16_t (*)[2])job->dev->registration_table16, job->dev->registration_table16_bias, job->input_packed + stripe->first_row * DEPTH_X_RES * 11 / 8,
+	              stripe->first_row, stripe->last_row, stripe->zbuf, stripe->target_begin, stripe->target_end);
+}
+
+static void merge_band_task(void* arg, int index)
+{
+	registration_job* job = (registration_job*)arg;
+	uint32_t begin = (uint32_t)index * DEPTH_X_RES * DEPTH_Y_RES / job->num_bands;
+	uint32_t end = (uint32_t)(index + 1) * DEPTH_X_RES * DEPTH_Y_RES / job->num_bands;
+	uint16_t* out = job->output_mm;
+	uint32_t i;
+	int s;
+
+	memset(out + begin, DEPTH_NO_MM_VALUE, sizeof(uint16_t) * (end - begin));
+	for (s = 0; s < job->dev->registration_threads; s++) {
+		registration_stripe* stripe = &job->dev->registration_stripes[s];
+		uint32_t from = begin > stripe->target_begin ? begin : stripe->target_begin;
+		uint32_t to = end < stripe->target_end ? end : stripe->target_end;
+		const uint16_t* z = stripe->zbuf - stripe->target_begin;
+		// smallest non-zero value: 0 wraps around to 0xffff when decremented
+		for (i = from; i < to; i++) {
+			uint16_t a = out[i], b = z[i];
+			out[i] = (uint16_t)(a - 1) < (uint16_t)(b - 1) ? a : b;
+		}
+	}
+}
+
+// apply registration data to a single packed frame
+FN_INTERNAL int freenect_apply_registration(freenect_device* dev, uint8_t* input_packed, uint16_t* output_mm)
+{
+	freenect_registration* reg = &(dev->registration);
+
+#ifndef DENSE_REGISTRATION
+	if (dev->registration_threads > 1) {
+		if (!dev->registration_stripes && setup_registration_stripes(dev) < 0) {
+			freenect_context *ctx = dev->parent;
+			FN_WARNING("Could not set up parallel registration, falling back to a single thread\n");
+			// freenect_set_registration_threads() refuses while depth is
+			// running, which would bring us back here on every frame
+			release_registration_pool(dev);
+		} else {
+			registration_job job;
+			job.dev = dev;
+			job.input_packed = input_packed;
+			job.output_mm = output_mm;
+			job.num_bands = dev->registration_threads;
+			fn_pool_run(dev->registration_pool, register_stripe_task, &job, dev->registration_threads);
+			fn_pool_run(dev->registration_pool, merge_band_task, &job, job.num_bands);
+			return 0;
+		}
+	}
+#endif
+
+	// set output buffer to zero using pointer-sized memory access (~ 30-40% faster than memset)
+	size_t i, *wipe = (size_t*)output_mm;
+	for (i = 0; i < DEPTH_X_RES * DEPTH_Y_RES * sizeof(uint16_t) / sizeof(size_t); i++) wipe[i] = DEPTH_NO_MM_VALUE;
+
+	register_rows(reg, (const int16_t (*)[2])dev->registration_table16, dev->registration_table16_bias, input_packed, 0, DEPTH_Y_RES, output_mm, 0, DEPTH_X_RES * DEPTH_Y_RES);
+	return 0;
+}
+
+int freenect_set_registration_threads(freenect_device* dev, int threads)
+{
+	if (threads < 1)
+		threads = 1;
+	if (threads > DEPTH_Y_RES)
+		threads = DEPTH_Y_RES;
+	if (dev->depth.running)
+		return -1;
+
+	release_registration_pool(dev);
+	if (threads == 1)
+		return 0;
+
+	// the thread delivering the frame does a share of the work itself
+	dev->registration_pool = fn_pool_create(threads - 1);
+	if (!dev->registration_pool)
+		return -1;
+	dev->registration_threads = threads;
+	return 0;
+}
+
+int freenect_get_registration_threads(freenect_device* dev)
+{
+	return dev->registration_threads > 1 ? dev->registration_threads : 1;
+}
+
+// build the int16 delta table from the int32 one, if requested and all
+// entries fit; otherwise leave the device on the int32 table.
+// The x deltas are in 1/256 pixel, so they only span 128 pixels either way;
+// a typical calibration shifts everything by more than that in one
+// direction, so they are stored against the middle of their range.
+static void update_registration_table16(freenect_device* dev)
+{
+	freenect_context *ctx = dev->parent;
+	int32_t (*table)[2] = dev->registration.registration_table;
+	int32_t x, y, index;
+	int32_t min_dx = INT32_MAX, max_dx = INT32_MIN, bias;
+	int fits = 1;
+
+	free(dev->registration_table16);
+	dev->registration_table16 = NULL;
+	dev->registration_table16_bias = 0;
+	if (!table || dev->registration_table_format == FREENECT_REGISTRATION_TABLE_INT32)
+		return;
+
+	for (y = 0, index = 0; y < DEPTH_Y_RES; y++) {
+		for (x = 0; x < DEPTH_X_RES; x++, index++) {
+			int32_t dx = table[index][0] - x * REG_X_VAL_SCALE;
+			int32_t dy = table[index][1] - y;
+			if (dy < INT16_MIN || dy > INT16_MAX)
+				fits = 0;
+			if (table[index][0] == 2 * DEPTH_X_RES * REG_X_VAL_SCALE)
+				continue;
+			if (dx < min_dx) min_dx = dx;
+			if (dx > max_dx) max_dx = dx;
+		}
+	}
+	bias = min_dx <= max_dx ? min_dx + (max_dx - min_dx) / 2 : 0;
+	// INT16_MIN itself marks out-of-bounds entries
+	if (min_dx <= max_dx && (min_dx - bias <= INT16_MIN || max_dx - bias > INT16_MAX))
+		fits = 0;
+	if (!fits) {
+		FN_NOTICE("Registration table does not fit int16 deltas, using the int32 layout\n");
+		return;
+	}
+
+	int16_t (*table16)[2] = (int16_t (*)[2])malloc(sizeof(int16_t) * DEPTH_X_RES * DEPTH_Y_RES * 2);
+	if (!table16)
+		return;
+	for (y = 0, index = 0; y < DEPTH_Y_RES; y++) {
+		for (x = 0; x < DEPTH_X_RES; x++, index++) {
+			if (table[index][0] == 2 * DEPTH_X_RES * REG_X_VAL_SCALE)
+				table16[index][0] = REG_TABLE16_OUT_OF_BOUNDS;
+			else
+				table16[index][0] = (int16_t)(table[index][0] - x * REG_X_VAL_SCALE - bias);
+			table16[index][1] = (int16_t)(table[index][1] - y);
+		}
+	}
+	dev->registration_table16 = table16;
+	dev->registration_table16_bias = bias;
+}
+
+int freenect_set_registration_table_format(freenect_device* dev, freenect_registration_table_format format)
+{
+	if (format != FREENECT_REGISTRATION_TABLE_INT32 && format != FREENECT_REGISTRATION_TABLE_INT16_DELTA)
+		return -1;
+	if (dev->depth.running)
+		return -1;
+	dev->registration_table_format = format;
+	update_registration_table16(dev);
+	return 0;
+}
+
+freenect_registration_table_format freenect_get_registration_table_format(freenect_device* dev)
+{
+	return dev->registration_table16 ? FREENECT_REGISTRATION_TABLE_INT16_DELTA : FREENECT_REGISTRATION_TABLE_INT32;
+}
+
+FN_INTERNAL void freenect_teardown_registration(freenect_device* dev)
+{
+	release_registration_pool(dev);
+	free(dev->registration_table16);
+	dev->registration_table16 = NULL;
+	free(dev->depth_rays);
+	dev->depth_rays = NULL;
+	free(dev->points_rgb);
+	dev->points_rgb = NULL;
+	free(dev->points);
+	dev->points = NULL;
+	freenect_destroy_registration(&(dev->registration));
+}
+
 // Same as freenect_apply_registration, but don't bother aligning to the RGB image
-FN_INTERNAL int freenect_apply_depth_to_mm(freenect_device* dev, uint8_t* input_packed, uint16_t* output_mm)
+FN_INTERNAL int freenect_apply_depth_to_mm_rows(freenect_device* dev, uint8_t* input_packed, uint16_t* output_mm, int first_row, int last_row)
 {
 	freenect_registration* reg = &(dev->registration);
-	uint16_t unpack[8];
-	uint32_t x,y,source_index = 8;
-	for (y = 0; y < DEPTH_Y_RES; y++) {
+	uint16_t unpack[DEPTH_X_RES];
+	uint32_t x;
+	int y;
+	input_packed += first_row * DEPTH_X_RES * 11 / 8;
+	for (y = first_row; y < last_row; y++) {
+		// unpack one row of the packed frame
+		freenect_convert_packed11_to_16bit( input_packed, unpack, DEPTH_X_RES );
+		input_packed += DEPTH_X_RES * 11 / 8;
 		for (x = 0; x < DEPTH_X_RES; x++) {
-			// get 8 pixels from the packed frame
-			if (source_index == 8) {
-				unpack_8_pixels( input_packed, unpack );
-				source_index = 0;
-				input_packed += 11;
-			}
 			// get the value at the current depth pixel, convert to millimeters
-			uint16_t metric_depth = reg->raw_to_mm_shift[ unpack[source_index++] ];
+			uint16_t metric_depth = reg->raw_to_mm_shift[ unpack[x] ];
 			output_mm[y * DEPTH_X_RES + x] = metric_depth < DEPTH_MAX_METRIC_VALUE ? metric_depth : DEPTH_MAX_METRIC_VALUE;
 		}
 	}
 	return 0;
 }
 
+FN_INTERNAL int freenect_apply_depth_to_mm(freenect_device* dev, uint8_t* input_packed, uint16_t* output_mm)
+{
+	return freenect_apply_depth_to_mm_rows(dev, input_packed, output_mm, 0, DEPTH_Y_RES);
+}
+
+// Same as freenect_apply_depth_to_mm, but project every pixel along its ray
+// to get x, y and z in mm
+FN_INTERNAL int freenect_apply_depth_to_xyz_rows(freenect_device* dev, uint8_t* input_packed, float* output_xyz, int first_row, int last_row)
+{
+	freenect_registration* reg = &(dev->registration);
+	const float* ray_x = dev->depth_rays;
+	const float* ray_y = dev->depth_rays + DEPTH_X_RES;
+	uint16_t unpack[DEPTH_X_RES];
+	uint32_t x;
+	int y;
+	if (!ray_x)
+		return -1;
+	input_packed += first_row * DEPTH_X_RES * 11 / 8;
+	output_xyz += first_row * DEPTH_X_RES * 3;
+	for (y = first_row; y < last_row; y++) {
+		// unpack one row of the packed frame
+		freenect_convert_packed11_to_16bit( input_packed, unpack, DEPTH_X_RES );
+		input_packed += DEPTH_X_RES * 11 / 8;
+		for (x = 0; x < DEPTH_X_RES; x++) {
+			uint16_t metric_depth = reg->raw_to_mm_shift[ unpack[x] ];
+			float z = metric_depth < DEPTH_MAX_METRIC_VALUE ? metric_depth : DEPTH_MAX_METRIC_VALUE;
+			output_xyz[0] = ray_x[x] * z;
+			output_xyz[1] = ray_y[y] * z;
+			output_xyz[2] = z;
+			output_xyz += 3;
+		}
+	}
+	return 0;
+}
+
+FN_INTERNAL int freenect_apply_depth_to_xyz(freenect_device* dev, uint8_t* input_packed, float* output_xyz)
+{
+	return freenect_apply_depth_to_xyz_rows(dev, input_packed, output_xyz, 0, DEPTH_Y_RES);
+}
+
+/*
+ * Colored point cloud
+ *
+ * Every depth pixel is projected along its ray like FREENECT_DEPTH_XYZ and
+ * looked up in the RGB image at the position freenect_apply_registration
+ * would move it to. Row stripes are processed concurrently, each writing
+ * its points at the start of its own slice of the output; the slices are
+ * then moved together.
+ */
+
+typedef struct {
+	freenect_device* dev;
+	uint8_t* input_packed;
+	const uint8_t* rgb;
+	freenect_point_xyzrgb* points;
+	int num_stripes;
+	int counts[DEPTH_Y_RES];
+} points_job;
+
+static int points_rows(freenect_device* dev, uint8_t* input_packed, const uint8_t* rgb,
+                       uint32_t first_row, uint32_t last_row, freenect_point_xyzrgb* out)
+{
+	freenect_registration* reg = &(dev->registration);
+	const float* ray_x = dev->depth_rays;
+	const float* ray_y = dev->depth_rays + DEPTH_X_RES;
+	uint32_t target_offset = DEPTH_Y_RES * reg->reg_pad_info.start_lines;
+	uint16_t unpack[DEPTH_X_RES];
+	uint32_t x,y;
+	int count = 0;
+
+	for (y = first_row; y < last_row; y++) {
+		// unpack one row of the packed frame
+		freenect_convert_packed11_to_16bit( input_packed, unpack, DEPTH_X_RES );
+		input_packed += DEPTH_X_RES * 11 / 8;
+
+		for (x = 0; x < DEPTH_X_RES; x++) {
+			uint16_t metric_depth = reg->raw_to_mm_shift[ unpack[x] ];
+			if (metric_depth == DEPTH_NO_MM_VALUE) continue;
+			if (metric_depth >= DEPTH_MAX_METRIC_VALUE) continue;
+
+			// same mapping as register_rows
+			uint32_t reg_index = DEPTH_MIRROR_X ? ((y + 1) * DEPTH_X_RES - x - 1) : (y * DEPTH_X_RES + x);
+			uint32_t nx = (reg->registration_table[reg_index][0] + reg->depth_to_rgb_shift[metric_depth]) / REG_X_VAL_SCALE;
+			uint32_t ny = reg->registration_table[reg_index][1];
+			if (nx >= DEPTH_X_RES) continue;
+			uint32_t rgb_index = (DEPTH_MIRROR_X ? ((ny + 1) * DEPTH_X_RES - nx - 1) : (ny * DEPTH_X_RES + nx)) - target_offset;
+			if (rgb_index >= DEPTH_X_RES * DEPTH_Y_RES) continue;
+
+			float z = metric_depth;
+			out[count].x = ray_x[x] * z;
+			out[count].y = ray_y[y] * z;
+			out[count].z = z;
+			out[count].r = rgb[3 * rgb_index];
+			out[count].g = rgb[3 * rgb_index + 1];
+			out[count].b = rgb[3 * rgb_index + 2];
+			out[count].pad = 0;
+			count++;
+		}
+	}
+	return count;
+}
+
+static void points_stripe_task(void* arg, int index)
+{
+	points_job* job = (points_job*)arg;
+	uint32_t first_row = (uint32_t)index * DEPTH_Y_RES / job->num_stripes;
+	uint32_t last_row = (uint32_t)(index + 1) * DEPTH_Y_RES / job->num_stripes;
+	job->counts[index] = points_rows(job->dev, job->input_packed + first_row * DEPTH_X_RES * 11 / 8, job->rgb,
+	                                 first_row, last_row, job->points + first_row * DEPTH_X_RES);
+}
+
+/// Build the colored point cloud of a packed frame into points, which holds
+/// room for 640x480 points. Returns the number of points.
+FN_INTERNAL int freenect_apply_points(freenect_device* dev, uint8_t* input_packed, const uint8_t* rgb, freenect_point_xyzrgb* points)
+{
+	points_job job;
+	int count, i;
+
+	if (!dev->depth_rays || !dev->registration.registration_table)
+		return -1;
+	job.dev = dev;
+	job.input_packed = input_packed;
+	job.rgb = rgb;
+	job.points = points;
+	job.num_stripes = dev->registration_pool ? dev->registration_threads : 1;
+	fn_pool_run(dev->registration_pool, points_stripe_task, &job, job.num_stripes);
+
+	count = job.counts[0];
+	for (i = 1; i < job.num_stripes; i++) {
+		uint32_t first_row = (uint32_t)i * DEPTH_Y_RES / job.num_stripes;
+		if ((uint32_t)count != first_row * DEPTH_X_RES)
+			memmove(points + count, points + first_row * DEPTH_X_RES, sizeof(freenect_point_xyzrgb) * job.counts[i]);
+		count += job.counts[i];
+	}
+	return count;
+}
+
+void freenect_set_points_callback(freenect_device *dev, freenect_points_cb cb)
+{
+	if (cb && !dev->points) {
+		dev->points_rgb = (uint8_t*)malloc(DEPTH_X_RES * DEPTH_Y_RES * 3);
+		dev->points = (freenect_point_xyzrgb*)malloc(sizeof(freenect_point_xyzrgb) * DEPTH_X_RES * DEPTH_Y_RES);
+		if (!dev->points_rgb || !dev->points) {
+			free(dev->points_rgb);
+			dev->points_rgb = NULL;
+			free(dev->points);
+			dev->points = NULL;
+			return;
+		}
+		dev->points_rgb_valid = 0;
+	}
+	dev->points_cb = cb;
+}
+
 // create temporary x/y shift tables
 static void freenect_create_dxdy_tables(double* reg_x_table, double* reg_y_table, int32_t resolution_x, int32_t resolution_y, freenect_reg_info* regdata )
 {
@@ -329,15 +728,164 @@ void freenect_camera_to_world(freenect_device* dev, int cx, int cy, int wz, doub
 	*wy = (double)(cy - DEPTH_Y_RES/2) * factor;
 }
 
+// the projection used by freenect_camera_to_world, for the batch converters
+static int get_projection(freenect_device* dev, int n, freenect_projection* p)
+{
+	freenect_zero_plane_info* zpi = &(dev->registration.zero_plane_info);
+	if (n < 0 || zpi->reference_distance == 0)
+		return -1;
+	p->center_x = DEPTH_X_RES/2;
+	p->center_y = DEPTH_Y_RES/2;
+	p->scale = (float)(2 * zpi->reference_pixel_size / zpi->reference_distance);
+	p->max_x = DEPTH_X_RES - 1;
+	p->max_y = DEPTH_Y_RES - 1;
+	return 0;
+}
+
+int freenect_camera_to_world_batch(freenect_device* dev, int n, const float* cx, const float* cy, const float* wz, float* wx, float* wy, uint8_t* valid)
+{
+	freenect_projection p;
+	if (get_projection(dev, n, &p) < 0)
+		return -1;
+	freenect_convert_camera_to_world(&p, n, cx, cy, wz, wx, wy, valid);
+	return 0;
+}
+
+int freenect_camera_to_world_batch_s16(freenect_device* dev, int n, const int16_t* cx, const int16_t* cy, const int16_t* wz, float* wx, float* wy, uint8_t* valid)
+{
+	freenect_projection p;
+	if (get_projection(dev, n, &p) < 0)
+		return -1;
+	freenect_convert_camera_to_world_s16(&p, n, cx, cy, wz, wx, wy, valid);
+	return 0;
+}
+
+int freenect_world_to_camera_batch(freenect_device* dev, int n, const float* wx, const float* wy, const float* wz, float* cx, float* cy, uint8_t* valid)
+{
+	freenect_projection p;
+	if (get_projection(dev, n, &p) < 0)
+		return -1;
+	freenect_convert_world_to_camera(&p, n, wx, wy, wz, cx, cy, valid);
+	return 0;
+}
+
+int freenect_world_to_camera_batch_s16(freenect_device* dev, int n, const int16_t* wx, const int16_t* wy, const int16_t* wz, float* cx, float* cy, uint8_t* valid)
+{
+	freenect_projection p;
+	if (get_projection(dev, n, &p) < 0)
+		return -1;
+	freenect_convert_world_to_camera_s16(&p, n, wx, wy, wz, cx, cy, valid);
+	return 0;
+}
+
+int freenect_set_registration_cache_dir(freenect_context* ctx, const char* path)
+{
+	free(ctx->registration_cache_dir);
+	ctx->registration_cache_dir = NULL;
+	if (!path || !*path)
+		return 0;
+	ctx->registration_cache_dir = strdup(path);
+	return ctx->registration_cache_dir ? 0 : -1;
+}
+
+// name of the cache file for the device at video resolution res, or < 0 if
+// the device cannot be cached
+static int registration_cache_filename(freenect_device* dev, freenect_resolution res, char* filename, size_t size)
+{
+	const char* dir = dev->parent->registration_cache_dir;
+	char serial[sizeof(dev->camera_serial)];
+	size_t i;
+	if (!dir || !dev->camera_serial[0])
+		return -1;
+	// keep the serial number from escaping the cache directory
+	for (i = 0; dev->camera_serial[i]; i++) {
+		char c = dev->camera_serial[i];
+		int safe = (c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z');
+		serial[i] = safe ? c : '_';
+	}
+	serial[i] = '\0';
+	if (strlen(dir) + strlen(serial) + 32 > size)
+		return -1;
+	sprintf(filename, "%s/registration-%s-%d.bin", dir, serial, (int)res);
+	return 0;
+}
+
+/// Load the parameters and tables for video resolution res from the
+/// registration cache, if it has them.
+FN_INTERNAL int freenect_load_registration_cache(freenect_device* dev, freenect_resolution res)
+{
+	freenect_context *ctx = dev->parent;
+	freenect_registration loaded;
+	char filename[1024];
+
+	if (registration_cache_filename(dev, res, filename, sizeof(filename)) < 0)
+		return -1;
+	if (freenect_load_registration(&loaded, filename) < 0) {
+		FN_SPEW("No usable registration cache in %s\n", filename);
+		return -1;
+	}
+	FN_INFO("Loaded registration from %s\n", filename);
+
+	freenect_destroy_registration(&(dev->registration));
+	free_registration_stripes(dev);
+	dev->registration = loaded;
+	dev->registration_stale = 0;
+	dev->reg_info_valid = 1;
+	dev->reg_info_resolution = res;
+	update_registration_table16(dev);
+	return 0;
+}
+
+static void save_registration_cache(freenect_device* dev)
+{
+	freenect_context *ctx = dev->parent;
+	char filename[1024];
+
+	if (!dev->reg_info_valid)
+		return;
+	if (registration_cache_filename(dev, dev->reg_info_resolution, filename, sizeof(filename)) < 0)
+		return;
+	if (freenect_save_registration(&(dev->registration), filename) < 0)
+		FN_WARNING("Failed to write registration cache %s\n", filename);
+	else
+		FN_INFO("Saved registration to %s\n", filename);
+}
+
+/// Fill the ray slopes for FREENECT_DEPTH_XYZ: the point seen by depth pixel
+/// (x, y) at depth z is z * (ray_x[x], ray_y[y], 1). This is
+/// freenect_camera_to_world() with the per-pixel factors taken out.
+static void update_depth_rays(freenect_device* dev)
+{
+	freenect_zero_plane_info* zpi = &(dev->registration.zero_plane_info);
+	int i;
+
+	if (!dev->depth_rays)
+		dev->depth_rays = (float*)malloc(sizeof(float) * (DEPTH_X_RES + DEPTH_Y_RES));
+	if (!dev->depth_rays)
+		return;
+	double factor = 2 * zpi->reference_pixel_size / zpi->reference_distance;
+	for (i = 0; i < DEPTH_X_RES; i++)
+		dev->depth_rays[i] = (float)((i - DEPTH_X_RES/2) * factor);
+	for (i = 0; i < DEPTH_Y_RES; i++)
+		dev->depth_rays[DEPTH_X_RES + i] = (float)((i - DEPTH_Y_RES/2) * factor);
+}
+
 /// Allocate and fill registration tables
 /// This function should be called every time a new video (not depth!) mode is
-/// activated.
+/// activated. Tables that are still up to date with the registration
+/// parameters are kept.
 FN_INTERNAL int freenect_init_registration(freenect_device* dev)
 {
 	freenect_registration* reg = &(dev->registration);
 
+	update_depth_rays(dev);
+	if (reg->registration_table && !dev->registration_stale)
+		return 0;
+
 	// Ensure that we free the previous tables before dropping the pointers, if there were any.
 	freenect_destroy_registration(&(dev->registration));
+	// stripe bounds depend on the registration table
+	free_registration_stripes(dev);
 
 	// Allocate tables.
 	reg->raw_to_mm_shift    = (uint16_t*)malloc( sizeof(uint16_t) * DEPTH_MAX_RAW_VALUE );
@@ -346,7 +894,10 @@ FN_INTERNAL int freenect_init_registration(freenect_device* dev)
 
 	// Fill tables.
 	complete_tables(reg);
+	update_registration_table16(dev);
+	dev->registration_stale = 0;
 
+	save_registration_cache(dev);
 	return 0;
 }
 
@@ -33,5 +33,12 @@
 int freenect_init_registration(freenect_device* dev);
 int freenect_apply_registration(freenect_device* dev, uint8_t* input_packed, uint16_t* output_mm);
 int freenect_apply_depth_to_mm(freenect_device* dev, uint8_t* input_packed, uint16_t* output_mm);
+int freenect_apply_depth_to_xyz(freenect_device* dev, uint8_t* input_packed, float* output_xyz);
+// Only rows [first_row, last_row) of the frame, for incremental decoding
+int freenect_apply_depth_to_mm_rows(freenect_device* dev, uint8_t* input_packed, uint16_t* output_mm, int first_row, int last_row);
+int freenect_apply_depth_to_xyz_rows(freenect_device* dev, uint8_t* input_packed, float* output_xyz, int first_row, int last_row);
+int freenect_apply_points(freenect_device* dev, uint8_t* input_packed, const uint8_t* rgb, freenect_point_xyzrgb* points);
+void freenect_teardown_registration(freenect_device* dev);
+int freenect_load_registration_cache(freenect_device* dev, freenect_resolution res);
 
 #endif
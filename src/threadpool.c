@@ -0,0 +1,149 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2010 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "freenect_internal.h"
+#include "threadpool.h"
+
+struct _fn_pool {
+	pthread_mutex_t lock;
+	pthread_cond_t work_cond; // a batch was posted, or the pool shuts down
+	pthread_cond_t done_cond; // the last task of a batch finished
+	pthread_t *threads;
+	int num_threads;
+	int shutdown;
+
+	// current batch
+	unsigned int generation;
+	fn_pool_task task;
+	void *arg;
+	int next;
+	int count;
+	int pending;
+};
+
+// Take tasks of the current batch until none are left. Called with the lock
+// held; the lock is dropped while a task runs.
+static void run_tasks(fn_pool *pool)
+{
+	while (pool->next < pool->count) {
+		int index = pool->next++;
+		fn_pool_task task = pool->task;
+		void *arg = pool->arg;
+		pthread_mutex_unlock(&pool->lock);
+		task(arg, index);
+		pthread_mutex_lock(&pool->lock);
+		if (--pool->pending == 0)
+			pthread_cond_broadcast(&pool->done_cond);
+	}
+}
+
+static void *pool_worker(void *arg)
+{
+	fn_pool *pool = (fn_pool*)arg;
+	unsigned int seen = 0;
+	pthread_mutex_lock(&pool->lock);
+	for (;;) {
+		while (!pool->shutdown && pool->generation == seen)
+			pthread_cond_wait(&pool->work_cond, &pool->lock);
+		if (pool->shutdown)
+			break;
+		seen = pool->generation;
+		run_tasks(pool);
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return NULL;
+}
+
+FN_INTERNAL fn_pool *fn_pool_create(int threads)
+{
+	if (threads < 0)
+		return NULL;
+	fn_pool *pool = (fn_pool*)malloc(sizeof(fn_pool));
+	if (!pool)
+		return NULL;
+	memset(pool, 0, sizeof(*pool));
+	pool->threads = (pthread_t*)malloc(sizeof(pthread_t) * (threads ? threads : 1));
+	if (!pool->threads) {
+		free(pool);
+		return NULL;
+	}
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->work_cond, NULL);
+	pthread_cond_init(&pool->done_cond, NULL);
+
+	for (pool->num_threads = 0; pool->num_threads < threads; pool->num_threads++) {
+		if (pthread_create(&pool->threads[pool->num_threads], NULL, pool_worker, pool) != 0) {
+			fn_pool_destroy(pool);
+			return NULL;
+		}
+	}
+	return pool;
+}
+
+FN_INTERNAL void fn_pool_destroy(fn_pool *pool)
+{
+	int i;
+	if (!pool)
+		return;
+	pthread_mutex_lock(&pool->lock);
+	pool->shutdown = 1;
+	pthread_cond_broadcast(&pool->work_cond);
+	pthread_mutex_unlock(&pool->lock);
+	for (i = 0; i < pool->num_threads; i++)
+		pthread_join(pool->threads[i], NULL);
+
+	pthread_cond_destroy(&pool->done_cond);
+	pthread_cond_destroy(&pool->work_cond);
+	pthread_mutex_destroy(&pool->lock);
+	free(pool->threads);
+	free(pool);
+}
+
+FN_INTERNAL void fn_pool_run(fn_pool *pool, fn_pool_task task, void *arg, int count)
+{
+	int i;
+	if (!pool || pool->num_threads == 0 || count <= 1) {
+		for (i = 0; i < count; i++)
+			task(arg, i);
+		return;
+	}
+	pthread_mutex_lock(&pool->lock);
+	pool->task = task;
+	pool->arg = arg;
+	pool->next = 0;
+	pool->count = count;
+	pool->pending = count;
+	pool->generation++;
+	pthread_cond_broadcast(&pool->work_cond);
+	run_tasks(pool);
+	while (pool->pending > 0)
+		pthread_cond_wait(&pool->done_cond, &pool->lock);
+	pthread_mutex_unlock(&pool->lock);
+}
@@ -0,0 +1,51 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2010 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+// A small pool of worker threads used to split per-frame work (e.g.
+// registration) into independent tasks.
+
+typedef struct _fn_pool fn_pool;
+
+// Task callback; index runs from 0 to the count passed to fn_pool_run().
+typedef void (*fn_pool_task)(void *arg, int index);
+
+// Create a pool with the given number of worker threads. Returns NULL on
+// failure.
+fn_pool *fn_pool_create(int threads);
+
+// Stop and join the workers and free the pool. NULL is allowed.
+void fn_pool_destroy(fn_pool *pool);
+
+// Run task(arg, i) for every i in [0, count) and return once all of them
+// have finished. The calling thread takes part in the work. A NULL pool
+// runs all tasks on the calling thread. Not reentrant: only one batch may be
+// running on a pool at a time.
+void fn_pool_run(fn_pool *pool, fn_pool_task task, void *arg, int count);
+
+#endif
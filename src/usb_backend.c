@@ -0,0 +1,156 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2010 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "freenect_internal.h"
+
+static const fnusb_backend *backends[] = {
+	&fnusb_libusb10_backend,
+	&fnusb_mock_backend,
+};
+
+static const fnusb_backend *dev_backend(fnusb_dev *dev)
+{
+	return dev->parent->parent->usb.backend;
+}
+
+FN_INTERNAL int fnusb_num_devices(fnusb_ctx *ctx)
+{
+	return ctx->backend->num_devices(ctx);
+}
+
+FN_INTERNAL int fnusb_list_device_attributes(fnusb_ctx *ctx, struct freenect_device_attributes** attribute_list)
+{
+	return ctx->backend->list_device_attributes(ctx, attribute_list);
+}
+
+FN_INTERNAL int fnusb_init(fnusb_ctx *ctx, freenect_usb_context *usb_ctx)
+{
+	// FREENECT_USB_BACKEND names the backend to use; libusb is the default
+	const char *name = getenv("FREENECT_USB_BACKEND");
+	unsigned int i;
+
+	ctx->backend = backends[0];
+	if (name && *name) {
+		ctx->backend = NULL;
+		for (i = 0; i < sizeof(backends) / sizeof(backends[0]); i++) {
+			if (strcmp(name, backends[i]->name) == 0)
+				ctx->backend = backends[i];
+		}
+		if (!ctx->backend)
+			return -1;
+	}
+	return ctx->backend->init(ctx, usb_ctx);
+}
+
+FN_INTERNAL int fnusb_shutdown(fnusb_ctx *ctx)
+{
+	return ctx->backend->shutdown(ctx);
+}
+
+FN_INTERNAL int fnusb_process_events(fnusb_ctx *ctx)
+{
+	return ctx->backend->process_events(ctx);
+}
+
+FN_INTERNAL int fnusb_process_events_timeout(fnusb_ctx *ctx, struct timeval* timeout)
+{
+	return ctx->backend->process_events_timeout(ctx, timeout);
+}
+
+FN_INTERNAL int fnusb_get_pollfds(fnusb_ctx *ctx, freenect_pollfd *fds, int max)
+{
+	return ctx->backend->get_pollfds(ctx, fds, max);
+}
+
+FN_INTERNAL void fnusb_set_pollfd_notifiers(fnusb_ctx *ctx, freenect_pollfd_added_cb added, freenect_pollfd_removed_cb removed, void *user)
+{
+	ctx->backend->set_pollfd_notifiers(ctx, added, removed, user);
+}
+
+FN_INTERNAL int fnusb_get_next_timeout(fnusb_ctx *ctx, struct timeval *timeout)
+{
+	return ctx->backend->get_next_timeout(ctx, timeout);
+}
+
+FN_INTERNAL int fnusb_interrupt_events(fnusb_ctx *ctx)
+{
+	return ctx->backend->interrupt_events(ctx);
+}
+
+FN_INTERNAL int fnusb_open_subdevices(freenect_device *dev, int index)
+{
+	return dev->parent->usb.backend->open_subdevices(dev, index);
+}
+
+FN_INTERNAL int fnusb_close_subdevices(freenect_device *dev)
+{
+	return dev->parent->usb.backend->close_subdevices(dev);
+}
+
+// Calls on a subdevice without a handle, such as one that went away and was
+// not reopened yet (see freenect_set_auto_reconnect()), fail like calls on
+// an unplugged one
+FN_INTERNAL int fnusb_start_iso(fnusb_dev *dev, fnusb_isoc_stream *strm, fnusb_iso_cb cb, int ep, int xfers, int pkts, int len)
+{
+	if (!dev->dev)
+		return LIBUSB_ERROR_NO_DEVICE;
+	return dev_backend(dev)->start_iso(dev, strm, cb, ep, xfers, pkts, len);
+}
+
+FN_INTERNAL int fnusb_stop_iso(fnusb_dev *dev, fnusb_isoc_stream *strm)
+{
+	return dev_backend(dev)->stop_iso(dev, strm);
+}
+
+FN_INTERNAL int fnusb_control(fnusb_dev *dev, uint8_t bmRequestType, uint8_t bRequest, uint16_t wValue, uint16_t wIndex, uint8_t *data, uint16_t wLength)
+{
+	if (!dev->dev)
+		return LIBUSB_ERROR_NO_DEVICE;
+	return dev_backend(dev)->control(dev, bmRequestType, bRequest, wValue, wIndex, data, wLength);
+}
+
+FN_INTERNAL int fnusb_control_async(fnusb_dev *dev, uint8_t bmRequestType, uint8_t bRequest, uint16_t wValue, uint16_t wIndex, uint8_t *data, uint16_t wLength, fnusb_control_cb cb, void *user)
+{
+	if (!dev->dev)
+		return LIBUSB_ERROR_NO_DEVICE;
+	return dev_backend(dev)->control_async(dev, bmRequestType, bRequest, wValue, wIndex, data, wLength, cb, user);
+}
+
+#ifdef BUILD_AUDIO
+FN_INTERNAL int fnusb_bulk(fnusb_dev *dev, uint8_t endpoint, uint8_t *data, int len, int *transferred)
+{
+	if (!dev->dev)
+		return LIBUSB_ERROR_NO_DEVICE;
+	return dev_backend(dev)->bulk(dev, endpoint, data, len, transferred);
+}
+
+FN_INTERNAL int fnusb_num_interfaces(fnusb_dev *dev)
+{
+	return dev_backend(dev)->num_interfaces(dev);
+}
+#endif
@@ -33,7 +33,7 @@
 #include "freenect_internal.h"
 #include "loader.h"
 
-FN_INTERNAL int fnusb_num_devices(fnusb_ctx *ctx)
+static int libusb10_num_devices(fnusb_ctx *ctx)
 {
 	libusb_device **devs; 
 	//pointer to pointer of device, used to retrieve a list of devices	
@@ -56,7 +56,7 @@ FN_INTERNAL int fnusb_num_devices(fnusb_ctx *ctx)
 	return nr;
 }
 
-FN_INTERNAL int fnusb_list_device_attributes(fnusb_ctx *ctx, struct freenect_device_attributes** attribute_list)
+static int libusb10_list_device_attributes(fnusb_ctx *ctx, struct freenect_device_attributes** attribute_list)
 {
 	*attribute_list = NULL; // initialize some return value in case the user is careless.
 	libusb_device **devs;
@@ -116,13 +116,38 @@ FN_INTERNAL int fnusb_list_device_attributes(fnusb_ctx *ctx, struct freenect_dev
 	return num_cams;
 }
 
-FN_INTERNAL int fnusb_init(fnusb_ctx *ctx, freenect_usb_context *usb_ctx)
+#if !defined(_WIN32) && defined(LIBUSB_API_VERSION) && LIBUSB_API_VERSION >= 0x01000102
+#define FN_LIBUSB_HOTPLUG
+// Counts cameras being plugged in, so that lost devices are looked for
+// right away. Runs from libusb_handle_events().
+static int LIBUSB_CALL hotplug_callback(libusb_context *usb_ctx, libusb_device *device, libusb_hotplug_event event, void *user_data)
+{
+	((fnusb_ctx*)user_data)->arrivals++;
+	return 0;
+}
+#endif
+
+static void watch_hotplug(fnusb_ctx *ctx)
+{
+	ctx->hotplug = 0;
+	ctx->arrivals = 0;
+#ifdef FN_LIBUSB_HOTPLUG
+	if (!libusb_has_capability(LIBUSB_CAP_HAS_HOTPLUG))
+		return;
+	if (libusb_hotplug_register_callback(ctx->ctx, LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED, 0, VID_MICROSOFT, PID_NUI_CAMERA,
+	                                     LIBUSB_HOTPLUG_MATCH_ANY, hotplug_callback, ctx, &ctx->hotplug_handle) == 0)
+		ctx->hotplug = 1;
+#endif
+}
+
+static int libusb10_init(fnusb_ctx *ctx, freenect_usb_context *usb_ctx)
 {
 	int res;
 	if (!usb_ctx) {
 		res = libusb_init(&ctx->ctx);
 		if (res >= 0) {
 			ctx->should_free_ctx = 1;
+			watch_hotplug(ctx);
 			return 0;
 		} else {
 			ctx->should_free_ctx = 0;
@@ -133,13 +158,20 @@ FN_INTERNAL int fnusb_init(fnusb_ctx *ctx, freenect_usb_context *usb_ctx)
     // explicit cast required: in WIN32, freenect_usb_context* maps to void*
     ctx->ctx = (libusb_context*)usb_ctx;
 		ctx->should_free_ctx = 0;
+		watch_hotplug(ctx);
 		return 0;
 	}
 }
 
-FN_INTERNAL int fnusb_shutdown(fnusb_ctx *ctx)
+static int libusb10_shutdown(fnusb_ctx *ctx)
 {
 	//int res;
+#ifdef FN_LIBUSB_HOTPLUG
+	// a caller's context outlives this one
+	if (ctx->hotplug)
+		libusb_hotplug_deregister_callback(ctx->ctx, ctx->hotplug_handle);
+#endif
+	ctx->hotplug = 0;
 	if (ctx->should_free_ctx) {
 		libusb_exit(ctx->ctx);
 		ctx->ctx = NULL;
@@ -147,17 +179,66 @@ FN_INTERNAL int fnusb_shutdown(fnusb_ctx *ctx)
 	return 0;
 }
 
-FN_INTERNAL int fnusb_process_events(fnusb_ctx *ctx)
+static int libusb10_process_events(fnusb_ctx *ctx)
 {
 	return libusb_handle_events(ctx->ctx);
 }
 
-FN_INTERNAL int fnusb_process_events_timeout(fnusb_ctx *ctx, struct timeval* timeout)
+static int libusb10_process_events_timeout(fnusb_ctx *ctx, struct timeval* timeout)
 {
 	return libusb_handle_events_timeout(ctx->ctx, timeout);
 }
 
-FN_INTERNAL int fnusb_open_subdevices(freenect_device *dev, int index)
+static int libusb10_get_pollfds(fnusb_ctx *ctx, freenect_pollfd *fds, int max)
+{
+#ifndef _WIN32
+	const struct libusb_pollfd **list = libusb_get_pollfds(ctx->ctx);
+	int n;
+
+	if (!list)
+		return LIBUSB_ERROR_NOT_SUPPORTED;
+	for (n = 0; list[n]; n++) {
+		if (n < max) {
+			fds[n].fd = list[n]->fd;
+			fds[n].events = list[n]->events;
+		}
+	}
+	libusb_free_pollfds(list);
+	return n;
+#else
+	return LIBUSB_ERROR_NOT_SUPPORTED;
+#endif
+}
+
+static void libusb10_set_pollfd_notifiers(fnusb_ctx *ctx, freenect_pollfd_added_cb added, freenect_pollfd_removed_cb removed, void *user)
+{
+#ifndef _WIN32
+	libusb_set_pollfd_notifiers(ctx->ctx, added, removed, user);
+#endif
+}
+
+static int libusb10_get_next_timeout(fnusb_ctx *ctx, struct timeval *timeout)
+{
+#ifndef _WIN32
+	return libusb_get_next_timeout(ctx->ctx, timeout);
+#else
+	return LIBUSB_ERROR_NOT_SUPPORTED;
+#endif
+}
+
+// libusb wakes its event handler through the pipe it keeps in the poll set,
+// so this also wakes an external loop polling freenect_get_pollfds()
+static int libusb10_interrupt_events(fnusb_ctx *ctx)
+{
+#if !defined(_WIN32) && defined(LIBUSB_API_VERSION) && LIBUSB_API_VERSION >= 0x01000105
+	libusb_interrupt_event_handler(ctx->ctx);
+	return 0;
+#else
+	return LIBUSB_ERROR_NOT_SUPPORTED;
+#endif
+}
+
+static int libusb10_open_subdevices(freenect_device *dev, int index)
 {
 	freenect_context *ctx = dev->parent;
 
@@ -220,6 +301,15 @@ FN_INTERNAL int fnusb_open_subdevices(freenect_device *dev, int index)
 					dev->usb_cam.dev = NULL;
 					break;
 				}
+				// The serial number keys the registration cache
+				if (desc.iSerialNumber != 0) {
+					unsigned char string_desc[256];
+					res = libusb_get_string_descriptor_ascii(dev->usb_cam.dev, desc.iSerialNumber, string_desc, sizeof(string_desc));
+					if (res > 0) {
+						strncpy(dev->camera_serial, (char*)string_desc, sizeof(dev->camera_serial) - 1);
+						dev->camera_serial[sizeof(dev->camera_serial) - 1] = '\0';
+					}
+				}
 			} else {
 				nr_cam++;
 			}
@@ -377,22 +467,25 @@ FN_INTERNAL int fnusb_open_subdevices(freenect_device *dev, int index)
 		if (dev->usb_cam.dev) {
 			libusb_release_interface(dev->usb_cam.dev, 0);
 			libusb_close(dev->usb_cam.dev);
+			dev->usb_cam.dev = NULL;
 		}
 		if (dev->usb_motor.dev) {
 			libusb_release_interface(dev->usb_motor.dev, 0);
 			libusb_close(dev->usb_motor.dev);
+			dev->usb_motor.dev = NULL;
 		}
 #ifdef BUILD_AUDIO
 		if (dev->usb_audio.dev) {
 			libusb_release_interface(dev->usb_audio.dev, 0);
 			libusb_close(dev->usb_audio.dev);
+			dev->usb_audio.dev = NULL;
 		}
 #endif
 		return -1;
 	}
 }
 
-FN_INTERNAL int fnusb_close_subdevices(freenect_device *dev)
+static int libusb10_close_subdevices(freenect_device *dev)
 {
 	if (dev->usb_cam.dev) {
 		libusb_release_interface(dev->usb_cam.dev, 0);
@@ -499,7 +592,7 @@ static void iso_callback(struct libusb_transfer *xfer)
 	}
 }
 
-FN_INTERNAL int fnusb_start_iso(fnusb_dev *dev, fnusb_isoc_stream *strm, fnusb_iso_cb cb, int ep, int xfers, int pkts, int len)
+static int libusb10_start_iso(fnusb_dev *dev, fnusb_isoc_stream *strm, fnusb_iso_cb cb, int ep, int xfers, int pkts, int len)
 {
 	freenect_context *ctx = dev->parent->parent;
 	int ret, i;
@@ -510,15 +603,25 @@ FN_INTERNAL int fnusb_start_iso(fnusb_dev *dev, fnusb_isoc_stream *strm, fnusb_i
 	strm->pkts = pkts;
 	strm->len = len;
 	strm->buffer = (uint8_t*)malloc(xfers * pkts * len);
-	strm->xfers = (struct libusb_transfer**)malloc(sizeof(struct libusb_transfer*) * xfers);
+	strm->xfers = (struct libusb_transfer**)calloc(xfers, sizeof(struct libusb_transfer*));
 	strm->dead = 0;
 	strm->dead_xfers = 0;
+	if (!strm->buffer || !strm->xfers) {
+		free(strm->buffer);
+		free(strm->xfers);
+		memset(strm, 0, sizeof(*strm));
+		return LIBUSB_ERROR_NO_MEM;
+	}
 
 	uint8_t *bufp = strm->buffer;
 
 	for (i=0; i<xfers; i++) {
 		FN_SPEW("Creating EP %02x transfer #%d\n", ep, i);
 		strm->xfers[i] = libusb_alloc_transfer(pkts);
+		if (!strm->xfers[i]) {
+			ret = LIBUSB_ERROR_NO_MEM;
+			break;
+		}
 
 		libusb_fill_iso_transfer(strm->xfers[i], dev->dev, ep, bufp, pkts * len, pkts, iso_callback, strm, 0);
 
@@ -527,17 +630,32 @@ FN_INTERNAL int fnusb_start_iso(fnusb_dev *dev, fnusb_isoc_stream *strm, fnusb_i
 		ret = libusb_submit_transfer(strm->xfers[i]);
 		if (ret < 0) {
 			FN_WARNING("Failed to submit isochronous transfer %d: %d\n", i, ret);
-			strm->dead_xfers++;
+			break;
 		}
 
 		bufp += pkts*len;
 	}
+	if (i == xfers)
+		return 0;
 
-	return 0;
-
+	// callers size the stream on what they asked for (the auto-tuner in
+	// particular), so don't run on fewer transfers: take back the ones
+	// that made it and fail the whole start
+	int submitted = i;
+	strm->dead = 1;
+	for (i=0; i<submitted; i++)
+		libusb_cancel_transfer(strm->xfers[i]);
+	while (strm->dead_xfers < submitted)
+		libusb_handle_events(ctx->usb.ctx);
+	for (i=0; i<xfers; i++)
+		libusb_free_transfer(strm->xfers[i]);
+	free(strm->buffer);
+	free(strm->xfers);
+	memset(strm, 0, sizeof(*strm));
+	return ret;
 }
 
-FN_INTERNAL int fnusb_stop_iso(fnusb_dev *dev, fnusb_isoc_stream *strm)
+static int libusb10_stop_iso(fnusb_dev *dev, fnusb_isoc_stream *strm)
 {
 	freenect_context *ctx = dev->parent->parent;
 	int i;
@@ -568,18 +686,96 @@ FN_INTERNAL int fnusb_stop_iso(fnusb_dev *dev, fnusb_isoc_stream *strm)
 	return 0;
 }
 
-FN_INTERNAL int fnusb_control(fnusb_dev *dev, uint8_t bmRequestType, uint8_t bRequest, uint16_t wValue, uint16_t wIndex, uint8_t *data, uint16_t wLength)
+static int libusb10_control(fnusb_dev *dev, uint8_t bmRequestType, uint8_t bRequest, uint16_t wValue, uint16_t wIndex, uint8_t *data, uint16_t wLength)
 {
 	return libusb_control_transfer(dev->dev, bmRequestType, bRequest, wValue, wIndex, data, wLength, 0);
 }
 
+#ifndef _WIN32
+typedef struct {
+	fnusb_dev *dev;
+	uint8_t *data;
+	fnusb_control_cb cb;
+	void *user;
+} control_request;
+
+static void control_callback(struct libusb_transfer *xfer)
+{
+	control_request *req = (control_request*)xfer->user_data;
+	int res;
+
+	switch (xfer->status) {
+		case LIBUSB_TRANSFER_COMPLETED:
+			res = xfer->actual_length;
+			if (libusb_control_transfer_get_setup(xfer)->bmRequestType & LIBUSB_ENDPOINT_IN)
+				memcpy(req->data, libusb_control_transfer_get_data(xfer), res);
+			break;
+		case LIBUSB_TRANSFER_TIMED_OUT:
+			res = LIBUSB_ERROR_TIMEOUT;
+			break;
+		case LIBUSB_TRANSFER_STALL:
+			res = LIBUSB_ERROR_PIPE;
+			break;
+		case LIBUSB_TRANSFER_NO_DEVICE:
+			res = LIBUSB_ERROR_NO_DEVICE;
+			req->dev->device_dead = 1;
+			break;
+		case LIBUSB_TRANSFER_OVERFLOW:
+			res = LIBUSB_ERROR_OVERFLOW;
+			break;
+		default:
+			res = LIBUSB_ERROR_IO;
+			break;
+	}
+	req->cb(req->dev, res, req->user);
+	free(req);
+	// the transfer and its buffer go with LIBUSB_TRANSFER_FREE_*
+}
+
+static int libusb10_control_async(fnusb_dev *dev, uint8_t bmRequestType, uint8_t bRequest, uint16_t wValue, uint16_t wIndex, uint8_t *data, uint16_t wLength, fnusb_control_cb cb, void *user)
+{
+	struct libusb_transfer *xfer = libusb_alloc_transfer(0);
+	uint8_t *buf = (uint8_t*)malloc(LIBUSB_CONTROL_SETUP_SIZE + wLength);
+	control_request *req = (control_request*)malloc(sizeof(control_request));
+	int res;
+
+	if (!xfer || !buf || !req) {
+		libusb_free_transfer(xfer);
+		free(buf);
+		free(req);
+		return LIBUSB_ERROR_NO_MEM;
+	}
+	req->dev = dev;
+	req->data = data;
+	req->cb = cb;
+	req->user = user;
+	libusb_fill_control_setup(buf, bmRequestType, bRequest, wValue, wIndex, wLength);
+	if (!(bmRequestType & LIBUSB_ENDPOINT_IN))
+		memcpy(buf + LIBUSB_CONTROL_SETUP_SIZE, data, wLength);
+	libusb_fill_control_transfer(xfer, dev->dev, buf, control_callback, req, 0);
+	xfer->flags = LIBUSB_TRANSFER_FREE_BUFFER | LIBUSB_TRANSFER_FREE_TRANSFER;
+	res = libusb_submit_transfer(xfer);
+	if (res < 0) {
+		free(req);
+		libusb_free_transfer(xfer); // frees buf as well
+	}
+	return res;
+}
+#else
+// the libusb emulation only does isochronous transfers asynchronously
+static int libusb10_control_async(fnusb_dev *dev, uint8_t bmRequestType, uint8_t bRequest, uint16_t wValue, uint16_t wIndex, uint8_t *data, uint16_t wLength, fnusb_control_cb cb, void *user)
+{
+	return LIBUSB_ERROR_NOT_SUPPORTED;
+}
+#endif
+
 #ifdef BUILD_AUDIO
-FN_INTERNAL int fnusb_bulk(fnusb_dev *dev, uint8_t endpoint, uint8_t *data, int len, int *transferred) {
+static int libusb10_bulk(fnusb_dev *dev, uint8_t endpoint, uint8_t *data, int len, int *transferred) {
 	*transferred = 0;
 	return libusb_bulk_transfer(dev->dev, endpoint, data, len, transferred, 0);
 }
 
-FN_INTERNAL int fnusb_num_interfaces(fnusb_dev *dev) {
+static int libusb10_num_interfaces(fnusb_dev *dev) {
 	int retval = 0;
 	int res;
 	libusb_device* d = libusb_get_device(dev->dev);
@@ -592,3 +788,27 @@ FN_INTERNAL int fnusb_num_interfaces(fnusb_dev *dev) {
 	return retval;
 }
 #endif
+
+FN_INTERNAL const fnusb_backend fnusb_libusb10_backend = {
+	"libusb",
+	libusb10_num_devices,
+	libusb10_list_device_attributes,
+	libusb10_init,
+	libusb10_shutdown,
+	libusb10_process_events,
+	libusb10_process_events_timeout,
+	libusb10_get_pollfds,
+	libusb10_set_pollfd_notifiers,
+	libusb10_get_next_timeout,
+	libusb10_interrupt_events,
+	libusb10_open_subdevices,
+	libusb10_close_subdevices,
+	libusb10_start_iso,
+	libusb10_stop_iso,
+	libusb10_control,
+	libusb10_control_async,
+#ifdef BUILD_AUDIO
+	libusb10_bulk,
+	libusb10_num_interfaces,
+#endif
+};
@@ -61,14 +61,27 @@
 #define VIDEO_PKTBUF 1920
 #endif
 
+// Bounds of the transfer settings the camera streams take at runtime, see
+// freenect_set_iso_geometry(): the rules above, and the 3 x 1024 bytes a
+// high-bandwidth endpoint moves per microframe
+#define ISO_MAX_PKTS_IN_FLIGHT 1000
+#define ISO_MAX_PKTBUF 3072
+
+struct _fnusb_backend;
+
 typedef struct {
+	const struct _fnusb_backend *backend;
 	libusb_context *ctx;
 	int should_free_ctx;
+	void *backend_data; // private state of a non-libusb backend
+	int hotplug; // hotplug_handle is registered
+	int hotplug_handle;
+	int arrivals; // cameras plugged in since init, as far as the backend can tell
 } fnusb_ctx;
 
 typedef struct {
 	freenect_device *parent; //so we can go up from the libusb userdata
-	libusb_device_handle *dev;
+	libusb_device_handle *dev; // opaque handle, only dereferenced by the backend that opened it
 	int device_dead; // set to 1 when the underlying libusb_device_handle vanishes (ie, Kinect was unplugged)
 } fnusb_dev;
 
@@ -82,8 +95,43 @@ typedef struct {
 	int len;
 	int dead;
 	int dead_xfers;
+	void *backend_data; // private state of a non-libusb backend
 } fnusb_isoc_stream;
 
+// Completion of fnusb_control_async(): res is the number of bytes moved (and,
+// for a device-to-host request, copied into the data buffer), or < 0
+typedef void (*fnusb_control_cb)(fnusb_dev *dev, int res, void *user);
+
+// The USB layer behind the fnusb_* calls below. fnusb_init picks a backend
+// (libusb, or the in-process mock when FREENECT_USB_BACKEND=mock) and every
+// other call is forwarded to the backend of the context it runs on.
+typedef struct _fnusb_backend {
+	const char *name;
+	int (*num_devices)(fnusb_ctx *ctx);
+	int (*list_device_attributes)(fnusb_ctx *ctx, struct freenect_device_attributes** attribute_list);
+	int (*init)(fnusb_ctx *ctx, freenect_usb_context *usb_ctx);
+	int (*shutdown)(fnusb_ctx *ctx);
+	int (*process_events)(fnusb_ctx *ctx);
+	int (*process_events_timeout)(fnusb_ctx *ctx, struct timeval* timeout);
+	int (*get_pollfds)(fnusb_ctx *ctx, freenect_pollfd *fds, int max);
+	void (*set_pollfd_notifiers)(fnusb_ctx *ctx, freenect_pollfd_added_cb added, freenect_pollfd_removed_cb removed, void *user);
+	int (*get_next_timeout)(fnusb_ctx *ctx, struct timeval *timeout);
+	int (*interrupt_events)(fnusb_ctx *ctx);
+	int (*open_subdevices)(freenect_device *dev, int index);
+	int (*close_subdevices)(freenect_device *dev);
+	int (*start_iso)(fnusb_dev *dev, fnusb_isoc_stream *strm, fnusb_iso_cb cb, int ep, int xfers, int pkts, int len);
+	int (*stop_iso)(fnusb_dev *dev, fnusb_isoc_stream *strm);
+	int (*control)(fnusb_dev *dev, uint8_t bmRequestType, uint8_t bRequest, uint16_t wValue, uint16_t wIndex, uint8_t *data, uint16_t wLength);
+	int (*control_async)(fnusb_dev *dev, uint8_t bmRequestType, uint8_t bRequest, uint16_t wValue, uint16_t wIndex, uint8_t *data, uint16_t wLength, fnusb_control_cb cb, void *user);
+#ifdef BUILD_AUDIO
+	int (*bulk)(fnusb_dev *dev, uint8_t endpoint, uint8_t *data, int len, int *transferred);
+	int (*num_interfaces)(fnusb_dev *dev);
+#endif
+} fnusb_backend;
+
+extern const fnusb_backend fnusb_libusb10_backend;
+extern const fnusb_backend fnusb_mock_backend;
+
 int fnusb_num_devices(fnusb_ctx *ctx);
 int fnusb_list_device_attributes(fnusb_ctx *ctx, struct freenect_device_attributes** attribute_list);
 
@@ -91,6 +139,12 @@ int fnusb_init(fnusb_ctx *ctx, freenect_usb_context *usb_ctx);
 int fnusb_shutdown(fnusb_ctx *ctx);
 int fnusb_process_events(fnusb_ctx *ctx);
 int fnusb_process_events_timeout(fnusb_ctx *ctx, struct timeval* timeout);
+int fnusb_get_pollfds(fnusb_ctx *ctx, freenect_pollfd *fds, int max);
+void fnusb_set_pollfd_notifiers(fnusb_ctx *ctx, freenect_pollfd_added_cb added, freenect_pollfd_removed_cb removed, void *user);
+int fnusb_get_next_timeout(fnusb_ctx *ctx, struct timeval *timeout);
+// Make a process_events call blocked on another thread, or else the next
+// one, return as soon as it can. Safe to call from any thread.
+int fnusb_interrupt_events(fnusb_ctx *ctx);
 
 int fnusb_open_subdevices(freenect_device *dev, int index);
 int fnusb_close_subdevices(freenect_device *dev);
@@ -99,6 +153,9 @@ int fnusb_start_iso(fnusb_dev *dev, fnusb_isoc_stream *strm, fnusb_iso_cb cb, in
 int fnusb_stop_iso(fnusb_dev *dev, fnusb_isoc_stream *strm);
 
 int fnusb_control(fnusb_dev *dev, uint8_t bmRequestType, uint8_t bRequest, uint16_t wValue, uint16_t wIndex, uint8_t *data, uint16_t wLength);
+// Submit a control transfer and return; cb runs from fnusb_process_events().
+// data must stay valid until then.
+int fnusb_control_async(fnusb_dev *dev, uint8_t bmRequestType, uint8_t bRequest, uint16_t wValue, uint16_t wIndex, uint8_t *data, uint16_t wLength, fnusb_control_cb cb, void *user);
 #ifdef BUILD_AUDIO
 int fnusb_bulk(fnusb_dev *dev, uint8_t endpoint, uint8_t *data, int len, int *transferred);
 int fnusb_num_interfaces(fnusb_dev *dev);
@@ -0,0 +1,1235 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2010 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+/*
+ * An in-process stand-in for Kinects, selected with FREENECT_USB_BACKEND=mock.
+ * It drives the real stream_process -> depth_process/video_process path and
+ * the camera command protocol without hardware, so decode throughput and
+ * latency can be measured anywhere. It is configured from the environment:
+ *
+ *   FREENECT_MOCK_DEVICES     number of devices to enumerate (default 1)
+ *   FREENECT_MOCK_FPS         frame rate of every stream (default: the rate of
+ *                             the selected mode). 0 hands out one transfer per
+ *                             stream on every event call, as fast as the
+ *                             caller can take them.
+ *   FREENECT_MOCK_LOSS        probability (0..1) that an iso packet arrives empty
+ *   FREENECT_MOCK_CLOCK_PPM   rate error of the frame timestamps against the
+ *                             host clock, in parts per million (default 0)
+ *   FREENECT_MOCK_CLOCK_START device clock when the device is opened (default
+ *                             0), e.g. 4294000000 to see it wrap right away
+ *   FREENECT_MOCK_DEPTH_FILE  raw frames to loop, in the stream's wire format
+ *   FREENECT_MOCK_VIDEO_FILE  (packed depth, bayer, ...); synthetic otherwise
+ *   FREENECT_MOCK_SCRIPT      camera command replies, see load_script()
+ *   FREENECT_MOCK_CAPTURE     raw packet capture (freenect_start_capture()) to
+ *                             replay instead of generating packets
+ *   FREENECT_MOCK_REPLAY      "realtime" (default) keeps the captured arrival
+ *                             times, "fast" replays as fast as the caller
+ *                             takes packets, and a number replays at that
+ *                             many frames per second
+ *   FREENECT_MOCK_LOOP        1 to restart the capture when it ends; otherwise
+ *                             the device goes away like an unplugged one
+ *   FREENECT_MOCK_CONTROL_US  time every control transfer takes to complete
+ *                             (default 0)
+ *   FREENECT_MOCK_OPEN_US     time opening a device takes, standing in for
+ *                             enumeration and firmware upload (default 0)
+ *   FREENECT_MOCK_UNPLUG_MS   unplug every camera this long after it was
+ *                             opened, like a USB brown-out (default never)
+ *   FREENECT_MOCK_REPLUG_MS   time until an unplugged device is plugged back
+ *                             in (default 1000)
+ *
+ * Packets carry the same 12-byte headers (flags, sequence numbers, 60 MHz
+ * frame timestamps) as the device's, and reach the stream callbacks one
+ * transfer at a time from the event loop, like libusb delivers them. A caller
+ * that falls a whole ring of transfers behind loses packets, as it would with
+ * a real isochronous endpoint.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#if defined(_WIN32)
+#include <windows.h>
+#include <sys/timeb.h>
+#else
+#include <time.h>
+#endif
+#include "freenect_internal.h"
+
+#define MOCK_TIMESTAMP_HZ 60000000
+#define MOCK_SYNTHETIC_FRAMES 4
+#define MOCK_REPLY_MAX 0x200
+#define MOCK_CMD_HDR 8
+#define MOCK_NEVER (~(uint64_t)0)
+#define MOCK_PKTBUF ISO_MAX_PKTBUF
+
+typedef struct _mock_command {
+	struct _mock_command *next;
+	uint16_t cmd;
+	int arg; // first command word to match, -1 for any
+	int len;
+	uint8_t reply[MOCK_REPLY_MAX - MOCK_CMD_HDR];
+} mock_command;
+
+// a control transfer submitted with fnusb_control_async(), already carried
+// out, that completes from the event loop once it is due
+typedef struct _mock_control_req {
+	struct _mock_control_req *next;
+	fnusb_dev *dev;
+	int res;
+	fnusb_control_cb cb;
+	void *user;
+	uint64_t due_ns;
+} mock_control_req;
+
+typedef struct _mock_stream {
+	struct _mock_stream *next;
+	fnusb_isoc_stream *strm;
+	int dead; // stopped from inside a callback, freed by the event loop
+	uint8_t flag;
+	uint8_t *frames;
+	int num_frames;
+	int frame_size;
+	int pkt_size;
+	int last_pkt_size;
+	int pkts_per_frame;
+	double fps; // 0 when unthrottled
+	double ts_per_frame;
+	uint32_t ts_start;
+	uint64_t start_ns;
+	uint64_t sent; // packets produced so far, including lost ones
+	int replay; // fed from the camera's capture reader instead
+	uint8_t pkt[MOCK_PKTBUF];
+} mock_stream;
+
+typedef enum {
+	MOCK_REPLAY_REALTIME,
+	MOCK_REPLAY_FAST,
+	MOCK_REPLAY_RATE,
+} mock_replay_mode;
+
+typedef struct _mock_dev mock_dev;
+
+typedef struct {
+	int num_devices;
+	double fps; // < 0 to follow the frame mode
+	double loss;
+	double clock_ppm;
+	uint32_t clock_start;
+	uint64_t control_ns;
+	uint64_t open_ns;
+	pthread_mutex_t lock; // for async control transfers and opening devices, which happen on any thread
+	mock_control_req *controls; // in submission order
+	pthread_cond_t wakeup; // signalled with lock held by freenect_interrupt_events()
+	int interrupted; // until the event loop notices
+	uint32_t rng;
+	char *script_path;
+	int script_loaded;
+	mock_command *script;
+	mock_stream *streams;
+	int delivering;
+	char *capture_path;
+	mock_replay_mode replay;
+	double replay_fps;
+	int replay_loop;
+	mock_dev *cams; // open cameras, for replay and unplugging
+	uint64_t unplug_ns; // 0 for never
+	uint64_t replug_ns;
+	uint64_t *back_ns; // per device, host time it is plugged back in; 0 while plugged in
+} mock_ctx;
+
+struct _mock_dev {
+	mock_ctx *mctx;
+	mock_dev *next;
+	fnusb_dev *usb;
+	int motor;
+	int index;
+	uint64_t unplug_ns; // host time the camera is unplugged, MOCK_NEVER if not
+	int unplugged; // transfers fail from then on, as on a handle of an unplugged device
+	uint16_t regs[0x200];
+	uint8_t reply[MOCK_REPLY_MAX];
+	int reply_len;
+	int8_t tilt_angle;
+	uint8_t led;
+	uint64_t clock_origin_ns; // host time the device clock read clock_start
+	// capture replay, one reader per camera so packets keep their order
+	int replaying;
+	int replay_ended;
+	fn_capture_reader reader;
+	uint64_t replay_start_ns;
+	uint64_t replay_records; // since the last rewind
+	uint64_t replay_frames; // paced frames so far, for MOCK_REPLAY_RATE
+	uint8_t pace_flag;
+	int have_record;
+	uint8_t record_flag;
+	int record_len;
+	uint8_t record[MOCK_PKTBUF];
+};
+
+// Registration parameters of the simulated camera, in freenect_reg_info order
+static const int32_t mock_reg_info[29] = {
+	0, -37, -47, 5384, -1, 1922, 11, -23, -22, 5483, 1472, 6, 2,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+};
+static const float mock_zero_plane[4] = { 7.5f, 2.4f, 120.0f, 0.1042f };
+#define MOCK_CONST_SHIFT 200
+
+static void put16(uint8_t *p, uint16_t v)
+{
+	p[0] = v & 0xff;
+	p[1] = v >> 8;
+}
+
+static void put32(uint8_t *p, uint32_t v)
+{
+	put16(p, v & 0xffff);
+	put16(p + 2, v >> 16);
+}
+
+static uint16_t get16(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static mock_ctx *get_mock_ctx(freenect_device *dev)
+{
+	return (mock_ctx*)dev->parent->usb.backend_data;
+}
+
+static double env_double(const char *name, double def)
+{
+	const char *value = getenv(name);
+	return (value && *value) ? atof(value) : def;
+}
+
+static void sleep_ns(uint64_t ns)
+{
+#if defined(_WIN32)
+	Sleep((DWORD)((ns + 999999) / 1000000));
+#else
+	struct timespec ts;
+	ts.tv_sec = ns / 1000000000;
+	ts.tv_nsec = ns % 1000000000;
+	nanosleep(&ts, NULL);
+#endif
+}
+
+// Sleep for up to ns, or until freenect_interrupt_events(). Returns 1, and
+// clears the request, if interrupted.
+static int wait_ns(mock_ctx *mctx, uint64_t ns)
+{
+	struct timespec until;
+	uint64_t nsec;
+	int interrupted;
+#if defined(_WIN32)
+	struct _timeb tb;
+	_ftime(&tb);
+	until.tv_sec = tb.time;
+	nsec = (uint64_t)tb.millitm * 1000000 + ns;
+#else
+	clock_gettime(CLOCK_REALTIME, &until);
+	nsec = (uint64_t)until.tv_nsec + ns;
+#endif
+	until.tv_sec += (time_t)(nsec / 1000000000);
+	until.tv_nsec = (long)(nsec % 1000000000);
+
+	pthread_mutex_lock(&mctx->lock);
+	if (!mctx->interrupted)
+		pthread_cond_timedwait(&mctx->wakeup, &mctx->lock, &until);
+	interrupted = mctx->interrupted;
+	mctx->interrupted = 0;
+	pthread_mutex_unlock(&mctx->lock);
+	return interrupted;
+}
+
+// xorshift32, uniform in [0, 1)
+static double next_random(mock_ctx *mctx)
+{
+	mctx->rng ^= mctx->rng << 13;
+	mctx->rng ^= mctx->rng >> 17;
+	mctx->rng ^= mctx->rng << 5;
+	return mctx->rng / 4294967296.0;
+}
+
+static void mock_serial(int index, char *buf, size_t len)
+{
+	snprintf(buf, len, "MOCK%012d", index);
+}
+
+/*
+ * Script lines are "<command> <first argument or *> <reply bytes...>", all in
+ * hex, with '#' starting a comment:
+ *
+ *   # registration parameters for every resolution
+ *   16 40  00 00 00 00 00 00 db ff ff ff ...
+ *
+ * The reply bytes are the payload after the reply header. The first line
+ * matching a command wins; commands no line matches get the built-in replies.
+ */
+static int load_script(freenect_context *ctx, mock_ctx *mctx, const char *path)
+{
+	FILE *fp = fopen(path, "r");
+	if (!fp) {
+		FN_ERROR("mock: can't open script %s\n", path);
+		return -1;
+	}
+	mock_command **tail = &mctx->script;
+	char line[4096];
+	int lineno = 0;
+	while (fgets(line, sizeof(line), fp)) {
+		lineno++;
+		char *comment = strchr(line, '#');
+		if (comment)
+			*comment = '\0';
+		char *tok = strtok(line, " \t\r\n");
+		if (!tok)
+			continue;
+		mock_command *mc = (mock_command*)calloc(1, sizeof(mock_command));
+		mc->cmd = (uint16_t)strtoul(tok, NULL, 16);
+		tok = strtok(NULL, " \t\r\n");
+		if (!tok) {
+			FN_ERROR("mock: %s:%d: missing argument\n", path, lineno);
+			free(mc);
+			fclose(fp);
+			return -1;
+		}
+		mc->arg = strcmp(tok, "*") == 0 ? -1 : (int)strtoul(tok, NULL, 16);
+		while ((tok = strtok(NULL, " \t\r\n")) != NULL) {
+			if (mc->len == (int)sizeof(mc->reply)) {
+				FN_ERROR("mock: %s:%d: reply longer than %d bytes\n", path, lineno, (int)sizeof(mc->reply));
+				free(mc);
+				fclose(fp);
+				return -1;
+			}
+			mc->reply[mc->len++] = (uint8_t)strtoul(tok, NULL, 16);
+		}
+		*tail = mc;
+		tail = &mc->next;
+	}
+	fclose(fp);
+	return 0;
+}
+
+static int default_reply(mock_dev *mdev, uint16_t cmd, const uint8_t *args, int nargs, uint8_t *out)
+{
+	uint16_t arg0 = nargs > 0 ? get16(args) : 0;
+	int i;
+
+	switch (cmd) {
+		case 0x02: // read register
+			put16(out, 0);
+			put16(out + 2, mdev->regs[arg0 & 0x1ff]);
+			return 4;
+		case 0x03: // write register
+			if (nargs > 1)
+				mdev->regs[arg0 & 0x1ff] = get16(args + 2);
+			put16(out, 0);
+			return 2;
+		case 0x04: // fixed parameters, with the zero plane info at byte 94
+			memset(out, 0, 322);
+			for (i = 0; i < 4; i++) {
+				union {
+					float f;
+					uint32_t ui;
+				} conversion_union;
+				conversion_union.f = mock_zero_plane[i];
+				put32(out + 94 + 4 * i, conversion_union.ui);
+			}
+			return 322;
+		case 0x16: // algorithm parameters
+			memset(out, 0, 2);
+			switch (arg0) {
+				case 0x40: // registration
+					for (i = 0; i < 29; i++)
+						put32(out + 2 + 4 * i, (uint32_t)mock_reg_info[i]);
+					return 118;
+				case 0x41: // padding: start, end and cropping lines
+					memset(out + 2, 0, 6);
+					return 8;
+				case 0x00: // constant shift
+					put16(out + 2, MOCK_CONST_SHIFT);
+					return 4;
+			}
+			return 2;
+	}
+	return 0;
+}
+
+static int camera_command(mock_dev *mdev, const uint8_t *data, int len)
+{
+	if (len < MOCK_CMD_HDR || data[0] != 0x47 || data[1] != 0x4d)
+		return LIBUSB_ERROR_PIPE;
+
+	uint16_t cmd = get16(data + 4);
+	const uint8_t *args = data + MOCK_CMD_HDR;
+	int nargs = (len - MOCK_CMD_HDR) / 2;
+	uint8_t *out = mdev->reply + MOCK_CMD_HDR;
+	mock_command *mc;
+	int n = -1;
+
+	for (mc = mdev->mctx->script; mc; mc = mc->next) {
+		if (mc->cmd == cmd && (mc->arg < 0 || (nargs > 0 && mc->arg == get16(args)))) {
+			memcpy(out, mc->reply, mc->len);
+			n = mc->len;
+			break;
+		}
+	}
+	if (n < 0)
+		n = default_reply(mdev, cmd, args, nargs, out);
+
+	mdev->reply[0] = 0x52;
+	mdev->reply[1] = 0x42;
+	put16(mdev->reply + 2, (uint16_t)(n / 2));
+	memcpy(mdev->reply + 4, data + 4, 4); // command and tag
+	mdev->reply_len = MOCK_CMD_HDR + n;
+	return len;
+}
+
+static int motor_control(mock_dev *mdev, uint8_t bmRequestType, uint8_t bRequest, uint16_t wValue, uint8_t *data, uint16_t wLength)
+{
+	if (bmRequestType == 0xC0 && bRequest == 0x32 && wLength >= 10) {
+		// Level and at rest: 1g (819 counts) along y, big-endian
+		memset(data, 0, 10);
+		data[4] = 819 >> 8;
+		data[5] = 819 & 0xff;
+		data[8] = (uint8_t)mdev->tilt_angle;
+		data[9] = TILT_STATUS_STOPPED;
+		return 10;
+	}
+	if (bmRequestType == 0x40 && bRequest == 0x31) {
+		mdev->tilt_angle = (int8_t)wValue;
+		return 0;
+	}
+	if (bmRequestType == 0x40 && bRequest == 0x06) {
+		mdev->led = (uint8_t)wValue;
+		return 0;
+	}
+	return LIBUSB_ERROR_PIPE;
+}
+
+// A wall about 1.8m away with a ball drifting across it, and the projector
+// shadow along the left edge, packed MSB first like the camera sends it
+static void synth_depth(uint8_t *out, int bits, int frame)
+{
+	int ball_x = 160 + 100 * frame, ball_y = 240, r = 90;
+	uint32_t acc = 0;
+	int nacc = 0;
+	int x, y;
+	for (y = 0; y < 480; y++) {
+		for (x = 0; x < 640; x++) {
+			int dx = x - ball_x, dy = y - ball_y;
+			int d2 = dx * dx + dy * dy;
+			int v = 900;
+			if (d2 < r * r)
+				v -= (r * r - d2) / 64;
+			if (x < 8)
+				v = 2047;
+			acc = (acc << bits) | (v >> (11 - bits));
+			nacc += bits;
+			while (nacc >= 8) {
+				*out++ = (uint8_t)(acc >> (nacc - 8));
+				nacc -= 8;
+			}
+		}
+	}
+}
+
+// Diagonal gradient bands, shifted every frame; valid in any video format
+static void synth_video(uint8_t *out, int size, int rows, int frame)
+{
+	int row_bytes = (rows > 0 && size % rows == 0) ? size / rows : size;
+	int i;
+	for (i = 0; i < size; i++) {
+		int x = i % row_bytes, y = i / row_bytes;
+		out[i] = (uint8_t)(x * 256 / row_bytes + y * 128 / (size / row_bytes) + frame * 16);
+	}
+}
+
+static int load_frames(freenect_context *ctx, mock_stream *ms, const char *path)
+{
+	FILE *fp = fopen(path, "rb");
+	if (!fp) {
+		FN_WARNING("mock: can't open %s, using synthetic frames\n", path);
+		return -1;
+	}
+	fseek(fp, 0, SEEK_END);
+	long size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	if (size < ms->frame_size || size % ms->frame_size) {
+		FN_WARNING("mock: %s is not a whole number of %d-byte frames, using synthetic frames\n", path, ms->frame_size);
+		fclose(fp);
+		return -1;
+	}
+	ms->num_frames = (int)(size / ms->frame_size);
+	ms->frames = (uint8_t*)malloc(size);
+	if (fread(ms->frames, 1, size, fp) != (size_t)size) {
+		FN_WARNING("mock: short read on %s, using synthetic frames\n", path);
+		free(ms->frames);
+		ms->frames = NULL;
+		fclose(fp);
+		return -1;
+	}
+	fclose(fp);
+	return 0;
+}
+
+static int build_packet(mock_stream *ms, uint64_t n)
+{
+	uint64_t frame = n / ms->pkts_per_frame;
+	int pkt = (int)(n % ms->pkts_per_frame);
+	int last = pkt == ms->pkts_per_frame - 1;
+	int size = last ? ms->last_pkt_size : ms->pkt_size;
+	uint8_t *p = ms->pkt;
+
+	memset(p, 0, 12);
+	p[0] = 'R';
+	p[1] = 'B';
+	p[3] = ms->flag | (pkt == 0 ? 1 : last ? 5 : 2);
+	p[5] = (uint8_t)n;
+	put32(p + 8, ms->ts_start + (uint32_t)(uint64_t)(frame * ms->ts_per_frame));
+	memcpy(p + 12, ms->frames + (frame % ms->num_frames) * ms->frame_size + pkt * ms->pkt_size, size);
+	return 12 + size;
+}
+
+static void deliver_transfer(mock_ctx *mctx, mock_stream *ms)
+{
+	int i;
+	for (i = 0; i < ms->strm->pkts; i++) {
+		uint64_t n = ms->sent++;
+		fnusb_isoc_stream *strm = ms->strm;
+		// A lost packet still completes, just without data
+		int len = (mctx->loss > 0 && next_random(mctx) < mctx->loss) ? 0 : build_packet(ms, n);
+		strm->cb(strm->parent->parent, ms->pkt, len);
+		if (ms->dead)
+			return;
+	}
+}
+
+static void free_stream(mock_stream *ms)
+{
+	free(ms->frames);
+	free(ms);
+}
+
+static mock_stream *find_stream(mock_ctx *mctx, fnusb_dev *usb, uint8_t flag)
+{
+	mock_stream *ms;
+	for (ms = mctx->streams; ms; ms = ms->next) {
+		if (!ms->dead && ms->strm->parent == usb && ms->flag == flag)
+			return ms;
+	}
+	return NULL;
+}
+
+static int stream_unplugged(mock_stream *ms)
+{
+	return ((mock_dev*)ms->strm->parent->dev)->unplugged;
+}
+
+// Deliver the captured packets that are due; returns the number of events
+// when the record read last is due; paced is set if it is a frame that sets
+// the pace of MOCK_REPLAY_RATE
+static uint64_t record_due(mock_ctx *mctx, mock_dev *cam, uint64_t now, int *paced)
+{
+	*paced = 0;
+	if (mctx->replay == MOCK_REPLAY_REALTIME)
+		return cam->replay_start_ns + cam->reader.time_us * 1000;
+	if (mctx->replay == MOCK_REPLAY_RATE && cam->record_len >= 12 && cam->record[3] == (cam->record_flag | 1)) {
+		// frames of the first stream seen set the pace
+		if (!cam->pace_flag)
+			cam->pace_flag = cam->record_flag;
+		if (cam->record_flag == cam->pace_flag) {
+			*paced = 1;
+			return cam->replay_start_ns + (uint64_t)(cam->replay_frames * 1e9 / mctx->replay_fps);
+		}
+	}
+	return now;
+}
+
+static int replay_packets(mock_ctx *mctx, mock_dev *cam, uint64_t now, uint64_t *wake)
+{
+	freenect_context *ctx = cam->usb->parent->parent;
+	int delivered = 0;
+
+	while (!cam->replay_ended) {
+		if (!cam->have_record) {
+			int len = fn_capture_read(&cam->reader, &cam->record_flag, cam->record, sizeof(cam->record));
+			if (len < 0) {
+				if (mctx->replay_loop && cam->replay_records > 0 && fn_capture_rewind(&cam->reader) == 0) {
+					cam->replay_start_ns = now;
+					cam->replay_records = 0;
+					cam->replay_frames = 0;
+					continue;
+				}
+				// Like an unplugged device: the event loop stops the
+				// streams and reports the end to the caller
+				FN_INFO("mock: end of capture\n");
+				cam->replay_ended = 1;
+				cam->usb->device_dead = 1;
+				return delivered + 1;
+			}
+			cam->record_len = len;
+			cam->have_record = 1;
+			cam->replay_records++;
+		}
+
+		int paced;
+		uint64_t due = record_due(mctx, cam, now, &paced);
+		if (due > now) {
+			if (due < *wake)
+				*wake = due;
+			break;
+		}
+		if (mctx->replay == MOCK_REPLAY_FAST && delivered >= PKTS_PER_XFER)
+			break;
+
+		cam->have_record = 0;
+		if (paced)
+			cam->replay_frames++;
+		mock_stream *ms = find_stream(mctx, cam->usb, cam->record_flag);
+		if (ms) {
+			ms->strm->cb(ms->strm->parent->parent, cam->record, cam->record_len);
+			delivered++;
+		}
+	}
+	return delivered;
+}
+
+// index of the nth device plugged in, -1 if there are fewer; lock held
+static int plugged_index(mock_ctx *mctx, int n)
+{
+	int i;
+	for (i = 0; i < mctx->num_devices; i++) {
+		if (!mctx->back_ns[i] && n-- == 0)
+			return i;
+	}
+	return -1;
+}
+
+// Unplug the cameras that are due, and plug back in the devices that are.
+// Returns the number of changes.
+static int plug_events(fnusb_ctx *ctx, mock_ctx *mctx, uint64_t now, uint64_t *wake)
+{
+	int changes = 0;
+	mock_dev *cam;
+	int i;
+
+	pthread_mutex_lock(&mctx->lock);
+	for (cam = mctx->cams; cam; cam = cam->next) {
+		if (cam->unplugged)
+			continue;
+		if (cam->unplug_ns > now) {
+			if (cam->unplug_ns < *wake)
+				*wake = cam->unplug_ns;
+			continue;
+		}
+		// the handles stay open but fail, and the event loop finds the
+		// device dead, like libusb has it when a transfer meets NO_DEVICE
+		mock_dev *motor = (mock_dev*)cam->usb->parent->usb_motor.dev;
+		cam->unplugged = 1;
+		if (motor)
+			motor->unplugged = 1;
+		cam->usb->device_dead = 1;
+		mctx->back_ns[cam->index] = now + mctx->replug_ns;
+		changes++;
+	}
+	for (i = 0; i < mctx->num_devices; i++) {
+		if (!mctx->back_ns[i])
+			continue;
+		if (mctx->back_ns[i] > now) {
+			if (mctx->back_ns[i] < *wake)
+				*wake = mctx->back_ns[i];
+			continue;
+		}
+		mctx->back_ns[i] = 0;
+		ctx->arrivals++; // what a libusb hotplug event would report
+		changes++;
+	}
+	pthread_mutex_unlock(&mctx->lock);
+	return changes;
+}
+
+static int mock_num_devices(fnusb_ctx *ctx)
+{
+	mock_ctx *mctx = (mock_ctx*)ctx->backend_data;
+	int n = 0;
+
+	pthread_mutex_lock(&mctx->lock);
+	while (plugged_index(mctx, n) >= 0)
+		n++;
+	pthread_mutex_unlock(&mctx->lock);
+	return n;
+}
+
+static int mock_list_device_attributes(fnusb_ctx *ctx, struct freenect_device_attributes** attribute_list)
+{
+	mock_ctx *mctx = (mock_ctx*)ctx->backend_data;
+	struct freenect_device_attributes** prev_next = attribute_list;
+	char serial[32];
+	int count = 0;
+	int i;
+
+	*attribute_list = NULL;
+	pthread_mutex_lock(&mctx->lock);
+	for (i = 0; i < mctx->num_devices; i++) {
+		if (mctx->back_ns[i])
+			continue;
+		count++;
+		struct freenect_device_attributes* new_dev_attrs = (struct freenect_device_attributes*)malloc(sizeof(struct freenect_device_attributes));
+		memset(new_dev_attrs, 0, sizeof(*new_dev_attrs));
+		mock_serial(i, serial, sizeof(serial));
+		new_dev_attrs->camera_serial = strdup(serial);
+		*prev_next = new_dev_attrs;
+		prev_next = &new_dev_attrs->next;
+	}
+	pthread_mutex_unlock(&mctx->lock);
+	return count;
+}
+
+static int mock_init(fnusb_ctx *ctx, freenect_usb_context *usb_ctx)
+{
+	mock_ctx *mctx = (mock_ctx*)calloc(1, sizeof(mock_ctx));
+	if (!mctx)
+		return -1;
+	const char *script = getenv("FREENECT_MOCK_SCRIPT");
+
+	mctx->num_devices = (int)env_double("FREENECT_MOCK_DEVICES", 1);
+	mctx->fps = env_double("FREENECT_MOCK_FPS", -1);
+	mctx->loss = env_double("FREENECT_MOCK_LOSS", 0);
+	mctx->clock_ppm = env_double("FREENECT_MOCK_CLOCK_PPM", 0);
+	mctx->clock_start = (uint32_t)env_double("FREENECT_MOCK_CLOCK_START", 0);
+	mctx->control_ns = (uint64_t)(env_double("FREENECT_MOCK_CONTROL_US", 0) * 1000);
+	mctx->open_ns = (uint64_t)(env_double("FREENECT_MOCK_OPEN_US", 0) * 1000);
+	mctx->unplug_ns = (uint64_t)(env_double("FREENECT_MOCK_UNPLUG_MS", 0) * 1000000);
+	mctx->replug_ns = (uint64_t)(env_double("FREENECT_MOCK_REPLUG_MS", 1000) * 1000000);
+	mctx->back_ns = (uint64_t*)calloc(mctx->num_devices > 0 ? mctx->num_devices : 1, sizeof(uint64_t));
+	if (!mctx->back_ns) {
+		free(mctx);
+		return -1;
+	}
+	pthread_mutex_init(&mctx->lock, NULL);
+	pthread_cond_init(&mctx->wakeup, NULL);
+	mctx->rng = 0x2545f491;
+	if (script && *script)
+		mctx->script_path = strdup(script);
+
+	const char *capture = getenv("FREENECT_MOCK_CAPTURE");
+	const char *replay = getenv("FREENECT_MOCK_REPLAY");
+	if (capture && *capture)
+		mctx->capture_path = strdup(capture);
+	mctx->replay = MOCK_REPLAY_REALTIME;
+	if (replay && strcmp(replay, "fast") == 0) {
+		mctx->replay = MOCK_REPLAY_FAST;
+	} else if (replay && atof(replay) > 0) {
+		mctx->replay = MOCK_REPLAY_RATE;
+		mctx->replay_fps = atof(replay);
+	}
+	mctx->replay_loop = (int)env_double("FREENECT_MOCK_LOOP", 0);
+
+	ctx->ctx = NULL;
+	ctx->should_free_ctx = 0;
+	ctx->backend_data = mctx;
+	return 0;
+}
+
+static int mock_shutdown(fnusb_ctx *ctx)
+{
+	mock_ctx *mctx = (mock_ctx*)ctx->backend_data;
+	while (mctx->streams) {
+		mock_stream *ms = mctx->streams;
+		mctx->streams = ms->next;
+		free_stream(ms);
+	}
+	while (mctx->script) {
+		mock_command *mc = mctx->script;
+		mctx->script = mc->next;
+		free(mc);
+	}
+	while (mctx->controls) {
+		mock_control_req *req = mctx->controls;
+		mctx->controls = req->next;
+		free(req);
+	}
+	pthread_cond_destroy(&mctx->wakeup);
+	pthread_mutex_destroy(&mctx->lock);
+	free(mctx->script_path);
+	free(mctx->capture_path);
+	free(mctx->back_ns);
+	free(mctx);
+	ctx->backend_data = NULL;
+	return 0;
+}
+
+static int mock_process_events_timeout(fnusb_ctx *ctx, struct timeval* timeout)
+{
+	mock_ctx *mctx = (mock_ctx*)ctx->backend_data;
+	uint64_t now = fn_get_time_ns();
+	uint64_t deadline = now + (uint64_t)timeout->tv_sec * 1000000000ull + (uint64_t)timeout->tv_usec * 1000;
+
+	for (;;) {
+		mock_stream *ms, **link;
+		uint64_t wake = deadline;
+		int delivered = 0;
+
+		// control transfers complete in the order they were submitted
+		for (;;) {
+			pthread_mutex_lock(&mctx->lock);
+			mock_control_req *req = mctx->controls;
+			if (req && req->due_ns > now && req->due_ns < wake)
+				wake = req->due_ns;
+			if (req && req->due_ns <= now)
+				mctx->controls = req->next;
+			else
+				req = NULL;
+			pthread_mutex_unlock(&mctx->lock);
+			if (!req)
+				break;
+			req->cb(req->dev, req->res, req->user);
+			free(req);
+			delivered++;
+		}
+		if (mctx->unplug_ns)
+			delivered += plug_events(ctx, mctx, now, &wake);
+
+		mctx->delivering = 1;
+		mock_dev *cam;
+		for (cam = mctx->cams; cam; cam = cam->next) {
+			if (cam->replaying && !cam->unplugged)
+				delivered += replay_packets(mctx, cam, now, &wake);
+		}
+		for (ms = mctx->streams; ms; ms = ms->next) {
+			if (ms->dead || ms->replay || stream_unplugged(ms))
+				continue;
+			if (ms->fps <= 0) {
+				deliver_transfer(mctx, ms);
+				delivered++;
+				continue;
+			}
+			uint64_t pkts = ms->strm->pkts;
+			uint64_t ring = pkts * ms->strm->num_xfers;
+			double pkts_per_ns = ms->fps * ms->pkts_per_frame / 1e9;
+			uint64_t due = now > ms->start_ns ? (uint64_t)((now - ms->start_ns) * pkts_per_ns) : 0;
+			if (due > ms->sent + ring)
+				ms->sent = due - ring; // overrun: the device dropped what didn't fit
+			while (!ms->dead && ms->sent + pkts <= due) {
+				deliver_transfer(mctx, ms);
+				delivered++;
+			}
+			if (!ms->dead) {
+				uint64_t next = ms->start_ns + (uint64_t)((ms->sent + pkts) / pkts_per_ns);
+				if (next < wake)
+					wake = next;
+			}
+		}
+		mctx->delivering = 0;
+
+		link = &mctx->streams;
+		while (*link) {
+			ms = *link;
+			if (ms->dead) {
+				*link = ms->next;
+				free_stream(ms);
+			} else {
+				link = &ms->next;
+			}
+		}
+
+		if (delivered)
+			return 0;
+		now = fn_get_time_ns();
+		if (now >= deadline)
+			return 0;
+		if (wake > now && wait_ns(mctx, wake - now))
+			return 0;
+		now = fn_get_time_ns();
+	}
+}
+
+static int mock_get_pollfds(fnusb_ctx *ctx, freenect_pollfd *fds, int max)
+{
+	return 0; // everything the mock does is timed
+}
+
+static void mock_set_pollfd_notifiers(fnusb_ctx *ctx, freenect_pollfd_added_cb added, freenect_pollfd_removed_cb removed, void *user)
+{
+}
+
+// the time until mock_process_events_timeout() has something to deliver
+static int mock_get_next_timeout(fnusb_ctx *ctx, struct timeval *timeout)
+{
+	mock_ctx *mctx = (mock_ctx*)ctx->backend_data;
+	uint64_t now = fn_get_time_ns();
+	uint64_t next = MOCK_NEVER;
+	mock_stream *ms;
+	mock_dev *cam;
+	int paced;
+	int i;
+
+	pthread_mutex_lock(&mctx->lock);
+	if (mctx->interrupted)
+		next = now;
+	else if (mctx->controls)
+		next = mctx->controls->due_ns;
+	pthread_mutex_unlock(&mctx->lock);
+	for (cam = mctx->cams; cam; cam = cam->next) {
+		if (mctx->unplug_ns && !cam->unplugged && cam->unplug_ns < next)
+			next = cam->unplug_ns;
+		if (!cam->replaying || cam->replay_ended || cam->unplugged)
+			continue;
+		uint64_t due = cam->have_record ? record_due(mctx, cam, now, &paced) : now;
+		if (due < next)
+			next = due;
+	}
+	pthread_mutex_lock(&mctx->lock);
+	for (i = 0; i < mctx->num_devices; i++) {
+		if (mctx->back_ns[i] && mctx->back_ns[i] < next)
+			next = mctx->back_ns[i];
+	}
+	pthread_mutex_unlock(&mctx->lock);
+	for (ms = mctx->streams; ms; ms = ms->next) {
+		if (ms->dead || ms->replay || stream_unplugged(ms))
+			continue;
+		uint64_t due = now;
+		if (ms->fps > 0)
+			due = ms->start_ns + (uint64_t)((ms->sent + ms->strm->pkts) / (ms->fps * ms->pkts_per_frame / 1e9));
+		if (due < next)
+			next = due;
+	}
+	if (next == MOCK_NEVER)
+		return 0;
+	next = next > now ? next - now : 0;
+	timeout->tv_sec = (long)(next / 1000000000);
+	timeout->tv_usec = (long)(next % 1000000000 / 1000);
+	return 1;
+}
+
+static int mock_interrupt_events(fnusb_ctx *ctx)
+{
+	mock_ctx *mctx = (mock_ctx*)ctx->backend_data;
+	pthread_mutex_lock(&mctx->lock);
+	mctx->interrupted = 1;
+	pthread_cond_broadcast(&mctx->wakeup);
+	pthread_mutex_unlock(&mctx->lock);
+	return 0;
+}
+
+static int mock_process_events(fnusb_ctx *ctx)
+{
+	struct timeval timeout;
+	timeout.tv_sec = 60;
+	timeout.tv_usec = 0;
+	return mock_process_events_timeout(ctx, &timeout);
+}
+
+static int mock_open_subdevices(freenect_device *dev, int index)
+{
+	freenect_context *ctx = dev->parent;
+	mock_ctx *mctx = get_mock_ctx(dev);
+
+	dev->usb_cam.parent = dev;
+	dev->usb_cam.dev = NULL;
+	dev->usb_motor.parent = dev;
+	dev->usb_motor.dev = NULL;
+#ifdef BUILD_AUDIO
+	dev->usb_audio.parent = dev;
+	dev->usb_audio.dev = NULL;
+	if (ctx->enabled_subdevices & FREENECT_DEVICE_AUDIO)
+		FN_INFO("mock: no audio subdevice, leaving it closed\n");
+#endif
+
+	if (index < 0 || index >= mctx->num_devices)
+		return -1;
+	if (mctx->open_ns)
+		sleep_ns(mctx->open_ns);
+	pthread_mutex_lock(&mctx->lock);
+	if (mctx->script_path && !mctx->script_loaded) {
+		if (load_script(ctx, mctx, mctx->script_path) < 0) {
+			pthread_mutex_unlock(&mctx->lock);
+			return -1;
+		}
+		mctx->script_loaded = 1;
+	}
+	// like libusb, count only the devices plugged in
+	index = plugged_index(mctx, index);
+	if (index < 0) {
+		pthread_mutex_unlock(&mctx->lock);
+		return -1;
+	}
+
+	// The mock keeps its per-device state where libusb keeps the handle
+	if (ctx->enabled_subdevices & FREENECT_DEVICE_CAMERA) {
+		mock_dev *cam = (mock_dev*)calloc(1, sizeof(mock_dev));
+		cam->mctx = mctx;
+		cam->usb = &dev->usb_cam;
+		cam->index = index;
+		cam->clock_origin_ns = fn_get_time_ns();
+		cam->unplug_ns = mctx->unplug_ns ? cam->clock_origin_ns + mctx->unplug_ns : MOCK_NEVER;
+		cam->next = mctx->cams;
+		mctx->cams = cam;
+		dev->usb_cam.dev = (libusb_device_handle*)cam;
+		mock_serial(index, dev->camera_serial, sizeof(dev->camera_serial));
+	}
+	if (ctx->enabled_subdevices & FREENECT_DEVICE_MOTOR) {
+		mock_dev *motor = (mock_dev*)calloc(1, sizeof(mock_dev));
+		motor->mctx = mctx;
+		motor->usb = &dev->usb_motor;
+		motor->motor = 1;
+		motor->index = index;
+		dev->usb_motor.dev = (libusb_device_handle*)motor;
+	}
+	pthread_mutex_unlock(&mctx->lock);
+	return 0;
+}
+
+static int mock_close_subdevices(freenect_device *dev)
+{
+	mock_ctx *mctx = get_mock_ctx(dev);
+	mock_dev *cam = (mock_dev*)dev->usb_cam.dev;
+	mock_dev **link;
+
+	if (cam) {
+		pthread_mutex_lock(&mctx->lock);
+		for (link = &mctx->cams; *link; link = &(*link)->next) {
+			if (*link == cam) {
+				*link = cam->next;
+				break;
+			}
+		}
+		pthread_mutex_unlock(&mctx->lock);
+		fn_capture_close(&cam->reader);
+	}
+	free(dev->usb_cam.dev);
+	dev->usb_cam.dev = NULL;
+	free(dev->usb_motor.dev);
+	dev->usb_motor.dev = NULL;
+	return 0;
+}
+
+static int mock_start_iso(fnusb_dev *dev, fnusb_isoc_stream *strm, fnusb_iso_cb cb, int ep, int xfers, int pkts, int len)
+{
+	freenect_device *fdev = dev->parent;
+	freenect_context *ctx = fdev->parent;
+	mock_ctx *mctx = get_mock_ctx(fdev);
+	packet_stream *source;
+	const char *file;
+	int framerate, i;
+
+	if (ep == 0x82) {
+		source = &fdev->depth;
+		framerate = freenect_get_current_depth_mode(fdev).framerate;
+		file = getenv("FREENECT_MOCK_DEPTH_FILE");
+	} else if (ep == 0x81) {
+		source = &fdev->video;
+		framerate = freenect_get_current_video_mode(fdev).framerate;
+		file = getenv("FREENECT_MOCK_VIDEO_FILE");
+	} else {
+		FN_ERROR("mock: no isochronous endpoint %02x\n", ep);
+		return -1;
+	}
+	if (source->pkt_size + 12 > len || source->pkt_size + 12 > MOCK_PKTBUF) {
+		FN_ERROR("mock: %d-byte packets don't fit %d-byte iso slots\n", source->pkt_size + 12, len);
+		return -1;
+	}
+
+	mock_dev *cam = (mock_dev*)dev->dev;
+	if (cam->unplugged)
+		return LIBUSB_ERROR_NO_DEVICE;
+	if (mctx->capture_path && !cam->replaying) {
+		if (fn_capture_open(&cam->reader, mctx->capture_path) < 0) {
+			FN_ERROR("mock: %s is not a readable capture\n", mctx->capture_path);
+			return -1;
+		}
+		cam->replaying = 1;
+		cam->replay_start_ns = fn_get_time_ns();
+	}
+	if (cam->replaying) {
+		uint32_t captured = ep == 0x82 ? cam->reader.header.depth_mode : cam->reader.header.video_mode;
+		uint32_t current = ep == 0x82 ? freenect_get_current_depth_mode(fdev).reserved : freenect_get_current_video_mode(fdev).reserved;
+		if (captured != current)
+			FN_WARNING("mock: EP %02x mode %08x differs from the captured %08x\n", ep, current, captured);
+	}
+
+	mock_stream *ms = (mock_stream*)calloc(1, sizeof(mock_stream));
+	if (!ms)
+		return -1;
+	ms->strm = strm;
+	ms->flag = source->flag;
+	ms->frame_size = source->frame_size;
+	ms->pkt_size = source->pkt_size;
+	ms->last_pkt_size = source->last_pkt_size;
+	ms->pkts_per_frame = source->pkts_per_frame;
+	ms->fps = mctx->fps < 0 ? framerate : mctx->fps;
+	ms->ts_per_frame = MOCK_TIMESTAMP_HZ / (ms->fps > 0 ? ms->fps : framerate > 0 ? framerate : 30)
+		* (1 + mctx->clock_ppm * 1e-6);
+
+	if (cam->replaying) {
+		ms->replay = 1;
+	} else if (!file || !*file || load_frames(ctx, ms, file) < 0) {
+		ms->num_frames = MOCK_SYNTHETIC_FRAMES;
+		ms->frames = (uint8_t*)malloc(ms->num_frames * ms->frame_size);
+		for (i = 0; i < ms->num_frames; i++) {
+			uint8_t *frame = ms->frames + i * ms->frame_size;
+			if (ep == 0x82 && ms->frame_size * 8 == 640*480*11)
+				synth_depth(frame, 11, i);
+			else if (ep == 0x82 && ms->frame_size * 8 == 640*480*10)
+				synth_depth(frame, 10, i);
+			else
+				synth_video(frame, ms->frame_size, ep == 0x82 ? 480 : freenect_get_current_video_mode(fdev).height, i);
+		}
+	}
+
+	strm->parent = dev;
+	strm->cb = cb;
+	strm->num_xfers = xfers;
+	strm->pkts = pkts;
+	strm->len = len;
+	strm->buffer = NULL;
+	strm->xfers = NULL;
+	strm->dead = 0;
+	strm->dead_xfers = 0;
+	strm->backend_data = ms;
+
+	ms->start_ns = fn_get_time_ns();
+	// both streams stamp their frames from the one device clock
+	ms->ts_start = mctx->clock_start + (uint32_t)(uint64_t)((ms->start_ns - cam->clock_origin_ns)
+		* (MOCK_TIMESTAMP_HZ * 1e-9) * (1 + mctx->clock_ppm * 1e-6));
+	ms->next = mctx->streams;
+	mctx->streams = ms;
+	FN_SPEW("mock: EP %02x streaming %d-packet frames at %.1f fps\n", ep, ms->pkts_per_frame, ms->fps);
+	return 0;
+}
+
+static int mock_stop_iso(fnusb_dev *dev, fnusb_isoc_stream *strm)
+{
+	mock_ctx *mctx = get_mock_ctx(dev->parent);
+	mock_stream *ms = (mock_stream*)strm->backend_data;
+	mock_stream **link;
+
+	if (mctx->delivering) {
+		// Called from a stream callback; the event loop frees it
+		ms->dead = 1;
+	} else {
+		for (link = &mctx->streams; *link; link = &(*link)->next) {
+			if (*link == ms) {
+				*link = ms->next;
+				break;
+			}
+		}
+		free_stream(ms);
+	}
+	memset(strm, 0, sizeof(*strm));
+	return 0;
+}
+
+static int mock_control_now(fnusb_dev *dev, uint8_t bmRequestType, uint8_t bRequest, uint16_t wValue, uint16_t wIndex, uint8_t *data, uint16_t wLength)
+{
+	mock_dev *mdev = (mock_dev*)dev->dev;
+
+	if (mdev->unplugged)
+		return LIBUSB_ERROR_NO_DEVICE;
+	if (mdev->motor)
+		return motor_control(mdev, bmRequestType, bRequest, wValue, data, wLength);
+	if (bmRequestType == 0x40)
+		return camera_command(mdev, data, wLength);
+	if (bmRequestType == 0xc0) {
+		// Nothing pending would make send_cmd poll forever; fail instead
+		if (!mdev->reply_len)
+			return LIBUSB_ERROR_IO;
+		int n = mdev->reply_len < wLength ? mdev->reply_len : wLength;
+		memcpy(data, mdev->reply, n);
+		mdev->reply_len = 0;
+		return n;
+	}
+	return LIBUSB_ERROR_PIPE;
+}
+
+static int mock_control(fnusb_dev *dev, uint8_t bmRequestType, uint8_t bRequest, uint16_t wValue, uint16_t wIndex, uint8_t *data, uint16_t wLength)
+{
+	mock_ctx *mctx = get_mock_ctx(dev->parent);
+
+	if (mctx->control_ns)
+		sleep_ns(mctx->control_ns);
+	return mock_control_now(dev, bmRequestType, bRequest, wValue, wIndex, data, wLength);
+}
+
+static int mock_control_async(fnusb_dev *dev, uint8_t bmRequestType, uint8_t bRequest, uint16_t wValue, uint16_t wIndex, uint8_t *data, uint16_t wLength, fnusb_control_cb cb, void *user)
+{
+	mock_ctx *mctx = get_mock_ctx(dev->parent);
+	mock_control_req *req = (mock_control_req*)malloc(sizeof(mock_control_req));
+	mock_control_req **link;
+
+	if (!req)
+		return LIBUSB_ERROR_NO_MEM;
+	req->next = NULL;
+	req->dev = dev;
+	req->res = mock_control_now(dev, bmRequestType, bRequest, wValue, wIndex, data, wLength);
+	req->cb = cb;
+	req->user = user;
+	req->due_ns = fn_get_time_ns() + mctx->control_ns;
+	pthread_mutex_lock(&mctx->lock);
+	for (link = &mctx->controls; *link; link = &(*link)->next)
+		;
+	*link = req;
+	pthread_mutex_unlock(&mctx->lock);
+	return 0;
+}
+
+#ifdef BUILD_AUDIO
+static int mock_bulk(fnusb_dev *dev, uint8_t endpoint, uint8_t *data, int len, int *transferred)
+{
+	*transferred = 0;
+	return LIBUSB_ERROR_NOT_SUPPORTED;
+}
+
+static int mock_num_interfaces(fnusb_dev *dev)
+{
+	return LIBUSB_ERROR_NOT_SUPPORTED;
+}
+#endif
+
+FN_INTERNAL const fnusb_backend fnusb_mock_backend = {
+	"mock",
+	mock_num_devices,
+	mock_list_device_attributes,
+	mock_init,
+	mock_shutdown,
+	mock_process_events,
+	mock_process_events_timeout,
+	mock_get_pollfds,
+	mock_set_pollfd_notifiers,
+	mock_get_next_timeout,
+	mock_interrupt_events,
+	mock_open_subdevices,
+	mock_close_subdevices,
+	mock_start_iso,
+	mock_stop_iso,
+	mock_control,
+	mock_control_async,
+#ifdef BUILD_AUDIO
+	mock_bulk,
+	mock_num_interfaces,
+#endif
+};
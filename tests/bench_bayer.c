@@ -0,0 +1,122 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2010 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+/*
+ * Times freenect_convert_bayer_to_rgb() on synthetic 640x480 and 1280x1024
+ * frames with every instruction set the CPU offers, against plain C, and
+ * checks that each one gives exactly the plain C output.
+ *
+ *   bench_bayer [-n iterations]
+ *
+ *   -n  frames converted per measurement (default 200)
+ *
+ * Only a release build (-DCMAKE_BUILD_TYPE=Release) gives meaningful
+ * numbers; without optimisation the SIMD versions are slower than plain C.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "convert.h"
+#include "bench_util.h"
+
+static const char *levels[] = { "none", "sse2", "ssse3", "avx2", "neon" };
+
+// a frame with smooth gradients, sharp edges and noise, so that every
+// configuration of the interpolation sees a mix of values
+static void fill_bayer(uint8_t *raw, int width, int height)
+{
+	uint32_t state = 1;
+	int x, y;
+	for (y = 0; y < height; y++) {
+		for (x = 0; x < width; x++) {
+			state = state * 1103515245 + 12345;
+			int v = (x * 255 / width + y * 255 / height) / 2;
+			if ((x / 32 + y / 32) & 1)
+				v = 255 - v;
+			raw[y * width + x] = (uint8_t)(v ^ ((state >> 16) & 0x0f));
+		}
+	}
+}
+
+static double time_convert(const uint8_t *raw, uint8_t *rgb, int width, int height, int iterations)
+{
+	int i;
+	freenect_convert_bayer_to_rgb(raw, rgb, width, height); // warm up
+	double start = bench_now();
+	for (i = 0; i < iterations; i++)
+		freenect_convert_bayer_to_rgb(raw, rgb, width, height);
+	return (bench_now() - start) / iterations;
+}
+
+static int bench(int width, int height, int iterations)
+{
+	uint8_t *raw = (uint8_t*)malloc(width * height);
+	uint8_t *ref = (uint8_t*)malloc(width * height * 3);
+	uint8_t *rgb = (uint8_t*)malloc(width * height * 3);
+	double scalar = 0;
+	int errors = 0;
+	size_t l;
+
+	fill_bayer(raw, width, height);
+	for (l = 0; l < sizeof(levels) / sizeof(levels[0]); l++) {
+		const char *simd = freenect_convert_set_simd(levels[l]);
+		if (l > 0 && strcmp(simd, levels[l]))
+			continue; // not available on this CPU
+		double t = time_convert(raw, l ? rgb : ref, width, height, iterations);
+		if (l == 0) {
+			scalar = t;
+		} else if (memcmp(rgb, ref, width * height * 3)) {
+			printf("%dx%d %s: output differs from plain C\n", width, height, simd);
+			errors++;
+		}
+		printf("%4dx%-4d %-5s %8.3f ms/frame %6.2fx\n", width, height, simd, t * 1e3, scalar / t);
+	}
+
+	free(raw);
+	free(ref);
+	free(rgb);
+	return errors;
+}
+
+int main(int argc, char **argv)
+{
+	int iterations = 200;
+	int errors = 0;
+
+	if (argc == 3 && !strcmp(argv[1], "-n")) {
+		iterations = atoi(argv[2]);
+	} else if (argc != 1) {
+		fprintf(stderr, "usage: %s [-n iterations]\n", argv[0]);
+		return 2;
+	}
+	if (iterations < 1)
+		iterations = 1;
+
+	errors += bench(640, 480, iterations);
+	errors += bench(1280, 1024, iterations);
+	return errors ? 1 : 0;
+}
@@ -0,0 +1,116 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2010 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+/*
+ * Times bringing up all devices one after the other with
+ * freenect_open_device() against freenect_open_devices(), which overlaps
+ * their firmware uploads and calibration fetches.
+ *
+ *   bench_open [-j threads]
+ *
+ *   -j  devices opened at a time by freenect_open_devices() (default: all)
+ *
+ * On the mock backend (FREENECT_USB_BACKEND=mock), FREENECT_MOCK_DEVICES sets
+ * the number of devices and FREENECT_MOCK_OPEN_US and
+ * FREENECT_MOCK_CONTROL_US stand in for the USB latencies of real devices.
+ * Exits with 0 if every device opened both ways.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libfreenect.h"
+#include "bench_util.h"
+
+int main(int argc, char **argv)
+{
+	freenect_context *ctx;
+	freenect_device **devs;
+	freenect_open_request *requests;
+	int threads = 0;
+	int count, opened, i;
+	int errors = 0;
+
+	if (argc == 3 && !strcmp(argv[1], "-j")) {
+		threads = atoi(argv[2]);
+	} else if (argc != 1) {
+		fprintf(stderr, "usage: %s [-j threads]\n", argv[0]);
+		return 2;
+	}
+
+	if (freenect_init(&ctx, NULL) < 0) {
+		printf("freenect_init() failed\n");
+		return 1;
+	}
+	freenect_set_log_level(ctx, FREENECT_LOG_WARNING);
+	freenect_select_subdevices(ctx, FREENECT_DEVICE_CAMERA);
+	count = freenect_num_devices(ctx);
+	if (count <= 0) {
+		printf("No devices found\n");
+		freenect_shutdown(ctx);
+		return 1;
+	}
+	devs = (freenect_device**)calloc(count, sizeof(freenect_device*));
+	requests = (freenect_open_request*)calloc(count, sizeof(freenect_open_request));
+
+	double start = bench_now();
+	for (i = 0; i < count; i++) {
+		if (freenect_open_device(ctx, &devs[i], i) < 0) {
+			printf("Could not open device %d\n", i);
+			devs[i] = NULL;
+			errors++;
+		}
+	}
+	double serial = bench_now() - start;
+	for (i = 0; i < count; i++) {
+		if (devs[i])
+			freenect_close_device(devs[i]);
+	}
+
+	for (i = 0; i < count; i++)
+		requests[i].index = i;
+	start = bench_now();
+	opened = freenect_open_devices(ctx, requests, count, threads);
+	double batch = bench_now() - start;
+	if (opened != count) {
+		printf("freenect_open_devices() opened %d of %d devices\n", opened, count);
+		errors++;
+	}
+
+	printf("%d devices: one by one %.1f ms, freenect_open_devices() %.1f ms (%.2fx)\n",
+	       count, serial * 1e3, batch * 1e3, serial / batch);
+	for (i = 0; i < count; i++) {
+		printf("  device %d: status %d, open %.1f ms, init %.1f ms\n", requests[i].index, requests[i].status,
+		       requests[i].open_ns / 1e6, requests[i].init_ns / 1e6);
+		if (requests[i].dev)
+			freenect_close_device(requests[i].dev);
+	}
+
+	free(devs);
+	free(requests);
+	freenect_shutdown(ctx);
+	return errors ? 1 : 0;
+}
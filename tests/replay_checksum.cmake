@@ -0,0 +1,26 @@
+# Records a capture on the mock backend with stream_bench, replays it and
+# fails unless the replay delivers exactly the frames of the recording.
+#
+#   cmake -DSTREAM_BENCH=<path> -DCAPTURE=<file> -P replay_checksum.cmake
+
+set(ENV{FREENECT_USB_BACKEND} mock)
+execute_process(COMMAND ${STREAM_BENCH} -f 10 -c ${CAPTURE}
+  OUTPUT_VARIABLE out RESULT_VARIABLE res)
+message("${out}")
+if(NOT res EQUAL 0)
+  message(FATAL_ERROR "recording the capture failed")
+endif()
+string(REGEX MATCH "checksum ([0-9a-f]+)" match "${out}")
+if(NOT match)
+  message(FATAL_ERROR "no checksum in the output of the recording")
+endif()
+set(checksum ${CMAKE_MATCH_1})
+
+set(ENV{FREENECT_MOCK_CAPTURE} ${CAPTURE})
+set(ENV{FREENECT_MOCK_REPLAY} fast)
+execute_process(COMMAND ${STREAM_BENCH} -x ${checksum}
+  OUTPUT_VARIABLE out RESULT_VARIABLE res)
+message("${out}")
+if(NOT res EQUAL 0)
+  message(FATAL_ERROR "the replay does not match the recording ${checksum}")
+endif()
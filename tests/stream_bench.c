@@ -0,0 +1,163 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2010 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+/*
+ * Streams depth and video from the first device and reports the frame rate,
+ * the decode time per frame and a checksum of the delivered frames.
+ *
+ * Run it with FREENECT_USB_BACKEND=mock to measure the decode path without
+ * hardware (FREENECT_MOCK_FPS=0 for as fast as it goes), or additionally with
+ * FREENECT_MOCK_CAPTURE=file to replay a raw packet capture. Replaying a
+ * capture with FREENECT_MOCK_REPLAY=fast gives the checksum of the run that
+ * recorded it; the replay_checksum test checks that with -x.
+ *
+ *   stream_bench [-f frames] [-t seconds] [-c capture] [-x checksum]
+ *
+ *   -f  stop after this many depth frames (default: when the stream ends)
+ *   -t  give up after this many seconds (default 10)
+ *   -c  write a raw packet capture of the run to this file
+ *   -x  fail unless the frames give this checksum, in hex
+ *
+ * Exits with 0 if both streams delivered frames (and -f was reached, and the
+ * checksum matched).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libfreenect.h"
+#include "bench_util.h"
+
+static int depth_frames, video_frames;
+static uint64_t checksum;
+
+static void depth_cb(freenect_device *dev, void *v_depth, uint32_t timestamp)
+{
+	const uint16_t *depth = (const uint16_t*)v_depth;
+	int i;
+	for (i = 0; i < 640 * 480; i += 97)
+		checksum = checksum * 31 + depth[i];
+	checksum += timestamp;
+	depth_frames++;
+}
+
+static void video_cb(freenect_device *dev, void *v_rgb, uint32_t timestamp)
+{
+	const uint8_t *rgb = (const uint8_t*)v_rgb;
+	int i;
+	for (i = 0; i < 640 * 480 * 3; i += 101)
+		checksum = checksum * 7 + rgb[i];
+	video_frames++;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-f frames] [-t seconds] [-c capture] [-x checksum]\n", name);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	freenect_context *ctx;
+	freenect_device *dev;
+	freenect_stream_stats depth_stats, video_stats;
+	const char *capture = NULL;
+	const char *expected = NULL;
+	int frames = 0;
+	double timeout = 10;
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		if (i + 1 == argc)
+			usage(argv[0]);
+		if (!strcmp(argv[i], "-f"))
+			frames = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-t"))
+			timeout = atof(argv[++i]);
+		else if (!strcmp(argv[i], "-c"))
+			capture = argv[++i];
+		else if (!strcmp(argv[i], "-x"))
+			expected = argv[++i];
+		else
+			usage(argv[0]);
+	}
+
+	if (freenect_init(&ctx, NULL) < 0) {
+		printf("freenect_init() failed\n");
+		return 1;
+	}
+	freenect_set_log_level(ctx, FREENECT_LOG_WARNING);
+	freenect_select_subdevices(ctx, FREENECT_DEVICE_CAMERA);
+	if (freenect_open_device(ctx, &dev, 0) < 0) {
+		printf("Could not open device\n");
+		freenect_shutdown(ctx);
+		return 1;
+	}
+
+	freenect_set_depth_mode(dev, freenect_find_depth_mode(FREENECT_RESOLUTION_MEDIUM, FREENECT_DEPTH_11BIT));
+	freenect_set_video_mode(dev, freenect_find_video_mode(FREENECT_RESOLUTION_MEDIUM, FREENECT_VIDEO_RGB));
+	freenect_set_depth_callback(dev, depth_cb);
+	freenect_set_video_callback(dev, video_cb);
+	if (capture && freenect_start_capture(dev, capture) < 0) {
+		printf("Could not start the capture to %s\n", capture);
+		freenect_close_device(dev);
+		freenect_shutdown(ctx);
+		return 1;
+	}
+	freenect_start_depth(dev);
+	freenect_start_video(dev);
+
+	double start = bench_now();
+	while (bench_now() - start < timeout && (frames == 0 || depth_frames < frames)) {
+		// a replayed capture ends like an unplugged device
+		if (freenect_process_events(ctx) < 0)
+			break;
+	}
+	double elapsed = bench_now() - start;
+
+	freenect_get_stream_stats(dev, FREENECT_STREAM_DEPTH, &depth_stats);
+	freenect_get_stream_stats(dev, FREENECT_STREAM_VIDEO, &video_stats);
+	if (capture && freenect_stop_capture(dev) < 0)
+		printf("Writing the capture to %s failed\n", capture);
+	freenect_stop_depth(dev);
+	freenect_stop_video(dev);
+	freenect_close_device(dev);
+	freenect_shutdown(ctx);
+
+	printf("depth %d video %d frames in %.3f s (%.1f fps)\n", depth_frames, video_frames, elapsed, depth_frames / elapsed);
+	printf("decode %.3f ms/depth frame, %.3f ms/video frame\n",
+	       depth_stats.frames ? depth_stats.decode_ns / 1e6 / depth_stats.frames : 0.0,
+	       video_stats.frames ? video_stats.decode_ns / 1e6 / video_stats.frames : 0.0);
+	printf("checksum %016llx\n", (unsigned long long)checksum);
+
+	if (depth_frames == 0 || video_frames == 0 || depth_frames < frames)
+		return 1;
+	if (expected && strtoull(expected, NULL, 16) != checksum) {
+		printf("checksum differs from the expected %s\n", expected);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,141 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2010 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+/*
+ * Streams depth and video with auto-reconnect from a mock camera that is
+ * unplugged and plugged back in (FREENECT_MOCK_UNPLUG_MS and
+ * FREENECT_MOCK_REPLUG_MS), and checks that every loss is followed by a
+ * restore, that both streams deliver frames again after each restore, and
+ * that the reconnect statistics agree with the events.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "libfreenect.h"
+#include "bench_util.h"
+
+#define RECONNECTS 2 // the mock unplugs the camera again after every reopen
+#define FRAMES_AFTER_RESTORE 3
+
+static int lost, restored, failed;
+static int depth_frames, video_frames; // since the last restore
+static int resumed; // restores after which both streams delivered frames
+
+static void depth_cb(freenect_device *dev, void *v_depth, uint32_t timestamp)
+{
+	depth_frames++;
+}
+
+static void video_cb(freenect_device *dev, void *v_video, uint32_t timestamp)
+{
+	video_frames++;
+}
+
+static void reconnect_cb(freenect_device *dev, freenect_reconnect_event event)
+{
+	switch (event) {
+		case FREENECT_RECONNECT_LOST:
+			if (restored > 0 && (depth_frames < FRAMES_AFTER_RESTORE || video_frames < FRAMES_AFTER_RESTORE))
+				printf("lost again after only %d depth and %d video frames\n", depth_frames, video_frames);
+			lost++;
+			break;
+		case FREENECT_RECONNECT_RESTORED:
+			restored++;
+			depth_frames = video_frames = 0;
+			break;
+		case FREENECT_RECONNECT_FAILED:
+			failed++;
+			break;
+	}
+}
+
+int main(void)
+{
+	freenect_context *ctx;
+	freenect_device *dev;
+	freenect_reconnect_stats stats;
+	int errors = 0;
+
+	if (freenect_init(&ctx, NULL) < 0) {
+		printf("freenect_init() failed\n");
+		return 1;
+	}
+	freenect_set_log_level(ctx, FREENECT_LOG_WARNING);
+	freenect_select_subdevices(ctx, FREENECT_DEVICE_CAMERA);
+	if (freenect_open_device(ctx, &dev, 0) < 0) {
+		printf("Could not open device\n");
+		freenect_shutdown(ctx);
+		return 1;
+	}
+	freenect_set_auto_reconnect(dev, 1);
+	freenect_set_reconnect_callback(dev, reconnect_cb);
+	freenect_set_depth_callback(dev, depth_cb);
+	freenect_set_video_callback(dev, video_cb);
+	freenect_start_depth(dev);
+	freenect_start_video(dev);
+
+	double start = bench_now();
+	while (bench_now() - start < 10) {
+		if (freenect_process_events(ctx) < 0) {
+			printf("freenect_process_events() failed with auto-reconnect on\n");
+			errors++;
+			break;
+		}
+		if (restored > resumed && depth_frames >= FRAMES_AFTER_RESTORE && video_frames >= FRAMES_AFTER_RESTORE)
+			resumed = restored;
+		if (resumed >= RECONNECTS)
+			break;
+	}
+
+	freenect_get_reconnect_stats(dev, &stats);
+	printf("lost %d, restored %d, failed %d, resumed %d\n", lost, restored, failed, resumed);
+	printf("stats: %llu disconnects, %llu reconnects, %llu failed attempts, %.1f ms down\n",
+	       (unsigned long long)stats.disconnects, (unsigned long long)stats.reconnects,
+	       (unsigned long long)stats.failed_attempts, stats.downtime_ns / 1e6);
+
+	if (resumed < RECONNECTS) {
+		printf("FAILED: the streams resumed after %d of %d reconnects\n", resumed, RECONNECTS);
+		errors++;
+	}
+	if (lost != restored) {
+		printf("FAILED: %d losses but %d restores\n", lost, restored);
+		errors++;
+	}
+	if (stats.disconnects != (uint64_t)lost || stats.reconnects != (uint64_t)restored || stats.failed_attempts != (uint64_t)failed) {
+		printf("FAILED: the statistics don't match the events\n");
+		errors++;
+	}
+	if (restored > 0 && stats.downtime_ns == 0) {
+		printf("FAILED: no downtime recorded\n");
+		errors++;
+	}
+
+	freenect_stop_depth(dev);
+	freenect_stop_video(dev);
+	freenect_close_device(dev);
+	freenect_shutdown(ctx);
+	return errors ? 1 : 0;
+}
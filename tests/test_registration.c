@@ -0,0 +1,148 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2010 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+/*
+ * Registers the same depth frames with one and with several registration
+ * threads, on both registration table layouts, and checks that every
+ * configuration gives exactly the output of the single-threaded int32 one.
+ * Runs on the mock backend, whose synthetic scene (a ball in front of a
+ * wall) makes pixels compete for the same target.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libfreenect.h"
+#include "libfreenect-registration.h"
+#include "bench_util.h"
+
+#define FRAMES 4 // the mock's synthetic depth loops over four frames
+#define FRAME_PIXELS (640 * 480)
+
+static uint16_t *frames;
+static int received;
+
+static void depth_cb(freenect_device *dev, void *v_depth, uint32_t timestamp)
+{
+	if (received < FRAMES)
+		memcpy(frames + received * FRAME_PIXELS, v_depth, FRAME_PIXELS * sizeof(uint16_t));
+	received++;
+}
+
+// register the first FRAMES frames of a fresh depth stream into out
+static int capture(freenect_context *ctx, freenect_device *dev, int threads, freenect_registration_table_format format, uint16_t *out)
+{
+	if (freenect_set_registration_threads(dev, threads) < 0
+		|| freenect_set_registration_table_format(dev, format) < 0) {
+		printf("Could not set %d threads and table format %d\n", threads, format);
+		return -1;
+	}
+	frames = out;
+	received = 0;
+	if (freenect_start_depth(dev) < 0) {
+		printf("Could not start depth\n");
+		return -1;
+	}
+	double start = bench_now();
+	while (received < FRAMES && bench_now() - start < 10) {
+		if (freenect_process_events(ctx) < 0)
+			break;
+	}
+	freenect_stop_depth(dev);
+	if (received < FRAMES) {
+		printf("Got %d of %d frames\n", received, FRAMES);
+		return -1;
+	}
+	return 0;
+}
+
+int main(void)
+{
+	static const int threads[] = { 1, 2, 4, 7 };
+	static const freenect_registration_table_format formats[] = { FREENECT_REGISTRATION_TABLE_INT32, FREENECT_REGISTRATION_TABLE_INT16_DELTA };
+	freenect_context *ctx;
+	freenect_device *dev;
+	uint16_t *ref = (uint16_t*)malloc(FRAMES * FRAME_PIXELS * sizeof(uint16_t));
+	uint16_t *out = (uint16_t*)malloc(FRAMES * FRAME_PIXELS * sizeof(uint16_t));
+	int errors = 0;
+	int valid = 0;
+	size_t t, f;
+	int i;
+
+	if (freenect_init(&ctx, NULL) < 0) {
+		printf("freenect_init() failed\n");
+		return 1;
+	}
+	freenect_set_log_level(ctx, FREENECT_LOG_WARNING);
+	freenect_select_subdevices(ctx, FREENECT_DEVICE_CAMERA);
+	if (freenect_open_device(ctx, &dev, 0) < 0) {
+		printf("Could not open device\n");
+		freenect_shutdown(ctx);
+		return 1;
+	}
+	freenect_set_depth_mode(dev, freenect_find_depth_mode(FREENECT_RESOLUTION_MEDIUM, FREENECT_DEPTH_REGISTERED));
+	freenect_set_depth_callback(dev, depth_cb);
+
+	if (capture(ctx, dev, 1, FREENECT_REGISTRATION_TABLE_INT32, ref) < 0) {
+		errors++;
+		goto out;
+	}
+	for (i = 0; i < FRAMES * FRAME_PIXELS; i++)
+		valid += ref[i] != FREENECT_DEPTH_MM_NO_VALUE;
+	printf("reference: %d registered pixels in %d frames\n", valid, FRAMES);
+	if (valid == 0) {
+		printf("FAILED: nothing was registered\n");
+		errors++;
+		goto out;
+	}
+
+	for (f = 0; f < sizeof(formats) / sizeof(formats[0]); f++) {
+		for (t = 0; t < sizeof(threads) / sizeof(threads[0]); t++) {
+			if (capture(ctx, dev, threads[t], formats[f], out) < 0) {
+				errors++;
+				continue;
+			}
+			int differ = 0;
+			for (i = 0; i < FRAMES * FRAME_PIXELS; i++)
+				differ += out[i] != ref[i];
+			printf("%d threads, %s table: %d pixels differ\n", freenect_get_registration_threads(dev),
+			       freenect_get_registration_table_format(dev) == FREENECT_REGISTRATION_TABLE_INT16_DELTA ? "int16 delta" : "int32", differ);
+			if (formats[f] != freenect_get_registration_table_format(dev)) {
+				printf("FAILED: the table doesn't fit the int16 delta layout\n");
+				errors++;
+			}
+			if (differ)
+				errors++;
+		}
+	}
+
+out:
+	freenect_close_device(dev);
+	freenect_shutdown(ctx);
+	free(ref);
+	free(out);
+	return errors ? 1 : 0;
+}
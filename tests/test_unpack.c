@@ -0,0 +1,142 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2010 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+/*
+ * Checks the 11-bit and 10-bit depth unpackers against a plain bit-by-bit
+ * reference. The converters pick their instruction set once per process, so
+ * ctest runs this once for every LIBFREENECT_SIMD level; a level the CPU or
+ * the build lacks is reported as skipped.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "convert.h"
+
+#define SKIPPED 77
+
+// value i of a big-endian stream of bits-wide values
+static uint16_t unpack_ref(const uint8_t *raw, int bits, int i)
+{
+	uint32_t value = 0;
+	int bit;
+	for (bit = i * bits; bit < (i + 1) * bits; bit++)
+		value = (value << 1) | ((raw[bit / 8] >> (7 - bit % 8)) & 1);
+	return (uint16_t)value;
+}
+
+static uint32_t rng_state = 12345;
+
+static uint8_t rng(void)
+{
+	rng_state = rng_state * 1103515245 + 12345;
+	return (uint8_t)(rng_state >> 16);
+}
+
+// n values, with the input at every alignment and exactly as long as needed
+// so that reading past its end shows up under a memory checker
+static int check(int bits, int n, int offset)
+{
+	int bytes = n * bits / 8;
+	uint8_t *block = (uint8_t*)malloc(offset + bytes);
+	uint8_t *raw = block + offset;
+	uint16_t *out16 = (uint16_t*)malloc(n * sizeof(uint16_t) + 2);
+	uint8_t *out8 = (uint8_t*)malloc(n + 1);
+	int i, errors = 0;
+
+	for (i = 0; i < bytes; i++)
+		raw[i] = rng();
+	// guard values just past the output catch converters that write too far
+	out16[n] = 0xdead;
+	out8[n] = 0xa5;
+
+	if (bits == 11)
+		freenect_convert_packed11_to_16bit(raw, out16, n);
+	else
+		freenect_convert_packed10_to_16bit(raw, out16, n);
+	for (i = 0; i < n && errors < 5; i++) {
+		if (out16[i] != unpack_ref(raw, bits, i)) {
+			printf("packed%d n=%d offset=%d: value %d is %u, expected %u\n", bits, n, offset, i, out16[i], unpack_ref(raw, bits, i));
+			errors++;
+		}
+	}
+	if (out16[n] != 0xdead) {
+		printf("packed%d n=%d: wrote past the end of the output\n", bits, n);
+		errors++;
+	}
+
+	if (bits == 10) {
+		freenect_convert_packed10_to_8bit(raw, out8, n);
+		for (i = 0; i < n && errors < 5; i++) {
+			if (out8[i] != unpack_ref(raw, bits, i) >> 2) {
+				printf("packed10 to 8 bit n=%d offset=%d: value %d is %u, expected %u\n", n, offset, i, out8[i], unpack_ref(raw, bits, i) >> 2);
+				errors++;
+			}
+		}
+		if (out8[n] != 0xa5) {
+			printf("packed10 to 8 bit n=%d: wrote past the end of the output\n", n);
+			errors++;
+		}
+	}
+
+	free(block);
+	free(out16);
+	free(out8);
+	return errors;
+}
+
+int main(void)
+{
+	const char *cap = getenv("LIBFREENECT_SIMD");
+	const char *simd = freenect_convert_simd_name();
+	int errors = 0;
+	int n, offset;
+
+	printf("instruction set: %s\n", simd);
+	if (cap && strcmp(cap, "none") && strcmp(cap, simd)) {
+		printf("%s is not available here, skipping\n", cap);
+		return SKIPPED;
+	}
+
+	// short lengths cover every tail after the vector loops, the long ones
+	// a whole frame at both resolutions
+	for (offset = 0; offset < 4; offset++) {
+		for (n = 0; n <= 256; n += 8)
+			errors += check(11, n, offset);
+		for (n = 0; n <= 256; n += 4)
+			errors += check(10, n, offset);
+	}
+	errors += check(11, 640 * 480, 0);
+	errors += check(10, 640 * 480, 0);
+	errors += check(10, 1280 * 1024, 1);
+
+	if (errors) {
+		printf("FAILED\n");
+		return 1;
+	}
+	printf("all values match the reference\n");
+	return 0;
+}
@@ -0,0 +1,127 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2010 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+/*
+ * Checks freenect_convert_uyvy_to_rgb() against the original conversion,
+ * which divides by 1000 per term (see convert.c), for every combination of
+ * u, y and v. Each channel may be off by UYVY_TOLERANCE. ctest runs this once
+ * for every LIBFREENECT_SIMD level, like test_unpack.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "convert.h"
+
+#define SKIPPED 77
+
+// the documented contract of freenect_convert_uyvy_to_rgb(), per channel
+#define UYVY_TOLERANCE 1
+
+static int clamp(int x)
+{
+	return x < 0 ? 0 : x > 255 ? 255 : x;
+}
+
+static void uyvy_ref(int u, int y, int v, int *rgb)
+{
+	rgb[0] = clamp((y-16)*1164/1000 + (v-128)*1596/1000);
+	rgb[1] = clamp((y-16)*1164/1000 - (v-128)*813/1000 - (u-128)*391/1000);
+	rgb[2] = clamp((y-16)*1164/1000 + (u-128)*2018/1000);
+}
+
+static int max_diff, off_by_one;
+
+// compare a converted frame pixel by pixel; returns the number of pixels
+// outside the tolerance
+static int compare(const uint8_t *uyvy, const uint8_t *rgb, int pixels)
+{
+	int i, c, errors = 0;
+	for (i = 0; i < pixels; i++) {
+		const uint8_t *pair = uyvy + (i & ~1) * 2;
+		int ref[3];
+		uyvy_ref(pair[0], pair[1 + (i & 1) * 2], pair[2], ref);
+		for (c = 0; c < 3; c++) {
+			int diff = abs(rgb[i * 3 + c] - ref[c]);
+			if (diff > max_diff)
+				max_diff = diff;
+			if (diff == 1)
+				off_by_one++;
+			if (diff > UYVY_TOLERANCE && errors++ < 5)
+				printf("u %d y %d v %d: channel %d is %d, expected %d\n", pair[0], pair[1 + (i & 1) * 2], pair[2], c, rgb[i * 3 + c], ref[c]);
+		}
+	}
+	return errors;
+}
+
+int main(void)
+{
+	const char *cap = getenv("LIBFREENECT_SIMD");
+	const char *simd = freenect_convert_simd_name();
+	// one frame per u: a row per v, and per y a pixel pair (y, 255 - y)
+	const int width = 512, height = 256;
+	uint8_t *uyvy = (uint8_t*)malloc(width * height * 2);
+	uint8_t *rgb = (uint8_t*)malloc(width * height * 3);
+	int errors = 0;
+	int u, v, y, w;
+
+	printf("instruction set: %s\n", simd);
+	if (cap && strcmp(cap, "none") && strcmp(cap, simd)) {
+		printf("%s is not available here, skipping\n", cap);
+		return SKIPPED;
+	}
+
+	for (u = 0; u < 256; u++) {
+		uint8_t *p = uyvy;
+		for (v = 0; v < 256; v++) {
+			for (y = 0; y < 256; y++, p += 4) {
+				p[0] = u;
+				p[1] = y;
+				p[2] = v;
+				p[3] = 255 - y;
+			}
+		}
+		freenect_convert_uyvy_to_rgb(uyvy, rgb, width, height);
+		errors += compare(uyvy, rgb, width * height);
+	}
+
+	// narrow frames, for the tails after the vector loops
+	for (w = 2; w <= 66; w += 2) {
+		for (y = 0; y < w * 2 * 3; y++)
+			uyvy[y] = (uint8_t)(y * 77 + w * 13);
+		freenect_convert_uyvy_to_rgb(uyvy, rgb, w, 3);
+		errors += compare(uyvy, rgb, w * 3);
+	}
+
+	free(uyvy);
+	free(rgb);
+	printf("largest difference %d, %d channels off by one\n", max_diff, off_by_one);
+	if (errors) {
+		printf("FAILED: %d channels off by more than %d\n", errors, UYVY_TOLERANCE);
+		return 1;
+	}
+	return 0;
+}
@@ -100,6 +100,7 @@ static int alloc_buffer_ring_depth(freenect_depth_format fmt, buffer_ring_t *buf
 		case FREENECT_DEPTH_10BIT_PACKED:
 		case FREENECT_DEPTH_REGISTERED:
 		case FREENECT_DEPTH_MM:
+		case FREENECT_DEPTH_XYZ:
 			sz = freenect_find_depth_mode(FREENECT_RESOLUTION_MEDIUM, fmt).bytes;
 			break;
 		default:
@@ -157,6 +158,9 @@ static void pending_runloop_tasks_inc(void)
 	assert(pending_runloop_tasks >= 0);
 	++pending_runloop_tasks;
 	pthread_mutex_unlock(&pending_runloop_tasks_lock);
+	// Get the runloop out of process_events now rather than at the next frame
+	if (thread_running)
+		freenect_interrupt_events(ctx);
 }
 
 static void pending_runloop_tasks_dec(void)
@@ -405,7 +409,13 @@ int freenect_sync_set_led(freenect_led_options led, int index) {
 void freenect_sync_stop(void)
 {
 	if (thread_running) {
+		// Hold the runloop between process_events calls, so that it sees
+		// thread_running cleared before it blocks again
+		pending_runloop_tasks_inc();
+		pthread_mutex_lock(&runloop_lock);
 		thread_running = 0;
+		pthread_mutex_unlock(&runloop_lock);
+		pending_runloop_tasks_dec();
 		pthread_join(thread, NULL);
 	}
 }
@@ -186,6 +186,7 @@ namespace Freenect {
 				delete it->second;
 			}
 			m_stop = true;
+			freenect_interrupt_events(m_ctx);
 			pthread_join(m_thread, NULL);
 			if(freenect_shutdown(m_ctx) < 0){} //FN_WARNING("Freenect did not shutdown in a clean fashion");
 		}
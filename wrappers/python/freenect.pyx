@@ -100,6 +100,7 @@ cdef extern from "libfreenect.h":
     int freenect_init(freenect_context **ctx, void *usb_ctx)
     int freenect_shutdown(freenect_context *ctx)
     int freenect_process_events(freenect_context *ctx) nogil
+    int freenect_interrupt_events(freenect_context *ctx) nogil
     int freenect_num_devices(freenect_context *ctx)
     int freenect_select_subdevices(freenect_context *ctx, freenect_device_flags subdevs)
     int freenect_open_device(freenect_context *ctx, freenect_device **dev, int index)
@@ -223,6 +224,15 @@ def shutdown(CtxPtr ctx):
 def process_events(CtxPtr ctx):
     return freenect_process_events(ctx._ptr)
 
+def interrupt_events(CtxPtr ctx):
+    """Makes a process_events() blocked on another thread return right away
+
+    Safe to call from any thread. In runloop() and base_runloop() this gets
+    the body called without waiting for the next frame, so a body that raises
+    Kill stops the loop promptly.
+    """
+    return freenect_interrupt_events(ctx._ptr)
+
 def num_devices(CtxPtr ctx):
     return freenect_num_devices(ctx._ptr)
 
@@ -347,7 +357,8 @@ def runloop(depth=None, video=None, body=None, dev=None):
             If None (default), then you won't get a callback for depth.
         video: A function that takes (dev, video, timestamp), corresponding to C function.
             If None (default), then you won't get a callback for video.
-        body: A function that takes (dev, ctx) and is called in the body of process_events
+        body: A function that takes (dev, ctx) and is called in the body of process_events.
+            Another thread can call interrupt_events(ctx) to have it called right away.
         dev: Optional freenect device context. If supplied, this function will use it instead
             of creating and destroying its own..
     """
@@ -406,7 +417,8 @@ def base_runloop(CtxPtr ctx, body=None):
 
     Args:
         ctx: Freenect library context
-        body: A function that takes (ctx) and is called in the body of process_events
+        body: A function that takes (ctx) and is called in the body of process_events.
+            Another thread can call interrupt_events(ctx) to have it called right away.
     """
     cdef freenect_context* ctxp
     ctxp = ctx._ptr